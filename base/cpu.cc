@@ -36,6 +36,7 @@ CPU::CPU()
     has_sse41_(false),
     has_sse42_(false),
     has_avx_(false),
+    has_avx2_(false),
     has_avx_hardware_(false),
     has_aesni_(false),
     has_non_stop_time_stamp_counter_(false),
@@ -56,7 +57,7 @@ void __cpuid(int cpu_info[4], int info_type) {
     "cpuid\n"
     "xchg %%edi, %%ebx\n"
     : "=a"(cpu_info[0]), "=D"(cpu_info[1]), "=c"(cpu_info[2]), "=d"(cpu_info[3])
-    : "a"(info_type)
+    : "a"(info_type), "c"(0)
   );
 }
 
@@ -66,7 +67,7 @@ void __cpuid(int cpu_info[4], int info_type) {
   __asm__ volatile (
     "cpuid \n\t"
     : "=a"(cpu_info[0]), "=b"(cpu_info[1]), "=c"(cpu_info[2]), "=d"(cpu_info[3])
-    : "a"(info_type)
+    : "a"(info_type), "c"(0)
   );
 }
 
@@ -135,6 +136,17 @@ void CPU::Initialize() {
     has_aesni_ = (cpu_info[2] & 0x02000000) != 0;
   }
 
+  // Extended feature flags live in leaf 7, sub-leaf 0. The inline __cpuid
+  // above always selects sub-leaf 0.
+  if (num_ids >= 7) {
+#if defined(_MSC_VER)
+    __cpuidex(cpu_info, 7, 0);
+#else
+    __cpuid(cpu_info, 7);
+#endif
+    has_avx2_ = has_avx_ && (cpu_info[1] & 0x00000020) != 0;
+  }
+
   // Get the brand string of the cpu.
   __cpuid(cpu_info, 0x80000000);
   const int parameter_end = 0x80000004;
@@ -4,6 +4,7 @@
 
 #include "chrome/browser/history/in_memory_url_index.h"
 
+#include "base/bind_helpers.h"
 #include "base/debug/trace_event.h"
 #include "base/file_util.h"
 #include "base/strings/utf_string_conversions.h"
@@ -27,11 +28,16 @@ using in_memory_url_index::InMemoryURLIndexCacheItem;
 
 namespace history {
 
-// Called by DoSaveToCacheFile to delete any old cache file at |path| when
-// there is no private data to save. Runs on the FILE thread.
+// The number of changes which may be journaled before the cache file is
+// rewritten in full, bounding the work done replaying the journal on restore.
+static const size_t kMaxJournalRecords = 1000;
+
+// Called by DoSaveToCacheFile to delete any old cache file, and its journal,
+// at |path| when there is no private data to save. Runs on the FILE thread.
 void DeleteCacheFile(const base::FilePath& path) {
   DCHECK(!content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
   base::DeleteFile(path, false);
+  base::DeleteFile(URLIndexPrivateData::GetJournalFilePath(path), false);
 }
 
 // Initializes a whitelist of URL schemes.
@@ -100,7 +106,8 @@ InMemoryURLIndex::InMemoryURLIndex(Profile* profile,
       save_cache_observer_(NULL),
       shutdown_(false),
       restored_(false),
-      needs_to_be_cached_(false) {
+      needs_to_be_cached_(false),
+      journal_record_count_(0) {
   InitializeSchemeWhitelist(&scheme_whitelist_);
   if (profile) {
     // TODO(mrossetti): Register for language change notifications.
@@ -120,7 +127,8 @@ InMemoryURLIndex::InMemoryURLIndex()
       save_cache_observer_(NULL),
       shutdown_(false),
       restored_(false),
-      needs_to_be_cached_(false) {
+      needs_to_be_cached_(false),
+      journal_record_count_(0) {
   InitializeSchemeWhitelist(&scheme_whitelist_);
 }
 
@@ -142,7 +150,14 @@ void InMemoryURLIndex::ShutDown() {
   if (!GetCacheFilePath(&path))
     return;
   private_data_->CancelPendingUpdates();
-  URLIndexPrivateData::WritePrivateDataToCacheFileTask(private_data_, path);
+  // Changes already journaled survive without rewriting the whole cache; only
+  // the recent visits fetched since then still need to be appended.
+  std::string records;
+  if (private_data_->AppendVisitJournalRecords(&records) &&
+      !URLIndexPrivateData::AppendToJournalFile(path, records))
+    needs_to_be_cached_ = true;
+  if (needs_to_be_cached_)
+    URLIndexPrivateData::WritePrivateDataToCacheFileTask(private_data_, path);
   needs_to_be_cached_ = false;
 }
 
@@ -206,29 +221,49 @@ void InMemoryURLIndex::OnURLVisited(const URLVisitedDetails* details) {
   HistoryService* service =
       HistoryServiceFactory::GetForProfile(profile_,
                                            Profile::EXPLICIT_ACCESS);
-  needs_to_be_cached_ |= private_data_->UpdateURL(
-      service, details->row, languages_, scheme_whitelist_);
+  if (private_data_->UpdateURL(service, details->row, languages_,
+                               scheme_whitelist_)) {
+    std::string records;
+    private_data_->AppendURLJournalRecord(details->row.id(),
+                                          details->row.url(), &records);
+    PostAppendToJournalTask(records, 1);
+  }
 }
 
 void InMemoryURLIndex::OnURLsModified(const URLsModifiedDetails* details) {
   HistoryService* service =
       HistoryServiceFactory::GetForProfile(profile_,
                                            Profile::EXPLICIT_ACCESS);
+  std::string records;
+  size_t record_count = 0;
   for (URLRows::const_iterator row = details->changed_urls.begin();
-       row != details->changed_urls.end(); ++row)
-    needs_to_be_cached_ |=
-        private_data_->UpdateURL(service, *row, languages_, scheme_whitelist_);
+       row != details->changed_urls.end(); ++row) {
+    if (private_data_->UpdateURL(service, *row, languages_,
+                                 scheme_whitelist_)) {
+      private_data_->AppendURLJournalRecord(row->id(), row->url(), &records);
+      ++record_count;
+    }
+  }
+  PostAppendToJournalTask(records, record_count);
 }
 
 void InMemoryURLIndex::OnURLsDeleted(const URLsDeletedDetails* details) {
+  std::string records;
+  size_t record_count = 0;
   if (details->all_history) {
     ClearPrivateData();
-    needs_to_be_cached_ = true;
+    URLIndexPrivateData::AppendClearJournalRecord(&records);
+    ++record_count;
   } else {
     for (URLRows::const_iterator row = details->rows.begin();
-         row != details->rows.end(); ++row)
-      needs_to_be_cached_ |= private_data_->DeleteURL(row->url());
+         row != details->rows.end(); ++row) {
+      if (private_data_->DeleteURL(row->url())) {
+        private_data_->AppendURLJournalRecord(row->id(), row->url(), &records);
+        ++record_count;
+      }
+    }
   }
+  PostAppendToJournalTask(records, record_count);
 }
 
 // Restoring from Cache --------------------------------------------------------
@@ -320,13 +355,19 @@ void InMemoryURLIndex::PostSaveToCacheFileTask() {
   base::FilePath path;
   if (!GetCacheFilePath(&path))
     return;
+  // Saving starts a new journal.
+  journal_record_count_ = 0;
   // If there is anything in our private data then make a copy of it and tell
   // it to save itself to a file.
   if (private_data_.get() && !private_data_->Empty()) {
+    // Visits waiting to be journaled are saved with the rest of the index.
+    std::string visit_records;
+    private_data_->AppendVisitJournalRecords(&visit_records);
     // Note that ownership of the copy of our private data is passed to the
     // completion closure below.
     scoped_refptr<URLIndexPrivateData> private_data_copy =
         private_data_->Duplicate();
+    needs_to_be_cached_ = true;
     content::BrowserThread::PostTaskAndReplyWithResult<bool>(
         content::BrowserThread::FILE, FROM_HERE,
         base::Bind(&URLIndexPrivateData::WritePrivateDataToCacheFileTask,
@@ -337,12 +378,44 @@ void InMemoryURLIndex::PostSaveToCacheFileTask() {
     content::BrowserThread::PostBlockingPoolTask(
         FROM_HERE,
         base::Bind(DeleteCacheFile, path));
+    needs_to_be_cached_ = false;
   }
 }
 
 void InMemoryURLIndex::OnCacheSaveDone(bool succeeded) {
+  needs_to_be_cached_ = !succeeded;
   if (save_cache_observer_)
     save_cache_observer_->OnCacheSaveFinished(succeeded);
 }
 
+// Journaling Changes ----------------------------------------------------------
+
+void InMemoryURLIndex::PostAppendToJournalTask(const std::string& records,
+                                               size_t record_count) {
+  base::FilePath path;
+  if (records.empty() || shutdown_ || !GetCacheFilePath(&path))
+    return;
+  // Recent visits fetched since the last append ride along.
+  std::string all_records;
+  record_count += private_data_->AppendVisitJournalRecords(&all_records);
+  all_records.append(records);
+  journal_record_count_ += record_count;
+  if (journal_record_count_ >= kMaxJournalRecords) {
+    // Fold the journal into a freshly written cache.
+    PostSaveToCacheFileTask();
+    return;
+  }
+  content::BrowserThread::PostTaskAndReplyWithResult<bool>(
+      content::BrowserThread::FILE, FROM_HERE,
+      base::Bind(&URLIndexPrivateData::AppendToJournalFile, path, all_records),
+      base::Bind(&InMemoryURLIndex::OnJournalAppendDone, AsWeakPtr()));
+}
+
+void InMemoryURLIndex::OnJournalAppendDone(bool succeeded) {
+  // Changes which could not be journaled, for instance because no cache has
+  // been written yet, must be saved with the whole cache at shutdown.
+  if (!succeeded)
+    needs_to_be_cached_ = true;
+}
+
 }  // namespace history
@@ -63,7 +63,7 @@ struct URLVisitedDetails;
 // indexing or when searching the index as the final filtering of results
 // is dependent on the comparison of a string of bytes, not individual
 // characters. While the lookup of those bytes during a search in the
-// |char_word_map_| could serve up words in which the individual char16
+// character-to-words index could serve up words in which the individual char16
 // occurs as a portion of a composite character the next filtering step
 // will eliminate such words except in the case where a single character
 // is being searched on and which character occurs as the second char16 of a
@@ -226,9 +226,20 @@ class InMemoryURLIndex : public content::NotificationObserver,
   void DoSaveToCacheFile(const base::FilePath& path);
 
   // Notifies the observer, if any, of the success of the private data caching.
-  // |succeeded| is true on a successful save.
+  // |succeeded| is true on a successful save. A failed save leaves the index
+  // to be cached at shutdown.
   void OnCacheSaveDone(bool succeeded);
 
+  // Posts a task to append the |record_count| journal |records| describing
+  // recent changes to the index to the cache file's journal. Once enough
+  // changes have been journaled the whole cache is rewritten instead.
+  void PostAppendToJournalTask(const std::string& records,
+                               size_t record_count);
+
+  // Marks the index as needing to be cached at shutdown unless the journal
+  // append |succeeded|.
+  void OnJournalAppendDone(bool succeeded);
+
   // Handles notifications of history changes.
   virtual void Observe(int notification_type,
                        const content::NotificationSource& source,
@@ -281,14 +292,19 @@ class InMemoryURLIndex : public content::NotificationObserver,
   // Set to true once the index restoration is complete.
   bool restored_;
 
-  // Set to true when changes to the index have been made and the index needs
-  // to be cached. Set to false when the index has been cached. Used as a
-  // temporary safety check to insure that the cache is saved before the
-  // index has been destructed.
+  // Set to true when the index has changes which are in neither the cache file
+  // nor its journal, including while a save is in flight, so that ShutDown()
+  // rewrites the cache only when it must. Set to false when the index has been
+  // cached. Also used as a temporary safety check to insure that the cache is
+  // saved before the index has been destructed.
   // TODO(mrossetti): Eliminate once the transition to SQLite has been done.
   // http://crbug.com/83659
   bool needs_to_be_cached_;
 
+  // The number of changes appended to the cache file's journal since the
+  // cache was last written.
+  size_t journal_record_count_;
+
   DISALLOW_COPY_AND_ASSIGN(InMemoryURLIndex);
 };
 
@@ -141,15 +141,13 @@ typedef size_t WordID;
 // A map allowing a WordID to be determined given a word.
 typedef std::map<base::string16, WordID> WordMap;
 
-// A map from character to the word_ids of words containing that character.
 typedef std::set<WordID> WordIDSet;  // An index into the WordList.
-typedef std::map<char16, WordIDSet> CharWordIDMap;
 
-// A map from word (by word_id) to history items containing that word.
+// The history items containing a word. The word-to-history-items and
+// character-to-words indexes themselves are URLIndexPostingLists.
 typedef history::URLID HistoryID;
 typedef std::set<HistoryID> HistoryIDSet;
 typedef std::vector<HistoryID> HistoryIDVector;
-typedef std::map<WordID, HistoryIDSet> WordIDHistoryMap;
 typedef std::map<HistoryID, WordIDSet> HistoryIDWordMap;
 
 
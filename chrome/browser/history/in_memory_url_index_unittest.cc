@@ -106,7 +106,7 @@ class InMemoryURLIndexTest : public testing::Test {
                const content::NotificationSource& source,
                const content::NotificationDetails& details);
   const std::set<std::string>& scheme_whitelist();
-
+  bool needs_to_be_cached() const;
 
   // Pass-through functions to simplify our friendship with URLIndexPrivateData.
   bool UpdateURL(const URLRow& row);
@@ -174,6 +174,10 @@ const std::set<std::string>& InMemoryURLIndexTest::scheme_whitelist() {
   return url_index_->scheme_whitelist();
 }
 
+bool InMemoryURLIndexTest::needs_to_be_cached() const {
+  return url_index_->needs_to_be_cached_;
+}
+
 bool InMemoryURLIndexTest::UpdateURL(const URLRow& row) {
   return GetPrivateData()->UpdateURL(
       history_service_, row, url_index_->languages_,
@@ -300,8 +304,7 @@ void InMemoryURLIndexTest::ExpectPrivateDataNotEmpty(
   // data set for these tests.
   EXPECT_TRUE(data.available_words_.empty());
   EXPECT_FALSE(data.word_map_.empty());
-  EXPECT_FALSE(data.char_word_map_.empty());
-  EXPECT_FALSE(data.word_id_history_map_.empty());
+  EXPECT_FALSE(data.posting_lists_.Empty());
   EXPECT_FALSE(data.history_id_word_map_.empty());
   EXPECT_FALSE(data.history_info_map_.empty());
 }
@@ -311,8 +314,7 @@ void InMemoryURLIndexTest::ExpectPrivateDataEmpty(
   EXPECT_TRUE(data.word_list_.empty());
   EXPECT_TRUE(data.available_words_.empty());
   EXPECT_TRUE(data.word_map_.empty());
-  EXPECT_TRUE(data.char_word_map_.empty());
-  EXPECT_TRUE(data.word_id_history_map_.empty());
+  EXPECT_TRUE(data.posting_lists_.Empty());
   EXPECT_TRUE(data.history_id_word_map_.empty());
   EXPECT_TRUE(data.history_info_map_.empty());
 }
@@ -336,14 +338,40 @@ void ExpectMapOfContainersIdentical(const T& expected, const T& actual) {
   }
 }
 
+// Helper function which compares the character and word postings of two
+// indexes whose word lists have |word_count| slots.
+void ExpectPostingListsIdentical(const URLIndexPostingLists& expected,
+                                 const URLIndexPostingLists& actual,
+                                 size_t word_count) {
+  Char16Vector expected_chars;
+  expected.GetChars(&expected_chars);
+  Char16Vector actual_chars;
+  actual.GetChars(&actual_chars);
+  ASSERT_EQ(expected_chars, actual_chars);
+  for (Char16Vector::const_iterator iter = expected_chars.begin();
+       iter != expected_chars.end(); ++iter) {
+    WordIDVector expected_word_ids;
+    expected.WordIDsForChar(*iter, &expected_word_ids);
+    WordIDVector actual_word_ids;
+    actual.WordIDsForChar(*iter, &actual_word_ids);
+    EXPECT_EQ(expected_word_ids, actual_word_ids);
+  }
+  for (WordID word_id = 0; word_id < word_count; ++word_id) {
+    HistoryIDVector expected_history_ids;
+    expected.HistoryIDsForWord(word_id, &expected_history_ids);
+    HistoryIDVector actual_history_ids;
+    actual.HistoryIDsForWord(word_id, &actual_history_ids);
+    EXPECT_EQ(expected_history_ids, actual_history_ids);
+  }
+}
+
 void InMemoryURLIndexTest::ExpectPrivateDataEqual(
     const URLIndexPrivateData& expected,
     const URLIndexPrivateData& actual) {
   EXPECT_EQ(expected.word_list_.size(), actual.word_list_.size());
   EXPECT_EQ(expected.word_map_.size(), actual.word_map_.size());
-  EXPECT_EQ(expected.char_word_map_.size(), actual.char_word_map_.size());
-  EXPECT_EQ(expected.word_id_history_map_.size(),
-            actual.word_id_history_map_.size());
+  EXPECT_EQ(expected.posting_lists_.CharCount(),
+            actual.posting_lists_.CharCount());
   EXPECT_EQ(expected.history_id_word_map_.size(),
             actual.history_id_word_map_.size());
   EXPECT_EQ(expected.history_info_map_.size(), actual.history_info_map_.size());
@@ -353,10 +381,8 @@ void InMemoryURLIndexTest::ExpectPrivateDataEqual(
   for (size_t i = 0; i < count; ++i)
     EXPECT_EQ(expected.word_list_[i], actual.word_list_[i]);
 
-  ExpectMapOfContainersIdentical(expected.char_word_map_,
-                                 actual.char_word_map_);
-  ExpectMapOfContainersIdentical(expected.word_id_history_map_,
-                                 actual.word_id_history_map_);
+  ExpectPostingListsIdentical(expected.posting_lists_, actual.posting_lists_,
+                              count);
   ExpectMapOfContainersIdentical(expected.history_id_word_map_,
                                  actual.history_id_word_map_);
 
@@ -437,7 +463,7 @@ TEST_F(LimitedInMemoryURLIndexTest, Initialization) {
 
   // history_info_map_ should have the same number of items as were filtered.
   EXPECT_EQ(1U, private_data.history_info_map_.size());
-  EXPECT_EQ(35U, private_data.char_word_map_.size());
+  EXPECT_EQ(35U, private_data.posting_lists_.CharCount());
   EXPECT_EQ(17U, private_data.word_map_.size());
 }
 
@@ -1011,8 +1037,7 @@ TEST_F(InMemoryURLIndexTest, CacheSaveRestore) {
   // data set for this test.
   EXPECT_TRUE(private_data.available_words_.empty());
   EXPECT_FALSE(private_data.word_map_.empty());
-  EXPECT_FALSE(private_data.char_word_map_.empty());
-  EXPECT_FALSE(private_data.word_id_history_map_.empty());
+  EXPECT_FALSE(private_data.posting_lists_.Empty());
   EXPECT_FALSE(private_data.history_id_word_map_.empty());
   EXPECT_FALSE(private_data.history_info_map_.empty());
   EXPECT_FALSE(private_data.word_starts_map_.empty());
@@ -1037,8 +1062,7 @@ TEST_F(InMemoryURLIndexTest, CacheSaveRestore) {
   EXPECT_TRUE(private_data.word_list_.empty());
   EXPECT_TRUE(private_data.available_words_.empty());
   EXPECT_TRUE(private_data.word_map_.empty());
-  EXPECT_TRUE(private_data.char_word_map_.empty());
-  EXPECT_TRUE(private_data.word_id_history_map_.empty());
+  EXPECT_TRUE(private_data.posting_lists_.Empty());
   EXPECT_TRUE(private_data.history_id_word_map_.empty());
   EXPECT_TRUE(private_data.history_info_map_.empty());
   EXPECT_TRUE(private_data.word_starts_map_.empty());
@@ -1062,6 +1086,74 @@ TEST_F(InMemoryURLIndexTest, CacheSaveRestore) {
   ExpectPrivateDataEqual(*old_data.get(), new_data);
 }
 
+TEST_F(InMemoryURLIndexTest, CacheJournalReplay) {
+  base::ScopedTempDir temp_directory;
+  ASSERT_TRUE(temp_directory.CreateUniqueTempDir());
+  set_history_dir(temp_directory.path());
+
+  // Saving the cache starts an empty journal alongside it.
+  CacheFileSaverObserver save_observer(&message_loop_);
+  url_index_->set_save_cache_observer(&save_observer);
+  PostSaveToCacheFileTask();
+  message_loop_.Run();
+  EXPECT_TRUE(save_observer.succeeded_);
+  EXPECT_FALSE(needs_to_be_cached());
+  base::FilePath cache_path;
+  ASSERT_TRUE(GetCacheFilePath(&cache_path));
+  base::FilePath journal_path(
+      URLIndexPrivateData::GetJournalFilePath(cache_path));
+  int64 empty_journal_size = 0;
+  ASSERT_TRUE(base::GetFileSize(journal_path, &empty_journal_size));
+  EXPECT_GT(empty_journal_size, 0);
+
+  // Add one row and delete another. Neither rewrites the cache; both are
+  // appended to the journal.
+  URLRow new_row(GURL("http://www.brokeandaloneinmanitoba.com/"), 87654321);
+  new_row.set_last_visit(base::Time::Now());
+  URLsModifiedDetails modified_details;
+  modified_details.changed_urls.push_back(new_row);
+  Observe(chrome::NOTIFICATION_HISTORY_URLS_MODIFIED,
+          content::Source<InMemoryURLIndexTest>(this),
+          content::Details<history::HistoryDetails>(&modified_details));
+
+  ScoredHistoryMatches matches = url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("DrudgeReport"), base::string16::npos);
+  ASSERT_EQ(1U, matches.size());
+  URLsDeletedDetails deleted_details;
+  deleted_details.all_history = false;
+  deleted_details.rows.push_back(matches[0].url_info);
+  Observe(chrome::NOTIFICATION_HISTORY_URLS_DELETED,
+          content::Source<InMemoryURLIndexTest>(this),
+          content::Details<history::HistoryDetails>(&deleted_details));
+  message_loop_.RunUntilIdle();
+
+  int64 journal_size = 0;
+  ASSERT_TRUE(base::GetFileSize(journal_path, &journal_size));
+  EXPECT_GT(journal_size, empty_journal_size);
+  // With every change journaled, shutdown need not rewrite the cache.
+  EXPECT_FALSE(needs_to_be_cached());
+
+  // Restoring from the cache replays the journal on top of it.
+  ClearPrivateData();
+  HistoryIndexRestoreObserver restore_observer(
+      base::Bind(&base::MessageLoop::Quit, base::Unretained(&message_loop_)));
+  url_index_->set_restore_cache_observer(&restore_observer);
+  PostRestoreFromCacheFileTask();
+  message_loop_.Run();
+  EXPECT_TRUE(restore_observer.succeeded());
+  EXPECT_EQ(1U, url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("brokeandalone"), base::string16::npos).size());
+  EXPECT_TRUE(url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("DrudgeReport"), base::string16::npos).empty());
+
+  // Saving again folds the journaled changes into the cache.
+  PostSaveToCacheFileTask();
+  message_loop_.Run();
+  EXPECT_TRUE(save_observer.succeeded_);
+  ASSERT_TRUE(base::GetFileSize(journal_path, &journal_size));
+  EXPECT_EQ(empty_journal_size, journal_size);
+}
+
 TEST_F(InMemoryURLIndexTest, RebuildFromHistoryIfCacheOld) {
   base::ScopedTempDir temp_directory;
   ASSERT_TRUE(temp_directory.CreateUniqueTempDir());
@@ -1075,8 +1167,7 @@ TEST_F(InMemoryURLIndexTest, RebuildFromHistoryIfCacheOld) {
   // data set for this test.
   EXPECT_TRUE(private_data.available_words_.empty());
   EXPECT_FALSE(private_data.word_map_.empty());
-  EXPECT_FALSE(private_data.char_word_map_.empty());
-  EXPECT_FALSE(private_data.word_id_history_map_.empty());
+  EXPECT_FALSE(private_data.posting_lists_.Empty());
   EXPECT_FALSE(private_data.history_id_word_map_.empty());
   EXPECT_FALSE(private_data.history_info_map_.empty());
   EXPECT_FALSE(private_data.word_starts_map_.empty());
@@ -1106,8 +1197,7 @@ TEST_F(InMemoryURLIndexTest, RebuildFromHistoryIfCacheOld) {
   EXPECT_TRUE(private_data.word_list_.empty());
   EXPECT_TRUE(private_data.available_words_.empty());
   EXPECT_TRUE(private_data.word_map_.empty());
-  EXPECT_TRUE(private_data.char_word_map_.empty());
-  EXPECT_TRUE(private_data.word_id_history_map_.empty());
+  EXPECT_TRUE(private_data.posting_lists_.Empty());
   EXPECT_TRUE(private_data.history_id_word_map_.empty());
   EXPECT_TRUE(private_data.history_info_map_.empty());
   EXPECT_TRUE(private_data.word_starts_map_.empty());
@@ -0,0 +1,640 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/url_index_posting_lists.h"
+
+#include <limits>
+
+#include "base/logging.h"
+
+namespace history {
+
+namespace {
+
+// The delta may hold up to this many postings, or one for every
+// |kSnapshotPostingsPerDeltaPosting| postings in the snapshot if that is more,
+// before the snapshot should be rebuilt. Rebuilding only once the delta has
+// grown in proportion to the snapshot keeps the cost of rebuilding constant
+// per change, amortized.
+const size_t kMinDeltaPostingsToCompact = 1024;
+const size_t kSnapshotPostingsPerDeltaPosting = 8;
+
+// A std::set node costs about three pointers and a color besides its value.
+const size_t kSetNodeOverheadBytes = 4 * sizeof(void*);
+
+// Identifies a snapshot, and that it was written in this machine's byte order.
+const uint32 kSnapshotMagic = 0x49555053;  // 'IUPS'
+
+// A snapshot starts with this header. It is followed by the character
+// offsets, the word offsets, the characters and then the two posting buffers,
+// in that order and with no padding, which keeps every array aligned.
+struct SnapshotHeader {
+  uint32 magic;
+  uint32 char_count;
+  uint32 word_count;
+  uint32 posting_count;
+  uint32 char_postings_size;
+  uint32 word_postings_size;
+};
+
+// Returns true if the |count| + 1 |offsets| rise from zero to |postings_size|
+// and every non-empty range of |postings| they mark ends a varint, so that
+// decoding never strays out of its range. Adds the number of varints to
+// |*posting_count|.
+bool ValidateOffsets(const uint32* offsets,
+                     size_t count,
+                     const uint8* postings,
+                     uint32 postings_size,
+                     uint64* posting_count) {
+  if (offsets[0] != 0 || offsets[count] != postings_size)
+    return false;
+  for (size_t i = 0; i < count; ++i) {
+    if (offsets[i] > offsets[i + 1])
+      return false;
+    if (offsets[i] != offsets[i + 1] && (postings[offsets[i + 1] - 1] & 0x80))
+      return false;
+  }
+  for (uint32 i = 0; i < postings_size; ++i) {
+    if (!(postings[i] & 0x80))
+      ++*posting_count;
+  }
+  return true;
+}
+
+// Appends the |size| bytes at |bytes| to |data|.
+void AppendBytes(const void* bytes,
+                 size_t size,
+                 std::vector<unsigned char>* data) {
+  const unsigned char* begin = static_cast<const unsigned char*>(bytes);
+  data->insert(data->end(), begin, begin + size);
+}
+
+}  // namespace
+
+URLIndexPostingLists::URLIndexPostingLists()
+    : chars_(NULL),
+      char_offsets_(NULL),
+      char_postings_(NULL),
+      char_count_(0),
+      word_offsets_(NULL),
+      word_postings_(NULL),
+      word_count_(0),
+      posting_count_(0) {}
+
+URLIndexPostingLists::~URLIndexPostingLists() {}
+
+void URLIndexPostingLists::Build(
+    std::vector<CharWordPosting>* char_words,
+    std::vector<WordHistoryPosting>* word_histories) {
+  Clear();
+
+  std::sort(char_words->begin(), char_words->end());
+  char_words->erase(std::unique(char_words->begin(), char_words->end()),
+                    char_words->end());
+  std::sort(word_histories->begin(), word_histories->end());
+  word_histories->erase(
+      std::unique(word_histories->begin(), word_histories->end()),
+      word_histories->end());
+
+  std::vector<char16> chars;
+  std::vector<uint32> char_offsets;
+  std::vector<uint8> char_postings;
+  WordIDVector word_ids;
+  for (std::vector<CharWordPosting>::const_iterator iter =
+           char_words->begin(); iter != char_words->end(); ++iter) {
+    word_ids.push_back(iter->second);
+    if (iter + 1 != char_words->end() && (iter + 1)->first == iter->first)
+      continue;
+    chars.push_back(iter->first);
+    char_offsets.push_back(static_cast<uint32>(char_postings.size()));
+    AppendPostings(word_ids, &char_postings);
+    word_ids.clear();
+  }
+  char_offsets.push_back(static_cast<uint32>(char_postings.size()));
+
+  // WordIDs index slots in the word list, so the largest one bounds the table.
+  WordID word_count = word_histories->empty() ?
+      0 : word_histories->back().first + 1;
+  std::vector<uint32> word_offsets;
+  word_offsets.reserve(word_count + 1);
+  std::vector<uint8> word_postings;
+  HistoryIDVector history_ids;
+  for (std::vector<WordHistoryPosting>::const_iterator iter =
+           word_histories->begin(); iter != word_histories->end(); ++iter) {
+    history_ids.push_back(iter->second);
+    if (iter + 1 != word_histories->end() && (iter + 1)->first == iter->first)
+      continue;
+    word_offsets.resize(iter->first + 1,
+                        static_cast<uint32>(word_postings.size()));
+    AppendPostings(history_ids, &word_postings);
+    history_ids.clear();
+  }
+  word_offsets.push_back(static_cast<uint32>(word_postings.size()));
+
+  SetSnapshot(chars, char_offsets, char_postings, word_offsets, word_postings,
+              char_words->size() + word_histories->size());
+}
+
+void URLIndexPostingLists::Clear() {
+  snapshot_ = NULL;
+  chars_ = NULL;
+  char_offsets_ = NULL;
+  char_postings_ = NULL;
+  char_count_ = 0;
+  word_offsets_ = NULL;
+  word_postings_ = NULL;
+  word_count_ = 0;
+  posting_count_ = 0;
+  added_char_words_.clear();
+  removed_char_words_.clear();
+  added_word_histories_.clear();
+  removed_word_histories_.clear();
+}
+
+bool URLIndexPostingLists::InitFromSnapshot(
+    const scoped_refptr<base::RefCountedMemory>& snapshot) {
+  Clear();
+  const uint8* data = snapshot->front();
+  size_t size = snapshot->size();
+  if (size < sizeof(SnapshotHeader) ||
+      reinterpret_cast<uintptr_t>(data) % sizeof(uint32) != 0)
+    return false;
+  const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(data);
+  if (header->magic != kSnapshotMagic)
+    return false;
+  uint64 expected_size = sizeof(SnapshotHeader) +
+      (static_cast<uint64>(header->char_count) + 1) * sizeof(uint32) +
+      (static_cast<uint64>(header->word_count) + 1) * sizeof(uint32) +
+      static_cast<uint64>(header->char_count) * sizeof(char16) +
+      header->char_postings_size + header->word_postings_size;
+  if (expected_size != size)
+    return false;
+
+  const uint8* next = data + sizeof(SnapshotHeader);
+  const uint32* char_offsets = reinterpret_cast<const uint32*>(next);
+  next += (header->char_count + 1) * sizeof(uint32);
+  const uint32* word_offsets = reinterpret_cast<const uint32*>(next);
+  next += (header->word_count + 1) * sizeof(uint32);
+  const char16* chars = reinterpret_cast<const char16*>(next);
+  next += header->char_count * sizeof(char16);
+  const uint8* char_postings = next;
+  next += header->char_postings_size;
+  const uint8* word_postings = next;
+
+  // The snapshot may come from disk, so check everything lookups rely on.
+  for (size_t i = 1; i < header->char_count; ++i) {
+    if (chars[i - 1] >= chars[i])
+      return false;
+  }
+  uint64 posting_count = 0;
+  if (!ValidateOffsets(char_offsets, header->char_count, char_postings,
+                       header->char_postings_size, &posting_count) ||
+      !ValidateOffsets(word_offsets, header->word_count, word_postings,
+                       header->word_postings_size, &posting_count) ||
+      posting_count != header->posting_count)
+    return false;
+
+  snapshot_ = snapshot;
+  chars_ = chars;
+  char_offsets_ = char_offsets;
+  char_postings_ = char_postings;
+  char_count_ = header->char_count;
+  word_offsets_ = word_offsets;
+  word_postings_ = word_postings;
+  word_count_ = header->word_count;
+  posting_count_ = header->posting_count;
+  return true;
+}
+
+void URLIndexPostingLists::AppendSnapshot(std::string* data) const {
+  DCHECK_EQ(0U, data->size() % sizeof(uint32));
+  if (DeltaSize()) {
+    URLIndexPostingLists compacted(*this);
+    compacted.Compact();
+    compacted.AppendSnapshot(data);
+    return;
+  }
+  if (!snapshot_.get()) {
+    URLIndexPostingLists empty;
+    empty.SetSnapshot(std::vector<char16>(), std::vector<uint32>(1, 0),
+                      std::vector<uint8>(), std::vector<uint32>(1, 0),
+                      std::vector<uint8>(), 0);
+    empty.AppendSnapshot(data);
+    return;
+  }
+  data->append(reinterpret_cast<const char*>(snapshot_->front()),
+               snapshot_->size());
+}
+
+void URLIndexPostingLists::AddCharWord(char16 uni_char, WordID word_id) {
+  AddToDelta(std::make_pair(uni_char, word_id), &added_char_words_,
+             &removed_char_words_);
+}
+
+void URLIndexPostingLists::RemoveCharWord(char16 uni_char, WordID word_id) {
+  RemoveFromDelta(std::make_pair(uni_char, word_id), &added_char_words_,
+                  &removed_char_words_);
+}
+
+void URLIndexPostingLists::AddWordHistory(WordID word_id,
+                                          HistoryID history_id) {
+  AddToDelta(std::make_pair(word_id, history_id), &added_word_histories_,
+             &removed_word_histories_);
+}
+
+void URLIndexPostingLists::RemoveWordHistory(WordID word_id,
+                                             HistoryID history_id) {
+  RemoveFromDelta(std::make_pair(word_id, history_id), &added_word_histories_,
+                  &removed_word_histories_);
+}
+
+bool URLIndexPostingLists::NeedsCompaction() const {
+  return DeltaSize() > std::max(kMinDeltaPostingsToCompact,
+                                posting_count_ /
+                                    kSnapshotPostingsPerDeltaPosting);
+}
+
+void URLIndexPostingLists::Compact() {
+  // Encode the current lists straight into new buffers, one key at a time, so
+  // that the index is never held in a less compact form along the way.
+  std::vector<char16> chars;
+  GetChars(&chars);
+  std::vector<uint32> char_offsets;
+  char_offsets.reserve(chars.size() + 1);
+  std::vector<uint8> char_postings;
+  size_t posting_count = 0;
+  WordIDVector word_ids;
+  for (std::vector<char16>::const_iterator iter = chars.begin();
+       iter != chars.end(); ++iter) {
+    WordIDsForChar(*iter, &word_ids);
+    char_offsets.push_back(static_cast<uint32>(char_postings.size()));
+    AppendPostings(word_ids, &char_postings);
+    posting_count += word_ids.size();
+  }
+  char_offsets.push_back(static_cast<uint32>(char_postings.size()));
+
+  WordID word_count = WordIDLimit();
+  std::vector<uint32> word_offsets;
+  word_offsets.reserve(word_count + 1);
+  std::vector<uint8> word_postings;
+  HistoryIDVector history_ids;
+  for (WordID word_id = 0; word_id < word_count; ++word_id) {
+    HistoryIDsForWord(word_id, &history_ids);
+    word_offsets.push_back(static_cast<uint32>(word_postings.size()));
+    AppendPostings(history_ids, &word_postings);
+    posting_count += history_ids.size();
+  }
+  word_offsets.push_back(static_cast<uint32>(word_postings.size()));
+
+  SetSnapshot(chars, char_offsets, char_postings, word_offsets, word_postings,
+              posting_count);
+}
+
+void URLIndexPostingLists::GetChars(Char16Vector* chars) const {
+  chars->assign(chars_, chars_ + char_count_);
+  size_t snapshot_size = chars->size();
+  for (CharWordDelta::const_iterator iter = added_char_words_.begin();
+       iter != added_char_words_.end(); ++iter) {
+    if (chars->size() == snapshot_size || chars->back() != iter->first)
+      chars->push_back(iter->first);
+  }
+  std::inplace_merge(chars->begin(), chars->begin() + snapshot_size,
+                     chars->end());
+  chars->erase(std::unique(chars->begin(), chars->end()), chars->end());
+
+  // Characters whose every word has been removed since the snapshot was
+  // built are still in |chars_|.
+  if (removed_char_words_.empty())
+    return;
+  Char16Vector::iterator out = chars->begin();
+  for (Char16Vector::const_iterator iter = chars->begin();
+       iter != chars->end(); ++iter) {
+    const uint8* begin;
+    const uint8* end;
+    CharPostings(*iter, &begin, &end);
+    if (HasPostings(*iter, begin, end, added_char_words_, removed_char_words_))
+      *out++ = *iter;
+  }
+  chars->erase(out, chars->end());
+}
+
+size_t URLIndexPostingLists::CharCount() const {
+  Char16Vector chars;
+  GetChars(&chars);
+  return chars.size();
+}
+
+WordID URLIndexPostingLists::WordIDLimit() const {
+  WordID limit = word_count_;
+  if (!added_word_histories_.empty())
+    limit = std::max(limit, added_word_histories_.rbegin()->first + 1);
+  return limit;
+}
+
+void URLIndexPostingLists::WordIDsForChar(char16 uni_char,
+                                          WordIDVector* word_ids) const {
+  const uint8* begin;
+  const uint8* end;
+  CharPostings(uni_char, &begin, &end);
+  word_ids->clear();
+  DecodePostings(begin, end, word_ids);
+  ApplyDelta(uni_char, added_char_words_, removed_char_words_, word_ids);
+}
+
+void URLIndexPostingLists::HistoryIDsForWord(
+    WordID word_id,
+    HistoryIDVector* history_ids) const {
+  const uint8* begin;
+  const uint8* end;
+  WordPostings(word_id, &begin, &end);
+  history_ids->clear();
+  DecodePostings(begin, end, history_ids);
+  ApplyDelta(word_id, added_word_histories_, removed_word_histories_,
+             history_ids);
+}
+
+bool URLIndexPostingLists::HasHistoryIDs(WordID word_id) const {
+  const uint8* begin;
+  const uint8* end;
+  WordPostings(word_id, &begin, &end);
+  return HasPostings(word_id, begin, end, added_word_histories_,
+                     removed_word_histories_);
+}
+
+void URLIndexPostingLists::WordIDsForChars(const Char16Set& chars,
+                                           WordIDVector* word_ids) const {
+  word_ids->clear();
+  if (chars.empty())
+    return;
+
+  // Size up every character's list first so that the shortest one can seed
+  // the intersection and bound the work done for the rest.
+  Char16Set::const_iterator shortest = chars.end();
+  size_t shortest_size = 0;
+  for (Char16Set::const_iterator iter = chars.begin(); iter != chars.end();
+       ++iter) {
+    size_t size = EstimatedCharPostings(*iter);
+    if (!size)
+      return;
+    if (shortest == chars.end() || size < shortest_size) {
+      shortest = iter;
+      shortest_size = size;
+    }
+  }
+
+  WordIDsForChar(*shortest, word_ids);
+  WordIDVector char_word_ids;
+  WordIDVector intersection;
+  for (Char16Set::const_iterator iter = chars.begin();
+       iter != chars.end() && !word_ids->empty(); ++iter) {
+    if (iter == shortest)
+      continue;
+    WordIDsForChar(*iter, &char_word_ids);
+    IntersectSortedVectors(*word_ids, char_word_ids, &intersection);
+    word_ids->swap(intersection);
+  }
+}
+
+void URLIndexPostingLists::HistoryIDsForWords(
+    const WordIDVector& word_ids,
+    HistoryIDVector* history_ids) const {
+  history_ids->clear();
+  if (word_ids.size() == 1) {
+    HistoryIDsForWord(word_ids[0], history_ids);
+    return;
+  }
+  HistoryIDVector word_history_ids;
+  for (WordIDVector::const_iterator iter = word_ids.begin();
+       iter != word_ids.end(); ++iter) {
+    HistoryIDsForWord(*iter, &word_history_ids);
+    history_ids->insert(history_ids->end(), word_history_ids.begin(),
+                        word_history_ids.end());
+  }
+  std::sort(history_ids->begin(), history_ids->end());
+  history_ids->erase(std::unique(history_ids->begin(), history_ids->end()),
+                     history_ids->end());
+}
+
+size_t URLIndexPostingLists::MemoryUsage() const {
+  return (snapshot_.get() ? snapshot_->size() : 0) +
+      (added_char_words_.size() + removed_char_words_.size()) *
+          (kSetNodeOverheadBytes + sizeof(CharWordDelta::value_type)) +
+      (added_word_histories_.size() + removed_word_histories_.size()) *
+          (kSetNodeOverheadBytes + sizeof(WordHistoryDelta::value_type));
+}
+
+// static
+template <typename Container>
+void URLIndexPostingLists::AppendPostings(const Container& values,
+                                          std::vector<uint8>* postings) {
+  uint64 previous = 0;
+  for (typename Container::const_iterator iter = values.begin();
+       iter != values.end(); ++iter) {
+    uint64 value = static_cast<uint64>(*iter);
+    DCHECK(iter == values.begin() || value > previous);
+    uint64 delta = value - previous;
+    previous = value;
+    while (delta >= 0x80) {
+      postings->push_back(static_cast<uint8>(delta | 0x80));
+      delta >>= 7;
+    }
+    postings->push_back(static_cast<uint8>(delta));
+  }
+}
+
+// static
+template <typename T>
+void URLIndexPostingLists::DecodePostings(const uint8* begin,
+                                          const uint8* end,
+                                          std::vector<T>* values) {
+  uint64 value = 0;
+  while (begin < end) {
+    uint64 delta = 0;
+    int shift = 0;
+    uint8 byte;
+    do {
+      DCHECK(begin < end);
+      byte = *begin++;
+      delta |= static_cast<uint64>(byte & 0x7f) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    value += delta;
+    values->push_back(static_cast<T>(value));
+  }
+}
+
+// static
+template <typename K, typename V>
+void URLIndexPostingLists::ApplyDelta(
+    K key,
+    const std::set<std::pair<K, V> >& added,
+    const std::set<std::pair<K, V> >& removed,
+    std::vector<V>* values) {
+  typedef typename std::set<std::pair<K, V> >::const_iterator DeltaIterator;
+  const std::pair<K, V> first(key, std::numeric_limits<V>::min());
+  const std::pair<K, V> last(key, std::numeric_limits<V>::max());
+
+  DeltaIterator added_begin = added.lower_bound(first);
+  DeltaIterator added_end = added.upper_bound(last);
+  if (added_begin != added_end) {
+    // Added postings are never in the snapshot, so this is a plain merge.
+    size_t snapshot_size = values->size();
+    for (DeltaIterator iter = added_begin; iter != added_end; ++iter)
+      values->push_back(iter->second);
+    std::inplace_merge(values->begin(), values->begin() + snapshot_size,
+                       values->end());
+  }
+
+  DeltaIterator removed_begin = removed.lower_bound(first);
+  DeltaIterator removed_end = removed.upper_bound(last);
+  if (removed_begin != removed_end) {
+    typename std::vector<V>::iterator out = values->begin();
+    for (typename std::vector<V>::iterator iter = values->begin();
+         iter != values->end(); ++iter) {
+      while (removed_begin != removed_end && removed_begin->second < *iter)
+        ++removed_begin;
+      if (removed_begin == removed_end || removed_begin->second != *iter)
+        *out++ = *iter;
+    }
+    values->erase(out, values->end());
+  }
+}
+
+// static
+template <typename K, typename V>
+bool URLIndexPostingLists::HasPostings(
+    K key,
+    const uint8* begin,
+    const uint8* end,
+    const std::set<std::pair<K, V> >& added,
+    const std::set<std::pair<K, V> >& removed) {
+  const std::pair<K, V> first(key, std::numeric_limits<V>::min());
+  const std::pair<K, V> last(key, std::numeric_limits<V>::max());
+  if (added.lower_bound(first) != added.upper_bound(last))
+    return true;
+
+  // Removed postings are always in the snapshot, so some posting is left if
+  // the snapshot holds more than were removed. Each posting ends with the
+  // one byte which lacks the continuation bit.
+  size_t removed_count = std::distance(removed.lower_bound(first),
+                                       removed.upper_bound(last));
+  size_t snapshot_count = 0;
+  for (; begin < end && snapshot_count <= removed_count; ++begin) {
+    if (!(*begin & 0x80))
+      ++snapshot_count;
+  }
+  return snapshot_count > removed_count;
+}
+
+// static
+template <typename P>
+void URLIndexPostingLists::AddToDelta(const P& posting,
+                                      std::set<P>* added,
+                                      std::set<P>* removed) {
+  // A posting removed since the snapshot was built is still in the snapshot,
+  // so putting it back only takes cancelling the removal.
+  if (removed->erase(posting))
+    return;
+  bool inserted = added->insert(posting).second;
+  DCHECK(inserted);
+}
+
+// static
+template <typename P>
+void URLIndexPostingLists::RemoveFromDelta(const P& posting,
+                                           std::set<P>* added,
+                                           std::set<P>* removed) {
+  if (added->erase(posting))
+    return;
+  bool inserted = removed->insert(posting).second;
+  DCHECK(inserted);
+}
+
+void URLIndexPostingLists::SetSnapshot(const std::vector<char16>& chars,
+                                       const std::vector<uint32>& char_offsets,
+                                       const std::vector<uint8>& char_postings,
+                                       const std::vector<uint32>& word_offsets,
+                                       const std::vector<uint8>& word_postings,
+                                       size_t posting_count) {
+  DCHECK_EQ(chars.size() + 1, char_offsets.size());
+  DCHECK(!word_offsets.empty());
+  SnapshotHeader header;
+  header.magic = kSnapshotMagic;
+  header.char_count = static_cast<uint32>(chars.size());
+  header.word_count = static_cast<uint32>(word_offsets.size() - 1);
+  header.posting_count = static_cast<uint32>(posting_count);
+  header.char_postings_size = static_cast<uint32>(char_postings.size());
+  header.word_postings_size = static_cast<uint32>(word_postings.size());
+
+  std::vector<unsigned char> data;
+  data.reserve(sizeof(header) +
+               (char_offsets.size() + word_offsets.size()) * sizeof(uint32) +
+               chars.size() * sizeof(char16) + char_postings.size() +
+               word_postings.size());
+  AppendBytes(&header, sizeof(header), &data);
+  AppendBytes(&char_offsets[0], char_offsets.size() * sizeof(uint32), &data);
+  AppendBytes(&word_offsets[0], word_offsets.size() * sizeof(uint32), &data);
+  if (!chars.empty())
+    AppendBytes(&chars[0], chars.size() * sizeof(char16), &data);
+  if (!char_postings.empty())
+    AppendBytes(&char_postings[0], char_postings.size(), &data);
+  if (!word_postings.empty())
+    AppendBytes(&word_postings[0], word_postings.size(), &data);
+
+  bool initialized =
+      InitFromSnapshot(base::RefCountedBytes::TakeVector(&data));
+  DCHECK(initialized);
+}
+
+size_t URLIndexPostingLists::EstimatedCharPostings(char16 uni_char) const {
+  size_t size = 0;
+  const char16* chars_end = chars_ + char_count_;
+  const char16* found = std::lower_bound(chars_, chars_end, uni_char);
+  if (found != chars_end && *found == uni_char) {
+    size_t slot = found - chars_;
+    size = char_offsets_[slot + 1] - char_offsets_[slot];
+  }
+  return size + std::distance(
+      added_char_words_.lower_bound(
+          std::make_pair(uni_char, std::numeric_limits<WordID>::min())),
+      added_char_words_.upper_bound(
+          std::make_pair(uni_char, std::numeric_limits<WordID>::max())));
+}
+
+void URLIndexPostingLists::CharPostings(char16 uni_char,
+                                        const uint8** begin,
+                                        const uint8** end) const {
+  *begin = *end = NULL;
+  const char16* chars_end = chars_ + char_count_;
+  const char16* found = std::lower_bound(chars_, chars_end, uni_char);
+  if (found != chars_end && *found == uni_char) {
+    size_t slot = found - chars_;
+    *begin = char_postings_ + char_offsets_[slot];
+    *end = char_postings_ + char_offsets_[slot + 1];
+  }
+}
+
+void URLIndexPostingLists::WordPostings(WordID word_id,
+                                        const uint8** begin,
+                                        const uint8** end) const {
+  *begin = *end = NULL;
+  if (word_id < word_count_ &&
+      word_offsets_[word_id] != word_offsets_[word_id + 1]) {
+    *begin = word_postings_ + word_offsets_[word_id];
+    *end = word_postings_ + word_offsets_[word_id + 1];
+  }
+}
+
+size_t URLIndexPostingLists::PostingCount() const {
+  return posting_count_ + added_char_words_.size() +
+      added_word_histories_.size() - removed_char_words_.size() -
+      removed_word_histories_.size();
+}
+
+size_t URLIndexPostingLists::DeltaSize() const {
+  return added_char_words_.size() + removed_char_words_.size() +
+      added_word_histories_.size() + removed_word_histories_.size();
+}
+
+}  // namespace history
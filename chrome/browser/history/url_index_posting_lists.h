@@ -0,0 +1,279 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_HISTORY_URL_INDEX_POSTING_LISTS_H_
+#define CHROME_BROWSER_HISTORY_URL_INDEX_POSTING_LISTS_H_
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/ref_counted_memory.h"
+#include "chrome/browser/history/in_memory_url_index_types.h"
+
+namespace history {
+
+typedef std::vector<WordID> WordIDVector;
+
+// Intersects the sorted, duplicate-free vectors |a| and |b| into |out|. When
+// one input is much shorter than the other, each of its elements is located
+// in the longer one by galloping (exponential then binary) search, so the
+// cost follows the shorter list rather than the sum of both. Otherwise this
+// is a plain linear merge.
+template <typename T>
+void IntersectSortedVectors(const std::vector<T>& a,
+                            const std::vector<T>& b,
+                            std::vector<T>* out) {
+  out->clear();
+  const std::vector<T>& shorter = a.size() <= b.size() ? a : b;
+  const std::vector<T>& longer = a.size() <= b.size() ? b : a;
+  if (shorter.empty())
+    return;
+
+  // Galloping only pays off once the lists differ in length by about this
+  // factor.
+  const size_t kGallopRatio = 16;
+  if (longer.size() / shorter.size() < kGallopRatio) {
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                          std::back_inserter(*out));
+    return;
+  }
+
+  typename std::vector<T>::const_iterator low = longer.begin();
+  for (typename std::vector<T>::const_iterator iter = shorter.begin();
+       iter != shorter.end(); ++iter) {
+    // Find a |high| with *high >= *iter by doubling the step from |low|.
+    typename std::vector<T>::const_iterator high = low;
+    size_t step = 1;
+    while (high != longer.end() && *high < *iter) {
+      low = high;
+      if (static_cast<size_t>(longer.end() - high) <= step) {
+        high = longer.end();
+        break;
+      }
+      high += step;
+      step *= 2;
+    }
+    low = std::lower_bound(low, high, *iter);
+    if (low == longer.end())
+      return;
+    if (*low == *iter) {
+      out->push_back(*iter);
+      ++low;
+    }
+  }
+}
+
+// The two word indexes of URLIndexPrivateData: the character-to-words index
+// and the word-to-history-items index. Each posting list is stored as sorted,
+// delta-encoded varints in one contiguous buffer per index, which costs a byte
+// or two per posting instead of a std::set node, and which is decoded into
+// flat vectors for intersection. Lookups by word are direct since WordIDs are
+// dense slots in the word list; lookups by character binary-search a sorted
+// character table.
+//
+// The encoded snapshot is immutable. Postings added or removed after it was
+// built are kept in a small delta which lookups merge in, so that each change
+// to the index costs a set insertion rather than re-encoding everything. The
+// owner folds the delta back into the snapshot by calling Compact() once
+// NeedsCompaction() says the delta has grown too large.
+//
+// The snapshot is a single self-describing block of memory which is shared,
+// not copied, between copies of the posting lists. It can be written out with
+// AppendSnapshot() and later queried in place, for instance straight from a
+// memory-mapped file, with InitFromSnapshot().
+class URLIndexPostingLists {
+ public:
+  typedef std::pair<char16, WordID> CharWordPosting;
+  typedef std::pair<WordID, HistoryID> WordHistoryPosting;
+
+  URLIndexPostingLists();
+  ~URLIndexPostingLists();
+
+  // Replaces the contents of the snapshot with |char_words| and
+  // |word_histories| and empties the delta. Both are sorted and have any
+  // duplicates removed in place, so they may be given in any order.
+  void Build(std::vector<CharWordPosting>* char_words,
+             std::vector<WordHistoryPosting>* word_histories);
+
+  // Empties the snapshot and the delta, releasing their memory.
+  void Clear();
+
+  // Replaces the contents with the snapshot in |snapshot|, as written by
+  // AppendSnapshot(), and empties the delta. The snapshot is queried in place
+  // and |snapshot| is kept alive for as long as it is in use. Returns false,
+  // leaving the posting lists empty, if |snapshot| is not well formed or does
+  // not start on a 4-byte boundary.
+  bool InitFromSnapshot(const scoped_refptr<base::RefCountedMemory>& snapshot);
+
+  // Appends the snapshot, with the delta folded in, to |data|. The result is
+  // made of 32-bit words in the machine's byte order, so |data| should be
+  // padded to a 4-byte boundary first.
+  void AppendSnapshot(std::string* data) const;
+
+  // Record a posting added to or removed from the index. Adding a posting
+  // which is already present, or removing one which is not, is not allowed.
+  void AddCharWord(char16 uni_char, WordID word_id);
+  void RemoveCharWord(char16 uni_char, WordID word_id);
+  void AddWordHistory(WordID word_id, HistoryID history_id);
+  void RemoveWordHistory(WordID word_id, HistoryID history_id);
+
+  // Returns true once the delta is large enough relative to the snapshot that
+  // merging it slows lookups down more than rebuilding would cost.
+  bool NeedsCompaction() const;
+
+  // Re-encodes the snapshot with the delta folded in and empties the delta.
+  void Compact();
+
+  // Returns true if there are no postings at all.
+  bool Empty() const { return PostingCount() == 0; }
+
+  // Fills |chars| with the sorted characters which occur in any word.
+  void GetChars(Char16Vector* chars) const;
+
+  // Returns the number of characters which occur in any word.
+  size_t CharCount() const;
+
+  // Returns one more than the largest WordID which may occur in any history
+  // item.
+  WordID WordIDLimit() const;
+
+  // Fills |word_ids| with the sorted IDs of the words containing |uni_char|.
+  void WordIDsForChar(char16 uni_char, WordIDVector* word_ids) const;
+
+  // Fills |history_ids| with the sorted IDs of the history items containing
+  // |word_id|.
+  void HistoryIDsForWord(WordID word_id, HistoryIDVector* history_ids) const;
+
+  // Returns true if |word_id| occurs in any history item. Unlike
+  // HistoryIDsForWord() this does not decode the word's whole list.
+  bool HasHistoryIDs(WordID word_id) const;
+
+  // Fills |word_ids| with the sorted IDs of the words which contain every
+  // character in |chars|. The result is empty if |chars| is empty or any
+  // character is not indexed.
+  void WordIDsForChars(const Char16Set& chars, WordIDVector* word_ids) const;
+
+  // Fills |history_ids| with the sorted, duplicate-free union of the history
+  // items containing any of |word_ids|.
+  void HistoryIDsForWords(const WordIDVector& word_ids,
+                          HistoryIDVector* history_ids) const;
+
+  // Returns the approximate number of bytes used by the snapshot and the
+  // delta. A snapshot given to InitFromSnapshot() is counted even though it
+  // may be file-backed memory.
+  size_t MemoryUsage() const;
+
+ private:
+  typedef std::set<CharWordPosting> CharWordDelta;
+  typedef std::set<WordHistoryPosting> WordHistoryDelta;
+
+  // Appends the sorted |values| to |postings| as varint-encoded deltas.
+  template <typename Container>
+  static void AppendPostings(const Container& values,
+                             std::vector<uint8>* postings);
+
+  // Appends the values encoded in [|begin|, |end|) to |values|.
+  template <typename T>
+  static void DecodePostings(const uint8* begin,
+                             const uint8* end,
+                             std::vector<T>* values);
+
+  // Replaces the sorted |values| posted under |key| in the snapshot with the
+  // current postings by merging in |added| and taking out |removed|.
+  template <typename K, typename V>
+  static void ApplyDelta(K key,
+                         const std::set<std::pair<K, V> >& added,
+                         const std::set<std::pair<K, V> >& removed,
+                         std::vector<V>* values);
+
+  // Returns true if anything is posted under |key|, given its encoded
+  // snapshot postings [|begin|, |end|) and the delta sets for its index.
+  // Decodes no more of the snapshot than the number of postings removed.
+  template <typename K, typename V>
+  static bool HasPostings(K key,
+                          const uint8* begin,
+                          const uint8* end,
+                          const std::set<std::pair<K, V> >& added,
+                          const std::set<std::pair<K, V> >& removed);
+
+  // Records that |posting| was added or removed, given the delta sets for its
+  // index.
+  template <typename P>
+  static void AddToDelta(const P& posting,
+                         std::set<P>* added,
+                         std::set<P>* removed);
+  template <typename P>
+  static void RemoveFromDelta(const P& posting,
+                              std::set<P>* added,
+                              std::set<P>* removed);
+
+  // Sets [|*begin|, |*end|) to the encoded snapshot postings for |uni_char|
+  // or |word_id|, which is empty if there are none.
+  void CharPostings(char16 uni_char,
+                    const uint8** begin,
+                    const uint8** end) const;
+  void WordPostings(WordID word_id,
+                    const uint8** begin,
+                    const uint8** end) const;
+
+  // Encodes the given lists into a new snapshot, makes it current and empties
+  // the delta. The postings for |chars[i]| are in |char_postings| at
+  // [|char_offsets[i]|, |char_offsets[i + 1]|) and those for WordID |w| are
+  // in |word_postings| at [|word_offsets[w]|, |word_offsets[w + 1]|).
+  void SetSnapshot(const std::vector<char16>& chars,
+                   const std::vector<uint32>& char_offsets,
+                   const std::vector<uint8>& char_postings,
+                   const std::vector<uint32>& word_offsets,
+                   const std::vector<uint8>& word_postings,
+                   size_t posting_count);
+
+  // Returns roughly how many words are posted under |uni_char|: the length
+  // of its encoded list plus the words added since. Used to pick the shortest
+  // list to seed an intersection.
+  size_t EstimatedCharPostings(char16 uni_char) const;
+
+  // Returns the number of postings in the snapshot and the delta together.
+  size_t PostingCount() const;
+
+  size_t DeltaSize() const;
+
+  // The snapshot, which the pointers below refer into. NULL when there is
+  // none.
+  scoped_refptr<base::RefCountedMemory> snapshot_;
+
+  // Characters present in the snapshot, sorted. The postings for |chars_[i]|
+  // are at [|char_offsets_[i]|, |char_offsets_[i + 1]|) in |char_postings_|.
+  const char16* chars_;
+  const uint32* char_offsets_;
+  const uint8* char_postings_;
+  size_t char_count_;
+
+  // The postings for WordID |w| are at [|word_offsets_[w]|,
+  // |word_offsets_[w + 1]|) in |word_postings_|. Words not in the snapshot
+  // have an empty range, and there are |word_count_| slots.
+  const uint32* word_offsets_;
+  const uint8* word_postings_;
+  size_t word_count_;
+
+  // The number of postings encoded in the snapshot.
+  size_t posting_count_;
+
+  // Postings added to and removed from the index since the snapshot was
+  // built. An added posting is never in the snapshot and a removed one always
+  // is.
+  CharWordDelta added_char_words_;
+  CharWordDelta removed_char_words_;
+  WordHistoryDelta added_word_histories_;
+  WordHistoryDelta removed_word_histories_;
+};
+
+}  // namespace history
+
+#endif  // CHROME_BROWSER_HISTORY_URL_INDEX_POSTING_LISTS_H_
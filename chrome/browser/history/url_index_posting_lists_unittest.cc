@@ -0,0 +1,474 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+
+#include "base/logging.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/process/process_metrics.h"
+#include "base/rand_util.h"
+#include "base/strings/string16.h"
+#include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
+#include "chrome/browser/history/url_index_posting_lists.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace history {
+
+namespace {
+
+// The std::set indexes which the posting lists replaced, kept here as the
+// reference to check lookups and to compare memory against.
+typedef std::map<char16, WordIDSet> CharWordIDMap;
+typedef std::map<WordID, HistoryIDSet> WordIDHistoryMap;
+
+// Adds |word| with |word_id|, occurring in |history_id|, to the maps.
+void AddWord(const char* word,
+             WordID word_id,
+             HistoryID history_id,
+             CharWordIDMap* char_word_map,
+             WordIDHistoryMap* word_id_history_map) {
+  Char16Set chars = Char16SetFromString16(ASCIIToUTF16(word));
+  for (Char16Set::iterator iter = chars.begin(); iter != chars.end(); ++iter)
+    (*char_word_map)[*iter].insert(word_id);
+  (*word_id_history_map)[word_id].insert(history_id);
+}
+
+// Reference implementation of the character lookup over the std::set maps.
+WordIDVector WordIDsForCharsFromMap(const Char16Set& chars,
+                                    const CharWordIDMap& char_word_map) {
+  WordIDSet word_id_set;
+  for (Char16Set::const_iterator iter = chars.begin(); iter != chars.end();
+       ++iter) {
+    CharWordIDMap::const_iterator found = char_word_map.find(*iter);
+    if (found == char_word_map.end())
+      return WordIDVector();
+    if (iter == chars.begin()) {
+      word_id_set = found->second;
+    } else {
+      WordIDSet intersection;
+      std::set_intersection(word_id_set.begin(), word_id_set.end(),
+                            found->second.begin(), found->second.end(),
+                            std::inserter(intersection, intersection.begin()));
+      word_id_set.swap(intersection);
+    }
+  }
+  return WordIDVector(word_id_set.begin(), word_id_set.end());
+}
+
+// Builds |posting_lists| from the same postings as the maps.
+void BuildFromMaps(const CharWordIDMap& char_word_map,
+                   const WordIDHistoryMap& word_id_history_map,
+                   URLIndexPostingLists* posting_lists) {
+  std::vector<URLIndexPostingLists::CharWordPosting> char_words;
+  for (CharWordIDMap::const_iterator iter = char_word_map.begin();
+       iter != char_word_map.end(); ++iter) {
+    for (WordIDSet::const_iterator word = iter->second.begin();
+         word != iter->second.end(); ++word)
+      char_words.push_back(std::make_pair(iter->first, *word));
+  }
+  std::vector<URLIndexPostingLists::WordHistoryPosting> word_histories;
+  for (WordIDHistoryMap::const_iterator iter = word_id_history_map.begin();
+       iter != word_id_history_map.end(); ++iter) {
+    for (HistoryIDSet::const_iterator history = iter->second.begin();
+         history != iter->second.end(); ++history)
+      word_histories.push_back(std::make_pair(iter->first, *history));
+  }
+  posting_lists->Build(&char_words, &word_histories);
+}
+
+size_t WorkingSetSize() {
+  scoped_ptr<base::ProcessMetrics> metrics(
+      base::ProcessMetrics::CreateProcessMetrics(
+          base::GetCurrentProcessHandle()));
+  return metrics->GetWorkingSetSize();
+}
+
+}  // namespace
+
+TEST(URLIndexPostingListsTest, IntersectSortedVectors) {
+  std::vector<int> a;
+  std::vector<int> b;
+  std::vector<int> out;
+  IntersectSortedVectors(a, b, &out);
+  EXPECT_TRUE(out.empty());
+
+  // Comparable sizes take the linear merge.
+  const int kA[] = { 1, 3, 5, 7, 9 };
+  const int kB[] = { 2, 3, 4, 9, 10 };
+  a.assign(kA, kA + arraysize(kA));
+  b.assign(kB, kB + arraysize(kB));
+  IntersectSortedVectors(a, b, &out);
+  ASSERT_EQ(2U, out.size());
+  EXPECT_EQ(3, out[0]);
+  EXPECT_EQ(9, out[1]);
+
+  // Very different sizes gallop through the longer list, in either order.
+  a.clear();
+  for (int i = 0; i < 1000; ++i)
+    a.push_back(i * 2);
+  const int kShort[] = { -1, 0, 7, 500, 1998, 1999, 5000 };
+  b.assign(kShort, kShort + arraysize(kShort));
+  IntersectSortedVectors(a, b, &out);
+  ASSERT_EQ(3U, out.size());
+  EXPECT_EQ(0, out[0]);
+  EXPECT_EQ(500, out[1]);
+  EXPECT_EQ(1998, out[2]);
+  IntersectSortedVectors(b, a, &out);
+  EXPECT_EQ(3U, out.size());
+}
+
+TEST(URLIndexPostingListsTest, Lookups) {
+  CharWordIDMap char_word_map;
+  WordIDHistoryMap word_id_history_map;
+  AddWord("drudge", 0, 1, &char_word_map, &word_id_history_map);
+  AddWord("report", 1, 1, &char_word_map, &word_id_history_map);
+  AddWord("reader", 3, 2, &char_word_map, &word_id_history_map);
+  AddWord("reader", 3, 1000000000, &char_word_map, &word_id_history_map);
+  AddWord("google", 200, 3, &char_word_map, &word_id_history_map);
+
+  URLIndexPostingLists posting_lists;
+  BuildFromMaps(char_word_map, word_id_history_map, &posting_lists);
+  EXPECT_GT(posting_lists.MemoryUsage(), 0U);
+  EXPECT_FALSE(posting_lists.Empty());
+
+  Char16Vector chars;
+  posting_lists.GetChars(&chars);
+  EXPECT_EQ(UTF8ToUTF16("adegloprtu"), base::string16(chars.begin(),
+                                                      chars.end()));
+  WordIDVector word_ids;
+  posting_lists.WordIDsForChar('u', &word_ids);
+  ASSERT_EQ(1U, word_ids.size());
+  EXPECT_EQ(0U, word_ids[0]);
+  HistoryIDVector history_ids;
+  posting_lists.HistoryIDsForWord(3, &history_ids);
+  ASSERT_EQ(2U, history_ids.size());
+  EXPECT_EQ(2, history_ids[0]);
+  EXPECT_EQ(1000000000, history_ids[1]);
+  EXPECT_TRUE(posting_lists.HasHistoryIDs(3));
+  EXPECT_FALSE(posting_lists.HasHistoryIDs(2));
+  EXPECT_FALSE(posting_lists.HasHistoryIDs(9999));
+
+  posting_lists.WordIDsForChars(Char16SetFromString16(ASCIIToUTF16("rd")),
+                                &word_ids);
+  ASSERT_EQ(2U, word_ids.size());
+  EXPECT_EQ(0U, word_ids[0]);
+  EXPECT_EQ(3U, word_ids[1]);
+
+  posting_lists.WordIDsForChars(Char16SetFromString16(ASCIIToUTF16("go")),
+                                &word_ids);
+  ASSERT_EQ(1U, word_ids.size());
+  EXPECT_EQ(200U, word_ids[0]);
+
+  // A character which is not indexed at all.
+  posting_lists.WordIDsForChars(Char16SetFromString16(ASCIIToUTF16("rz")),
+                                &word_ids);
+  EXPECT_TRUE(word_ids.empty());
+  posting_lists.WordIDsForChars(Char16Set(), &word_ids);
+  EXPECT_TRUE(word_ids.empty());
+
+  WordIDVector words;
+  words.push_back(0);
+  words.push_back(1);
+  words.push_back(3);
+  words.push_back(42);    // Not in the index.
+  words.push_back(9999);  // Past the end of the index.
+  posting_lists.HistoryIDsForWords(words, &history_ids);
+  ASSERT_EQ(3U, history_ids.size());
+  EXPECT_EQ(1, history_ids[0]);
+  EXPECT_EQ(2, history_ids[1]);
+  EXPECT_EQ(1000000000, history_ids[2]);
+
+  // Rebuilding from nothing leaves nothing behind.
+  BuildFromMaps(CharWordIDMap(), WordIDHistoryMap(), &posting_lists);
+  EXPECT_TRUE(posting_lists.Empty());
+  posting_lists.WordIDsForChars(Char16SetFromString16(ASCIIToUTF16("r")),
+                                &word_ids);
+  EXPECT_TRUE(word_ids.empty());
+  posting_lists.HistoryIDsForWords(words, &history_ids);
+  EXPECT_TRUE(history_ids.empty());
+}
+
+TEST(URLIndexPostingListsTest, Delta) {
+  CharWordIDMap char_word_map;
+  WordIDHistoryMap word_id_history_map;
+  AddWord("drudge", 0, 1, &char_word_map, &word_id_history_map);
+  AddWord("report", 1, 1, &char_word_map, &word_id_history_map);
+  AddWord("reader", 3, 2, &char_word_map, &word_id_history_map);
+
+  URLIndexPostingLists posting_lists;
+  BuildFromMaps(char_word_map, word_id_history_map, &posting_lists);
+
+  // "reader" now also occurs in history item 7, "drudge" no longer does in
+  // item 1, and "zed" is new.
+  posting_lists.AddWordHistory(3, 7);
+  posting_lists.RemoveWordHistory(0, 1);
+  posting_lists.RemoveCharWord('d', 0);
+  posting_lists.RemoveCharWord('r', 0);
+  posting_lists.AddWordHistory(4, 5);
+  posting_lists.AddCharWord('z', 4);
+  posting_lists.AddCharWord('e', 4);
+  posting_lists.AddCharWord('d', 4);
+  EXPECT_FALSE(posting_lists.NeedsCompaction());
+
+  WordIDVector word_ids;
+  posting_lists.WordIDsForChars(Char16SetFromString16(ASCIIToUTF16("rd")),
+                                &word_ids);
+  ASSERT_EQ(1U, word_ids.size());
+  EXPECT_EQ(3U, word_ids[0]);
+  posting_lists.WordIDsForChars(Char16SetFromString16(ASCIIToUTF16("de")),
+                                &word_ids);
+  ASSERT_EQ(2U, word_ids.size());
+  EXPECT_EQ(3U, word_ids[0]);
+  EXPECT_EQ(4U, word_ids[1]);
+  // 'z' is only in the delta.
+  posting_lists.WordIDsForChars(Char16SetFromString16(ASCIIToUTF16("z")),
+                                &word_ids);
+  ASSERT_EQ(1U, word_ids.size());
+  EXPECT_EQ(4U, word_ids[0]);
+
+  HistoryIDVector history_ids;
+  WordIDVector words;
+  words.push_back(0);
+  posting_lists.HistoryIDsForWords(words, &history_ids);
+  EXPECT_TRUE(history_ids.empty());
+  words.push_back(3);
+  words.push_back(4);
+  posting_lists.HistoryIDsForWords(words, &history_ids);
+  ASSERT_EQ(3U, history_ids.size());
+  EXPECT_EQ(2, history_ids[0]);
+  EXPECT_EQ(5, history_ids[1]);
+  EXPECT_EQ(7, history_ids[2]);
+  EXPECT_FALSE(posting_lists.HasHistoryIDs(0));
+  EXPECT_TRUE(posting_lists.HasHistoryIDs(4));
+
+  // Removing the only word under a character drops the character, and 'z'
+  // arrived with the delta.
+  posting_lists.RemoveCharWord('u', 0);
+  Char16Vector chars;
+  posting_lists.GetChars(&chars);
+  EXPECT_EQ(UTF8ToUTF16("adegoprtz"), base::string16(chars.begin(),
+                                                    chars.end()));
+
+  // Compacting folds the delta in without changing any lookup.
+  size_t memory_with_delta = posting_lists.MemoryUsage();
+  posting_lists.Compact();
+  EXPECT_LT(posting_lists.MemoryUsage(), memory_with_delta);
+  Char16Vector compacted_chars;
+  posting_lists.GetChars(&compacted_chars);
+  EXPECT_EQ(chars, compacted_chars);
+  posting_lists.HistoryIDsForWords(words, &history_ids);
+  ASSERT_EQ(3U, history_ids.size());
+  EXPECT_EQ(7, history_ids[2]);
+  posting_lists.WordIDsForChars(Char16SetFromString16(ASCIIToUTF16("de")),
+                                &word_ids);
+  ASSERT_EQ(2U, word_ids.size());
+  EXPECT_EQ(4U, word_ids[1]);
+  EXPECT_FALSE(posting_lists.HasHistoryIDs(0));
+
+  // Undoing a change cancels it out of the delta, or puts a compacted
+  // posting back.
+  posting_lists.AddWordHistory(0, 1);
+  posting_lists.RemoveWordHistory(3, 7);
+  words.clear();
+  words.push_back(0);
+  words.push_back(3);
+  posting_lists.HistoryIDsForWords(words, &history_ids);
+  ASSERT_EQ(2U, history_ids.size());
+  EXPECT_EQ(1, history_ids[0]);
+  EXPECT_EQ(2, history_ids[1]);
+}
+
+TEST(URLIndexPostingListsTest, Snapshot) {
+  CharWordIDMap char_word_map;
+  WordIDHistoryMap word_id_history_map;
+  AddWord("drudge", 0, 1, &char_word_map, &word_id_history_map);
+  AddWord("report", 1, 1, &char_word_map, &word_id_history_map);
+  AddWord("reader", 3, 2, &char_word_map, &word_id_history_map);
+  URLIndexPostingLists posting_lists;
+  BuildFromMaps(char_word_map, word_id_history_map, &posting_lists);
+  posting_lists.AddWordHistory(3, 7);
+  posting_lists.RemoveCharWord('u', 0);
+
+  // The snapshot written carries the delta, and is used in place.
+  std::string data;
+  posting_lists.AppendSnapshot(&data);
+  std::vector<unsigned char> bytes(data.begin(), data.end());
+  scoped_refptr<base::RefCountedBytes> snapshot(
+      base::RefCountedBytes::TakeVector(&bytes));
+  URLIndexPostingLists restored;
+  ASSERT_TRUE(restored.InitFromSnapshot(snapshot));
+  EXPECT_EQ(snapshot->size(), restored.MemoryUsage());
+  Char16Vector chars;
+  posting_lists.GetChars(&chars);
+  Char16Vector restored_chars;
+  restored.GetChars(&restored_chars);
+  EXPECT_EQ(chars, restored_chars);
+  for (WordID word_id = 0; word_id < 4; ++word_id) {
+    HistoryIDVector history_ids;
+    posting_lists.HistoryIDsForWord(word_id, &history_ids);
+    HistoryIDVector restored_history_ids;
+    restored.HistoryIDsForWord(word_id, &restored_history_ids);
+    EXPECT_EQ(history_ids, restored_history_ids);
+  }
+  EXPECT_EQ(4U, restored.WordIDLimit());
+
+  // Copies share the snapshot rather than duplicating it.
+  URLIndexPostingLists copy(restored);
+  EXPECT_FALSE(snapshot->HasOneRef());
+
+  // Empty posting lists round-trip too.
+  std::string empty_data;
+  URLIndexPostingLists().AppendSnapshot(&empty_data);
+  std::vector<unsigned char> empty_bytes(empty_data.begin(), empty_data.end());
+  EXPECT_TRUE(restored.InitFromSnapshot(
+      base::RefCountedBytes::TakeVector(&empty_bytes)));
+  EXPECT_TRUE(restored.Empty());
+
+  // Damage anywhere the lookups rely on is caught: in the header, in an
+  // offset, or in the last posting of a list.
+  const size_t kDamagedOffsets[] = { 0, 7 * sizeof(uint32), data.size() - 1 };
+  for (size_t i = 0; i < arraysize(kDamagedOffsets); ++i) {
+    std::vector<unsigned char> damaged(data.begin(), data.end());
+    damaged[kDamagedOffsets[i]] ^= 0x80;
+    EXPECT_FALSE(restored.InitFromSnapshot(
+        base::RefCountedBytes::TakeVector(&damaged))) << kDamagedOffsets[i];
+    EXPECT_TRUE(restored.Empty());
+  }
+  std::vector<unsigned char> truncated(data.begin(), data.end() - 1);
+  EXPECT_FALSE(restored.InitFromSnapshot(
+      base::RefCountedBytes::TakeVector(&truncated)));
+}
+
+TEST(URLIndexPostingListsTest, NeedsCompaction) {
+  CharWordIDMap char_word_map;
+  WordIDHistoryMap word_id_history_map;
+  URLIndexPostingLists posting_lists;
+  EXPECT_TRUE(posting_lists.Empty());
+
+  // Mirror many changes into both the maps and the delta, checking that the
+  // delta asks to be folded in before it grows without bound and that lookups
+  // agree with the maps throughout.
+  const char* kWords[] = { "alpha", "bravo", "charlie", "delta", "echo" };
+  size_t compactions = 0;
+  for (HistoryID history_id = 1; history_id <= 5000; ++history_id) {
+    WordID word_id = history_id % arraysize(kWords);
+    Char16Set chars = Char16SetFromString16(ASCIIToUTF16(kWords[word_id]));
+    for (Char16Set::iterator iter = chars.begin(); iter != chars.end();
+         ++iter) {
+      if (char_word_map[*iter].insert(word_id).second)
+        posting_lists.AddCharWord(*iter, word_id);
+    }
+    word_id_history_map[word_id].insert(history_id);
+    posting_lists.AddWordHistory(word_id, history_id);
+    if (history_id % 3 == 0) {
+      word_id_history_map[word_id].erase(history_id);
+      posting_lists.RemoveWordHistory(word_id, history_id);
+    }
+    if (posting_lists.NeedsCompaction()) {
+      posting_lists.Compact();
+      ++compactions;
+    }
+  }
+  EXPECT_GT(compactions, 0U);
+  EXPECT_LT(compactions, 10U);
+
+  WordIDVector word_ids;
+  posting_lists.WordIDsForChars(Char16SetFromString16(ASCIIToUTF16("ha")),
+                                &word_ids);
+  EXPECT_EQ(WordIDsForCharsFromMap(Char16SetFromString16(ASCIIToUTF16("ha")),
+                                   char_word_map),
+            word_ids);
+  for (WordID word_id = 0; word_id < arraysize(kWords); ++word_id) {
+    HistoryIDVector history_ids;
+    posting_lists.HistoryIDsForWords(WordIDVector(1, word_id), &history_ids);
+    EXPECT_EQ(HistoryIDVector(word_id_history_map[word_id].begin(),
+                              word_id_history_map[word_id].end()),
+              history_ids);
+  }
+}
+
+// Compares per-keystroke character lookups and memory use of the std::set
+// maps the index used to keep against the posting lists which replaced them,
+// over a synthetic index of 100k URLs. Memory is the growth of the process
+// working set while each is built, so it includes allocator overhead.
+TEST(URLIndexPostingListsTest, DISABLED_LookupPerf) {
+  const size_t kURLCount = 100000;
+  const size_t kWordsPerURL = 8;
+  const size_t kWordCount = 50000;
+  std::vector<std::string> words;
+  for (size_t i = 0; i < kWordCount; ++i) {
+    std::string word;
+    size_t length = base::RandInt(3, 10);
+    for (size_t j = 0; j < length; ++j)
+      word.push_back(static_cast<char>(base::RandInt('a', 'z')));
+    words.push_back(word);
+  }
+  std::vector<URLIndexPostingLists::CharWordPosting> char_words;
+  for (WordID word_id = 0; word_id < kWordCount; ++word_id) {
+    Char16Set chars = Char16SetFromString16(ASCIIToUTF16(words[word_id]));
+    for (Char16Set::iterator iter = chars.begin(); iter != chars.end(); ++iter)
+      char_words.push_back(std::make_pair(*iter, word_id));
+  }
+  std::vector<URLIndexPostingLists::WordHistoryPosting> word_histories;
+  for (size_t i = 0; i < kURLCount; ++i) {
+    for (size_t j = 0; j < kWordsPerURL; ++j) {
+      WordID word_id = base::RandInt(0, kWordCount - 1);
+      word_histories.push_back(std::make_pair(word_id, i + 1));
+    }
+  }
+
+  size_t working_set = WorkingSetSize();
+  base::TimeTicks start = base::TimeTicks::Now();
+  URLIndexPostingLists posting_lists;
+  posting_lists.Build(&char_words, &word_histories);
+  base::TimeDelta build_time = base::TimeTicks::Now() - start;
+  size_t posting_bytes = WorkingSetSize() - working_set;
+
+  working_set = WorkingSetSize();
+  CharWordIDMap char_word_map;
+  for (size_t i = 0; i < char_words.size(); ++i)
+    char_word_map[char_words[i].first].insert(char_words[i].second);
+  WordIDHistoryMap word_id_history_map;
+  for (size_t i = 0; i < word_histories.size(); ++i)
+    word_id_history_map[word_histories[i].first].insert(
+        word_histories[i].second);
+  size_t set_bytes = WorkingSetSize() - working_set;
+  size_t postings = char_words.size() + word_histories.size();
+
+  // Simulate typing each prefix of a handful of terms.
+  const char* kTerms[] = { "rep", "goog", "xq", "meals", "e" };
+  base::TimeDelta set_time;
+  base::TimeDelta posting_time;
+  for (size_t i = 0; i < arraysize(kTerms); ++i) {
+    base::string16 term = ASCIIToUTF16(kTerms[i]);
+    for (size_t length = 1; length <= term.length(); ++length) {
+      Char16Set chars = Char16SetFromString16(term.substr(0, length));
+      start = base::TimeTicks::Now();
+      WordIDVector expected = WordIDsForCharsFromMap(chars, char_word_map);
+      set_time += base::TimeTicks::Now() - start;
+
+      WordIDVector actual;
+      start = base::TimeTicks::Now();
+      posting_lists.WordIDsForChars(chars, &actual);
+      posting_time += base::TimeTicks::Now() - start;
+      EXPECT_EQ(expected, actual);
+    }
+  }
+
+  LOG(INFO) << base::StringPrintf(
+      "%d postings: sets %d KB (%.1f bytes each), %.2f ms; posting lists "
+      "%d KB (%.1f bytes each, %d reported), %.2f ms (built in %.2f ms)",
+      static_cast<int>(postings), static_cast<int>(set_bytes / 1024),
+      static_cast<double>(set_bytes) / postings, set_time.InMillisecondsF(),
+      static_cast<int>(posting_bytes / 1024),
+      static_cast<double>(posting_bytes) / postings,
+      static_cast<int>(posting_lists.MemoryUsage()),
+      posting_time.InMillisecondsF(), build_time.InMillisecondsF());
+}
+
+}  // namespace history
@@ -14,8 +14,11 @@
 
 #include "base/basictypes.h"
 #include "base/file_util.h"
+#include "base/files/important_file_writer.h"
+#include "base/files/memory_mapped_file.h"
 #include "base/i18n/case_conversion.h"
 #include "base/metrics/histogram.h"
+#include "base/rand_util.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
 #include "base/time/time.h"
@@ -41,9 +44,23 @@
 using google::protobuf::RepeatedField;
 using google::protobuf::RepeatedPtrField;
 using in_memory_url_index::InMemoryURLIndexCacheItem;
+using in_memory_url_index::InMemoryURLIndexJournalRecord;
 
 namespace {
 static const size_t kMaxVisitsToStoreInCache = 10u;
+
+// Size of the length prefix on each journal record.
+static const size_t kJournalRecordSizeBytes = 4u;
+
+// The cache file is a CacheFileHeader, the InMemoryURLIndexCacheItem protobuf,
+// padding to a 4-byte boundary and then the posting lists snapshot, which is
+// queried straight from the mapped file rather than parsed.
+static const uint32 kCacheFileMagic = 0x49554d43;  // 'IUMC'
+
+struct CacheFileHeader {
+  uint32 magic;
+  uint32 protobuf_size;
+};
 }  // anonymous namespace
 
 namespace history {
@@ -51,14 +68,6 @@ namespace history {
 typedef imui::InMemoryURLIndexCacheItem_WordListItem WordListItem;
 typedef imui::InMemoryURLIndexCacheItem_WordMapItem_WordMapEntry WordMapEntry;
 typedef imui::InMemoryURLIndexCacheItem_WordMapItem WordMapItem;
-typedef imui::InMemoryURLIndexCacheItem_CharWordMapItem CharWordMapItem;
-typedef imui::InMemoryURLIndexCacheItem_CharWordMapItem_CharWordMapEntry
-    CharWordMapEntry;
-typedef imui::InMemoryURLIndexCacheItem_WordIDHistoryMapItem
-    WordIDHistoryMapItem;
-typedef imui::
-    InMemoryURLIndexCacheItem_WordIDHistoryMapItem_WordIDHistoryMapEntry
-    WordIDHistoryMapEntry;
 typedef imui::InMemoryURLIndexCacheItem_HistoryInfoMapItem HistoryInfoMapItem;
 typedef imui::InMemoryURLIndexCacheItem_HistoryInfoMapItem_HistoryInfoMapEntry
     HistoryInfoMapEntry;
@@ -70,6 +79,94 @@ typedef imui::InMemoryURLIndexCacheItem_WordStartsMapItem_WordStartsMapEntry
     WordStartsMapEntry;
 
 
+// MappedSnapshot --------------------------------------------------------------
+
+// Keeps a mapped cache file alive for as long as the posting lists restored
+// from it refer into it, and presents the snapshot at its end.
+class MappedSnapshot : public base::RefCountedMemory {
+ public:
+  MappedSnapshot(scoped_ptr<base::MemoryMappedFile> file, size_t offset)
+      : file_(file.Pass()),
+        offset_(offset) {
+    DCHECK_LE(offset_, file_->length());
+  }
+
+  virtual const unsigned char* front() const OVERRIDE {
+    return file_->data() + offset_;
+  }
+  virtual size_t size() const OVERRIDE { return file_->length() - offset_; }
+
+ private:
+  virtual ~MappedSnapshot() {}
+
+  scoped_ptr<base::MemoryMappedFile> file_;
+  size_t offset_;
+
+  DISALLOW_COPY_AND_ASSIGN(MappedSnapshot);
+};
+
+// Cache Conversion Functions --------------------------------------------------
+
+// Fills |entry| with the cached form of the history item |history_id| whose
+// index data is |value|.
+void HistoryInfoMapEntryFromValue(HistoryID history_id,
+                                  const HistoryInfoMapValue& value,
+                                  HistoryInfoMapEntry* entry) {
+  entry->set_history_id(history_id);
+  const URLRow& url_row(value.url_row);
+  // Note: We only save information that contributes to the index so there
+  // is no need to save search_term_cache_ (not persistent).
+  entry->set_visit_count(url_row.visit_count());
+  entry->set_typed_count(url_row.typed_count());
+  entry->set_last_visit(url_row.last_visit().ToInternalValue());
+  entry->set_url(url_row.url().spec());
+  entry->set_title(UTF16ToUTF8(url_row.title()));
+  const VisitInfoVector& visits(value.visits);
+  for (VisitInfoVector::const_iterator visit_iter = visits.begin();
+       visit_iter != visits.end(); ++visit_iter) {
+    HistoryInfoMapEntry_VisitInfo* visit_info = entry->add_visits();
+    visit_info->set_visit_time(visit_iter->first.ToInternalValue());
+    visit_info->set_transition_type(visit_iter->second);
+  }
+}
+
+// Fills |value| with the index data for the cached history item |entry|.
+void HistoryInfoMapValueFromEntry(const HistoryInfoMapEntry& entry,
+                                  HistoryInfoMapValue* value) {
+  URLRow url_row(GURL(entry.url()), entry.history_id());
+  url_row.set_visit_count(entry.visit_count());
+  url_row.set_typed_count(entry.typed_count());
+  url_row.set_last_visit(base::Time::FromInternalValue(entry.last_visit()));
+  if (entry.has_title())
+    url_row.set_title(UTF8ToUTF16(entry.title()));
+  value->url_row = url_row;
+
+  VisitInfoVector visits;
+  visits.reserve(entry.visits_size());
+  for (int i = 0; i < entry.visits_size(); ++i) {
+    visits.push_back(std::make_pair(
+        base::Time::FromInternalValue(entry.visits(i).visit_time()),
+        static_cast<content::PageTransition>(
+            entry.visits(i).transition_type())));
+  }
+  value->visits.swap(visits);
+}
+
+// Appends |record| to |records|, framed as it is stored in the journal file.
+void AppendJournalRecord(const InMemoryURLIndexJournalRecord& record,
+                         std::string* records) {
+  std::string data;
+  if (!record.SerializeToString(&data)) {
+    NOTREACHED();
+    return;
+  }
+  uint32 size = static_cast<uint32>(data.size());
+  for (int shift = 24; shift >= 0; shift -= 8)
+    records->push_back(static_cast<char>((size >> shift) & 0xFF));
+  records->append(data);
+}
+
+
 // Algorithm Functions ---------------------------------------------------------
 
 // Comparison function for sorting search terms by descending length.
@@ -193,22 +290,19 @@ ScoredHistoryMatches URLIndexPrivateData::HistoryItemsForTerms(
   // approach.
   ResetSearchTermCache();
 
-  HistoryIDSet history_id_set = HistoryIDSetFromWords(lower_words);
+  HistoryIDVector history_ids = HistoryIDsFromWords(lower_words);
 
   // Trim the candidate pool if it is large. Note that we do not filter out
   // items that do not contain the search terms as proper substrings -- doing
   // so is the performance-costly operation we are trying to avoid in order
   // to maintain omnibox responsiveness.
   const size_t kItemsToScoreLimit = 500;
-  pre_filter_item_count_ = history_id_set.size();
+  pre_filter_item_count_ = history_ids.size();
   // If we trim the results set we do not want to cache the results for next
   // time as the user's ultimately desired result could easily be eliminated
   // in this early rough filter.
   bool was_trimmed = (pre_filter_item_count_ > kItemsToScoreLimit);
   if (was_trimmed) {
-    HistoryIDVector history_ids;
-    std::copy(history_id_set.begin(), history_id_set.end(),
-              std::back_inserter(history_ids));
     // Trim down the set by sorting by typed-count, visit-count, and last
     // visit.
     HistoryItemFactorGreater
@@ -217,10 +311,10 @@ ScoredHistoryMatches URLIndexPrivateData::HistoryItemsForTerms(
                       history_ids.begin() + kItemsToScoreLimit,
                       history_ids.end(),
                       item_factor_functor);
-    history_id_set.clear();
-    std::copy(history_ids.begin(), history_ids.begin() + kItemsToScoreLimit,
-              std::inserter(history_id_set, history_id_set.end()));
-    post_filter_item_count_ = history_id_set.size();
+    history_ids.resize(kItemsToScoreLimit);
+    // Score the survivors in HistoryID order, as for an untrimmed pool.
+    std::sort(history_ids.begin(), history_ids.end());
+    post_filter_item_count_ = history_ids.size();
   }
 
   // Pass over all of the candidates filtering out any without a proper
@@ -246,7 +340,7 @@ ScoredHistoryMatches URLIndexPrivateData::HistoryItemsForTerms(
     // but this is such a rare edge case that it's not worth the time.
     return scored_items;
   }
-  scored_items = std::for_each(history_id_set.begin(), history_id_set.end(),
+  scored_items = std::for_each(history_ids.begin(), history_ids.end(),
       AddHistoryMatch(*this, languages, bookmark_service, lower_raw_string,
                       lower_raw_terms, base::Time::Now())).ScoredMatches();
 
@@ -352,6 +446,7 @@ void URLIndexPrivateData::UpdateRecentVisits(
       visits->push_back(std::make_pair(recent_visits[i].visit_time,
                                        recent_visits[i].transition));
     }
+    visits_to_journal_.insert(url_id);
   }
   // Else: Oddly, the URL doesn't seem to exist in the private index.
   // Ignore this update.  This can happen if, for instance, the user
@@ -400,32 +495,63 @@ scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::RestoreFromFile(
   base::TimeTicks beginning_time = base::TimeTicks::Now();
   if (!base::PathExists(file_path))
     return NULL;
-  std::string data;
   // If there is no cache file then simply give up. This will cause us to
   // attempt to rebuild from the history database.
-  if (!base::ReadFileToString(file_path, &data))
+  scoped_ptr<base::MemoryMappedFile> file(new base::MemoryMappedFile);
+  if (!file->Initialize(file_path))
     return NULL;
+  size_t cache_size = file->length();
 
   scoped_refptr<URLIndexPrivateData> restored_data(new URLIndexPrivateData);
   InMemoryURLIndexCacheItem index_cache;
-  if (!index_cache.ParseFromArray(data.c_str(), data.size())) {
+  const CacheFileHeader* header =
+      reinterpret_cast<const CacheFileHeader*>(file->data());
+  if (cache_size < sizeof(CacheFileHeader) ||
+      header->magic != kCacheFileMagic ||
+      header->protobuf_size > cache_size - sizeof(CacheFileHeader) ||
+      !index_cache.ParseFromArray(file->data() + sizeof(CacheFileHeader),
+                                  header->protobuf_size)) {
     LOG(WARNING) << "Failed to parse URLIndexPrivateData cache data read from "
                  << file_path.value();
     return restored_data;
   }
+  size_t snapshot_offset = sizeof(CacheFileHeader) + header->protobuf_size;
+  snapshot_offset = std::min(cache_size,
+                             (snapshot_offset + sizeof(uint32) - 1) /
+                                 sizeof(uint32) * sizeof(uint32));
+#if defined(OS_WIN)
+  // Windows cannot replace a file while it is mapped, which saving the cache
+  // does, so copy the snapshot out and let the file go.
+  std::vector<unsigned char> snapshot_bytes(
+      file->data() + snapshot_offset, file->data() + cache_size);
+  scoped_refptr<base::RefCountedMemory> snapshot(
+      base::RefCountedBytes::TakeVector(&snapshot_bytes));
+#else
+  scoped_refptr<base::RefCountedMemory> snapshot(
+      new MappedSnapshot(file.Pass(), snapshot_offset));
+#endif
 
-  if (!restored_data->RestorePrivateData(index_cache, languages))
+  if (!restored_data->RestorePrivateData(index_cache, snapshot, languages))
     return NULL;
 
+  // Bring the index up to date with the changes made since the cache was
+  // written.
+  if (index_cache.has_journal_id()) {
+    size_t record_count = restored_data->ReplayJournal(
+        GetJournalFilePath(file_path), index_cache.journal_id(), languages);
+    UMA_HISTOGRAM_COUNTS_10000("History.InMemoryURLJournalRecords",
+                               record_count);
+  }
+
   UMA_HISTOGRAM_TIMES("History.InMemoryURLIndexRestoreCacheTime",
                       base::TimeTicks::Now() - beginning_time);
   UMA_HISTOGRAM_COUNTS("History.InMemoryURLHistoryItems",
                        restored_data->history_id_word_map_.size());
-  UMA_HISTOGRAM_COUNTS("History.InMemoryURLCacheSize", data.size());
+  UMA_HISTOGRAM_COUNTS("History.InMemoryURLCacheSize", cache_size);
   UMA_HISTOGRAM_COUNTS_10000("History.InMemoryURLWords",
                              restored_data->word_map_.size());
   UMA_HISTOGRAM_COUNTS_10000("History.InMemoryURLChars",
-                             restored_data->char_word_map_.size());
+                             restored_data->posting_lists_.CharCount());
   if (restored_data->Empty())
     return NULL;  // 'No data' is the same as a failed reload.
   return restored_data;
@@ -459,7 +585,7 @@ scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::RebuildFromHistory(
   UMA_HISTOGRAM_COUNTS_10000("History.InMemoryURLWords",
                              rebuilt_data->word_map_.size());
   UMA_HISTOGRAM_COUNTS_10000("History.InMemoryURLChars",
-                             rebuilt_data->char_word_map_.size());
+                             rebuilt_data->posting_lists_.CharCount());
   return rebuilt_data;
 }
 
@@ -472,6 +598,74 @@ bool URLIndexPrivateData::WritePrivateDataToCacheFileTask(
   return private_data->SaveToFile(file_path);
 }
 
+// static
+base::FilePath URLIndexPrivateData::GetJournalFilePath(
+    const base::FilePath& cache_path) {
+  return base::FilePath(cache_path.value() + FILE_PATH_LITERAL(" Journal"));
+}
+
+// static
+bool URLIndexPrivateData::AppendToJournalFile(const base::FilePath& file_path,
+                                              const std::string& records) {
+  DCHECK(!file_path.empty());
+  // Records only make sense on top of the cache they follow, which creates the
+  // journal when it is written.
+  base::FilePath journal_path(GetJournalFilePath(file_path));
+  if (records.empty() || !base::PathExists(journal_path))
+    return false;
+  int size = records.size();
+  if (file_util::AppendToFile(journal_path, records.data(), size) != size) {
+    LOG(WARNING) << "Failed to append to " << journal_path.value();
+    return false;
+  }
+  return true;
+}
+
+void URLIndexPrivateData::AppendURLJournalRecord(URLID url_id,
+                                                 const GURL& url,
+                                                 std::string* records) const {
+  DCHECK(records);
+  InMemoryURLIndexJournalRecord record;
+  HistoryInfoMap::const_iterator pos = history_info_map_.find(url_id);
+  if (pos != history_info_map_.end()) {
+    record.set_type(InMemoryURLIndexJournalRecord::UPDATE_URL);
+    HistoryInfoMapEntryFromValue(pos->first, pos->second,
+                                 record.mutable_history_info());
+  } else {
+    record.set_type(InMemoryURLIndexJournalRecord::DELETE_URL);
+    record.set_url(url.spec());
+  }
+  AppendJournalRecord(record, records);
+}
+
+// static
+void URLIndexPrivateData::AppendClearJournalRecord(std::string* records) {
+  DCHECK(records);
+  InMemoryURLIndexJournalRecord record;
+  record.set_type(InMemoryURLIndexJournalRecord::CLEAR);
+  AppendJournalRecord(record, records);
+}
+
+size_t URLIndexPrivateData::AppendVisitJournalRecords(std::string* records) {
+  DCHECK(records);
+  size_t record_count = 0;
+  for (std::set<URLID>::const_iterator iter = visits_to_journal_.begin();
+       iter != visits_to_journal_.end(); ++iter) {
+    HistoryInfoMap::const_iterator pos = history_info_map_.find(*iter);
+    // A deleted item has already been journaled as such.
+    if (pos == history_info_map_.end())
+      continue;
+    InMemoryURLIndexJournalRecord record;
+    record.set_type(InMemoryURLIndexJournalRecord::UPDATE_URL);
+    HistoryInfoMapEntryFromValue(pos->first, pos->second,
+                                 record.mutable_history_info());
+    AppendJournalRecord(record, records);
+    ++record_count;
+  }
+  visits_to_journal_.clear();
+  return record_count;
+}
+
 void URLIndexPrivateData::CancelPendingUpdates() {
   recent_visits_consumer_.CancelAllRequests();
 }
@@ -482,8 +676,7 @@ scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::Duplicate() const {
   data_copy->word_list_ = word_list_;
   data_copy->available_words_ = available_words_;
   data_copy->word_map_ = word_map_;
-  data_copy->char_word_map_ = char_word_map_;
-  data_copy->word_id_history_map_ = word_id_history_map_;
+  data_copy->posting_lists_ = posting_lists_;
   data_copy->history_id_word_map_ = history_id_word_map_;
   data_copy->history_info_map_ = history_info_map_;
   data_copy->word_starts_map_ = word_starts_map_;
@@ -493,6 +686,7 @@ scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::Duplicate() const {
   //    pre_filter_item_count_
   //    post_filter_item_count_
   //    post_scoring_item_count_
+  //    visits_to_journal_
 };
 
 bool URLIndexPrivateData::Empty() const {
@@ -504,23 +698,23 @@ void URLIndexPrivateData::Clear() {
   word_list_.clear();
   available_words_.clear();
   word_map_.clear();
-  char_word_map_.clear();
-  word_id_history_map_.clear();
+  posting_lists_.Clear();
   history_id_word_map_.clear();
   history_info_map_.clear();
   word_starts_map_.clear();
+  visits_to_journal_.clear();
 }
 
 URLIndexPrivateData::~URLIndexPrivateData() {}
 
-HistoryIDSet URLIndexPrivateData::HistoryIDSetFromWords(
+HistoryIDVector URLIndexPrivateData::HistoryIDsFromWords(
     const String16Vector& unsorted_words) {
   // Break the terms down into individual terms (words), get the candidate
   // set for each term, and intersect each to get a final candidate list.
   // Note that a single 'term' from the user's perspective might be
   // a string like "http://www.somewebsite.com" which, from our perspective,
   // is four words: 'http', 'www', 'somewebsite', and 'com'.
-  HistoryIDSet history_id_set;
+  HistoryIDVector history_ids;
   String16Vector words(unsorted_words);
   // Sort the words into the longest first as such are likely to narrow down
   // the results quicker. Also, single character words are the most expensive
@@ -529,36 +723,33 @@ HistoryIDSet URLIndexPrivateData::HistoryIDSetFromWords(
   for (String16Vector::iterator iter = words.begin(); iter != words.end();
        ++iter) {
     base::string16 uni_word = *iter;
-    HistoryIDSet term_history_set = HistoryIDsForTerm(uni_word);
-    if (term_history_set.empty()) {
-      history_id_set.clear();
+    HistoryIDVector term_history_ids = HistoryIDsForTerm(uni_word);
+    if (term_history_ids.empty()) {
+      history_ids.clear();
       break;
     }
     if (iter == words.begin()) {
-      history_id_set.swap(term_history_set);
+      history_ids.swap(term_history_ids);
     } else {
-      HistoryIDSet new_history_id_set;
-      std::set_intersection(history_id_set.begin(), history_id_set.end(),
-                            term_history_set.begin(), term_history_set.end(),
-                            std::inserter(new_history_id_set,
-                                          new_history_id_set.begin()));
-      history_id_set.swap(new_history_id_set);
+      HistoryIDVector new_history_ids;
+      IntersectSortedVectors(history_ids, term_history_ids, &new_history_ids);
+      history_ids.swap(new_history_ids);
     }
   }
-  return history_id_set;
+  return history_ids;
 }
 
-HistoryIDSet URLIndexPrivateData::HistoryIDsForTerm(
+HistoryIDVector URLIndexPrivateData::HistoryIDsForTerm(
     const base::string16& term) {
   if (term.empty())
-    return HistoryIDSet();
+    return HistoryIDVector();
 
   // TODO(mrossetti): Consider optimizing for very common terms such as
   // 'http[s]', 'www', 'com', etc. Or collect the top 100 more frequently
   // occuring words in the user's searches.
 
   size_t term_length = term.length();
-  WordIDSet word_id_set;
+  WordIDVector word_ids;
   if (term_length > 1) {
     // See if this term or a prefix thereof is present in the cache.
     SearchTermCacheMap::iterator best_prefix(search_term_cache_.end());
@@ -580,17 +771,17 @@ HistoryIDSet URLIndexPrivateData::HistoryIDsForTerm(
       size_t prefix_length = best_prefix->first.length();
       if (prefix_length == term_length) {
         best_prefix->second.used_ = true;
-        return best_prefix->second.history_id_set_;
+        return best_prefix->second.history_ids_;
       }
 
       // Otherwise we have a handy starting point.
       // If there are no history results for this prefix then we can bail early
       // as there will be no history results for the full term.
-      if (best_prefix->second.history_id_set_.empty()) {
+      if (best_prefix->second.history_ids_.empty()) {
         search_term_cache_[term] = SearchTermCacheItem();
-        return HistoryIDSet();
+        return HistoryIDVector();
       }
-      word_id_set = best_prefix->second.word_id_set_;
+      word_ids = best_prefix->second.word_ids_;
       prefix_chars = Char16SetFromString16(best_prefix->first);
       leftovers = term.substr(prefix_length);
     }
@@ -602,95 +793,59 @@ HistoryIDSet URLIndexPrivateData::HistoryIDsForTerm(
 
     // Reduce the word set with any leftover, unprocessed characters.
     if (!unique_chars.empty()) {
-      WordIDSet leftover_set(WordIDSetForTermChars(unique_chars));
+      WordIDVector leftover_ids(WordIDsForTermChars(unique_chars));
       // We might come up empty on the leftovers.
-      if (leftover_set.empty()) {
+      if (leftover_ids.empty()) {
         search_term_cache_[term] = SearchTermCacheItem();
-        return HistoryIDSet();
+        return HistoryIDVector();
       }
       // Or there may not have been a prefix from which to start.
       if (prefix_chars.empty()) {
-        word_id_set.swap(leftover_set);
+        word_ids.swap(leftover_ids);
       } else {
-        WordIDSet new_word_id_set;
-        std::set_intersection(word_id_set.begin(), word_id_set.end(),
-                              leftover_set.begin(), leftover_set.end(),
-                              std::inserter(new_word_id_set,
-                                            new_word_id_set.begin()));
-        word_id_set.swap(new_word_id_set);
+        WordIDVector new_word_ids;
+        IntersectSortedVectors(word_ids, leftover_ids, &new_word_ids);
+        word_ids.swap(new_word_ids);
       }
     }
 
     // We must filter the word list because the resulting word set surely
     // contains words which do not have the search term as a proper subset.
-    for (WordIDSet::iterator word_set_iter = word_id_set.begin();
-         word_set_iter != word_id_set.end(); ) {
-      if (word_list_[*word_set_iter].find(term) == base::string16::npos)
-        word_id_set.erase(word_set_iter++);
-      else
-        ++word_set_iter;
+    WordIDVector::iterator out = word_ids.begin();
+    for (WordIDVector::const_iterator word_iter = word_ids.begin();
+         word_iter != word_ids.end(); ++word_iter) {
+      if (word_list_[*word_iter].find(term) != base::string16::npos)
+        *out++ = *word_iter;
     }
+    word_ids.erase(out, word_ids.end());
   } else {
-    word_id_set = WordIDSetForTermChars(Char16SetFromString16(term));
+    word_ids = WordIDsForTermChars(Char16SetFromString16(term));
   }
 
   // If any words resulted then we can compose a set of history IDs by unioning
   // the sets from each word.
-  HistoryIDSet history_id_set;
-  if (!word_id_set.empty()) {
-    for (WordIDSet::iterator word_id_iter = word_id_set.begin();
-         word_id_iter != word_id_set.end(); ++word_id_iter) {
-      WordID word_id = *word_id_iter;
-      WordIDHistoryMap::iterator word_iter = word_id_history_map_.find(word_id);
-      if (word_iter != word_id_history_map_.end()) {
-        HistoryIDSet& word_history_id_set(word_iter->second);
-        history_id_set.insert(word_history_id_set.begin(),
-                              word_history_id_set.end());
-      }
-    }
-  }
+  HistoryIDVector history_ids;
+  if (!word_ids.empty())
+    posting_lists_.HistoryIDsForWords(word_ids, &history_ids);
 
   // Record a new cache entry for this word if the term is longer than
   // a single character.
   if (term_length > 1)
-    search_term_cache_[term] = SearchTermCacheItem(word_id_set, history_id_set);
+    search_term_cache_[term] = SearchTermCacheItem(word_ids, history_ids);
 
-  return history_id_set;
+  return history_ids;
 }
 
-WordIDSet URLIndexPrivateData::WordIDSetForTermChars(
+WordIDVector URLIndexPrivateData::WordIDsForTermChars(
     const Char16Set& term_chars) {
-  WordIDSet word_id_set;
-  for (Char16Set::const_iterator c_iter = term_chars.begin();
-       c_iter != term_chars.end(); ++c_iter) {
-    CharWordIDMap::iterator char_iter = char_word_map_.find(*c_iter);
-    if (char_iter == char_word_map_.end()) {
-      // A character was not found so there are no matching results: bail.
-      word_id_set.clear();
-      break;
-    }
-    WordIDSet& char_word_id_set(char_iter->second);
-    // It is possible for there to no longer be any words associated with
-    // a particular character. Give up in that case.
-    if (char_word_id_set.empty()) {
-      word_id_set.clear();
-      break;
-    }
+  WordIDVector word_ids;
+  posting_lists_.WordIDsForChars(term_chars, &word_ids);
+  return word_ids;
+}
 
-    if (c_iter == term_chars.begin()) {
-      // First character results becomes base set of results.
-      word_id_set = char_word_id_set;
-    } else {
-      // Subsequent character results get intersected in.
-      WordIDSet new_word_id_set;
-      std::set_intersection(word_id_set.begin(), word_id_set.end(),
-                            char_word_id_set.begin(), char_word_id_set.end(),
-                            std::inserter(new_word_id_set,
-                                          new_word_id_set.begin()));
-      word_id_set.swap(new_word_id_set);
-    }
-  }
-  return word_id_set;
+void URLIndexPrivateData::CompactPostingListsIfNeeded() {
+  if (posting_lists_.NeedsCompaction())
+    posting_lists_.Compact();
 }
 
 bool URLIndexPrivateData::IndexRow(
@@ -769,6 +924,7 @@ void URLIndexPrivateData::AddRowWordsToIndex(const URLRow& row,
   for (String16Set::iterator word_iter = words.begin();
        word_iter != words.end(); ++word_iter)
     AddWordToIndex(*word_iter, history_id);
+  CompactPostingListsIfNeeded();
 
   search_term_cache_.clear();  // Invalidate the term cache.
 }
@@ -794,51 +950,36 @@ void URLIndexPrivateData::AddWordHistory(const base::string16& term,
   }
   word_map_[term] = word_id;
 
-  HistoryIDSet history_id_set;
-  history_id_set.insert(history_id);
-  word_id_history_map_[word_id] = history_id_set;
+  posting_lists_.AddWordHistory(word_id, history_id);
   AddToHistoryIDWordMap(history_id, word_id);
 
   // For each character in the newly added word (i.e. a word that is not
   // already in the word index), add the word to the character index.
   Char16Set characters = Char16SetFromString16(term);
   for (Char16Set::iterator uni_char_iter = characters.begin();
-       uni_char_iter != characters.end(); ++uni_char_iter) {
-    char16 uni_char = *uni_char_iter;
-    CharWordIDMap::iterator char_iter = char_word_map_.find(uni_char);
-    if (char_iter != char_word_map_.end()) {
-      // Update existing entry in the char/word index.
-      WordIDSet& word_id_set(char_iter->second);
-      word_id_set.insert(word_id);
-    } else {
-      // Create a new entry in the char/word index.
-      WordIDSet word_id_set;
-      word_id_set.insert(word_id);
-      char_word_map_[uni_char] = word_id_set;
-    }
-  }
+       uni_char_iter != characters.end(); ++uni_char_iter)
+    posting_lists_.AddCharWord(*uni_char_iter, word_id);
 }
 
 void URLIndexPrivateData::UpdateWordHistory(WordID word_id,
                                             HistoryID history_id) {
-  WordIDHistoryMap::iterator history_pos = word_id_history_map_.find(word_id);
-  DCHECK(history_pos != word_id_history_map_.end());
-  HistoryIDSet& history_id_set(history_pos->second);
-  history_id_set.insert(history_id);
-  AddToHistoryIDWordMap(history_id, word_id);
+  // |history_id_word_map_| is the inverse of the word/history index, so it
+  // tells whether |history_id| is already posted for |word_id|.
+  if (AddToHistoryIDWordMap(history_id, word_id))
+    posting_lists_.AddWordHistory(word_id, history_id);
 }
 
-void URLIndexPrivateData::AddToHistoryIDWordMap(HistoryID history_id,
+bool URLIndexPrivateData::AddToHistoryIDWordMap(HistoryID history_id,
                                                 WordID word_id) {
   HistoryIDWordMap::iterator iter = history_id_word_map_.find(history_id);
   if (iter != history_id_word_map_.end()) {
     WordIDSet& word_id_set(iter->second);
-    word_id_set.insert(word_id);
-  } else {
-    WordIDSet word_id_set;
-    word_id_set.insert(word_id);
-    history_id_word_map_[history_id] = word_id_set;
+    return word_id_set.insert(word_id).second;
   }
+  WordIDSet word_id_set;
+  word_id_set.insert(word_id);
+  history_id_word_map_[history_id] = word_id_set;
+  return true;
 }
 
 void URLIndexPrivateData::RemoveRowFromIndex(const URLRow& row) {
@@ -849,7 +990,7 @@ void URLIndexPrivateData::RemoveRowFromIndex(const URLRow& row) {
 }
 
 void URLIndexPrivateData::RemoveRowWordsFromIndex(const URLRow& row) {
-  // Remove the entries in history_id_word_map_ and word_id_history_map_ for
+  // Remove the entries in history_id_word_map_ and the word/history index for
   // this row.
   HistoryID history_id = static_cast<HistoryID>(row.id());
   WordIDSet word_id_set = history_id_word_map_[history_id];
@@ -859,27 +1000,23 @@ void URLIndexPrivateData::RemoveRowWordsFromIndex(const URLRow& row) {
   for (WordIDSet::iterator word_id_iter = word_id_set.begin();
        word_id_iter != word_id_set.end(); ++word_id_iter) {
     WordID word_id = *word_id_iter;
-    word_id_history_map_[word_id].erase(history_id);
-    if (!word_id_history_map_[word_id].empty())
+    posting_lists_.RemoveWordHistory(word_id, history_id);
+    if (posting_lists_.HasHistoryIDs(word_id))
       continue;  // The word is still in use.
 
     // The word is no longer in use. Reconcile any changes to character usage.
     base::string16 word = word_list_[word_id];
     Char16Set characters = Char16SetFromString16(word);
     for (Char16Set::iterator uni_char_iter = characters.begin();
-         uni_char_iter != characters.end(); ++uni_char_iter) {
-      char16 uni_char = *uni_char_iter;
-      char_word_map_[uni_char].erase(word_id);
-      if (char_word_map_[uni_char].empty())
-        char_word_map_.erase(uni_char);  // No longer in use.
-    }
+         uni_char_iter != characters.end(); ++uni_char_iter)
+      posting_lists_.RemoveCharWord(*uni_char_iter, word_id);
 
     // Complete the removal of references to the word.
-    word_id_history_map_.erase(word_id);
     word_map_.erase(word);
     word_list_[word_id] = base::string16();
     available_words_.insert(word_id);
   }
+  CompactPostingListsIfNeeded();
 }
 
 void URLIndexPrivateData::ResetSearchTermCache() {
@@ -892,17 +1029,45 @@ bool URLIndexPrivateData::SaveToFile(const base::FilePath& file_path) {
   base::TimeTicks beginning_time = base::TimeTicks::Now();
   InMemoryURLIndexCacheItem index_cache;
   SavePrivateData(&index_cache);
-  std::string data;
-  if (!index_cache.SerializeToString(&data)) {
+  // A fresh journal ID keeps records written against an earlier cache from
+  // being replayed onto this one.
+  int64 journal_id = static_cast<int64>(base::RandUint64());
+  index_cache.set_journal_id(journal_id);
+  std::string data(sizeof(CacheFileHeader), '\0');
+  if (!index_cache.AppendToString(&data)) {
     LOG(WARNING) << "Failed to serialize the InMemoryURLIndex cache.";
     return false;
   }
-
-  int size = data.size();
-  if (file_util::WriteFile(file_path, data.c_str(), size) != size) {
+  CacheFileHeader cache_header;
+  cache_header.magic = kCacheFileMagic;
+  cache_header.protobuf_size = data.size() - sizeof(CacheFileHeader);
+  data.replace(0, sizeof(cache_header),
+               reinterpret_cast<const char*>(&cache_header),
+               sizeof(cache_header));
+  data.resize((data.size() + sizeof(uint32) - 1) / sizeof(uint32) *
+              sizeof(uint32), '\0');
+  posting_lists_.AppendSnapshot(&data);
+
+  // The index restored from the old file may still be querying its mapping,
+  // so replace the file rather than rewriting it in place.
+  if (!base::ImportantFileWriter::WriteFileAtomically(file_path, data)) {
     LOG(WARNING) << "Failed to write " << file_path.value();
     return false;
   }
+
+  // Start an empty journal for this cache. Should this fail the cache is
+  // still good; later changes simply won't be journaled until the next save.
+  InMemoryURLIndexJournalRecord header;
+  header.set_type(InMemoryURLIndexJournalRecord::HEADER);
+  header.set_journal_id(journal_id);
+  std::string journal;
+  AppendJournalRecord(header, &journal);
+  base::FilePath journal_path(GetJournalFilePath(file_path));
+  int size = journal.size();
+  if (file_util::WriteFile(journal_path, journal.data(), size) != size) {
+    LOG(WARNING) << "Failed to write " << journal_path.value();
+    base::DeleteFile(journal_path, false);
+  }
   UMA_HISTOGRAM_TIMES("History.InMemoryURLIndexSaveCacheTime",
                       base::TimeTicks::Now() - beginning_time);
   return true;
@@ -919,8 +1084,6 @@ void URLIndexPrivateData::SavePrivateData(
   cache->set_history_item_count(0);
   SaveWordList(cache);
   SaveWordMap(cache);
-  SaveCharWordMap(cache);
-  SaveWordIDHistoryMap(cache);
   SaveHistoryInfoMap(cache);
   SaveWordStartsMap(cache);
 }
@@ -948,43 +1111,6 @@ void URLIndexPrivateData::SaveWordMap(InMemoryURLIndexCacheItem* cache) const {
   }
 }
 
-void URLIndexPrivateData::SaveCharWordMap(
-    InMemoryURLIndexCacheItem* cache) const {
-  if (char_word_map_.empty())
-    return;
-  CharWordMapItem* map_item = cache->mutable_char_word_map();
-  map_item->set_item_count(char_word_map_.size());
-  for (CharWordIDMap::const_iterator iter = char_word_map_.begin();
-       iter != char_word_map_.end(); ++iter) {
-    CharWordMapEntry* map_entry = map_item->add_char_word_map_entry();
-    map_entry->set_char_16(iter->first);
-    const WordIDSet& word_id_set(iter->second);
-    map_entry->set_item_count(word_id_set.size());
-    for (WordIDSet::const_iterator set_iter = word_id_set.begin();
-         set_iter != word_id_set.end(); ++set_iter)
-      map_entry->add_word_id(*set_iter);
-  }
-}
-
-void URLIndexPrivateData::SaveWordIDHistoryMap(
-    InMemoryURLIndexCacheItem* cache) const {
-  if (word_id_history_map_.empty())
-    return;
-  WordIDHistoryMapItem* map_item = cache->mutable_word_id_history_map();
-  map_item->set_item_count(word_id_history_map_.size());
-  for (WordIDHistoryMap::const_iterator iter = word_id_history_map_.begin();
-       iter != word_id_history_map_.end(); ++iter) {
-    WordIDHistoryMapEntry* map_entry =
-        map_item->add_word_id_history_map_entry();
-    map_entry->set_word_id(iter->first);
-    const HistoryIDSet& history_id_set(iter->second);
-    map_entry->set_item_count(history_id_set.size());
-    for (HistoryIDSet::const_iterator set_iter = history_id_set.begin();
-         set_iter != history_id_set.end(); ++set_iter)
-      map_entry->add_history_id(*set_iter);
-  }
-}
-
 void URLIndexPrivateData::SaveHistoryInfoMap(
     InMemoryURLIndexCacheItem* cache) const {
   if (history_info_map_.empty())
@@ -993,23 +1119,8 @@ void URLIndexPrivateData::SaveHistoryInfoMap(
   map_item->set_item_count(history_info_map_.size());
   for (HistoryInfoMap::const_iterator iter = history_info_map_.begin();
        iter != history_info_map_.end(); ++iter) {
-    HistoryInfoMapEntry* map_entry = map_item->add_history_info_map_entry();
-    map_entry->set_history_id(iter->first);
-    const URLRow& url_row(iter->second.url_row);
-    // Note: We only save information that contributes to the index so there
-    // is no need to save search_term_cache_ (not persistent).
-    map_entry->set_visit_count(url_row.visit_count());
-    map_entry->set_typed_count(url_row.typed_count());
-    map_entry->set_last_visit(url_row.last_visit().ToInternalValue());
-    map_entry->set_url(url_row.url().spec());
-    map_entry->set_title(UTF16ToUTF8(url_row.title()));
-    const VisitInfoVector& visits(iter->second.visits);
-    for (VisitInfoVector::const_iterator visit_iter = visits.begin();
-         visit_iter != visits.end(); ++visit_iter) {
-      HistoryInfoMapEntry_VisitInfo* visit_info = map_entry->add_visits();
-      visit_info->set_visit_time(visit_iter->first.ToInternalValue());
-      visit_info->set_transition_type(visit_iter->second);
-    }
+    HistoryInfoMapEntryFromValue(iter->first, iter->second,
+                                 map_item->add_history_info_map_entry());
   }
 }
 
@@ -1043,6 +1154,7 @@ void URLIndexPrivateData::SaveWordStartsMap(
 
 bool URLIndexPrivateData::RestorePrivateData(
     const InMemoryURLIndexCacheItem& cache,
+    const scoped_refptr<base::RefCountedMemory>& snapshot,
     const std::string& languages) {
   last_time_rebuilt_from_history_ =
       base::Time::FromInternalValue(cache.last_rebuild_timestamp());
@@ -1067,8 +1179,8 @@ bool URLIndexPrivateData::RestorePrivateData(
     restored_cache_version_ = cache.version();
   }
   return RestoreWordList(cache) && RestoreWordMap(cache) &&
-      RestoreCharWordMap(cache) && RestoreWordIDHistoryMap(cache) &&
-      RestoreHistoryInfoMap(cache) && RestoreWordStartsMap(cache, languages);
+      RestorePostingLists(snapshot) && RestoreHistoryInfoMap(cache) &&
+      RestoreWordStartsMap(cache, languages);
 }
 
 bool URLIndexPrivateData::RestoreWordList(
@@ -1103,60 +1215,32 @@ bool URLIndexPrivateData::RestoreWordMap(
   return true;
 }
 
-bool URLIndexPrivateData::RestoreCharWordMap(
-    const InMemoryURLIndexCacheItem& cache) {
-  if (!cache.has_char_word_map())
+bool URLIndexPrivateData::RestorePostingLists(
+    const scoped_refptr<base::RefCountedMemory>& snapshot) {
+  if (!posting_lists_.InitFromSnapshot(snapshot) || posting_lists_.Empty())
     return false;
-  const CharWordMapItem& list_item(cache.char_word_map());
-  uint32 expected_item_count = list_item.item_count();
-  uint32 actual_item_count = list_item.char_word_map_entry_size();
-  if (actual_item_count == 0 || actual_item_count != expected_item_count)
+
+  // Every word posted must be in the word list.
+  WordID word_count = word_list_.size();
+  if (posting_lists_.WordIDLimit() > word_count)
     return false;
-  const RepeatedPtrField<CharWordMapEntry>&
-      entries(list_item.char_word_map_entry());
-  for (RepeatedPtrField<CharWordMapEntry>::const_iterator iter =
-       entries.begin(); iter != entries.end(); ++iter) {
-    expected_item_count = iter->item_count();
-    actual_item_count = iter->word_id_size();
-    if (actual_item_count == 0 || actual_item_count != expected_item_count)
+  Char16Vector chars;
+  posting_lists_.GetChars(&chars);
+  WordIDVector word_ids;
+  for (Char16Vector::const_iterator iter = chars.begin(); iter != chars.end();
+       ++iter) {
+    posting_lists_.WordIDsForChar(*iter, &word_ids);
+    if (word_ids.back() >= word_count)
       return false;
-    char16 uni_char = static_cast<char16>(iter->char_16());
-    WordIDSet word_id_set;
-    const RepeatedField<int32>& word_ids(iter->word_id());
-    for (RepeatedField<int32>::const_iterator jiter = word_ids.begin();
-         jiter != word_ids.end(); ++jiter)
-      word_id_set.insert(*jiter);
-    char_word_map_[uni_char] = word_id_set;
   }
-  return true;
-}
 
-bool URLIndexPrivateData::RestoreWordIDHistoryMap(
-    const InMemoryURLIndexCacheItem& cache) {
-  if (!cache.has_word_id_history_map())
-    return false;
-  const WordIDHistoryMapItem& list_item(cache.word_id_history_map());
-  uint32 expected_item_count = list_item.item_count();
-  uint32 actual_item_count = list_item.word_id_history_map_entry_size();
-  if (actual_item_count == 0 || actual_item_count != expected_item_count)
-    return false;
-  const RepeatedPtrField<WordIDHistoryMapEntry>&
-      entries(list_item.word_id_history_map_entry());
-  for (RepeatedPtrField<WordIDHistoryMapEntry>::const_iterator iter =
-       entries.begin(); iter != entries.end(); ++iter) {
-    expected_item_count = iter->item_count();
-    actual_item_count = iter->history_id_size();
-    if (actual_item_count == 0 || actual_item_count != expected_item_count)
-      return false;
-    WordID word_id = iter->word_id();
-    HistoryIDSet history_id_set;
-    const RepeatedField<int64>& history_ids(iter->history_id());
-    for (RepeatedField<int64>::const_iterator jiter = history_ids.begin();
-         jiter != history_ids.end(); ++jiter) {
-      history_id_set.insert(*jiter);
-      AddToHistoryIDWordMap(*jiter, word_id);
-    }
-    word_id_history_map_[word_id] = history_id_set;
+  // The history/word map is the inverse of the word/history index.
+  HistoryIDVector history_ids;
+  for (WordID word_id = 0; word_id < word_count; ++word_id) {
+    posting_lists_.HistoryIDsForWord(word_id, &history_ids);
+    for (HistoryIDVector::const_iterator iter = history_ids.begin();
+         iter != history_ids.end(); ++iter)
+      AddToHistoryIDWordMap(*iter, word_id);
   }
   return true;
 }
@@ -1174,28 +1258,8 @@ bool URLIndexPrivateData::RestoreHistoryInfoMap(
       entries(list_item.history_info_map_entry());
   for (RepeatedPtrField<HistoryInfoMapEntry>::const_iterator iter =
        entries.begin(); iter != entries.end(); ++iter) {
-    HistoryID history_id = iter->history_id();
-    GURL url(iter->url());
-    URLRow url_row(url, history_id);
-    url_row.set_visit_count(iter->visit_count());
-    url_row.set_typed_count(iter->typed_count());
-    url_row.set_last_visit(base::Time::FromInternalValue(iter->last_visit()));
-    if (iter->has_title()) {
-      base::string16 title(UTF8ToUTF16(iter->title()));
-      url_row.set_title(title);
-    }
-    history_info_map_[history_id].url_row = url_row;
-
-    // Restore visits list.
-    VisitInfoVector visits;
-    visits.reserve(iter->visits_size());
-    for (int i = 0; i < iter->visits_size(); ++i) {
-      visits.push_back(std::make_pair(
-          base::Time::FromInternalValue(iter->visits(i).visit_time()),
-          static_cast<content::PageTransition>(iter->visits(i).
-                                               transition_type())));
-    }
-    history_info_map_[history_id].visits = visits;
+    HistoryInfoMapValueFromEntry(*iter,
+                                 &history_info_map_[iter->history_id()]);
   }
   return true;
 }
@@ -1247,6 +1311,71 @@ bool URLIndexPrivateData::RestoreWordStartsMap(
   return true;
 }
 
+size_t URLIndexPrivateData::ReplayJournal(const base::FilePath& journal_path,
+                                         int64 journal_id,
+                                         const std::string& languages) {
+  std::string journal;
+  if (!base::ReadFileToString(journal_path, &journal))
+    return 0;
+
+  size_t record_count = 0;
+  size_t offset = 0;
+  InMemoryURLIndexJournalRecord record;
+  while (journal.size() - offset >= kJournalRecordSizeBytes) {
+    uint32 size = 0;
+    for (size_t i = 0; i < kJournalRecordSizeBytes; ++i)
+      size = (size << 8) | static_cast<uint8>(journal[offset + i]);
+    offset += kJournalRecordSizeBytes;
+    // A record cut short, most likely by a crash while it was being appended,
+    // ends the journal.
+    if (journal.size() - offset < size ||
+        !record.ParseFromArray(journal.data() + offset, size))
+      break;
+    offset += size;
+
+    if (record_count == 0) {
+      // Records written against some other cache must not be applied.
+      if (record.type() != InMemoryURLIndexJournalRecord::HEADER ||
+          record.journal_id() != journal_id)
+        return 0;
+      ++record_count;
+      continue;
+    }
+    switch (record.type()) {
+      case InMemoryURLIndexJournalRecord::UPDATE_URL:
+        if (record.has_history_info())
+          RestoreJournaledURL(record.history_info(), languages);
+        break;
+      case InMemoryURLIndexJournalRecord::DELETE_URL:
+        DeleteURL(GURL(record.url()));
+        break;
+      case InMemoryURLIndexJournalRecord::CLEAR:
+        Clear();
+        break;
+      default:
+        break;
+    }
+    ++record_count;
+  }
+  // The header is not a change.
+  return record_count ? record_count - 1 : 0;
+}
+
+void URLIndexPrivateData::RestoreJournaledURL(
+    const HistoryInfoMapEntry& entry,
+    const std::string& languages) {
+  HistoryID history_id = entry.history_id();
+  HistoryInfoMap::iterator pos = history_info_map_.find(history_id);
+  if (pos != history_info_map_.end())
+    RemoveRowFromIndex(pos->second.url_row);
+
+  HistoryInfoMapValue& value = history_info_map_[history_id];
+  HistoryInfoMapValueFromEntry(entry, &value);
+  RowWordStarts word_starts;
+  AddRowWordsToIndex(value.url_row, &word_starts, languages);
+  word_starts_map_[history_id] = word_starts;
+}
+
 // static
 bool URLIndexPrivateData::URLSchemeIsWhitelisted(
     const GURL& gurl,
@@ -1258,10 +1387,10 @@ bool URLIndexPrivateData::URLSchemeIsWhitelisted(
 // SearchTermCacheItem ---------------------------------------------------------
 
 URLIndexPrivateData::SearchTermCacheItem::SearchTermCacheItem(
-    const WordIDSet& word_id_set,
-    const HistoryIDSet& history_id_set)
-    : word_id_set_(word_id_set),
-      history_id_set_(history_id_set),
+    const WordIDVector& word_ids,
+    const HistoryIDVector& history_ids)
+    : word_ids_(word_ids),
+      history_ids_(history_ids),
       used_(true) {}
 
 URLIndexPrivateData::SearchTermCacheItem::SearchTermCacheItem()
@@ -11,11 +11,13 @@
 #include "base/files/file_path.h"
 #include "base/gtest_prod_util.h"
 #include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
 #include "chrome/browser/common/cancelable_request.h"
 #include "chrome/browser/history/history_service.h"
 #include "chrome/browser/history/in_memory_url_index_cache.pb.h"
 #include "chrome/browser/history/in_memory_url_index_types.h"
 #include "chrome/browser/history/scored_history_match.h"
+#include "chrome/browser/history/url_index_posting_lists.h"
 #include "content/public/browser/notification_details.h"
 
 class BookmarkService;
@@ -34,7 +36,7 @@ class InMemoryURLIndex;
 class RefCountedBool;
 
 // Current version of the cache file.
-static const int kCurrentCacheFileVersion = 4;
+static const int kCurrentCacheFileVersion = 5;
 
 // A structure private to InMemoryURLIndex describing its internal data and
 // providing for restoring, rebuilding and updating that internal data. As
@@ -125,10 +127,37 @@ class URLIndexPrivateData
       const std::set<std::string>& scheme_whitelist);
 
   // Writes |private_data| as a cache file to |file_path| and returns success.
+  // Also starts a new, empty journal for the cache.
   static bool WritePrivateDataToCacheFileTask(
       scoped_refptr<URLIndexPrivateData> private_data,
       const base::FilePath& file_path);
 
+  // Returns the path of the journal which accompanies the cache file at
+  // |cache_path|. The journal records changes made to the index since the
+  // cache was written so that they survive a restart without the cost of
+  // rewriting the whole cache.
+  static base::FilePath GetJournalFilePath(const base::FilePath& cache_path);
+
+  // Appends the journal |records| to the journal of the cache file at
+  // |file_path| and returns success. Does nothing if that cache has no
+  // journal, since the records could not be applied on restore. This function
+  // should be run on the file thread.
+  static bool AppendToJournalFile(const base::FilePath& file_path,
+                                  const std::string& records);
+
+  // Appends to |records| a journal record for the history item |url_id| with
+  // |url|: its current index data if it is indexed, otherwise its deletion.
+  void AppendURLJournalRecord(URLID url_id,
+                              const GURL& url,
+                              std::string* records) const;
+
+  // Appends to |records| a journal record which clears the whole index.
+  static void AppendClearJournalRecord(std::string* records);
+
+  // Appends to |records| a journal record for each history item whose recent
+  // visits were updated since the last call, and returns how many.
+  size_t AppendVisitJournalRecords(std::string* records);
+
   // Stops all pending updates to recent visits fields.  This should be
   // called during shutdown.
   void CancelPendingUpdates();
@@ -171,22 +200,22 @@ class URLIndexPrivateData
   // no longer needed.
   //
   // Items stored in the search term cache. If a search term exactly matches one
-  // in the cache then we can quickly supply the proper |history_id_set_| (and
+  // in the cache then we can quickly supply the proper |history_ids_| (and
   // marking the cache item as being |used_|. If we find a prefix for a search
   // term in the cache (which is very likely to occur as the user types each
   // term into the omnibox) then we can short-circuit the index search for those
-  // characters in the prefix by returning the |word_id_set|. In that case we do
-  // not mark the item as being |used_|.
+  // characters in the prefix by returning the |word_ids_|. In that case we do
+  // not mark the item as being |used_|. Both vectors are sorted.
   struct SearchTermCacheItem {
-    SearchTermCacheItem(const WordIDSet& word_id_set,
-                        const HistoryIDSet& history_id_set);
+    SearchTermCacheItem(const WordIDVector& word_ids,
+                        const HistoryIDVector& history_ids);
     // Creates a cache item for a term which has no results.
     SearchTermCacheItem();
 
     ~SearchTermCacheItem();
 
-    WordIDSet word_id_set_;
-    HistoryIDSet history_id_set_;
+    WordIDVector word_ids_;
+    HistoryIDVector history_ids_;
     bool used_;  // True if this item has been used for the current term search.
   };
   typedef std::map<base::string16, SearchTermCacheItem> SearchTermCacheMap;
@@ -233,16 +262,22 @@ class URLIndexPrivateData
 
   // URL History indexing support functions.
 
-  // Composes a set of history item IDs by intersecting the set for each word
-  // in |unsorted_words|.
-  HistoryIDSet HistoryIDSetFromWords(const String16Vector& unsorted_words);
+  // Composes the sorted history item IDs matching every word in
+  // |unsorted_words| by intersecting the IDs for each word.
+  HistoryIDVector HistoryIDsFromWords(const String16Vector& unsorted_words);
 
-  // Helper function to HistoryIDSetFromWords which composes a set of history
+  // Helper function to HistoryIDsFromWords which composes the sorted history
   // ids for the given term given in |term|.
-  HistoryIDSet HistoryIDsForTerm(const base::string16& term);
+  HistoryIDVector HistoryIDsForTerm(const base::string16& term);
+
+  // Given a set of Char16s, finds the sorted IDs of words containing those
+  // characters.
+  WordIDVector WordIDsForTermChars(const Char16Set& term_chars);
 
-  // Given a set of Char16s, finds words containing those characters.
-  WordIDSet WordIDSetForTermChars(const Char16Set& term_chars);
+  // Folds the changes to |posting_lists_| since it was last encoded back into
+  // it once enough of them have piled up. Called after changes to the index
+  // rather than before queries, so that lookups never wait for a rebuild.
+  void CompactPostingListsIfNeeded();
 
   // Indexes one URL history item as described by |row|. Returns true if the
   // row was actually indexed. |languages| gives a list of language encodings by
@@ -276,13 +311,14 @@ class URLIndexPrivateData
   // |history_id| as the initial element of the word's set.
   void AddWordHistory(const base::string16& uni_word, HistoryID history_id);
 
-  // Updates an existing entry in the word/history index by adding the
-  // |history_id| to set for |word_id| in the word_id_history_map_.
+  // Updates an existing entry in the word/history index by adding
+  // |history_id| to the history items for |word_id|.
   void UpdateWordHistory(WordID word_id, HistoryID history_id);
 
   // Adds |word_id| to |history_id|'s entry in the history/word map,
-  // creating a new entry if one does not already exist.
-  void AddToHistoryIDWordMap(HistoryID history_id, WordID word_id);
+  // creating a new entry if one does not already exist. Returns false if
+  // |word_id| was already there.
+  bool AddToHistoryIDWordMap(HistoryID history_id, WordID word_id);
 
   // Removes |row| and all associated words and characters from the index.
   void RemoveRowFromIndex(const URLRow& row);
@@ -301,24 +337,40 @@ class URLIndexPrivateData
   void SavePrivateData(imui::InMemoryURLIndexCacheItem* cache) const;
   void SaveWordList(imui::InMemoryURLIndexCacheItem* cache) const;
   void SaveWordMap(imui::InMemoryURLIndexCacheItem* cache) const;
-  void SaveCharWordMap(imui::InMemoryURLIndexCacheItem* cache) const;
-  void SaveWordIDHistoryMap(imui::InMemoryURLIndexCacheItem* cache) const;
   void SaveHistoryInfoMap(imui::InMemoryURLIndexCacheItem* cache) const;
   void SaveWordStartsMap(imui::InMemoryURLIndexCacheItem* cache) const;
 
-  // Decode a data structure from the protobuf |cache|. Return false if there
-  // is any kind of failure. |languages| will be used to break URLs and page
-  // titles into words
+  // Decode a data structure from the protobuf |cache|, or the posting lists
+  // from |snapshot|. Return false if there is any kind of failure.
+  // |languages| will be used to break URLs and page titles into words
   bool RestorePrivateData(const imui::InMemoryURLIndexCacheItem& cache,
+                          const scoped_refptr<base::RefCountedMemory>& snapshot,
                           const std::string& languages);
   bool RestoreWordList(const imui::InMemoryURLIndexCacheItem& cache);
   bool RestoreWordMap(const imui::InMemoryURLIndexCacheItem& cache);
-  bool RestoreCharWordMap(const imui::InMemoryURLIndexCacheItem& cache);
-  bool RestoreWordIDHistoryMap(const imui::InMemoryURLIndexCacheItem& cache);
+  // Queries the posting lists in place in |snapshot| and rebuilds the
+  // history/word map from them. Must follow RestoreWordList().
+  bool RestorePostingLists(
+      const scoped_refptr<base::RefCountedMemory>& snapshot);
   bool RestoreHistoryInfoMap(const imui::InMemoryURLIndexCacheItem& cache);
   bool RestoreWordStartsMap(const imui::InMemoryURLIndexCacheItem& cache,
                             const std::string& languages);
 
+  // Applies the changes recorded in the journal at |journal_path| provided
+  // that it was started for the cache identified by |journal_id|. Returns the
+  // number of changes applied.
+  size_t ReplayJournal(const base::FilePath& journal_path,
+                       int64 journal_id,
+                       const std::string& languages);
+
+  typedef imui::
+      InMemoryURLIndexCacheItem_HistoryInfoMapItem_HistoryInfoMapEntry
+      HistoryInfoMapEntry;
+
+  // Replaces any index data for the journaled history item |entry|.
+  void RestoreJournaledURL(const HistoryInfoMapEntry& entry,
+                           const std::string& languages);
+
   // Determines if |gurl| has a whitelisted scheme and returns true if so.
   static bool URLSchemeIsWhitelisted(const GURL& gurl,
                                      const std::set<std::string>& whitelist);
@@ -329,6 +381,9 @@ class URLIndexPrivateData
   // Allows canceling pending requests to update recent visits information.
   CancelableRequestConsumer recent_visits_consumer_;
 
+  // History items whose recent visits were updated but not yet journaled.
+  std::set<URLID> visits_to_journal_;
+
   // Start of data members that are cached -------------------------------------
 
   // The version of the cache file most recently used to restore this instance
@@ -358,13 +413,12 @@ class URLIndexPrivateData
   // WordID) in the |word_list_|.
   WordMap word_map_;
 
-  // A one-to-many mapping from a single character to all WordIDs of words
-  // containing that character.
-  CharWordIDMap char_word_map_;
-
-  // A one-to-many mapping from a WordID to all HistoryIDs (the row_id as
-  // used in the history database) of history items in which the word occurs.
-  WordIDHistoryMap word_id_history_map_;
+  // The one-to-many mappings from a single character to all WordIDs of words
+  // containing that character, and from a WordID to all HistoryIDs (the
+  // row_id as used in the history database) of history items in which the
+  // word occurs. Both are kept as compressed posting lists, which queries
+  // intersect directly.
+  URLIndexPostingLists posting_lists_;
 
   // A one-to-many mapping from a HistoryID to all WordIDs of words that occur
   // in the URL and/or page title of the history item referenced by that
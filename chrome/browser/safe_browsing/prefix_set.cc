@@ -12,6 +12,10 @@
 #include "base/md5.h"
 #include "base/metrics/histogram.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace {
 
 // |kMagic| should be reasonably unique, and not match itself across
@@ -29,10 +33,27 @@ typedef struct {
   uint32 deltas_size;
 } FileHeader;
 
-// For |std::upper_bound()| to find a prefix w/in a vector of pairs.
-bool PrefixLess(const std::pair<SBPrefix,size_t>& a,
-                const std::pair<SBPrefix,size_t>& b) {
-  return a.first < b.first;
+// Returns the number of the |count| items at |prefixes| which are
+// less than or equal to |prefix|.  |prefixes| must be sorted.
+size_t CountNotGreater(const SBPrefix* prefixes, size_t count,
+                       SBPrefix prefix) {
+#if defined(__SSE2__)
+  // A full block is one cache line, compare all of it at once.  Each
+  // comparison yields -1 for items greater than |prefix|.
+  if (count == 16) {
+    const __m128i* items = reinterpret_cast<const __m128i*>(prefixes);
+    const __m128i target = _mm_set1_epi32(prefix);
+    __m128i greater = _mm_add_epi32(
+        _mm_add_epi32(_mm_cmpgt_epi32(_mm_loadu_si128(items), target),
+                      _mm_cmpgt_epi32(_mm_loadu_si128(items + 1), target)),
+        _mm_add_epi32(_mm_cmpgt_epi32(_mm_loadu_si128(items + 2), target),
+                      _mm_cmpgt_epi32(_mm_loadu_si128(items + 3), target)));
+    greater = _mm_add_epi32(greater, _mm_shuffle_epi32(greater, 0x4E));
+    greater = _mm_add_epi32(greater, _mm_shuffle_epi32(greater, 0xB1));
+    return count + _mm_cvtsi128_si32(greater);
+  }
+#endif
+  return std::upper_bound(prefixes, prefixes + count, prefix) - prefixes;
 }
 
 }  // namespace
@@ -42,16 +63,18 @@ namespace safe_browsing {
 PrefixSet::PrefixSet(const std::vector<SBPrefix>& sorted_prefixes) {
   if (sorted_prefixes.size()) {
     // Estimate the resulting vector sizes.  There will be strictly
-    // more than |min_runs| entries in |index_|, but there generally
+    // more than |min_runs| entries in the index, but there generally
     // aren't many forced breaks.
     const size_t min_runs = sorted_prefixes.size() / kMaxRun;
-    index_.reserve(min_runs);
+    index_prefixes_.reserve(min_runs);
+    index_offsets_.reserve(min_runs);
     deltas_.reserve(sorted_prefixes.size() - min_runs);
 
     // Lead with the first prefix.
     SBPrefix prev_prefix = sorted_prefixes[0];
     size_t run_length = 0;
-    index_.push_back(std::make_pair(prev_prefix, deltas_.size()));
+    index_prefixes_.push_back(prev_prefix);
+    index_offsets_.push_back(static_cast<uint32>(deltas_.size()));
 
     for (size_t i = 1; i < sorted_prefixes.size(); ++i) {
       // Skip duplicates.
@@ -67,7 +90,8 @@ PrefixSet::PrefixSet(const std::vector<SBPrefix>& sorted_prefixes) {
       // New index ref if the delta doesn't fit, or if too many
       // consecutive deltas have been encoded.
       if (delta != static_cast<unsigned>(delta16) || run_length >= kMaxRun) {
-        index_.push_back(std::make_pair(sorted_prefixes[i], deltas_.size()));
+        index_prefixes_.push_back(sorted_prefixes[i]);
+        index_offsets_.push_back(static_cast<uint32>(deltas_.size()));
         run_length = 0;
       } else {
         // Continue the run of deltas.
@@ -78,12 +102,16 @@ PrefixSet::PrefixSet(const std::vector<SBPrefix>& sorted_prefixes) {
 
       prev_prefix = sorted_prefixes[i];
     }
+    BuildBlockIndex();
 
     // Send up some memory-usage stats.  Bits because fractional bytes
     // are weird.
-    const size_t bits_used = index_.size() * sizeof(index_[0]) * CHAR_BIT +
+    const size_t bits_used =
+        index_prefixes_.size() * sizeof(index_prefixes_[0]) * CHAR_BIT +
+        index_offsets_.size() * sizeof(index_offsets_[0]) * CHAR_BIT +
+        block_prefixes_.size() * sizeof(block_prefixes_[0]) * CHAR_BIT +
         deltas_.size() * sizeof(deltas_[0]) * CHAR_BIT;
-    const size_t unique_prefixes = index_.size() + deltas_.size();
+    const size_t unique_prefixes = index_prefixes_.size() + deltas_.size();
     static const size_t kMaxBitsPerPrefix = sizeof(SBPrefix) * CHAR_BIT;
     UMA_HISTOGRAM_ENUMERATION("SB2.PrefixSetBitsPerPrefix",
                               bits_used / unique_prefixes,
@@ -91,60 +119,103 @@ PrefixSet::PrefixSet(const std::vector<SBPrefix>& sorted_prefixes) {
   }
 }
 
-PrefixSet::PrefixSet(std::vector<std::pair<SBPrefix,size_t> > *index,
+PrefixSet::PrefixSet(const std::vector<std::pair<SBPrefix,size_t> >& index,
                      std::vector<uint16> *deltas) {
-  DCHECK(index && deltas);
-  index_.swap(*index);
+  DCHECK(deltas);
+  index_prefixes_.reserve(index.size());
+  index_offsets_.reserve(index.size());
+  for (size_t i = 0; i < index.size(); ++i) {
+    index_prefixes_.push_back(index[i].first);
+    index_offsets_.push_back(static_cast<uint32>(index[i].second));
+  }
   deltas_.swap(*deltas);
+  BuildBlockIndex();
 }
 
 PrefixSet::~PrefixSet() {}
 
+void PrefixSet::BuildBlockIndex() {
+  block_prefixes_.clear();
+  block_prefixes_.reserve(
+      (index_prefixes_.size() + kIndexBlockSize - 1) / kIndexBlockSize);
+  for (size_t i = 0; i < index_prefixes_.size(); i += kIndexBlockSize)
+    block_prefixes_.push_back(index_prefixes_[i]);
+}
+
 bool PrefixSet::Exists(SBPrefix prefix) const {
-  if (index_.empty())
+  if (index_prefixes_.empty())
     return false;
 
-  // Find the first position after |prefix| in |index_|.
-  std::vector<std::pair<SBPrefix,size_t> >::const_iterator
-      iter = std::upper_bound(index_.begin(), index_.end(),
-                              std::pair<SBPrefix,size_t>(prefix, 0),
-                              PrefixLess);
+  // Find the block which |prefix| would be in.
+  std::vector<SBPrefix>::const_iterator block_iter =
+      std::upper_bound(block_prefixes_.begin(), block_prefixes_.end(), prefix);
 
   // |prefix| comes before anything that's in the set.
-  if (iter == index_.begin())
+  if (block_iter == block_prefixes_.begin())
     return false;
 
-  // Capture the upper bound of our target entry's deltas.
-  const size_t bound = (iter == index_.end() ? deltas_.size() : iter->second);
-
-  // Back up to the entry our target is in.
-  --iter;
-
-  // All prefixes in |index_| are in the set.
-  SBPrefix current = iter->first;
-  if (current == prefix)
+  // Find the last index entry at or before |prefix| within the
+  // block.  The first entry of the block always qualifies.
+  const size_t block_begin =
+      (block_iter - block_prefixes_.begin() - 1) * kIndexBlockSize;
+  const size_t block_size =
+      std::min(kIndexBlockSize, index_prefixes_.size() - block_begin);
+  const size_t ii = block_begin - 1 +
+      CountNotGreater(&index_prefixes_[block_begin], block_size, prefix);
+
+  // All prefixes in the index are in the set.
+  if (index_prefixes_[ii] == prefix)
     return true;
 
-  // Scan forward accumulating deltas while a match is possible.
-  for (size_t di = iter->second; di < bound && current < prefix; ++di) {
-    current += deltas_[di];
+  // The deltas for this entry run to the next entry, or the end of
+  // the deltas.
+  const size_t bound = (ii + 1 < index_offsets_.size() ?
+                        index_offsets_[ii + 1] : deltas_.size());
+
+  // Scan forward consuming the distance to |prefix|.  |unsigned|
+  // because the distance could be more than INT_MAX.
+  unsigned remaining = static_cast<unsigned>(prefix) -
+      static_cast<unsigned>(index_prefixes_[ii]);
+  size_t di = index_offsets_[ii];
+
+#if defined(__SSE2__)
+  // Skip groups of eight deltas which all fall short of |prefix|.
+  const __m128i zero = _mm_setzero_si128();
+  for (; di + 8 <= bound; di += 8) {
+    const __m128i deltas =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(&deltas_[di]));
+    __m128i sum = _mm_add_epi32(_mm_unpacklo_epi16(deltas, zero),
+                                _mm_unpackhi_epi16(deltas, zero));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    const unsigned group = static_cast<unsigned>(_mm_cvtsi128_si32(sum));
+    if (group >= remaining)
+      break;
+    remaining -= group;
+  }
+#endif
+
+  for (; di < bound; ++di) {
+    if (deltas_[di] >= remaining)
+      return deltas_[di] == remaining;
+    remaining -= deltas_[di];
   }
 
-  return current == prefix;
+  return false;
 }
 
 void PrefixSet::GetPrefixes(std::vector<SBPrefix>* prefixes) const {
-  prefixes->reserve(index_.size() + deltas_.size());
+  prefixes->reserve(index_prefixes_.size() + deltas_.size());
 
-  for (size_t ii = 0; ii < index_.size(); ++ii) {
-    // The deltas for this |index_| entry run to the next index entry,
+  for (size_t ii = 0; ii < index_prefixes_.size(); ++ii) {
+    // The deltas for this index entry run to the next index entry,
     // or the end of the deltas.
-    const size_t deltas_end =
-        (ii + 1 < index_.size()) ? index_[ii + 1].second : deltas_.size();
+    const size_t deltas_end = (ii + 1 < index_offsets_.size()) ?
+        index_offsets_[ii + 1] : deltas_.size();
 
-    SBPrefix current = index_[ii].first;
+    SBPrefix current = index_prefixes_[ii];
     prefixes->push_back(current);
-    for (size_t di = index_[ii].second; di < deltas_end; ++di) {
+    for (size_t di = index_offsets_[ii]; di < deltas_end; ++di) {
       current += deltas_[di];
       prefixes->push_back(current);
     }
@@ -225,19 +296,26 @@ PrefixSet* PrefixSet::LoadFile(const base::FilePath& filter_name) {
   if (0 != memcmp(&file_digest, &calculated_digest, sizeof(file_digest)))
     return NULL;
 
-  // Steals contents of |index| and |deltas| via swap().
-  return new PrefixSet(&index, &deltas);
+  // Steals contents of |deltas| via swap().
+  return new PrefixSet(index, &deltas);
 }
 
 bool PrefixSet::WriteFile(const base::FilePath& filter_name) const {
+  // The file format predates splitting the index into parallel
+  // vectors.
+  std::vector<std::pair<SBPrefix,size_t> > index;
+  index.reserve(index_prefixes_.size());
+  for (size_t i = 0; i < index_prefixes_.size(); ++i)
+    index.push_back(std::make_pair(index_prefixes_[i], index_offsets_[i]));
+
   FileHeader header;
   header.magic = kMagic;
   header.version = kVersion;
-  header.index_size = static_cast<uint32>(index_.size());
+  header.index_size = static_cast<uint32>(index.size());
   header.deltas_size = static_cast<uint32>(deltas_.size());
 
   // Sanity check that the 32-bit values never mess things up.
-  if (static_cast<size_t>(header.index_size) != index_.size() ||
+  if (static_cast<size_t>(header.index_size) != index.size() ||
       static_cast<size_t>(header.deltas_size) != deltas_.size()) {
     NOTREACHED();
     return false;
@@ -260,15 +338,15 @@ bool PrefixSet::WriteFile(const base::FilePath& filter_name) const {
 
   // As for reads, the standard guarantees the ability to access the
   // contents of the vector by a pointer to an element.
-  if (index_.size()) {
-    const size_t index_bytes = sizeof(index_[0]) * index_.size();
-    written = fwrite(&(index_[0]), sizeof(index_[0]), index_.size(),
+  if (index.size()) {
+    const size_t index_bytes = sizeof(index[0]) * index.size();
+    written = fwrite(&(index[0]), sizeof(index[0]), index.size(),
                      file.get());
-    if (written != index_.size())
+    if (written != index.size())
       return false;
     base::MD5Update(&context,
                     base::StringPiece(
-                        reinterpret_cast<const char*>(&(index_[0])),
+                        reinterpret_cast<const char*>(&(index[0])),
                         index_bytes));
   }
 
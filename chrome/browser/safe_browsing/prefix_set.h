@@ -9,11 +9,11 @@
 //
 // For example, the sequence {20, 25, 41, 65432, 150000, 160000} would
 // be stored as:
-//  A pair {20, 0} in |index_|.
+//  A pair {20, 0} in the index.
 //  5, 16, 65391 in |deltas_|.
-//  A pair {150000, 3} in |index_|.
+//  A pair {150000, 3} in the index.
 //  10000 in |deltas_|.
-// |index_.size()| will be 2, |deltas_.size()| will be 4.
+// The index will have 2 entries, |deltas_.size()| will be 4.
 //
 // This structure is intended for storage of sparse uniform sets of
 // prefixes of a certain size.  As of this writing, my safe-browsing
@@ -37,14 +37,24 @@
 // 2^16 apart, which would need 512k (versus 256k to store the raw
 // data).
 //
+// In memory, the index is kept as parallel vectors of prefixes and
+// offsets, so that |Exists()| only touches the prefixes while
+// searching.  A second level holds the first prefix of every
+// cache-line-sized block of index prefixes.  It is small enough to
+// stay in cache, so a lookup binary-searches it, scans a single block
+// of the index (with SSE2 where available), and then accumulates
+// deltas, skipping eight at a time while the target is further away.
+//
 // The on-disk format looks like:
 //         4 byte magic number
 //         4 byte version number
-//         4 byte |index_.size()|
+//         4 byte |index_prefixes_.size()|
 //         4 byte |deltas_.size()|
-//     n * 8 byte |&index_[0]..&index_[n]|
+//     n * 8 byte pairs of |index_prefixes_[i]| and |index_offsets_[i]|
 //     m * 2 byte |&deltas_[0]..&deltas_[m]|
 //        16 byte digest
+// The pairs are written as std::pair<SBPrefix,size_t>, so their size
+// depends on the platform.
 
 #ifndef CHROME_BROWSER_SAFE_BROWSING_PREFIX_SET_H_
 #define CHROME_BROWSER_SAFE_BROWSING_PREFIX_SET_H_
@@ -81,20 +91,34 @@ class PrefixSet {
   // for |Exists()| under control.
   static const size_t kMaxRun = 100;
 
-  // Helper for |LoadFile()|.  Steals the contents of |index| and
-  // |deltas| using |swap()|.
-  PrefixSet(std::vector<std::pair<SBPrefix,size_t> > *index,
+  // Number of |index_prefixes_| entries summarized by each entry of
+  // |block_prefixes_|, one cache line's worth.
+  static const size_t kIndexBlockSize = 16;
+
+  // Helper for |LoadFile()|.  Splits |index| into |index_prefixes_|
+  // and |index_offsets_|, and steals the contents of |deltas| using
+  // |swap()|.
+  PrefixSet(const std::vector<std::pair<SBPrefix,size_t> >& index,
             std::vector<uint16> *deltas);
 
-  // Top-level index of prefix to offset in |deltas_|.  Each pair
-  // indicates a base prefix and where the deltas from that prefix
-  // begin in |deltas_|.  The deltas for a pair end at the next pair's
-  // index into |deltas_|.
-  std::vector<std::pair<SBPrefix,size_t> > index_;
+  // Fill in |block_prefixes_| from |index_prefixes_|.
+  void BuildBlockIndex();
+
+  // Top-level index of prefix to offset in |deltas_|.  Each entry
+  // gives a base prefix and where the deltas from that prefix begin
+  // in |deltas_|.  The deltas for an entry end at the next entry's
+  // offset into |deltas_|.
+  std::vector<SBPrefix> index_prefixes_;
+  std::vector<uint32> index_offsets_;
+
+  // |index_prefixes_[i * kIndexBlockSize]| for each block of the
+  // index.
+  std::vector<SBPrefix> block_prefixes_;
 
-  // Deltas which are added to the prefix in |index_| to generate
-  // prefixes.  Deltas are only valid between consecutive items from
-  // |index_|, or the end of |deltas_| for the last |index_| pair.
+  // Deltas which are added to the prefix in |index_prefixes_| to
+  // generate prefixes.  Deltas are only valid between consecutive
+  // items from |index_offsets_|, or the end of |deltas_| for the last
+  // index entry.
   std::vector<uint16> deltas_;
 
   DISALLOW_COPY_AND_ASSIGN(PrefixSet);
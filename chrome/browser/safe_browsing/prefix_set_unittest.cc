@@ -13,6 +13,8 @@
 #include "base/md5.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/rand_util.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
 #include "testing/gtest/include/gtest/gtest.h"
 #include "testing/platform_test.h"
 
@@ -324,6 +326,80 @@ TEST_F(PrefixSetTest, EdgeCases) {
   }
 }
 
+// Lookups must land in the right index entry regardless of where it
+// falls within an index block, and must find every item of a long run
+// of deltas, including across the groups Exists() skips at once.
+TEST_F(PrefixSetTest, IndexBlocksAndRuns) {
+  std::vector<SBPrefix> prefixes;
+
+  // Large deltas make every item an index entry, filling several full
+  // index blocks and a partial one.
+  const unsigned kBigDelta = 100 * 1000;
+  SBPrefix prefix = -1000 * 1000 * 1000;
+  for (int i = 0; i < 53; ++i) {
+    prefixes.push_back(prefix);
+    prefix += kBigDelta;
+  }
+
+  // Runs of small varied deltas, each broken at |kMaxRun|.
+  for (int i = 0; i < 1000; ++i) {
+    prefix += 1 + (i * 7919) % 60000;
+    prefixes.push_back(prefix);
+  }
+
+  safe_browsing::PrefixSet prefix_set(prefixes);
+  CheckPrefixes(prefix_set, prefixes);
+  EXPECT_FALSE(prefix_set.Exists(prefixes.front() - 1));
+  EXPECT_FALSE(prefix_set.Exists(prefixes.back() + 1));
+  EXPECT_FALSE(prefix_set.Exists(prefixes[20] + kBigDelta / 2));
+}
+
+// Compare lookup speed against binary search of the raw sorted
+// prefixes, on a database-sized set of uniformly-distributed prefixes
+// (the distribution of real prefix lists).
+TEST_F(PrefixSetTest, DISABLED_LookupPerf) {
+  const size_t kPrefixCount = 650000;
+  const size_t kLookupCount = 1000 * 1000;
+
+  std::vector<SBPrefix> prefixes;
+  for (size_t i = 0; i < kPrefixCount; ++i)
+    prefixes.push_back(static_cast<SBPrefix>(base::RandUint64()));
+  std::sort(prefixes.begin(), prefixes.end());
+  safe_browsing::PrefixSet prefix_set(prefixes);
+
+  // Half hits, half (almost certain) misses.
+  std::vector<SBPrefix> lookups;
+  for (size_t i = 0; i < kLookupCount; ++i) {
+    if (i % 2) {
+      lookups.push_back(prefixes[base::RandGenerator(prefixes.size())]);
+    } else {
+      lookups.push_back(static_cast<SBPrefix>(base::RandUint64()));
+    }
+  }
+
+  size_t hits = 0;
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (size_t i = 0; i < lookups.size(); ++i) {
+    if (prefix_set.Exists(lookups[i]))
+      ++hits;
+  }
+  base::TimeDelta set_time = base::TimeTicks::Now() - start;
+
+  size_t expected_hits = 0;
+  start = base::TimeTicks::Now();
+  for (size_t i = 0; i < lookups.size(); ++i) {
+    if (std::binary_search(prefixes.begin(), prefixes.end(), lookups[i]))
+      ++expected_hits;
+  }
+  base::TimeDelta vector_time = base::TimeTicks::Now() - start;
+  EXPECT_EQ(expected_hits, hits);
+
+  LOG(INFO) << base::StringPrintf(
+      "%d lookups: PrefixSet %.2f ms, sorted vector %.2f ms",
+      static_cast<int>(lookups.size()), set_time.InMillisecondsF(),
+      vector_time.InMillisecondsF());
+}
+
 // Test writing a prefix set to disk and reading it back in.
 TEST_F(PrefixSetTest, ReadWrite) {
   base::FilePath filename;
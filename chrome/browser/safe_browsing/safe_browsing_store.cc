@@ -143,6 +143,17 @@ void SBProcessSubs(SBAddPrefixes* add_prefixes,
   std::sort(sub_full_hashes->begin(), sub_full_hashes->end(),
             SBAddPrefixHashLess<SBSubFullHash,SBSubFullHash>);
 
+  SBProcessSortedSubs(add_prefixes, sub_prefixes,
+                      add_full_hashes, sub_full_hashes,
+                      add_chunks_deleted, sub_chunks_deleted);
+}
+
+void SBProcessSortedSubs(SBAddPrefixes* add_prefixes,
+                         SBSubPrefixes* sub_prefixes,
+                         std::vector<SBAddFullHash>* add_full_hashes,
+                         std::vector<SBSubFullHash>* sub_full_hashes,
+                         const base::hash_set<int32>& add_chunks_deleted,
+                         const base::hash_set<int32>& sub_chunks_deleted) {
   // Factor out the prefix subs.
   SBAddPrefixes removed_adds;
   KnockoutSubs(sub_prefixes, add_prefixes,
@@ -133,12 +133,10 @@ bool SBAddPrefixHashLess(const T& a, const U& b) {
 // matched items from all vectors.  Additionally remove items from
 // deleted chunks.
 //
-// TODO(shess): Since the prefixes are uniformly-distributed hashes,
-// there aren't many ways to organize the inputs for efficient
-// processing.  For this reason, the vectors are sorted and processed
-// in parallel.  At this time this code does the sorting internally,
-// but it might make sense to make sorting an API requirement so that
-// the storage can optimize for it.
+// Since the prefixes are uniformly-distributed hashes, there aren't
+// many ways to organize the inputs for efficient processing.  For
+// this reason, the vectors are sorted and processed in parallel.
+// The outputs are left sorted.
 void SBProcessSubs(SBAddPrefixes* add_prefixes,
                    SBSubPrefixes* sub_prefixes,
                    std::vector<SBAddFullHash>* add_full_hashes,
@@ -146,6 +144,19 @@ void SBProcessSubs(SBAddPrefixes* add_prefixes,
                    const base::hash_set<int32>& add_chunks_deleted,
                    const base::hash_set<int32>& sub_chunks_deleted);
 
+// Like SBProcessSubs(), but skips the sorting.  The prefix vectors
+// must already be ordered by SBAddPrefixLess() and the full-hash
+// vectors by SBAddPrefixHashLess().  This lets storage which keeps
+// its data sorted (such as SafeBrowsingStoreFile, which merges
+// updates into an already-sorted base) avoid an O(N log N) pass over
+// the entire database for every update.
+void SBProcessSortedSubs(SBAddPrefixes* add_prefixes,
+                         SBSubPrefixes* sub_prefixes,
+                         std::vector<SBAddFullHash>* add_full_hashes,
+                         std::vector<SBSubFullHash>* sub_full_hashes,
+                         const base::hash_set<int32>& add_chunks_deleted,
+                         const base::hash_set<int32>& sub_chunks_deleted);
+
 // TODO(shess): This uses int32 rather than int because it's writing
 // specifically-sized items to files.  SBPrefix should likewise be
 // explicitly sized.
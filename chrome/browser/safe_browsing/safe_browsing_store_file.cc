@@ -4,6 +4,8 @@
 
 #include "chrome/browser/safe_browsing/safe_browsing_store_file.h"
 
+#include <algorithm>
+
 #include "base/md5.h"
 #include "base/metrics/histogram.h"
 
@@ -118,6 +120,42 @@ bool WriteContainer(const CT& values, FILE* fp,
   return true;
 }
 
+// Read |count| items from |fp| into |values|, merging them with the
+// items of |delta| so that the combined items are appended to
+// |values| in |less| order.  |delta| must be sorted, and the items
+// in |fp| are expected to be, since they were written sorted by a
+// previous update.  If they turn out not to be, |*base_sorted| is
+// set to false and the caller is responsible for sorting |values|.
+// The items from |fp| are folded into the checksum in |context|.
+// Returns true on success.
+template <typename CT, typename LessT>
+bool MergeToContainer(CT* values, size_t count, FILE* fp,
+                      base::MD5Context* context,
+                      const std::vector<typename CT::value_type>& delta,
+                      LessT less, bool* base_sorted) {
+  typedef typename CT::value_type ValueType;
+  typename std::vector<ValueType>::const_iterator delta_iter = delta.begin();
+
+  ValueType previous;
+  for (size_t i = 0; i < count; ++i) {
+    ValueType value;
+    if (!ReadItem(&value, fp, context))
+      return false;
+    if (i > 0 && less(value, previous))
+      *base_sorted = false;
+    previous = value;
+
+    while (delta_iter != delta.end() && less(*delta_iter, value)) {
+      values->insert(values->end(), *delta_iter);
+      ++delta_iter;
+    }
+    values->insert(values->end(), value);
+  }
+  values->insert(values->end(), delta_iter, delta.end());
+
+  return true;
+}
+
 // Delete the chunks in |deleted| from |chunks|.
 void DeleteChunksFromSet(const base::hash_set<int32>& deleted,
                          std::set<int32>* chunks) {
@@ -483,12 +521,82 @@ bool SafeBrowsingStoreFile::DoUpdate(
   CHECK(add_prefixes_result);
   CHECK(add_full_hashes_result);
 
+  // The new data from the accumulated chunks, sorted below.
+  std::vector<SBAddPrefix> new_add_prefixes;
+  std::vector<SBSubPrefix> new_sub_prefixes;
+  std::vector<SBAddFullHash> new_add_full_hashes;
+  std::vector<SBSubFullHash> new_sub_full_hashes;
+
+  // Rewind the temporary storage.
+  if (!FileRewind(new_file_.get()))
+    return false;
+
+  // Get chunk file's size for validating counts.
+  int64 size = 0;
+  if (!base::GetFileSize(TemporaryFileForFilename(filename_), &size))
+    return OnCorruptDatabase();
+
+  // Track update size to answer questions at http://crbug.com/72216 .
+  // Log small updates as 1k so that the 0 (underflow) bucket can be
+  // used for "empty" in SafeBrowsingDatabase.
+  UMA_HISTOGRAM_COUNTS("SB2.DatabaseUpdateKilobytes",
+                       std::max(static_cast<int>(size / 1024), 1));
+
+  // Collect the accumulated chunks.
+  for (int i = 0; i < chunks_written_; ++i) {
+    ChunkHeader header;
+
+    int64 ofs = ftell(new_file_.get());
+    if (ofs == -1)
+      return false;
+
+    if (!ReadItem(&header, new_file_.get(), NULL))
+      return false;
+
+    // As a safety measure, make sure that the header describes a sane
+    // chunk, given the remaining file size.
+    int64 expected_size = ofs + sizeof(ChunkHeader);
+    expected_size += header.add_prefix_count * sizeof(SBAddPrefix);
+    expected_size += header.sub_prefix_count * sizeof(SBSubPrefix);
+    expected_size += header.add_hash_count * sizeof(SBAddFullHash);
+    expected_size += header.sub_hash_count * sizeof(SBSubFullHash);
+    if (expected_size > size)
+      return false;
+
+    if (!ReadToContainer(&new_add_prefixes, header.add_prefix_count,
+                         new_file_.get(), NULL) ||
+        !ReadToContainer(&new_sub_prefixes, header.sub_prefix_count,
+                         new_file_.get(), NULL) ||
+        !ReadToContainer(&new_add_full_hashes, header.add_hash_count,
+                         new_file_.get(), NULL) ||
+        !ReadToContainer(&new_sub_full_hashes, header.sub_hash_count,
+                         new_file_.get(), NULL))
+      return false;
+  }
+
+  // Append items from |pending_adds|.
+  new_add_full_hashes.insert(new_add_full_hashes.end(),
+                             pending_adds.begin(), pending_adds.end());
+
+  // Updates are generally small relative to the database, so only the
+  // new data is sorted.  It is then merged with the existing data,
+  // which the previous update left sorted.
+  std::sort(new_add_prefixes.begin(), new_add_prefixes.end(),
+            SBAddPrefixLess<SBAddPrefix,SBAddPrefix>);
+  std::sort(new_sub_prefixes.begin(), new_sub_prefixes.end(),
+            SBAddPrefixLess<SBSubPrefix,SBSubPrefix>);
+  std::sort(new_add_full_hashes.begin(), new_add_full_hashes.end(),
+            SBAddPrefixHashLess<SBAddFullHash,SBAddFullHash>);
+  std::sort(new_sub_full_hashes.begin(), new_sub_full_hashes.end(),
+            SBAddPrefixHashLess<SBSubFullHash,SBSubFullHash>);
+
   SBAddPrefixes add_prefixes;
   SBSubPrefixes sub_prefixes;
   std::vector<SBAddFullHash> add_full_hashes;
   std::vector<SBSubFullHash> sub_full_hashes;
+  bool base_sorted = true;
 
-  // Read original data into the vectors.
+  // Merge the original data with the new data.
   if (!empty_) {
     DCHECK(file_.get());
 
@@ -512,14 +620,26 @@ bool SafeBrowsingStoreFile::DoUpdate(
                          file_.get(), &context))
       return OnCorruptDatabase();
 
-    if (!ReadToContainer(&add_prefixes, header.add_prefix_count,
-                         file_.get(), &context) ||
-        !ReadToContainer(&sub_prefixes, header.sub_prefix_count,
-                         file_.get(), &context) ||
-        !ReadToContainer(&add_full_hashes, header.add_hash_count,
-                         file_.get(), &context) ||
-        !ReadToContainer(&sub_full_hashes, header.sub_hash_count,
-                         file_.get(), &context))
+    add_full_hashes.reserve(header.add_hash_count +
+                            new_add_full_hashes.size());
+    sub_full_hashes.reserve(header.sub_hash_count +
+                            new_sub_full_hashes.size());
+    if (!MergeToContainer(&add_prefixes, header.add_prefix_count,
+                          file_.get(), &context, new_add_prefixes,
+                          SBAddPrefixLess<SBAddPrefix,SBAddPrefix>,
+                          &base_sorted) ||
+        !MergeToContainer(&sub_prefixes, header.sub_prefix_count,
+                          file_.get(), &context, new_sub_prefixes,
+                          SBAddPrefixLess<SBSubPrefix,SBSubPrefix>,
+                          &base_sorted) ||
+        !MergeToContainer(&add_full_hashes, header.add_hash_count,
+                          file_.get(), &context, new_add_full_hashes,
+                          SBAddPrefixHashLess<SBAddFullHash,SBAddFullHash>,
+                          &base_sorted) ||
+        !MergeToContainer(&sub_full_hashes, header.sub_hash_count,
+                          file_.get(), &context, new_sub_full_hashes,
+                          SBAddPrefixHashLess<SBSubFullHash,SBSubFullHash>,
+                          &base_sorted))
       return OnCorruptDatabase();
 
     // Calculate the digest to this point.
@@ -538,72 +658,29 @@ bool SafeBrowsingStoreFile::DoUpdate(
 
     // Close the file so we can later rename over it.
     file_.reset();
+  } else {
+    add_prefixes.insert(add_prefixes.end(),
+                        new_add_prefixes.begin(), new_add_prefixes.end());
+    sub_prefixes.insert(sub_prefixes.end(),
+                        new_sub_prefixes.begin(), new_sub_prefixes.end());
+    add_full_hashes.swap(new_add_full_hashes);
+    sub_full_hashes.swap(new_sub_full_hashes);
   }
   DCHECK(!file_.get());
 
-  // Rewind the temporary storage.
-  if (!FileRewind(new_file_.get()))
-    return false;
-
-  // Get chunk file's size for validating counts.
-  int64 size = 0;
-  if (!base::GetFileSize(TemporaryFileForFilename(filename_), &size))
-    return OnCorruptDatabase();
-
-  // Track update size to answer questions at http://crbug.com/72216 .
-  // Log small updates as 1k so that the 0 (underflow) bucket can be
-  // used for "empty" in SafeBrowsingDatabase.
-  UMA_HISTOGRAM_COUNTS("SB2.DatabaseUpdateKilobytes",
-                       std::max(static_cast<int>(size / 1024), 1));
-
-  // Append the accumulated chunks onto the vectors read from |file_|.
-  for (int i = 0; i < chunks_written_; ++i) {
-    ChunkHeader header;
-
-    int64 ofs = ftell(new_file_.get());
-    if (ofs == -1)
-      return false;
-
-    if (!ReadItem(&header, new_file_.get(), NULL))
-      return false;
-
-    // As a safety measure, make sure that the header describes a sane
-    // chunk, given the remaining file size.
-    int64 expected_size = ofs + sizeof(ChunkHeader);
-    expected_size += header.add_prefix_count * sizeof(SBAddPrefix);
-    expected_size += header.sub_prefix_count * sizeof(SBSubPrefix);
-    expected_size += header.add_hash_count * sizeof(SBAddFullHash);
-    expected_size += header.sub_hash_count * sizeof(SBSubFullHash);
-    if (expected_size > size)
-      return false;
-
-    // TODO(shess): If the vectors were kept sorted, then this code
-    // could use std::inplace_merge() to merge everything together in
-    // sorted order.  That might still be slower than just sorting at
-    // the end if there were a large number of chunks.  In that case
-    // some sort of recursive binary merge might be in order (merge
-    // chunks pairwise, merge those chunks pairwise, and so on, then
-    // merge the result with the main list).
-    if (!ReadToContainer(&add_prefixes, header.add_prefix_count,
-                         new_file_.get(), NULL) ||
-        !ReadToContainer(&sub_prefixes, header.sub_prefix_count,
-                         new_file_.get(), NULL) ||
-        !ReadToContainer(&add_full_hashes, header.add_hash_count,
-                         new_file_.get(), NULL) ||
-        !ReadToContainer(&sub_full_hashes, header.sub_hash_count,
-                         new_file_.get(), NULL))
-      return false;
+  // Knock the subs from the adds and process deleted chunks.  Files
+  // written by this code are always sorted, but fall back to a full
+  // sort rather than trusting the order of data from elsewhere.
+  if (base_sorted) {
+    SBProcessSortedSubs(&add_prefixes, &sub_prefixes,
+                        &add_full_hashes, &sub_full_hashes,
+                        add_del_cache_, sub_del_cache_);
+  } else {
+    SBProcessSubs(&add_prefixes, &sub_prefixes,
+                  &add_full_hashes, &sub_full_hashes,
+                  add_del_cache_, sub_del_cache_);
   }
 
-  // Append items from |pending_adds|.
-  add_full_hashes.insert(add_full_hashes.end(),
-                         pending_adds.begin(), pending_adds.end());
-
-  // Knock the subs from the adds and process deleted chunks.
-  SBProcessSubs(&add_prefixes, &sub_prefixes,
-                &add_full_hashes, &sub_full_hashes,
-                add_del_cache_, sub_del_cache_);
-
   // We no longer need to track deleted chunks.
   DeleteChunksFromSet(add_del_cache_, &add_chunks_cache_);
   DeleteChunksFromSet(sub_del_cache_, &sub_chunks_cache_);
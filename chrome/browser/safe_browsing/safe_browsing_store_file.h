@@ -53,6 +53,11 @@
 // }
 // MD5Digest checksum;      // Checksum over preceeding data.
 //
+// The chunk id arrays are in increasing order.  The prefix arrays are
+// ordered by SBAddPrefixLess() and the hash arrays by
+// SBAddPrefixHashLess(), which is the order SBProcessSubs() leaves
+// them in.
+//
 // During the course of an update, uncommitted data is stored in a
 // temporary file (which is later re-used to commit).  This is an
 // array of chunks, with the count kept in memory until the end of the
@@ -90,8 +95,10 @@
 // - Open a temp file for storing new chunk info.
 // - Write new chunks to the temp file.
 // - When the transaction is finished:
-//   - Read the rest of the original file's data into buffers.
-//   - Rewind the temp file and merge the new data into buffers.
+//   - Rewind the temp file, read the new data into buffers and sort
+//     them.
+//   - Stream the rest of the original file's data in, merging the
+//     sorted new data into it.
 //   - Process buffers for deletions and apply subs.
 //   - Rewind and write the buffers out to temp file.
 //   - Delete original file.
@@ -7,6 +7,9 @@
 #include "base/bind.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/md5.h"
+#include "base/rand_util.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
 #include "chrome/browser/safe_browsing/safe_browsing_store_unittest_helper.h"
 #include "testing/gtest/include/gtest/gtest.h"
 #include "testing/platform_test.h"
@@ -187,4 +190,148 @@ TEST_F(SafeBrowsingStoreFileTest, CheckValidityChecksum) {
   EXPECT_TRUE(store_->CancelUpdate());
 }
 
+// Test that updates are merged into the sorted data from previous
+// updates, with subs from either side knocking out adds from either
+// side.
+TEST_F(SafeBrowsingStoreFileTest, MergeUpdates) {
+  const SBPrefix kPrefix1 = 10;
+  const SBPrefix kPrefix2 = 20;
+  const SBPrefix kPrefix3 = 30;
+  const SBPrefix kPrefix4 = 40;
+  const SBPrefix kPrefix5 = 50;
+
+  std::vector<SBAddFullHash> pending_adds;
+  SBAddPrefixes add_prefixes;
+  std::vector<SBAddFullHash> add_hashes;
+
+  // Write out of order, and include a sub for an add not yet seen.
+  ASSERT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->BeginChunk());
+  store_->SetAddChunk(3);
+  EXPECT_TRUE(store_->WriteAddPrefix(3, kPrefix2));
+  EXPECT_TRUE(store_->FinishChunk());
+  EXPECT_TRUE(store_->BeginChunk());
+  store_->SetAddChunk(1);
+  EXPECT_TRUE(store_->WriteAddPrefix(1, kPrefix3));
+  EXPECT_TRUE(store_->WriteAddPrefix(1, kPrefix1));
+  store_->SetSubChunk(2);
+  EXPECT_TRUE(store_->WriteSubPrefix(2, 5, kPrefix4));
+  EXPECT_TRUE(store_->FinishChunk());
+  ASSERT_TRUE(store_->FinishUpdate(pending_adds, &add_prefixes, &add_hashes));
+
+  ASSERT_EQ(3U, add_prefixes.size());
+  EXPECT_EQ(1, add_prefixes[0].chunk_id);
+  EXPECT_EQ(kPrefix1, add_prefixes[0].prefix);
+  EXPECT_EQ(1, add_prefixes[1].chunk_id);
+  EXPECT_EQ(kPrefix3, add_prefixes[1].prefix);
+  EXPECT_EQ(3, add_prefixes[2].chunk_id);
+  EXPECT_EQ(kPrefix2, add_prefixes[2].prefix);
+
+  // Interleave new adds with the stored ones, knock out a stored add,
+  // and add the item the stored sub refers to.
+  ASSERT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->BeginChunk());
+  store_->SetAddChunk(2);
+  EXPECT_TRUE(store_->WriteAddPrefix(2, kPrefix5));
+  EXPECT_TRUE(store_->WriteAddPrefix(2, kPrefix1));
+  store_->SetAddChunk(5);
+  EXPECT_TRUE(store_->WriteAddPrefix(5, kPrefix4));
+  store_->SetSubChunk(4);
+  EXPECT_TRUE(store_->WriteSubPrefix(4, 3, kPrefix2));
+  EXPECT_TRUE(store_->FinishChunk());
+  ASSERT_TRUE(store_->FinishUpdate(pending_adds, &add_prefixes, &add_hashes));
+
+  ASSERT_EQ(4U, add_prefixes.size());
+  EXPECT_EQ(1, add_prefixes[0].chunk_id);
+  EXPECT_EQ(kPrefix1, add_prefixes[0].prefix);
+  EXPECT_EQ(1, add_prefixes[1].chunk_id);
+  EXPECT_EQ(kPrefix3, add_prefixes[1].prefix);
+  EXPECT_EQ(2, add_prefixes[2].chunk_id);
+  EXPECT_EQ(kPrefix1, add_prefixes[2].prefix);
+  EXPECT_EQ(2, add_prefixes[3].chunk_id);
+  EXPECT_EQ(kPrefix5, add_prefixes[3].prefix);
+
+  // An empty update reproduces the same data from the file.
+  SBAddPrefixes reread_prefixes;
+  ASSERT_TRUE(store_->BeginUpdate());
+  ASSERT_TRUE(store_->FinishUpdate(pending_adds, &reread_prefixes,
+                                   &add_hashes));
+  ASSERT_EQ(add_prefixes.size(), reread_prefixes.size());
+  for (size_t i = 0; i < add_prefixes.size(); ++i) {
+    EXPECT_EQ(add_prefixes[i].chunk_id, reread_prefixes[i].chunk_id);
+    EXPECT_EQ(add_prefixes[i].prefix, reread_prefixes[i].prefix);
+  }
+  EXPECT_FALSE(corruption_detected_);
+}
+
+// Times a small update against a full-size database, and compares it
+// with sorting and processing the entire database, which is what each
+// update used to cost on top of the file I/O.
+TEST_F(SafeBrowsingStoreFileTest, DISABLED_UpdatePerf) {
+  const int kChunkCount = 2000;
+  const int kPrefixesPerChunk = 500;
+  const int kSubCount = 50;
+
+  std::vector<SBAddFullHash> pending_adds;
+  SBAddPrefixes add_prefixes;
+  std::vector<SBAddFullHash> add_hashes;
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  ASSERT_TRUE(store_->BeginUpdate());
+  for (int chunk_id = 1; chunk_id <= kChunkCount; ++chunk_id) {
+    ASSERT_TRUE(store_->BeginChunk());
+    store_->SetAddChunk(chunk_id);
+    for (int i = 0; i < kPrefixesPerChunk; ++i) {
+      ASSERT_TRUE(store_->WriteAddPrefix(
+          chunk_id, static_cast<SBPrefix>(base::RandUint64())));
+    }
+    ASSERT_TRUE(store_->FinishChunk());
+  }
+  ASSERT_TRUE(store_->FinishUpdate(pending_adds, &add_prefixes, &add_hashes));
+  base::TimeDelta build_time = base::TimeTicks::Now() - start;
+
+  // One new add chunk and one sub chunk knocking out existing adds.
+  start = base::TimeTicks::Now();
+  ASSERT_TRUE(store_->BeginUpdate());
+  ASSERT_TRUE(store_->BeginChunk());
+  store_->SetAddChunk(kChunkCount + 1);
+  for (int i = 0; i < kPrefixesPerChunk; ++i) {
+    ASSERT_TRUE(store_->WriteAddPrefix(
+        kChunkCount + 1, static_cast<SBPrefix>(base::RandUint64())));
+  }
+  store_->SetSubChunk(1);
+  for (int i = 0; i < kSubCount; ++i) {
+    const SBAddPrefix& add =
+        add_prefixes[base::RandInt(0, add_prefixes.size() - 1)];
+    ASSERT_TRUE(store_->WriteSubPrefix(1, add.chunk_id, add.prefix));
+  }
+  ASSERT_TRUE(store_->FinishChunk());
+  SBAddPrefixes updated_prefixes;
+  ASSERT_TRUE(store_->FinishUpdate(pending_adds, &updated_prefixes,
+                                   &add_hashes));
+  base::TimeDelta update_time = base::TimeTicks::Now() - start;
+  EXPECT_GE(updated_prefixes.size(),
+            add_prefixes.size() + kPrefixesPerChunk - kSubCount);
+
+  // The sorting and processing cost of the same update when the new
+  // data is simply appended to the old.
+  for (int i = 0; i < kPrefixesPerChunk; ++i) {
+    add_prefixes.push_back(SBAddPrefix(
+        kChunkCount + 1, static_cast<SBPrefix>(base::RandUint64())));
+  }
+  SBSubPrefixes sub_prefixes;
+  std::vector<SBSubFullHash> sub_hashes;
+  start = base::TimeTicks::Now();
+  SBProcessSubs(&add_prefixes, &sub_prefixes, &add_hashes, &sub_hashes,
+                base::hash_set<int32>(), base::hash_set<int32>());
+  base::TimeDelta process_time = base::TimeTicks::Now() - start;
+
+  LOG(INFO) << base::StringPrintf(
+      "%d prefixes: built in %.2f ms, small update %.2f ms, "
+      "full sort and process %.2f ms",
+      static_cast<int>(updated_prefixes.size()),
+      build_time.InMillisecondsF(), update_time.InMillisecondsF(),
+      process_time.InMillisecondsF());
+}
+
 }  // namespace
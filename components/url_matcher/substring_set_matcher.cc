@@ -8,45 +8,17 @@
 #include <queue>
 
 #include "base/logging.h"
-#include "base/stl_util.h"
 
 namespace url_matcher {
 
 namespace {
 
-// Compare StringPattern instances based on their string patterns.
-bool ComparePatterns(const StringPattern* a, const StringPattern* b) {
-  return a->pattern() < b->pattern();
-}
+// Edge lists up to this length are scanned linearly, longer ones are binary
+// searched.
+const size_t kMaxLinearEdgeSearch = 8;
 
-// Given the set of patterns, compute how many nodes will the corresponding
-// Aho-Corasick tree have. Note that |patterns| need to be sorted.
-uint32 TreeSize(const std::vector<const StringPattern*>& patterns) {
-  uint32 result = 1u;  // 1 for the root node.
-  if (patterns.empty())
-    return result;
-
-  std::vector<const StringPattern*>::const_iterator last = patterns.begin();
-  std::vector<const StringPattern*>::const_iterator current = last + 1;
-  // For the first pattern, each letter is a label of an edge to a new node.
-  result += (*last)->pattern().size();
-
-  // For the subsequent patterns, only count the edges which were not counted
-  // yet. For this it suffices to test against the previous pattern, because the
-  // patterns are sorted.
-  for (; current != patterns.end(); ++last, ++current) {
-    const std::string& last_pattern = (*last)->pattern();
-    const std::string& current_pattern = (*current)->pattern();
-    const uint32 prefix_bound =
-        std::min(last_pattern.size(), current_pattern.size());
-
-    uint32 common_prefix = 0;
-    while (common_prefix < prefix_bound &&
-           last_pattern[common_prefix] == current_pattern[common_prefix])
-      ++common_prefix;
-    result += current_pattern.size() - common_prefix;
-  }
-  return result;
+bool CompareEdgeLabel(const std::pair<char, uint32>& edge, char c) {
+  return edge.first < c;
 }
 
 }  // namespace
@@ -55,8 +27,11 @@ uint32 TreeSize(const std::vector<const StringPattern*>& patterns) {
 // SubstringSetMatcher
 //
 
-SubstringSetMatcher::SubstringSetMatcher() {
-  RebuildAhoCorasickTree(SubstringPatternVector());
+SubstringSetMatcher::SubstringSetMatcher()
+    : tree_(1),
+      root_edges_(256, AhoCorasickNode::kNoSuchEdge),
+      label_lists_(256, AhoCorasickNode::kNoSuchEdge) {
+  tree_[0].set_failure(0);
 }
 
 SubstringSetMatcher::~SubstringSetMatcher() {}
@@ -76,34 +51,72 @@ void SubstringSetMatcher::UnregisterPatterns(
 void SubstringSetMatcher::RegisterAndUnregisterPatterns(
       const std::vector<const StringPattern*>& to_register,
       const std::vector<const StringPattern*>& to_unregister) {
+  if (to_register.empty() && to_unregister.empty())
+    return;
+
+  // Nodes which gained their first or lost their last match.
+  std::set<uint32> toggled;
+
+  // Unregister patterns first so that their nodes can be reused.
+  std::vector<uint32> orphans;
+  for (std::vector<const StringPattern*>::const_iterator i =
+      to_unregister.begin(); i != to_unregister.end(); ++i) {
+    SubstringPatternMap::iterator pattern = patterns_.find((*i)->id());
+    if (pattern == patterns_.end())
+      continue;
+    RemovePatternFromAhoCorasickTree(pattern->second, &orphans, &toggled);
+    patterns_.erase(pattern);
+  }
+
+  // Relink the nodes whose failure edges led to pruned nodes before new
+  // nodes are looked up through the failure edges.
+  if (!orphans.empty())
+    UpdateEdges(orphans, std::set<uint32>());
+
   // Register patterns.
+  std::vector<uint32> new_subtrees;
+  size_t new_nodes = 0;
   for (std::vector<const StringPattern*>::const_iterator i =
       to_register.begin(); i != to_register.end(); ++i) {
     DCHECK(patterns_.find((*i)->id()) == patterns_.end());
     patterns_[(*i)->id()] = *i;
+    new_nodes += InsertPatternIntoAhoCorasickTree(*i, &new_subtrees, &toggled);
   }
 
-  // Unregister patterns
-  for (std::vector<const StringPattern*>::const_iterator i =
-      to_unregister.begin(); i != to_unregister.end(); ++i) {
-    patterns_.erase((*i)->id());
+  if (patterns_.empty()) {
+    // Release everything so that the matcher is back to its initial state.
+    std::vector<AhoCorasickNode>(1).swap(tree_);
+    tree_[0].set_failure(0);
+    std::vector<uint32>().swap(free_nodes_);
+    std::fill(root_edges_.begin(), root_edges_.end(),
+              AhoCorasickNode::kNoSuchEdge);
+    std::fill(label_lists_.begin(), label_lists_.end(),
+              AhoCorasickNode::kNoSuchEdge);
+    return;
   }
 
-  // Now we compute the total number of tree nodes needed.
-  SubstringPatternVector sorted_patterns;
-  sorted_patterns.resize(patterns_.size());
-
-  size_t next = 0;
-  for (SubstringPatternMap::const_iterator i = patterns_.begin();
-       i != patterns_.end();
-       ++i, ++next) {
-    sorted_patterns[next] = i->second;
+  // Once much of the tree is new, such as on the first registration,
+  // recomputing every edge breadth first is cheaper than finding the ones
+  // which changed.
+  const size_t live_nodes = tree_.size() - free_nodes_.size();
+  if (new_nodes > live_nodes / 4) {
+    RebuildEdges();
+    return;
   }
 
-  std::sort(sorted_patterns.begin(), sorted_patterns.end(), ComparePatterns);
-  tree_.reserve(TreeSize(sorted_patterns));
-
-  RebuildAhoCorasickTree(sorted_patterns);
+  // A node's failure edge can only change if one of the new nodes is a suffix
+  // of its path, which is what CollectFailureDependents() looks for.
+  std::set<uint32> dependents;
+  size_t budget = live_nodes;
+  for (std::vector<uint32>::const_iterator i = new_subtrees.begin();
+       i != new_subtrees.end(); ++i) {
+    if (!CollectFailureDependents(*i, &budget, &dependents)) {
+      RebuildEdges();
+      return;
+    }
+  }
+  UpdateEdges(std::vector<uint32>(dependents.begin(), dependents.end()),
+              toggled);
 }
 
 bool SubstringSetMatcher::Match(const std::string& text,
@@ -115,16 +128,24 @@ bool SubstringSetMatcher::Match(const std::string& text,
 
   uint32 current_node = 0;
   for (std::string::const_iterator i = text.begin(); i != text.end(); ++i) {
-    uint32 edge_from_current = tree_[current_node].GetEdge(*i);
+    uint32 edge_from_current = GetEdge(current_node, *i);
     while (edge_from_current == AhoCorasickNode::kNoSuchEdge &&
            current_node != 0) {
       current_node = tree_[current_node].failure();
-      edge_from_current = tree_[current_node].GetEdge(*i);
+      edge_from_current = GetEdge(current_node, *i);
     }
     if (edge_from_current != AhoCorasickNode::kNoSuchEdge) {
       current_node = edge_from_current;
-      matches->insert(tree_[current_node].matches().begin(),
-                      tree_[current_node].matches().end());
+      // Report the patterns ending here, then those which are suffixes of the
+      // text matched so far.
+      uint32 output = current_node;
+      if (tree_[output].matches().empty())
+        output = tree_[output].output();
+      while (output != AhoCorasickNode::kNoSuchEdge) {
+        const AhoCorasickNode::Matches& node_matches = tree_[output].matches();
+        matches->insert(node_matches.begin(), node_matches.end());
+        output = tree_[output].output();
+      }
     } else {
       DCHECK_EQ(0u, current_node);
     }
@@ -138,27 +159,67 @@ bool SubstringSetMatcher::IsEmpty() const {
   return patterns_.empty() && tree_.size() == 1u;
 }
 
-void SubstringSetMatcher::RebuildAhoCorasickTree(
-    const SubstringPatternVector& sorted_patterns) {
-  tree_.clear();
+void SubstringSetMatcher::SetEdge(uint32 from, char c, uint32 to) {
+  tree_[from].SetEdge(c, to);
+  if (from == 0)
+    root_edges_[static_cast<unsigned char>(c)] = to;
+}
+
+void SubstringSetMatcher::LinkLabel(uint32 node) {
+  uint32& head = label_lists_[static_cast<unsigned char>(tree_[node].label())];
+  tree_[node].set_next_with_label(head);
+  if (head != AhoCorasickNode::kNoSuchEdge)
+    tree_[head].set_prev_with_label(node);
+  head = node;
+}
 
-  // Initialize root note of tree.
-  AhoCorasickNode root;
-  root.set_failure(0);
-  tree_.push_back(root);
+void SubstringSetMatcher::UnlinkLabel(uint32 node) {
+  const uint32 prev = tree_[node].prev_with_label();
+  const uint32 next = tree_[node].next_with_label();
+  if (prev != AhoCorasickNode::kNoSuchEdge)
+    tree_[prev].set_next_with_label(next);
+  else
+    label_lists_[static_cast<unsigned char>(tree_[node].label())] = next;
+  if (next != AhoCorasickNode::kNoSuchEdge)
+    tree_[next].set_prev_with_label(prev);
+}
 
-  // Insert all patterns.
-  for (SubstringPatternVector::const_iterator i = sorted_patterns.begin();
-       i != sorted_patterns.end();
-       ++i) {
-    InsertPatternIntoAhoCorasickTree(*i);
+void SubstringSetMatcher::SetFailure(uint32 node, uint32 failure) {
+  DCHECK_NE(0u, node);
+  AhoCorasickNode& current_node = tree_[node];
+  const uint32 old_failure = current_node.failure();
+  if (old_failure == failure)
+    return;
+
+  // Unlink from the old failure node's list...
+  if (old_failure != AhoCorasickNode::kNoSuchEdge) {
+    const uint32 prev = current_node.prev_failure_sibling();
+    const uint32 next = current_node.next_failure_sibling();
+    if (prev != AhoCorasickNode::kNoSuchEdge)
+      tree_[prev].set_next_failure_sibling(next);
+    else
+      tree_[old_failure].set_first_failure_child(next);
+    if (next != AhoCorasickNode::kNoSuchEdge)
+      tree_[next].set_prev_failure_sibling(prev);
+    current_node.set_prev_failure_sibling(AhoCorasickNode::kNoSuchEdge);
+    current_node.set_next_failure_sibling(AhoCorasickNode::kNoSuchEdge);
   }
 
-  CreateFailureEdges();
+  // ...and link to the front of the new one's.
+  current_node.set_failure(failure);
+  if (failure != AhoCorasickNode::kNoSuchEdge) {
+    const uint32 next = tree_[failure].first_failure_child();
+    current_node.set_next_failure_sibling(next);
+    if (next != AhoCorasickNode::kNoSuchEdge)
+      tree_[next].set_prev_failure_sibling(node);
+    tree_[failure].set_first_failure_child(node);
+  }
 }
 
-void SubstringSetMatcher::InsertPatternIntoAhoCorasickTree(
-    const StringPattern* pattern) {
+size_t SubstringSetMatcher::InsertPatternIntoAhoCorasickTree(
+    const StringPattern* pattern,
+    std::vector<uint32>* new_subtrees,
+    std::set<uint32>* toggled) {
   const std::string& text = pattern->pattern();
   const std::string::const_iterator text_end = text.end();
 
@@ -168,63 +229,250 @@ void SubstringSetMatcher::InsertPatternIntoAhoCorasickTree(
 
   // Follow existing paths for as long as possible.
   while (i != text_end) {
-    uint32 edge_from_current = tree_[current_node].GetEdge(*i);
+    uint32 edge_from_current = GetEdge(current_node, *i);
     if (edge_from_current == AhoCorasickNode::kNoSuchEdge)
       break;
     current_node = edge_from_current;
     ++i;
   }
 
-  // Create new nodes if necessary.
+  // Create new nodes if necessary, reusing pruned ones first.
+  const size_t new_nodes = text_end - i;
+  if (i != text_end)
+    new_subtrees->push_back(free_nodes_.empty() ? tree_.size()
+                                                : free_nodes_.back());
   while (i != text_end) {
-    tree_.push_back(AhoCorasickNode());
-    tree_[current_node].SetEdge(*i, tree_.size() - 1);
-    current_node = tree_.size() - 1;
+    uint32 new_node;
+    if (free_nodes_.empty()) {
+      new_node = tree_.size();
+      tree_.push_back(AhoCorasickNode());
+    } else {
+      new_node = free_nodes_.back();
+      free_nodes_.pop_back();
+      tree_[new_node] = AhoCorasickNode();
+    }
+    tree_[new_node].SetParent(current_node, *i,
+                              tree_[current_node].depth() + 1);
+    LinkLabel(new_node);
+    SetEdge(current_node, *i, new_node);
+    current_node = new_node;
     ++i;
   }
 
   // Register match.
+  if (tree_[current_node].matches().empty())
+    toggled->insert(current_node);
   tree_[current_node].AddMatch(pattern->id());
+  return new_nodes;
+}
+
+void SubstringSetMatcher::RemovePatternFromAhoCorasickTree(
+    const StringPattern* pattern,
+    std::vector<uint32>* orphans,
+    std::set<uint32>* toggled) {
+  const std::string& text = pattern->pattern();
+
+  // Record the path to the pattern's node.
+  std::vector<uint32> path(1, 0u);
+  path.reserve(text.size() + 1);
+  for (std::string::const_iterator i = text.begin(); i != text.end(); ++i) {
+    uint32 edge_from_current = GetEdge(path.back(), *i);
+    DCHECK_NE(AhoCorasickNode::kNoSuchEdge, edge_from_current);
+    if (edge_from_current == AhoCorasickNode::kNoSuchEdge)
+      return;
+    path.push_back(edge_from_current);
+  }
+  tree_[path.back()].RemoveMatch(pattern->id());
+  if (tree_[path.back()].matches().empty())
+    toggled->insert(path.back());
+
+  // Prune the nodes which now neither match nor lead anywhere, bottom up.
+  for (size_t depth = text.size(); depth > 0; --depth) {
+    uint32 node = path[depth];
+    if (!tree_[node].matches().empty() || !tree_[node].edges().empty())
+      break;
+
+    // Nodes whose failure edges led here have to be relinked.
+    uint32 orphan = tree_[node].first_failure_child();
+    while (orphan != AhoCorasickNode::kNoSuchEdge) {
+      const uint32 next = tree_[orphan].next_failure_sibling();
+      SetFailure(orphan, AhoCorasickNode::kNoSuchEdge);
+      orphans->push_back(orphan);
+      orphan = next;
+    }
+    SetFailure(node, AhoCorasickNode::kNoSuchEdge);
+    UnlinkLabel(node);
+
+    uint32 parent = path[depth - 1];
+    tree_[parent].RemoveEdge(text[depth - 1]);
+    if (parent == 0) {
+      root_edges_[static_cast<unsigned char>(text[depth - 1])] =
+          AhoCorasickNode::kNoSuchEdge;
+    }
+    tree_[node] = AhoCorasickNode();
+    free_nodes_.push_back(node);
+  }
 }
 
-void SubstringSetMatcher::CreateFailureEdges() {
+bool SubstringSetMatcher::CollectFailureDependents(uint32 new_subtree,
+                                                   size_t* budget,
+                                                   std::set<uint32>* nodes) {
+  CollectSubtree(new_subtree, nodes);
+
+  const uint32 parent = tree_[new_subtree].parent();
+  const char label = tree_[new_subtree].label();
+  if (parent == 0) {
+    for (uint32 node = label_lists_[static_cast<unsigned char>(label)];
+         node != AhoCorasickNode::kNoSuchEdge;
+         node = tree_[node].next_with_label()) {
+      if (*budget == 0)
+        return false;
+      --*budget;
+      CollectSubtree(node, nodes);
+    }
+    return true;
+  }
+
+  // Paths having the new subtree's parent as a suffix are exactly the nodes
+  // reachable from it backwards over failure edges.
+  std::vector<uint32> stack;
+  for (uint32 child = tree_[parent].first_failure_child();
+       child != AhoCorasickNode::kNoSuchEdge;
+       child = tree_[child].next_failure_sibling()) {
+    stack.push_back(child);
+  }
+  while (!stack.empty()) {
+    if (*budget == 0)
+      return false;
+    --*budget;
+    const uint32 node = stack.back();
+    stack.pop_back();
+    const uint32 edge = GetEdge(node, label);
+    if (edge != AhoCorasickNode::kNoSuchEdge)
+      CollectSubtree(edge, nodes);
+    for (uint32 child = tree_[node].first_failure_child();
+         child != AhoCorasickNode::kNoSuchEdge;
+         child = tree_[child].next_failure_sibling()) {
+      stack.push_back(child);
+    }
+  }
+  return true;
+}
+
+void SubstringSetMatcher::CollectSubtree(uint32 node,
+                                         std::set<uint32>* nodes) {
   typedef AhoCorasickNode::Edges Edges;
 
-  std::queue<uint32> queue;
+  std::vector<uint32> stack(1, node);
+  while (!stack.empty()) {
+    const uint32 current = stack.back();
+    stack.pop_back();
+    // A node already collected was collected along with its subtree.
+    if (!nodes->insert(current).second)
+      continue;
+    const Edges& edges = tree_[current].edges();
+    for (Edges::const_iterator e = edges.begin(); e != edges.end(); ++e)
+      stack.push_back(e->second);
+  }
+}
+
+void SubstringSetMatcher::UpdateEdges(const std::vector<uint32>& nodes,
+                                      const std::set<uint32>& toggled) {
+  // Failure and output edges lead to shallower nodes, so visiting nodes by
+  // depth sees every edge before it is followed.
+  std::vector<std::pair<uint32, uint32> > by_depth;
+  by_depth.reserve(nodes.size() + toggled.size());
+  for (std::vector<uint32>::const_iterator i = nodes.begin();
+       i != nodes.end(); ++i) {
+    if (!IsFree(*i))
+      by_depth.push_back(std::make_pair(tree_[*i].depth(), *i));
+  }
+  const size_t number_of_nodes = by_depth.size();
+  std::sort(by_depth.begin(), by_depth.end());
 
-  AhoCorasickNode& root = tree_[0];
-  root.set_failure(0);
-  const Edges& root_edges = root.edges();
-  for (Edges::const_iterator e = root_edges.begin(); e != root_edges.end();
-       ++e) {
-    const uint32& leads_to = e->second;
-    tree_[leads_to].set_failure(0);
-    queue.push(leads_to);
+  for (size_t i = 0; i < number_of_nodes; ++i) {
+    const uint32 node = by_depth[i].second;
+    SetFailure(node, FindFailure(node));
   }
 
+  // A node's output edge depends on its failure node's matches and output
+  // edge, so changes to either spread down the failure tree.
+  for (std::set<uint32>::const_iterator i = toggled.begin();
+       i != toggled.end(); ++i) {
+    if (!IsFree(*i))
+      by_depth.push_back(std::make_pair(tree_[*i].depth(), *i));
+  }
+  std::sort(by_depth.begin(), by_depth.end());
+  by_depth.erase(std::unique(by_depth.begin(), by_depth.end()),
+                 by_depth.end());
+  for (size_t i = 0; i < by_depth.size(); ++i) {
+    const uint32 node = by_depth[i].second;
+    const bool output_changed = node != 0 && UpdateOutputEdge(node);
+    if ((output_changed && tree_[node].matches().empty()) ||
+        toggled.count(node)) {
+      PropagateOutputEdges(node);
+    }
+  }
+}
+
+void SubstringSetMatcher::RebuildEdges() {
+  typedef AhoCorasickNode::Edges Edges;
+
+  // Visiting nodes breadth first sees every failure node's edges before they
+  // are needed.
+  std::queue<uint32> queue;
+  queue.push(0);
   while (!queue.empty()) {
-    AhoCorasickNode& current_node = tree_[queue.front()];
+    const uint32 node = queue.front();
     queue.pop();
-    for (Edges::const_iterator e = current_node.edges().begin();
-         e != current_node.edges().end(); ++e) {
-      const char& edge_label = e->first;
-      const uint32& leads_to = e->second;
-      queue.push(leads_to);
-
-      uint32 failure = current_node.failure();
-      uint32 edge_from_failure = tree_[failure].GetEdge(edge_label);
-      while (edge_from_failure == AhoCorasickNode::kNoSuchEdge &&
-             failure != 0) {
-        failure = tree_[failure].failure();
-        edge_from_failure = tree_[failure].GetEdge(edge_label);
-      }
+    const Edges& edges = tree_[node].edges();
+    for (Edges::const_iterator e = edges.begin(); e != edges.end(); ++e)
+      queue.push(e->second);
+    if (node != 0) {
+      SetFailure(node, FindFailure(node));
+      UpdateOutputEdge(node);
+    }
+  }
+}
+
+uint32 SubstringSetMatcher::FindFailure(uint32 node) const {
+  const uint32 parent = tree_[node].parent();
+  if (parent == 0)
+    return 0;
+  const char label = tree_[node].label();
+  uint32 failure = tree_[parent].failure();
+  uint32 edge_from_failure = GetEdge(failure, label);
+  while (edge_from_failure == AhoCorasickNode::kNoSuchEdge && failure != 0) {
+    failure = tree_[failure].failure();
+    edge_from_failure = GetEdge(failure, label);
+  }
+  return edge_from_failure != AhoCorasickNode::kNoSuchEdge ? edge_from_failure
+                                                           : 0;
+}
 
-      const uint32 follow_in_case_of_failure =
-          edge_from_failure != AhoCorasickNode::kNoSuchEdge
-              ? edge_from_failure
-              : 0;
-      tree_[leads_to].set_failure(follow_in_case_of_failure);
-      tree_[leads_to].AddMatches(tree_[follow_in_case_of_failure].matches());
+bool SubstringSetMatcher::UpdateOutputEdge(uint32 node) {
+  const uint32 failure = tree_[node].failure();
+  uint32 output = AhoCorasickNode::kNoSuchEdge;
+  if (failure != 0)
+    output = tree_[failure].matches().empty() ? tree_[failure].output()
+                                              : failure;
+  if (tree_[node].output() == output)
+    return false;
+  tree_[node].set_output(output);
+  return true;
+}
+
+void SubstringSetMatcher::PropagateOutputEdges(uint32 node) {
+  std::vector<uint32> stack(1, node);
+  while (!stack.empty()) {
+    const uint32 current = stack.back();
+    stack.pop_back();
+    for (uint32 child = tree_[current].first_failure_child();
+         child != AhoCorasickNode::kNoSuchEdge;
+         child = tree_[child].next_failure_sibling()) {
+      // Nodes with matches of their own are the output of those below them.
+      if (UpdateOutputEdge(child) && tree_[child].matches().empty())
+        stack.push_back(child);
     }
   }
 }
@@ -232,41 +480,98 @@ void SubstringSetMatcher::CreateFailureEdges() {
 const uint32 SubstringSetMatcher::AhoCorasickNode::kNoSuchEdge = ~0;
 
 SubstringSetMatcher::AhoCorasickNode::AhoCorasickNode()
-    : failure_(kNoSuchEdge) {}
+    : parent_(kNoSuchEdge),
+      depth_(0),
+      label_(0),
+      failure_(kNoSuchEdge),
+      first_failure_child_(kNoSuchEdge),
+      next_failure_sibling_(kNoSuchEdge),
+      prev_failure_sibling_(kNoSuchEdge),
+      next_with_label_(kNoSuchEdge),
+      prev_with_label_(kNoSuchEdge),
+      output_(kNoSuchEdge) {}
 
 SubstringSetMatcher::AhoCorasickNode::~AhoCorasickNode() {}
 
 SubstringSetMatcher::AhoCorasickNode::AhoCorasickNode(
     const SubstringSetMatcher::AhoCorasickNode& other)
     : edges_(other.edges_),
+      parent_(other.parent_),
+      depth_(other.depth_),
+      label_(other.label_),
       failure_(other.failure_),
+      first_failure_child_(other.first_failure_child_),
+      next_failure_sibling_(other.next_failure_sibling_),
+      prev_failure_sibling_(other.prev_failure_sibling_),
+      next_with_label_(other.next_with_label_),
+      prev_with_label_(other.prev_with_label_),
+      output_(other.output_),
       matches_(other.matches_) {}
 
 SubstringSetMatcher::AhoCorasickNode&
 SubstringSetMatcher::AhoCorasickNode::operator=(
     const SubstringSetMatcher::AhoCorasickNode& other) {
   edges_ = other.edges_;
+  parent_ = other.parent_;
+  depth_ = other.depth_;
+  label_ = other.label_;
   failure_ = other.failure_;
+  first_failure_child_ = other.first_failure_child_;
+  next_failure_sibling_ = other.next_failure_sibling_;
+  prev_failure_sibling_ = other.prev_failure_sibling_;
+  next_with_label_ = other.next_with_label_;
+  prev_with_label_ = other.prev_with_label_;
+  output_ = other.output_;
   matches_ = other.matches_;
   return *this;
 }
 
 uint32 SubstringSetMatcher::AhoCorasickNode::GetEdge(char c) const {
-  Edges::const_iterator i = edges_.find(c);
-  return i == edges_.end() ? kNoSuchEdge : i->second;
+  if (edges_.size() <= kMaxLinearEdgeSearch) {
+    for (Edges::const_iterator i = edges_.begin(); i != edges_.end(); ++i) {
+      if (i->first == c)
+        return i->second;
+    }
+    return kNoSuchEdge;
+  }
+  Edges::const_iterator i =
+      std::lower_bound(edges_.begin(), edges_.end(), c, CompareEdgeLabel);
+  return (i == edges_.end() || i->first != c) ? kNoSuchEdge : i->second;
+}
+
+void SubstringSetMatcher::AhoCorasickNode::SetParent(uint32 parent,
+                                                     char label,
+                                                     uint32 depth) {
+  parent_ = parent;
+  label_ = label;
+  depth_ = depth;
 }
 
 void SubstringSetMatcher::AhoCorasickNode::SetEdge(char c, uint32 node) {
-  edges_[c] = node;
+  Edges::iterator i =
+      std::lower_bound(edges_.begin(), edges_.end(), c, CompareEdgeLabel);
+  if (i != edges_.end() && i->first == c)
+    i->second = node;
+  else
+    edges_.insert(i, Edge(c, node));
+}
+
+void SubstringSetMatcher::AhoCorasickNode::RemoveEdge(char c) {
+  Edges::iterator i =
+      std::lower_bound(edges_.begin(), edges_.end(), c, CompareEdgeLabel);
+  if (i != edges_.end() && i->first == c)
+    edges_.erase(i);
 }
 
 void SubstringSetMatcher::AhoCorasickNode::AddMatch(StringPattern::ID id) {
-  matches_.insert(id);
+  DCHECK(std::find(matches_.begin(), matches_.end(), id) == matches_.end());
+  matches_.push_back(id);
 }
 
-void SubstringSetMatcher::AhoCorasickNode::AddMatches(
-    const SubstringSetMatcher::AhoCorasickNode::Matches& matches) {
-  matches_.insert(matches.begin(), matches.end());
+void SubstringSetMatcher::AhoCorasickNode::RemoveMatch(StringPattern::ID id) {
+  Matches::iterator i = std::find(matches_.begin(), matches_.end(), id);
+  if (i != matches_.end())
+    matches_.erase(i);
 }
 
 }  // namespace url_matcher
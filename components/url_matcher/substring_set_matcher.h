@@ -79,11 +79,25 @@ class URL_MATCHER_EXPORT SubstringSetMatcher {
   // If your brain thinks "Forget it, let's go shopping.", don't worry.
   // Take a nap and read an introductory text on the Aho Corasick algorithm.
   // It will make sense. Eventually.
+  //
+  // Rather than copying the matches of every node reachable by failure edges
+  // into each node, a node only stores the IDs of patterns ending exactly
+  // there plus an output edge to the closest node along its failure edges
+  // which has matches of its own. Matching follows the output edges. This
+  // keeps match lists flat and small.
+  //
+  // Each node also lists the nodes whose failure edges lead to it, which
+  // turns the failure edges into a tree. Registering or unregistering
+  // patterns uses it to find the few nodes whose failure or output edges
+  // depend on the nodes added, removed or changed, and recomputes only those.
   class AhoCorasickNode {
    public:
-    // Key: label of the edge, value: node index in |tree_| of parent class.
-    typedef std::map<char, uint32> Edges;
-    typedef std::set<StringPattern::ID> Matches;
+    // An edge label and the index in |tree_| of the node it leads to.
+    typedef std::pair<char, uint32> Edge;
+    // Edges sorted by label.
+    typedef std::vector<Edge> Edges;
+    // Identifiers of the patterns ending at this node, unsorted.
+    typedef std::vector<StringPattern::ID> Matches;
 
     static const uint32 kNoSuchEdge;  // Represents an invalid node index.
 
@@ -94,44 +108,159 @@ class URL_MATCHER_EXPORT SubstringSetMatcher {
 
     uint32 GetEdge(char c) const;
     void SetEdge(char c, uint32 node);
+    void RemoveEdge(char c);
     const Edges& edges() const { return edges_; }
 
+    // The node's parent in the trie, the label of the edge from it and the
+    // length of the node's path from the root. The root and free nodes have
+    // no parent.
+    uint32 parent() const { return parent_; }
+    char label() const { return label_; }
+    uint32 depth() const { return depth_; }
+    void SetParent(uint32 parent, char label, uint32 depth);
+
     uint32 failure() const { return failure_; }
     void set_failure(uint32 failure) { failure_ = failure; }
 
+    // Links of the list of nodes whose failure edges lead to the same node.
+    uint32 first_failure_child() const { return first_failure_child_; }
+    void set_first_failure_child(uint32 node) { first_failure_child_ = node; }
+    uint32 next_failure_sibling() const { return next_failure_sibling_; }
+    void set_next_failure_sibling(uint32 node) { next_failure_sibling_ = node; }
+    uint32 prev_failure_sibling() const { return prev_failure_sibling_; }
+    void set_prev_failure_sibling(uint32 node) { prev_failure_sibling_ = node; }
+
+    // Links of the list of nodes with the same label.
+    uint32 next_with_label() const { return next_with_label_; }
+    void set_next_with_label(uint32 node) { next_with_label_ = node; }
+    uint32 prev_with_label() const { return prev_with_label_; }
+    void set_prev_with_label(uint32 node) { prev_with_label_ = node; }
+
+    uint32 output() const { return output_; }
+    void set_output(uint32 output) { output_ = output; }
+
     void AddMatch(StringPattern::ID id);
-    void AddMatches(const Matches& matches);
+    void RemoveMatch(StringPattern::ID id);
     const Matches& matches() const { return matches_; }
 
    private:
     // Outgoing edges of current node.
     Edges edges_;
 
+    uint32 parent_;
+    uint32 depth_;
+    char label_;
+
     // Node index that failure edge leads to.
     uint32 failure_;
 
+    uint32 first_failure_child_;
+    uint32 next_failure_sibling_;
+    uint32 prev_failure_sibling_;
+
+    uint32 next_with_label_;
+    uint32 prev_with_label_;
+
+    // Index of the nearest node other than the root along the failure edges
+    // which has matches, or kNoSuchEdge.
+    uint32 output_;
+
     // Identifiers of matches.
     Matches matches_;
   };
 
   typedef std::map<StringPattern::ID, const StringPattern*> SubstringPatternMap;
-  typedef std::vector<const StringPattern*> SubstringPatternVector;
 
-  // |sorted_patterns| is a copy of |patterns_| sorted by the pattern string.
-  void RebuildAhoCorasickTree(const SubstringPatternVector& sorted_patterns);
+  // Returns the node reached from |node| by an edge labelled |c|, or
+  // kNoSuchEdge. Edges out of the root, which is revisited after every
+  // failed transition, are looked up in the dense |root_edges_| table.
+  uint32 GetEdge(uint32 node, char c) const {
+    return node == 0 ? root_edges_[static_cast<unsigned char>(c)]
+                     : tree_[node].GetEdge(c);
+  }
+
+  // Adds an edge labelled |c| from |from| to |to|.
+  void SetEdge(uint32 from, char c, uint32 to);
+
+  // Returns true if |node| was pruned and awaits reuse.
+  bool IsFree(uint32 node) const {
+    return node != 0 && tree_[node].parent() == AhoCorasickNode::kNoSuchEdge;
+  }
+
+  // Adds |node| to or removes it from the list of nodes with its label.
+  void LinkLabel(uint32 node);
+  void UnlinkLabel(uint32 node);
+
+  // Points the failure edge of |node| to |failure|, or nowhere for
+  // kNoSuchEdge, and moves |node| to the matching list of failure children.
+  void SetFailure(uint32 node, uint32 failure);
 
   // Inserts a path for |pattern->pattern()| into the tree and adds
-  // |pattern->id()| to the set of matches. Ownership of |pattern| remains with
-  // the caller.
-  void InsertPatternIntoAhoCorasickTree(const StringPattern* pattern);
-  void CreateFailureEdges();
+  // |pattern->id()| to the set of matches. Appends the first node added, if
+  // any, to |new_subtrees|, and the pattern's node to |toggled| if this is its
+  // first match. Returns the number of nodes added. Ownership of |pattern|
+  // remains with the caller.
+  size_t InsertPatternIntoAhoCorasickTree(const StringPattern* pattern,
+                                        std::vector<uint32>* new_subtrees,
+                                        std::set<uint32>* toggled);
+
+  // Removes |pattern->id()| from the set of matches and prunes the nodes on
+  // its path which no longer lead to any match. Appends the nodes whose
+  // failure edges led to a pruned node to |orphans|, and the pattern's node to
+  // |toggled| if this was its last match.
+  void RemovePatternFromAhoCorasickTree(const StringPattern* pattern,
+                                        std::vector<uint32>* orphans,
+                                        std::set<uint32>* toggled);
+
+  // Adds to |nodes| the nodes whose failure edges may have to lead into the
+  // subtree just added at |new_subtree|: that subtree itself, and the subtrees
+  // below every node whose path ends with the new subtree's first label and
+  // has the new subtree's parent as a suffix; below the root that is every
+  // node with the new subtree's label. Returns false once more than
+  // |*budget| nodes were searched, leaving |nodes| incomplete.
+  bool CollectFailureDependents(uint32 new_subtree,
+                                size_t* budget,
+                                std::set<uint32>* nodes);
+
+  // Adds |node| and all nodes below it to |nodes|.
+  void CollectSubtree(uint32 node, std::set<uint32>* nodes);
+
+  // Recomputes the failure edges of |nodes|, shallowest first, and then the
+  // output edges which depend on them or on the matches of the |toggled|
+  // nodes.
+  void UpdateEdges(const std::vector<uint32>& nodes,
+                   const std::set<uint32>& toggled);
 
-  // Set of all registered StringPatterns. Used to regenerate the
-  // Aho-Corasick tree in case patterns are registered or unregistered.
+  // Recomputes the failure and output edges of all nodes.
+  void RebuildEdges();
+
+  // Returns the node the failure edge of |node| has to lead to, given correct
+  // failure edges for all shallower nodes.
+  uint32 FindFailure(uint32 node) const;
+
+  // Recomputes the output edge of |node| from its failure edge. Returns true
+  // if it changed.
+  bool UpdateOutputEdge(uint32 node);
+
+  // Recomputes the output edges of the nodes whose failure edges lead to
+  // |node|, and so on down the failure tree for those whose output edges
+  // changed and which have no matches.
+  void PropagateOutputEdges(uint32 node);
+
+  // Set of all registered StringPatterns.
   SubstringPatternMap patterns_;
 
-  // The nodes of a Aho-Corasick tree.
+  // The nodes of a Aho-Corasick tree. Nodes which were pruned are not erased
+  // but listed in |free_nodes_| for reuse.
   std::vector<AhoCorasickNode> tree_;
+  std::vector<uint32> free_nodes_;
+
+  // Dense transition table of the root node, indexed by unsigned label.
+  std::vector<uint32> root_edges_;
+
+  // Heads of the lists of nodes with the same label, indexed by unsigned
+  // label.
+  std::vector<uint32> label_lists_;
 
   DISALLOW_COPY_AND_ASSIGN(SubstringSetMatcher);
 };
@@ -8,6 +8,11 @@
 #include <string>
 #include <vector>
 
+#include "base/logging.h"
+#include "base/memory/scoped_vector.h"
+#include "base/rand_util.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
 namespace url_matcher {
@@ -167,4 +172,196 @@ TEST(SubstringSetMatcherTest, TestEmptyMatcher) {
   EXPECT_TRUE(matches.empty());
 }
 
+namespace {
+
+// Returns a random string of |length| characters from a small alphabet, so
+// that patterns share prefixes and suffixes.
+std::string RandomString(size_t length) {
+  std::string result;
+  for (size_t i = 0; i < length; ++i)
+    result.push_back(static_cast<char>('a' + base::RandInt(0, 3)));
+  return result;
+}
+
+// Returns the IDs of those of |patterns| which occur in |text|.
+std::set<int> FindMatches(const std::string& text,
+                          const std::vector<const StringPattern*>& patterns) {
+  std::set<int> matches;
+  for (size_t i = 0; i < patterns.size(); ++i) {
+    if (text.find(patterns[i]->pattern()) != std::string::npos)
+      matches.insert(patterns[i]->id());
+  }
+  return matches;
+}
+
+}  // namespace
+
+// Registering a pattern has to relink nodes deep below the ones whose failure
+// edges already led elsewhere, here "bacd" to the new "cd".
+TEST(SubstringSetMatcherTest, UpdateDeepFailureEdges) {
+  StringPattern pattern_ac("ac", 1);
+  StringPattern pattern_bacd("bacd", 2);
+  StringPattern pattern_cd("cd", 3);
+  std::vector<const StringPattern*> patterns;
+  patterns.push_back(&pattern_ac);
+  patterns.push_back(&pattern_bacd);
+
+  SubstringSetMatcher matcher;
+  matcher.RegisterPatterns(patterns);
+  matcher.RegisterPatterns(std::vector<const StringPattern*>(1, &pattern_cd));
+
+  std::set<StringPattern::ID> matches;
+  matcher.Match("xbacd", &matches);
+  EXPECT_EQ(3u, matches.size());
+  EXPECT_TRUE(matches.find(3) != matches.end());
+
+  matcher.UnregisterPatterns(std::vector<const StringPattern*>(1, &pattern_ac));
+  matches.clear();
+  matcher.Match("xbacd", &matches);
+  EXPECT_EQ(2u, matches.size());
+  EXPECT_TRUE(matches.find(1) == matches.end());
+}
+
+// Registers and unregisters random patterns in small batches and checks that
+// the incrementally updated matcher agrees with a brute force search.
+TEST(SubstringSetMatcherTest, IncrementalUpdates) {
+  ScopedVector<StringPattern> all_patterns;
+  for (int i = 0; i < 200; ++i)
+    all_patterns.push_back(new StringPattern(RandomString(base::RandInt(0, 6)),
+                                             i));
+  std::vector<std::string> texts;
+  for (int i = 0; i < 20; ++i)
+    texts.push_back(RandomString(base::RandInt(0, 40)));
+
+  SubstringSetMatcher matcher;
+  std::vector<const StringPattern*> registered;
+  std::vector<const StringPattern*> unregistered(all_patterns.begin(),
+                                                 all_patterns.end());
+  for (int round = 0; round < 100; ++round) {
+    std::vector<const StringPattern*> to_register;
+    std::vector<const StringPattern*> to_unregister;
+    for (int i = base::RandInt(0, 5); i > 0 && !unregistered.empty(); --i) {
+      size_t index = base::RandInt(0, unregistered.size() - 1);
+      to_register.push_back(unregistered[index]);
+      unregistered.erase(unregistered.begin() + index);
+    }
+    for (int i = base::RandInt(0, 4); i > 0 && !registered.empty(); --i) {
+      size_t index = base::RandInt(0, registered.size() - 1);
+      to_unregister.push_back(registered[index]);
+      registered.erase(registered.begin() + index);
+    }
+    matcher.RegisterAndUnregisterPatterns(to_register, to_unregister);
+    registered.insert(registered.end(), to_register.begin(),
+                      to_register.end());
+    unregistered.insert(unregistered.end(), to_unregister.begin(),
+                        to_unregister.end());
+
+    for (size_t i = 0; i < texts.size(); ++i) {
+      std::set<int> matches;
+      matcher.Match(texts[i], &matches);
+      EXPECT_EQ(FindMatches(texts[i], registered), matches)
+          << "round " << round << ", text " << texts[i];
+    }
+  }
+
+  matcher.UnregisterPatterns(registered);
+  EXPECT_TRUE(matcher.IsEmpty());
+}
+
+// Measures matching throughput and the latency of small rule updates with
+// tens of thousands of registered patterns.
+TEST(SubstringSetMatcherTest, DISABLED_Perf) {
+  const int kPatternCount = 50000;
+  const int kUpdateCount = 1000;
+  ScopedVector<StringPattern> patterns;
+  std::vector<const StringPattern*> pattern_pointers;
+  for (int i = 0; i < kPatternCount + kUpdateCount; ++i) {
+    patterns.push_back(new StringPattern(
+        base::StringPrintf("host%d.example%d.com/path", i, i % 97), i));
+    if (i < kPatternCount)
+      pattern_pointers.push_back(patterns[i]);
+  }
+
+  SubstringSetMatcher matcher;
+  base::TimeTicks start = base::TimeTicks::Now();
+  matcher.RegisterPatterns(pattern_pointers);
+  base::TimeDelta register_time = base::TimeTicks::Now() - start;
+
+  start = base::TimeTicks::Now();
+  for (int i = 0; i < kUpdateCount; ++i) {
+    std::vector<const StringPattern*> to_register(
+        1, patterns[kPatternCount + i]);
+    std::vector<const StringPattern*> to_unregister(1, patterns[i]);
+    matcher.RegisterAndUnregisterPatterns(to_register, to_unregister);
+  }
+  base::TimeDelta update_time = base::TimeTicks::Now() - start;
+
+  const int kMatchCount = 100000;
+  size_t match_count = 0;
+  start = base::TimeTicks::Now();
+  for (int i = 0; i < kMatchCount; ++i) {
+    std::set<int> matches;
+    matcher.Match(base::StringPrintf(
+        "http://www.host%d.example%d.com/path/to/some/resource.html?q=%d",
+        i, i % 97, i), &matches);
+    match_count += matches.size();
+  }
+  base::TimeDelta match_time = base::TimeTicks::Now() - start;
+
+  LOG(INFO) << base::StringPrintf(
+      "%d patterns registered in %.1f ms; %.3f ms per update; "
+      "%.2f us per match (%d matches)",
+      kPatternCount, register_time.InMillisecondsF(),
+      update_time.InMillisecondsF() / kUpdateCount,
+      match_time.InMicroseconds() / static_cast<double>(kMatchCount),
+      static_cast<int>(match_count));
+}
+
+// Measures single pattern updates in a large tree, which should only touch the
+// nodes around the pattern instead of the whole tree.
+TEST(SubstringSetMatcherTest, DISABLED_SinglePatternUpdatePerf) {
+  const int kPatternCount = 200000;
+  const int kUpdateCount = 1000;
+  ScopedVector<StringPattern> patterns;
+  std::vector<const StringPattern*> pattern_pointers;
+  for (int i = 0; i < kPatternCount; ++i) {
+    patterns.push_back(new StringPattern(
+        base::StringPrintf("host%d.example%d.com/path", i, i % 97), i));
+    pattern_pointers.push_back(patterns[i]);
+  }
+  for (int i = 0; i < kUpdateCount; ++i) {
+    patterns.push_back(new StringPattern(
+        base::StringPrintf("update%d.example.org/", i), kPatternCount + i));
+  }
+
+  SubstringSetMatcher matcher;
+  base::TimeTicks start = base::TimeTicks::Now();
+  matcher.RegisterPatterns(pattern_pointers);
+  base::TimeDelta register_time = base::TimeTicks::Now() - start;
+
+  base::TimeDelta add_time;
+  base::TimeDelta remove_time;
+  for (int i = 0; i < kUpdateCount; ++i) {
+    std::vector<const StringPattern*> update(1, patterns[kPatternCount + i]);
+    start = base::TimeTicks::Now();
+    matcher.RegisterPatterns(update);
+    add_time += base::TimeTicks::Now() - start;
+
+    std::set<int> matches;
+    matcher.Match("http://" + update[0]->pattern(), &matches);
+    EXPECT_EQ(1u, matches.count(kPatternCount + i));
+
+    start = base::TimeTicks::Now();
+    matcher.UnregisterPatterns(update);
+    remove_time += base::TimeTicks::Now() - start;
+  }
+
+  LOG(INFO) << base::StringPrintf(
+      "%d patterns registered in %.1f ms; %.3f ms per single registration; "
+      "%.3f ms per single unregistration",
+      kPatternCount, register_time.InMillisecondsF(),
+      add_time.InMillisecondsF() / kUpdateCount,
+      remove_time.InMillisecondsF() / kUpdateCount);
+}
+
 }  // namespace url_matcher
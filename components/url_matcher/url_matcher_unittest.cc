@@ -4,7 +4,10 @@
 
 #include "components/url_matcher/url_matcher.h"
 
+#include "base/logging.h"
 #include "base/strings/string_util.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
 #include "testing/gtest/include/gtest/gtest.h"
 #include "url/gurl.h"
 
@@ -679,4 +682,57 @@ TEST(URLMatcherTest, TestOriginAndPathRegExNegative) {
   EXPECT_EQ(0u, matcher.MatchURL(url).size());
 }
 
+// Measures MatchURL throughput and the latency of adding or removing a
+// single rule with tens of thousands of rules registered.
+TEST(URLMatcherTest, DISABLED_MatchURLPerf) {
+  const int kConditionSetCount = 20000;
+  const int kUpdateCount = 500;
+  const int kMatchCount = 20000;
+
+  URLMatcher matcher;
+  URLMatcherConditionFactory* factory = matcher.condition_factory();
+  URLMatcherConditionSet::Vector condition_sets;
+  for (int i = 0; i < kConditionSetCount + kUpdateCount; ++i) {
+    URLMatcherConditionSet::Conditions conditions;
+    conditions.insert(factory->CreateHostSuffixCondition(
+        base::StringPrintf("site%d.example.com", i)));
+    conditions.insert(factory->CreatePathContainsCondition(
+        base::StringPrintf("/section%d/", i % 50)));
+    condition_sets.push_back(make_scoped_refptr(
+        new URLMatcherConditionSet(i, conditions)));
+  }
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  matcher.AddConditionSets(URLMatcherConditionSet::Vector(
+      condition_sets.begin(), condition_sets.begin() + kConditionSetCount));
+  base::TimeDelta add_time = base::TimeTicks::Now() - start;
+
+  start = base::TimeTicks::Now();
+  for (int i = 0; i < kUpdateCount; ++i) {
+    matcher.AddConditionSets(URLMatcherConditionSet::Vector(
+        1, condition_sets[kConditionSetCount + i]));
+    matcher.RemoveConditionSets(
+        std::vector<URLMatcherConditionSet::ID>(1, i));
+  }
+  base::TimeDelta update_time = base::TimeTicks::Now() - start;
+
+  size_t match_count = 0;
+  start = base::TimeTicks::Now();
+  for (int i = 0; i < kMatchCount; ++i) {
+    GURL url(base::StringPrintf(
+        "http://www.site%d.example.com/section%d/index.html?q=%d",
+        i % (kConditionSetCount + kUpdateCount), i % 50, i));
+    match_count += matcher.MatchURL(url).size();
+  }
+  base::TimeDelta match_time = base::TimeTicks::Now() - start;
+
+  LOG(INFO) << base::StringPrintf(
+      "%d rules added in %.1f ms; %.3f ms per rule update; "
+      "%.2f us per MatchURL (%d matches)",
+      kConditionSetCount, add_time.InMillisecondsF(),
+      update_time.InMillisecondsF() / kUpdateCount,
+      match_time.InMicroseconds() / static_cast<double>(kMatchCount),
+      static_cast<int>(match_count));
+}
+
 }  // namespace url_matcher
@@ -53,6 +53,22 @@ const unsigned VisitedLinkMaster::kDefaultTableSize = 16381;
 
 const size_t VisitedLinkMaster::kBigDeleteThreshold = 64;
 
+// Growing a table means migrating it into one about twice as big, so a
+// region four times the table's length can take it through two resizes
+// before it has to be moved. The whole region is mapped by the browser and
+// every renderer, so this costs each of them three times the table's size in
+// address space: 384KB for the default table of 128KB. Big tables reserve
+// less, at most 4M slots (32MB), which is only reached once the table itself
+// has over a million slots and takes 8MB. The reserve is never touched
+// until a resize uses it, so it takes address space but no memory.
+const int32 VisitedLinkMaster::kTableReserveFactor = 4;
+const int32 VisitedLinkMaster::kMaxTableReserve = 4 * 1024 * 1024;
+
+// After a resize, the table has to take about a sixth of its length in new
+// URLs before it grows again, by when the migration and clearing of the old
+// table, up to twice its length, must be done. This is plenty.
+const int32 VisitedLinkMaster::kMigrationStepSize = 128;
+
 namespace {
 
 // Fills the given salt structure with some quasi-random values
@@ -127,10 +143,11 @@ void AsyncClose(FILE** file) {
 // will be called on the history thread by the history system for every URL
 // in the database.
 //
-// The builder will store the fingerprints for those URLs, and then marshalls
-// back to the main thread where the VisitedLinkMaster will be notified. The
-// master then replaces its table with a new table containing the computed
-// fingerprints.
+// The builder will store the fingerprints for those URLs, hash them into a new
+// table, and then marshalls back to the main thread where the
+// VisitedLinkMaster will be notified. The master then replaces its table with
+// a copy of the new one, so that the main thread does not have to hash every
+// URL in history.
 //
 // The builder must remain active while the history system is using it.
 // Sometimes, the master will be deleted before the rebuild is complete, in
@@ -171,6 +188,11 @@ class VisitedLinkMaster::TableBuilder
   // Stores the fingerprints we computed on the background thread.
   VisitedLinkCommon::Fingerprints fingerprints_;
 
+  // The hash table built from |fingerprints_| on the background thread, and
+  // the number of fingerprints in it.
+  VisitedLinkCommon::Fingerprints table_;
+  int32 used_count_;
+
   DISALLOW_COPY_AND_ASSIGN(TableBuilder);
 };
 
@@ -211,6 +233,9 @@ VisitedLinkMaster::~VisitedLinkMaster() {
     // system is still writing into it. When that is complete, the table
     // builder will destroy itself when it finds we are gone.
     table_builder_->DisownMaster();
+  } else if (hash_table_) {
+    // The file is only rewritten once a resize is complete.
+    FinishTableMigration();
   }
   FreeURLTable();
   // FreeURLTable() will schedule closing of the file and deletion of |file_|.
@@ -222,6 +247,11 @@ void VisitedLinkMaster::InitMembers() {
   shared_memory_ = NULL;
   shared_memory_serial_ = 0;
   used_items_ = 0;
+  old_hash_table_ = NULL;
+  old_table_length_ = 0;
+  migrate_position_ = 0;
+  clear_begin_ = 0;
+  clear_end_ = 0;
   table_size_override_ = 0;
   suppress_rebuild_ = false;
   sequence_token_ = BrowserThread::GetBlockingPool()->GetSequenceToken();
@@ -294,7 +324,10 @@ void VisitedLinkMaster::AddURL(const GURL& url) {
     // Not rebuilding, so we want to keep the file on disk up-to-date.
     if (persist_to_disk_) {
       WriteUsedItemCountToFile();
-      WriteHashRangeToFile(index, index);
+      if (old_hash_table_)
+        AddFingerprintToOldTableFile(hash_table_[index]);
+      else
+        WriteHashRangeToFile(index, index);
     }
     ResizeTableIfNecessary();
   }
@@ -318,13 +351,18 @@ void VisitedLinkMaster::DeleteAllURLs() {
   added_since_rebuild_.clear();
   deleted_since_rebuild_.clear();
 
-  // Clear the hash table.
+  // Clear the hash table, including the part of it still in the old table.
+  if (old_hash_table_)
+    EndTableMigration();
   used_items_ = 0;
   memset(hash_table_, 0, this->table_length_ * sizeof(Fingerprint));
 
   // Resize it if it is now too empty. Resize may write the new table out for
-  // us, otherwise, schedule writing the new table to disk ourselves.
-  if (!ResizeTableIfNecessary() && persist_to_disk_)
+  // us, otherwise, schedule writing the new table to disk ourselves. Deleted
+  // links should not linger on disk, so the resize is done right away.
+  if (ResizeTableIfNecessary())
+    FinishTableMigration();
+  else if (persist_to_disk_)
     WriteFullTable();
 
   listener_->Reset();
@@ -338,6 +376,10 @@ void VisitedLinkMaster::DeleteURLs(URLIterator* urls) {
   if (!urls->HasNextURL())
     return;
 
+  // Deleting shuffles fingerprints around in the current table, which must
+  // therefore hold all of them.
+  FinishTableMigration();
+
   listener_->Reset();
 
   if (table_builder_.get()) {
@@ -378,7 +420,6 @@ void VisitedLinkMaster::DeleteURLs(URLIterator* urls) {
   DeleteFingerprintsFromCurrentTable(deleted_fingerprints);
 }
 
-// See VisitedLinkCommon::IsVisited which should be in sync with this algorithm
 VisitedLinkMaster::Hash VisitedLinkMaster::AddFingerprint(
     Fingerprint fingerprint,
     bool send_notifications) {
@@ -387,25 +428,45 @@ VisitedLinkMaster::Hash VisitedLinkMaster::AddFingerprint(
     return null_hash_;
   }
 
-  Hash cur_hash = HashFingerprint(fingerprint);
+  // Fingerprints which are not migrated yet are only in the old table.
+  if (old_hash_table_ &&
+      IsVisitedInTable(old_hash_table_, old_table_length_, fingerprint))
+    return null_hash_;
+
+  Hash cur_hash = InsertFingerprint(hash_table_, table_length_, fingerprint);
+  if (cur_hash == null_hash_)
+    return null_hash_;
+
+  used_items_++;
+  // If allowed, notify listener that a new visited link was added.
+  if (send_notifications)
+    listener_->Add(fingerprint);
+  return cur_hash;
+}
+
+// See VisitedLinkCommon::IsVisited which should be in sync with this algorithm
+// static
+VisitedLinkMaster::Hash VisitedLinkMaster::InsertFingerprint(
+    Fingerprint* table,
+    int32 table_length,
+    Fingerprint fingerprint) {
+  Hash cur_hash = HashFingerprint(fingerprint, table_length);
   Hash first_hash = cur_hash;
   while (true) {
-    Fingerprint cur_fingerprint = FingerprintAt(cur_hash);
+    Fingerprint cur_fingerprint = table[cur_hash];
     if (cur_fingerprint == fingerprint)
       return null_hash_;  // This fingerprint is already in there, do nothing.
 
     if (cur_fingerprint == null_fingerprint_) {
       // End of probe sequence found, insert here.
-      hash_table_[cur_hash] = fingerprint;
-      used_items_++;
-      // If allowed, notify listener that a new visited link was added.
-      if (send_notifications)
-        listener_->Add(fingerprint);
+      table[cur_hash] = fingerprint;
       return cur_hash;
     }
 
     // Advance in the probe sequence.
-    cur_hash = IncrementHash(cur_hash);
+    cur_hash++;
+    if (cur_hash == table_length)
+      cur_hash = 0;
     if (cur_hash == first_hash) {
       // This means that we've wrapped around and are about to go into an
       // infinite loop. Something was wrong with the hashtable resizing
@@ -421,13 +482,18 @@ void VisitedLinkMaster::DeleteFingerprintsFromCurrentTable(
   bool bulk_write = (fingerprints.size() > kBigDeleteThreshold);
 
   // Delete the URLs from the table.
+  if (!fingerprints.empty())
+    FinishTableMigration();
   for (std::set<Fingerprint>::const_iterator i = fingerprints.begin();
        i != fingerprints.end(); ++i)
     DeleteFingerprint(*i, !bulk_write);
 
-  // These deleted fingerprints may make us shrink the table.
-  if (ResizeTableIfNecessary())
+  // These deleted fingerprints may make us shrink the table. Deleted links
+  // should not linger on disk, so the resize is done right away.
+  if (ResizeTableIfNecessary()) {
+    FinishTableMigration();
     return;  // The resize function wrote the new table to disk for us.
+  }
 
   // Nobody wrote this out for us, write the full file to disk.
   if (bulk_write && persist_to_disk_)
@@ -510,6 +576,11 @@ void VisitedLinkMaster::WriteFullTable() {
   // regenerate the table.
   DCHECK(persist_to_disk_);
 
+  // While resizing, the file keeps the old table and is rewritten once the
+  // migration is complete.
+  if (old_hash_table_)
+    return;
+
   if (!file_) {
     file_ = static_cast<FILE**>(calloc(1, sizeof(*file_)));
     base::FilePath filename;
@@ -549,7 +620,8 @@ bool VisitedLinkMaster::InitFromFile() {
     return false;  // Header isn't valid.
 
   // Allocate and read the table.
-  if (!CreateURLTable(num_entries, false))
+  if (!CreateURLTable(num_entries, TableCapacityForLength(num_entries),
+                      false))
     return false;
   if (!ReadFromFile(file_closer.get(), kFileHeaderSize,
                     hash_table_, num_entries * sizeof(Fingerprint))) {
@@ -575,7 +647,7 @@ bool VisitedLinkMaster::InitFromScratch(bool suppress_rebuild) {
   // The salt must be generated before the table so that it can be copied to
   // the shared memory.
   GenerateSalt(salt_);
-  if (!CreateURLTable(table_size, true))
+  if (!CreateURLTable(table_size, TableCapacityForLength(table_size), true))
     return false;
 
 #ifndef NDEBUG
@@ -666,9 +738,13 @@ bool VisitedLinkMaster::GetDatabaseFileName(base::FilePath* filename) {
 
 // Initializes the shared memory structure. The salt should already be filled
 // in so that it can be written to the shared memory
-bool VisitedLinkMaster::CreateURLTable(int32 num_entries, bool init_to_empty) {
-  // The table is the size of the table followed by the entries.
-  uint32 alloc_size = num_entries * sizeof(Fingerprint) + sizeof(SharedHeader);
+bool VisitedLinkMaster::CreateURLTable(int32 num_entries,
+                                       int32 capacity,
+                                       bool init_to_empty) {
+  DCHECK_LE(num_entries, capacity);
+
+  // The table is the header followed by the entries.
+  uint32 alloc_size = capacity * sizeof(Fingerprint) + sizeof(SharedHeader);
 
   // Create the shared memory object.
   shared_memory_ = new base::SharedMemory();
@@ -681,29 +757,43 @@ bool VisitedLinkMaster::CreateURLTable(int32 num_entries, bool init_to_empty) {
     return false;
   }
 
+  // New shared memory is zero-filled, so there is no need to touch the pages
+  // of the unused slots, which the OS will only commit once they are used.
   if (init_to_empty) {
-    memset(shared_memory_->memory(), 0, alloc_size);
+    memset(shared_memory_->memory(), 0,
+           num_entries * sizeof(Fingerprint) + sizeof(SharedHeader));
     used_items_ = 0;
   }
   table_length_ = num_entries;
+  table_capacity_ = capacity;
+  old_hash_table_ = NULL;
+  old_table_length_ = 0;
+  migrate_position_ = 0;
+  clear_begin_ = 0;
+  clear_end_ = 0;
 
   // Save the header for other processes to read.
-  SharedHeader* header = static_cast<SharedHeader*>(shared_memory_->memory());
-  header->length = table_length_;
-  memcpy(header->salt, salt_, LINK_SALT_LENGTH);
-
-  // Our table pointer is just the data immediately following the size.
-  hash_table_ = reinterpret_cast<Fingerprint*>(
-      static_cast<char*>(shared_memory_->memory()) + sizeof(SharedHeader));
+  shared_header_ = static_cast<SharedHeader*>(shared_memory_->memory());
+  shared_header_->sequence = 0;
+  shared_header_->length = table_length_;
+  shared_header_->offset = 0;
+  shared_header_->old_offset = 0;
+  shared_header_->old_length = 0;
+  shared_header_->capacity = capacity;
+  memcpy(shared_header_->salt, salt_, LINK_SALT_LENGTH);
+
+  // Our table pointer is just the data immediately following the header.
+  hash_table_ = TableSlots();
 
   return true;
 }
 
-bool VisitedLinkMaster::BeginReplaceURLTable(int32 num_entries) {
+bool VisitedLinkMaster::BeginReplaceURLTable(int32 num_entries,
+                                             int32 capacity) {
   base::SharedMemory *old_shared_memory = shared_memory_;
   Fingerprint* old_hash_table = hash_table_;
   int32 old_table_length = table_length_;
-  if (!CreateURLTable(num_entries, true)) {
+  if (!CreateURLTable(num_entries, capacity, true)) {
     // Try to put back the old state.
     shared_memory_ = old_shared_memory;
     hash_table_ = old_hash_table;
@@ -718,11 +808,46 @@ bool VisitedLinkMaster::BeginReplaceURLTable(int32 num_entries) {
   return true;
 }
 
+bool VisitedLinkMaster::MoveURLTable(int32 new_size) {
+  DCHECK(!old_hash_table_);
+  DCHECK_GE(clear_begin_, clear_end_);
+
+  base::SharedMemory* old_shared_memory = shared_memory_;
+  Fingerprint* old_hash_table = hash_table_;
+  int32 used_items = used_items_;
+  if (!BeginReplaceURLTable(table_length_,
+                            table_length_ + TableCapacityForLength(new_size)))
+    return false;
+  shared_memory_serial_++;
+
+  memcpy(hash_table_, old_hash_table, table_length_ * sizeof(Fingerprint));
+  used_items_ = used_items;
+
+  // On error unmapping, just forget about it since we can't do anything
+  // else to release it.
+  delete old_shared_memory;
+
+  // Send an update notification to all child processes so they read the new
+  // table.
+  listener_->NewTable(shared_memory_);
+  return true;
+}
+
+// static
+int32 VisitedLinkMaster::TableCapacityForLength(int32 num_entries) {
+  return num_entries + std::min(num_entries * (kTableReserveFactor - 1),
+                                kMaxTableReserve);
+}
+
 void VisitedLinkMaster::FreeURLTable() {
   if (shared_memory_) {
     delete shared_memory_;
     shared_memory_ = NULL;
   }
+  shared_header_ = NULL;
+  hash_table_ = NULL;
+  old_hash_table_ = NULL;
+  old_table_length_ = 0;
   if (!persist_to_disk_ || !file_)
     return;
   PostIOTask(FROM_HERE, base::Bind(&AsyncClose, file_));
@@ -733,6 +858,9 @@ void VisitedLinkMaster::FreeURLTable() {
 bool VisitedLinkMaster::ResizeTableIfNecessary() {
   DCHECK(table_length_ > 0) << "Must have a table";
 
+  // Each change to the table moves a resize in progress along.
+  ContinueTableMigration(kMigrationStepSize);
+
   // Load limits for good performance/space. We are pretty conservative about
   // keeping the table not very full. This is because we use linear probing
   // which increases the likelihood of clumps of entries which will reduce
@@ -756,44 +884,97 @@ bool VisitedLinkMaster::ResizeTableIfNecessary() {
 
 void VisitedLinkMaster::ResizeTable(int32 new_size) {
   DCHECK(shared_memory_ && shared_memory_->memory() && hash_table_);
-  shared_memory_serial_++;
+
+  // The new table goes where the previous resize left unused slots, which
+  // must all be clear.
+  FinishTableMigration();
 
 #ifndef NDEBUG
   DebugValidate();
 #endif
 
-  base::SharedMemory* old_shared_memory = shared_memory_;
-  Fingerprint* old_hash_table = hash_table_;
-  int32 old_table_length = table_length_;
-  if (!BeginReplaceURLTable(new_size))
-    return;
-
-  // Now we have two tables, our local copy which is the old one, and the new
-  // one loaded into this object where we need to copy the data.
-  for (int32 i = 0; i < old_table_length; i++) {
-    Fingerprint cur = old_hash_table[i];
-    if (cur)
-      AddFingerprint(cur, false);
+  // Place the new table before the current one if it fits there, otherwise
+  // at the end of the shared memory. If neither has room, move to a bigger
+  // shared memory first.
+  int32 offset = static_cast<int32>(hash_table_ - TableSlots());
+  int32 new_offset;
+  if (new_size <= offset) {
+    new_offset = 0;
+  } else if (table_capacity_ - (offset + table_length_) >= new_size) {
+    new_offset = table_capacity_ - new_size;
+  } else {
+    if (!MoveURLTable(new_size))
+      return;
+    new_offset = table_capacity_ - new_size;
   }
 
-  // On error unmapping, just forget about it since we can't do anything
-  // else to release it.
-  delete old_shared_memory;
+  old_hash_table_ = hash_table_;
+  old_table_length_ = table_length_;
+  migrate_position_ = 0;
+  hash_table_ = TableSlots() + new_offset;
+  table_length_ = new_size;
+  PublishTableLayout();
+}
 
-  // Send an update notification to all child processes so they read the new
-  // table.
-  listener_->NewTable(shared_memory_);
+void VisitedLinkMaster::ContinueTableMigration(int32 max_slots) {
+  if (old_hash_table_) {
+    int32 count =
+        std::min(max_slots, old_table_length_ - migrate_position_);
+    for (int32 end = migrate_position_ + count; migrate_position_ < end;
+         migrate_position_++) {
+      Fingerprint cur = old_hash_table_[migrate_position_];
+      if (cur)
+        InsertFingerprint(hash_table_, table_length_, cur);
+    }
+    if (migrate_position_ < old_table_length_)
+      return;
+    max_slots -= count;
+
+    EndTableMigration();
 
 #ifndef NDEBUG
-  DebugValidate();
+    DebugValidate();
 #endif
 
-  // The new table needs to be written to disk.
-  if (persist_to_disk_)
-    WriteFullTable();
+    // The new table needs to be written to disk.
+    if (persist_to_disk_)
+      WriteFullTable();
+  }
+
+  if (clear_begin_ < clear_end_) {
+    int32 count = std::min(max_slots, clear_end_ - clear_begin_);
+    memset(TableSlots() + clear_begin_, 0, count * sizeof(Fingerprint));
+    clear_begin_ += count;
+  }
+}
+
+void VisitedLinkMaster::EndTableMigration() {
+  DCHECK(old_hash_table_);
+  DCHECK_GE(clear_begin_, clear_end_);
+  clear_begin_ = static_cast<int32>(old_hash_table_ - TableSlots());
+  clear_end_ = clear_begin_ + old_table_length_;
+  old_hash_table_ = NULL;
+  old_table_length_ = 0;
+  migrate_position_ = 0;
+  PublishTableLayout();
+}
+
+void VisitedLinkMaster::PublishTableLayout() {
+  base::subtle::Atomic32 sequence = shared_header_->sequence;
+  base::subtle::NoBarrier_Store(&shared_header_->sequence, sequence + 1);
+  base::subtle::MemoryBarrier();
+
+  shared_header_->offset = static_cast<uint32>(hash_table_ - TableSlots());
+  shared_header_->length = table_length_;
+  shared_header_->old_offset = old_hash_table_ ?
+      static_cast<uint32>(old_hash_table_ - TableSlots()) : 0;
+  shared_header_->old_length = old_table_length_;
+
+  base::subtle::Release_Store(&shared_header_->sequence, sequence + 2);
 }
 
-uint32 VisitedLinkMaster::NewTableSizeForCount(int32 item_count) const {
+// static
+uint32 VisitedLinkMaster::NewTableSizeForCount(int32 item_count) {
   // These table sizes are selected to be the maximum prime number less than
   // a "convenient" multiple of 1K.
   static const int table_sizes[] = {
@@ -838,7 +1019,8 @@ bool VisitedLinkMaster::RebuildTableFromDelegate() {
 // See the TableBuilder declaration above for how this works.
 void VisitedLinkMaster::OnTableRebuildComplete(
     bool success,
-    const std::vector<Fingerprint>& fingerprints) {
+    const std::vector<Fingerprint>& table,
+    int32 used_count) {
   if (success) {
     // Replace the old table with a new blank one.
     shared_memory_serial_++;
@@ -847,21 +1029,23 @@ void VisitedLinkMaster::OnTableRebuildComplete(
     // replacement succeeds.
     base::SharedMemory* old_shared_memory = shared_memory_;
 
-    int new_table_size = NewTableSizeForCount(
-        static_cast<int>(fingerprints.size() + added_since_rebuild_.size()));
-    if (BeginReplaceURLTable(new_table_size)) {
+    int32 new_table_size = static_cast<int32>(table.size());
+    if (BeginReplaceURLTable(new_table_size,
+                             TableCapacityForLength(new_table_size))) {
       // Free the old table.
       delete old_shared_memory;
 
-      // Add the stored fingerprints to the hash table.
-      for (size_t i = 0; i < fingerprints.size(); i++)
-        AddFingerprint(fingerprints[i], false);
+      // Copy in the table built from the stored fingerprints.
+      memcpy(hash_table_, &table[0], new_table_size * sizeof(Fingerprint));
+      used_items_ = used_count;
 
       // Also add anything that was added while we were asynchronously
-      // generating the new table.
+      // generating the new table, growing the table as needed.
       for (std::set<Fingerprint>::iterator i = added_since_rebuild_.begin();
-           i != added_since_rebuild_.end(); ++i)
-        AddFingerprint(*i, false);
+           i != added_since_rebuild_.end(); ++i) {
+        if (AddFingerprint(*i, false) != null_hash_)
+          ResizeTableIfNecessary();
+      }
       added_since_rebuild_.clear();
 
       // Now handle deletions.
@@ -904,6 +1088,20 @@ void VisitedLinkMaster::WriteUsedItemCountToFile() {
   WriteToFile(file_, kFileHeaderUsedOffset, &used_items_, sizeof(used_items_));
 }
 
+void VisitedLinkMaster::AddFingerprintToOldTableFile(Fingerprint fingerprint) {
+  DCHECK(persist_to_disk_);
+  DCHECK(old_hash_table_);
+
+  // The migration will find the fingerprint already in the current table
+  // should it reach this slot.
+  Hash index = InsertFingerprint(old_hash_table_, old_table_length_,
+                                 fingerprint);
+  if (!file_ || index == null_hash_)
+    return;
+  WriteToFile(file_, index * sizeof(Fingerprint) + kFileHeaderSize,
+              &old_hash_table_[index], sizeof(Fingerprint));
+}
+
 void VisitedLinkMaster::WriteHashRangeToFile(Hash first_hash, Hash last_hash) {
   DCHECK(persist_to_disk_);
 
@@ -950,7 +1148,8 @@ VisitedLinkMaster::TableBuilder::TableBuilder(
     VisitedLinkMaster* master,
     const uint8 salt[LINK_SALT_LENGTH])
     : master_(master),
-      success_(true) {
+      success_(true),
+      used_count_(0) {
   fingerprints_.reserve(4096);
   memcpy(salt_, salt, LINK_SALT_LENGTH * sizeof(uint8));
 }
@@ -972,6 +1171,20 @@ void VisitedLinkMaster::TableBuilder::OnComplete(bool success) {
   success_ = success;
   DLOG_IF(WARNING, !success) << "Unable to rebuild visited links";
 
+  // Hash the fingerprints here rather than on the main thread, which only
+  // has to copy the result.
+  if (success_) {
+    int32 table_length = NewTableSizeForCount(
+        static_cast<int32>(fingerprints_.size()));
+    table_.assign(table_length, null_fingerprint_);
+    for (size_t i = 0; i < fingerprints_.size(); i++) {
+      if (InsertFingerprint(&table_[0], table_length, fingerprints_[i]) !=
+          null_hash_)
+        used_count_++;
+    }
+  }
+  VisitedLinkCommon::Fingerprints().swap(fingerprints_);
+
   // Marshal to the main thread to notify the VisitedLinkMaster that the
   // rebuild is complete.
   BrowserThread::PostTask(
@@ -981,7 +1194,7 @@ void VisitedLinkMaster::TableBuilder::OnComplete(bool success) {
 
 void VisitedLinkMaster::TableBuilder::OnCompleteMainThread() {
   if (master_)
-    master_->OnTableRebuildComplete(success_, fingerprints_);
+    master_->OnTableRebuildComplete(success_, table_, used_count_);
 }
 
 }  // namespace visitedlink
@@ -159,6 +159,8 @@ class VisitedLinkMaster : public VisitedLinkCommon {
   FRIEND_TEST_ALL_PREFIXES(VisitedLinkTest, Delete);
   FRIEND_TEST_ALL_PREFIXES(VisitedLinkTest, BigDelete);
   FRIEND_TEST_ALL_PREFIXES(VisitedLinkTest, BigImport);
+  FRIEND_TEST_ALL_PREFIXES(VisitedLinkTest, IncrementalResize);
+  FRIEND_TEST_ALL_PREFIXES(VisitedLinkTest, AddDuringMigrationIsWritten);
 
   // Object to rebuild the table on the history thread (see the .cc file).
   class TableBuilder;
@@ -187,6 +189,17 @@ class VisitedLinkMaster : public VisitedLinkCommon {
   // we will write the whole table to disk at once instead of individual items.
   static const size_t kBigDeleteThreshold;
 
+  // The shared memory holding a table has room for this many times its
+  // length, but at most kMaxTableReserve slots more, so that it can usually be
+  // resized in place. Every renderer maps the whole of it; the .cc file spells
+  // out the address space this costs.
+  static const int32 kTableReserveFactor;
+  static const int32 kMaxTableReserve;
+
+  // The number of slots of the old table that each added URL migrates into
+  // the current one (or clears once migrated) while resizing.
+  static const int32 kMigrationStepSize;
+
   // Backend for the constructors initializing the members.
   void InitMembers();
 
@@ -237,6 +250,11 @@ class VisitedLinkMaster : public VisitedLinkCommon {
   // wrap around at 0 and this function will handle it.
   void WriteHashRangeToFile(Hash first_hash, Hash last_hash);
 
+  // While resizing, the file holds the old table until the migration is done.
+  // This adds |fingerprint|, just added to the current table, to the old one
+  // as well and writes it out, so that it survives a crash before then.
+  void AddFingerprintToOldTableFile(Fingerprint fingerprint);
+
   // Synchronous read from the file. Assumes there are no pending asynchronous
   // I/O functions. Returns true if the entire buffer was successfully filled.
   bool ReadFromFile(FILE* hfile, off_t offset, void* data, size_t data_size);
@@ -250,6 +268,13 @@ class VisitedLinkMaster : public VisitedLinkCommon {
   // duplicate and this item was skippped.
   Hash AddFingerprint(Fingerprint fingerprint, bool send_notifications);
 
+  // Inserts |fingerprint| into the linear probing hash table of |table_length|
+  // entries starting at |table|. Returns the index of the inserted
+  // fingerprint or null_hash_ if it was already there (or the table is full).
+  static Hash InsertFingerprint(Fingerprint* table,
+                                int32 table_length,
+                                Fingerprint fingerprint);
+
   // Deletes all fingerprints from the given vector from the current hash table
   // and syncs it to disk if there are changes. This does not update the
   // deleted_since_rebuild_ list, the caller must update this itself if there
@@ -269,12 +294,12 @@ class VisitedLinkMaster : public VisitedLinkCommon {
   // database and for unit tests.
   bool InitFromScratch(bool suppress_rebuild);
 
-  // Allocates the Fingerprint structure and length. When init_to_empty is set,
-  // the table will be filled with 0s and used_items_ will be set to 0 as well.
-  // If the flag is not set, these things are untouched and it is the
-  // responsibility of the caller to fill them (like when we are reading from
-  // a file).
-  bool CreateURLTable(int32 num_entries, bool init_to_empty);
+  // Allocates the Fingerprint structure and length, in shared memory with
+  // room for |capacity| entries. When init_to_empty is set, the table will be
+  // filled with 0s and used_items_ will be set to 0 as well. If the flag is
+  // not set, these things are untouched and it is the responsibility of the
+  // caller to fill them (like when we are reading from a file).
+  bool CreateURLTable(int32 num_entries, int32 capacity, bool init_to_empty);
 
   // A wrapper for CreateURLTable, this will allocate a new table, initialized
   // to empty. The caller is responsible for saving the shared memory pointer
@@ -285,7 +310,17 @@ class VisitedLinkMaster : public VisitedLinkCommon {
   //
   // Returns true on success. On failure, the old table will be restored. The
   // caller should not attemp to release the pointer/handle in this case.
-  bool BeginReplaceURLTable(int32 num_entries);
+  bool BeginReplaceURLTable(int32 num_entries, int32 capacity);
+
+  // Copies the current table into a new shared memory region with room to
+  // migrate it into a table of |new_size| entries, and sends the new region to
+  // the slaves. Copying is much cheaper than rehashing but the slaves have to
+  // remap the table, so this is only done when the current region is full.
+  bool MoveURLTable(int32 new_size);
+
+  // Returns the number of entries to allocate shared memory for when creating
+  // a table of |num_entries| entries.
+  static int32 TableCapacityForLength(int32 num_entries);
 
   // unallocates the Fingerprint table
   void FreeURLTable();
@@ -296,11 +331,33 @@ class VisitedLinkMaster : public VisitedLinkCommon {
   bool ResizeTableIfNecessary();
 
   // Resizes the table (growing or shrinking) as necessary to accomodate the
-  // current count.
+  // current count. The new table is placed in the unused part of the shared
+  // memory and becomes the current one right away, while the old one stays
+  // readable; its fingerprints are migrated kMigrationStepSize at a time by
+  // ContinueTableMigration, so that neither this nor any later call pauses
+  // for a full rehash and the slaves keep using the same shared memory.
   void ResizeTable(int32 new_size);
 
+  // Migrates up to |max_slots| slots of the old table into the current one.
+  // Once all are migrated, the old table is retired and the file rewritten,
+  // and the next calls clear its slots for reuse by a later resize.
+  void ContinueTableMigration(int32 max_slots);
+
+  // Completes any migration and clearing in progress.
+  void FinishTableMigration() {
+    ContinueTableMigration(kint32max);
+  }
+
+  // Stops lookups from probing the old table, scheduling its slots to be
+  // cleared. Fingerprints which were not migrated yet are dropped.
+  void EndTableMigration();
+
+  // Copies the current table layout to the shared header, bracketed by
+  // increments of the sequence number (see VisitedLinkCommon::IsVisited).
+  void PublishTableLayout();
+
   // Returns the desired table size for |item_count| URLs.
-  uint32 NewTableSizeForCount(int32 item_count) const;
+  static uint32 NewTableSizeForCount(int32 item_count);
 
   // Computes the table load as fraction. For example, if 1/4 of the entries are
   // full, this value will be 0.25
@@ -319,10 +376,12 @@ class VisitedLinkMaster : public VisitedLinkCommon {
 
   // Callback that the table rebuilder uses when the rebuild is complete.
   // |success| is true if the fingerprint generation succeeded, in which case
-  // |fingerprints| will contain the computed fingerprints. On failure, there
-  // will be no fingerprints.
+  // |table| will contain the hash table the rebuilder built from the computed
+  // fingerprints, holding |used_count| of them. On failure, the table is
+  // empty.
   void OnTableRebuildComplete(bool success,
-                              const std::vector<Fingerprint>& fingerprints);
+                              const std::vector<Fingerprint>& table,
+                              int32 used_count);
 
   // Increases or decreases the given hash value by one, wrapping around as
   // necessary. Used for probing.
@@ -397,9 +456,22 @@ class VisitedLinkMaster : public VisitedLinkCommon {
   // shared memory object.
   int32 shared_memory_serial_;
 
-  // Number of non-empty items in the table, used to compute fullness.
+  // Number of non-empty items in the table, used to compute fullness. While
+  // a migration is in progress, this includes the fingerprints which are
+  // still only in the old table.
   int32 used_items_;
 
+  // While the table is being resized, the old table and the index of its next
+  // slot to migrate into the current table. NULL otherwise.
+  Fingerprint* old_hash_table_;
+  int32 old_table_length_;
+  int32 migrate_position_;
+
+  // The slots of the last old table which remain to be cleared, as
+  // [clear_begin_, clear_end_) relative to the first slot.
+  int32 clear_begin_;
+  int32 clear_end_;
+
   // Testing values -----------------------------------------------------------
   //
   // The following fields exist for testing purposes. They are not used in
@@ -436,6 +508,13 @@ inline void VisitedLinkMaster::DebugValidate() {
     if (hash_table_[i])
       used_count++;
   }
+  // Fingerprints which are not migrated yet are only in the old table, unless
+  // they were added during the migration.
+  for (int32 i = migrate_position_; i < old_table_length_; i++) {
+    if (old_hash_table_[i] &&
+        !IsVisitedInTable(hash_table_, table_length_, old_hash_table_[i]))
+      used_count++;
+  }
   DCHECK_EQ(used_count, used_items_);
 }
 #endif
@@ -8,16 +8,29 @@
 
 #include "base/logging.h"
 #include "base/md5.h"
+#include "base/threading/platform_thread.h"
 #include "url/gurl.h"
 
 namespace visitedlink {
 
+namespace {
+
+// The number of times a lookup is tried while the master keeps changing the
+// table layout. The master holds the sequence number odd only for a few stores,
+// so running out means it was descheduled in the middle of them; the link is
+// then reported as unvisited rather than holding up the renderer.
+const int kMaxLookupAttempts = 64;
+
+}  // namespace
+
 const VisitedLinkCommon::Fingerprint VisitedLinkCommon::null_fingerprint_ = 0;
 const VisitedLinkCommon::Hash VisitedLinkCommon::null_hash_ = -1;
 
 VisitedLinkCommon::VisitedLinkCommon()
     : hash_table_(NULL),
-      table_length_(0) {
+      table_length_(0),
+      shared_header_(NULL),
+      table_capacity_(0) {
   memset(salt_, 0, sizeof(salt_));
 }
 
@@ -30,7 +43,7 @@ bool VisitedLinkCommon::IsVisited(const char* canonical_url,
                                   size_t url_len) const {
   if (url_len == 0)
     return false;
-  if (!hash_table_ || table_length_ == 0)
+  if (!shared_header_)
     return false;
   return IsVisited(ComputeURLFingerprint(canonical_url, url_len));
 }
@@ -40,13 +53,57 @@ bool VisitedLinkCommon::IsVisited(const GURL& url) const {
 }
 
 bool VisitedLinkCommon::IsVisited(Fingerprint fingerprint) const {
+  if (!shared_header_)
+    return false;
+
+  // The master may move the tables around while we look. It brackets each
+  // change with two increments of the sequence number, so retry the lookup
+  // if the number was odd or changed under us. A fingerprint being migrated
+  // stays in the old table until the migration is over, so resizing never
+  // hides a visited link from a lookup.
+  const Fingerprint* slots = TableSlots();
+  for (int attempt = 0; attempt < kMaxLookupAttempts; ++attempt) {
+    base::subtle::Atomic32 sequence =
+        base::subtle::Acquire_Load(&shared_header_->sequence);
+    if (sequence & 1) {
+      // Let the master finish its change.
+      base::PlatformThread::YieldCurrentThread();
+      continue;
+    }
+
+    uint32 offset = shared_header_->offset;
+    uint32 length = shared_header_->length;
+    uint32 old_offset = shared_header_->old_offset;
+    uint32 old_length = shared_header_->old_length;
+    uint32 capacity = static_cast<uint32>(table_capacity_);
+
+    bool found = false;
+    if (offset <= capacity && length <= capacity - offset)
+      found = IsVisitedInTable(slots + offset, length, fingerprint);
+    if (!found && old_length && old_offset <= capacity &&
+        old_length <= capacity - old_offset)
+      found = IsVisitedInTable(slots + old_offset, old_length, fingerprint);
+
+    base::subtle::MemoryBarrier();
+    if (base::subtle::NoBarrier_Load(&shared_header_->sequence) == sequence)
+      return found;
+  }
+  return false;
+}
+
+// static
+bool VisitedLinkCommon::IsVisitedInTable(const Fingerprint* table,
+                                         int32 table_length,
+                                         Fingerprint fingerprint) {
   // Go through the table until we find the item or an empty spot (meaning it
   // wasn't found). This loop will terminate as long as the table isn't full,
   // which should be enforced by AddFingerprint.
-  Hash first_hash = HashFingerprint(fingerprint);
+  Hash first_hash = HashFingerprint(fingerprint, table_length);
+  if (first_hash == null_hash_)
+    return false;
   Hash cur_hash = first_hash;
   while (true) {
-    Fingerprint cur_fingerprint = FingerprintAt(cur_hash);
+    Fingerprint cur_fingerprint = table[cur_hash];
     if (cur_fingerprint == null_fingerprint_)
       return false;  // End of probe sequence found.
     if (cur_fingerprint == fingerprint)
@@ -55,7 +112,7 @@ bool VisitedLinkCommon::IsVisited(Fingerprint fingerprint) const {
     // This spot was taken, but not by the item we're looking for, search in
     // the next position.
     cur_hash++;
-    if (cur_hash == table_length_)
+    if (cur_hash == table_length)
       cur_hash = 0;
     if (cur_hash == first_hash) {
       // Wrapped around and didn't find an empty space, this means we're in an
@@ -7,6 +7,7 @@
 
 #include <vector>
 
+#include "base/atomicops.h"
 #include "base/basictypes.h"
 
 class GURL;
@@ -20,8 +21,10 @@ namespace visitedlink {
 // should be exactly one process that has write access (implemented by
 // VisitedLinkMaster), while all other processes should be read-only
 // (implemented by VisitedLinkSlave). These other processes add links by calling
-// the writer process to add them for it. The writer may also notify the readers
-// to replace their table when the table is resized.
+// the writer process to add them for it. The table is resized in place within
+// the shared memory when possible (see VisitedLinkMaster::ResizeTable); the
+// writer only notifies the readers to replace their table when it has to move
+// to a bigger shared memory region.
 //
 // IPC is not implemented in these classes. This is done through callback
 // functions supplied by the creator of these objects to allow more flexibility,
@@ -66,7 +69,8 @@ class VisitedLinkCommon {
 
   // Looks up the given key in the table. The fingerprint for the URL is
   // computed if you call one with the string argument. Returns true if found.
-  // Does not modify the hastable.
+  // Does not modify the hastable. A lookup which keeps racing with the master
+  // resizing the table gives up and returns false.
   bool IsVisited(const char* canonical_url, size_t url_len) const;
   bool IsVisited(const GURL& url) const;
   bool IsVisited(Fingerprint fingerprint) const;
@@ -75,20 +79,40 @@ class VisitedLinkCommon {
   // Returns statistics about DB usage
   void GetUsageStatistics(int32* table_size,
                           VisitedLinkCommon::Fingerprint** fingerprints) {
-    *table_size = table_length_;
-    *fingerprints = hash_table_;
+    *table_size = shared_header_ ? shared_header_->length : 0;
+    *fingerprints =
+        shared_header_ ? TableSlots() + shared_header_->offset : NULL;
   }
 #endif
 
  protected:
   // This structure is at the beginning of the shared memory so that the slaves
-  // can get stats on the table
+  // can get stats on the table. It is followed by |capacity| fingerprint
+  // slots, which hold the current table and, while the master is resizing it,
+  // the old table whose entries are being migrated into the current one. Every
+  // renderer maps all of them, unused ones included; see
+  // VisitedLinkMaster::kTableReserveFactor for how many there are.
   struct SharedHeader {
-    // see goes into table_length_
+    // the number of slots in the current table
     uint32 length;
 
     // goes into salt_
     uint8 salt[LINK_SALT_LENGTH];
+
+    // The master makes this odd while it changes the fields below and even
+    // again afterwards, so readers can detect a lookup that raced with it.
+    base::subtle::Atomic32 sequence;
+
+    // The slot at which the current table starts.
+    uint32 offset;
+
+    // The slot at which the old table starts and its length, which is 0 when
+    // no migration is in progress.
+    uint32 old_offset;
+    uint32 old_length;
+
+    // The total number of slots following the header.
+    uint32 capacity;
   };
 
   // Returns the fingerprint at the given index into the URL table. This
@@ -120,12 +144,30 @@ class VisitedLinkCommon {
     return HashFingerprint(fingerprint, table_length_);
   }
 
+  // Returns true if |fingerprint| is in the linear probing hash table of
+  // |table_length| entries starting at |table|.
+  static bool IsVisitedInTable(const Fingerprint* table,
+                               int32 table_length,
+                               Fingerprint fingerprint);
+
+  // Returns the first slot following the shared header.
+  Fingerprint* TableSlots() const {
+    return reinterpret_cast<Fingerprint*>(shared_header_ + 1);
+  }
+
   // pointer to the first item
   VisitedLinkCommon::Fingerprint* hash_table_;
 
   // the number of items in the hash table
   int32 table_length_;
 
+  // The header at the start of the shared memory, NULL until it is mapped.
+  // Lookups go through it so that they follow the master's resizes.
+  SharedHeader* shared_header_;
+
+  // The number of slots mapped after |shared_header_|.
+  int32 table_capacity_;
+
   // salt used for each URL when computing the fingerprint
   uint8 salt_[LINK_SALT_LENGTH];
 
@@ -38,7 +38,7 @@ void VisitedLinkSlave::OnUpdateVisitedLinks(base::SharedMemoryHandle table) {
   // since this function may be called again to change the table, we may need
   // to free old objects
   FreeTable();
-  DCHECK(shared_memory_ == NULL && hash_table_ == NULL);
+  DCHECK(shared_memory_ == NULL && shared_header_ == NULL);
 
   // create the shared memory object
   shared_memory_ = new base::SharedMemory(table, true);
@@ -52,22 +52,22 @@ void VisitedLinkSlave::OnUpdateVisitedLinks(base::SharedMemoryHandle table) {
   SharedHeader* header =
     static_cast<SharedHeader*>(shared_memory_->memory());
   DCHECK(header);
-  int32 table_len = header->length;
+  int32 table_capacity = header->capacity;
   memcpy(salt_, header->salt, sizeof(salt_));
   shared_memory_->Unmap();
 
-  // now do the whole table because we know the length
+  // now do all the slots because we know how many there are; the master may
+  // later resize the table anywhere within them
   if (!shared_memory_->Map(sizeof(SharedHeader) +
-                          table_len * sizeof(Fingerprint))) {
+                          table_capacity * sizeof(Fingerprint))) {
     shared_memory_->Close();
     return;
   }
 
   // commit the data
   DCHECK(shared_memory_->memory());
-  hash_table_ = reinterpret_cast<Fingerprint*>(
-      static_cast<char*>(shared_memory_->memory()) + sizeof(SharedHeader));
-  table_length_ = table_len;
+  shared_header_ = static_cast<SharedHeader*>(shared_memory_->memory());
+  table_capacity_ = table_capacity;
 }
 
 void VisitedLinkSlave::OnAddVisitedLinks(
@@ -85,8 +85,8 @@ void VisitedLinkSlave::FreeTable() {
     delete shared_memory_;
     shared_memory_ = NULL;
   }
-  hash_table_ = NULL;
-  table_length_ = 0;
+  shared_header_ = NULL;
+  table_capacity_ = 0;
 }
 
 }  // namespace visitedlink
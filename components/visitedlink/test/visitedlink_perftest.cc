@@ -13,6 +13,7 @@
 #include "base/test/perf_log.h"
 #include "base/test/perf_time_logger.h"
 #include "base/test/test_file_util.h"
+#include "base/time/time.h"
 #include "base/timer/elapsed_timer.h"
 #include "components/visitedlink/browser/visitedlink_master.h"
 #include "testing/gtest/include/gtest/gtest.h"
@@ -44,6 +45,19 @@ class DummyVisitedLinkEventListener : public VisitedLinkMaster::Listener {
   virtual void Reset() OVERRIDE {}
 };
 
+// Counts the tables sent to the (nonexistent) slaves.
+class CountingVisitedLinkEventListener : public DummyVisitedLinkEventListener {
+ public:
+  explicit CountingVisitedLinkEventListener(int* new_table_count)
+      : new_table_count_(new_table_count) {}
+  virtual void NewTable(base::SharedMemory* table) OVERRIDE {
+    (*new_table_count_)++;
+  }
+
+ private:
+  int* new_table_count_;
+};
+
 
 // this checks IsVisited for the URLs starting with the given prefix and
 // within the given range
@@ -106,6 +120,37 @@ TEST_F(VisitedLink, TestAddAndQuery) {
   CheckVisited(master, unadded_prefix, 0, add_count);
 }
 
+// Tests how fast URLs can be added to a growing table, and how long the
+// longest single add takes. The table used to be rehashed in one go when it
+// grew, so that add was the resize pause; now it should be close to the
+// others.
+TEST_F(VisitedLink, TestAddThroughputAndResizePause) {
+  int new_table_count = 0;
+  VisitedLinkMaster master(
+      new CountingVisitedLinkEventListener(&new_table_count),
+      NULL, true, true, db_path_, 0);
+  ASSERT_TRUE(master.Init());
+
+  std::vector<GURL> urls;
+  for (int i = 0; i < load_test_add_count; i++)
+    urls.push_back(TestURL(added_prefix, i));
+
+  TimeDelta max_add_time;
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (int i = 0; i < load_test_add_count; i++) {
+    base::TimeTicks add_start = base::TimeTicks::Now();
+    master.AddURL(urls[i]);
+    max_add_time = std::max(max_add_time, base::TimeTicks::Now() - add_start);
+  }
+  TimeDelta total_time = base::TimeTicks::Now() - start;
+
+  base::LogPerfResult("Visited_link_add_throughput",
+                      load_test_add_count / total_time.InSecondsF(), "adds/s");
+  base::LogPerfResult("Visited_link_max_add_time",
+                      max_add_time.InMillisecondsF(), "ms");
+  base::LogPerfResult("Visited_link_new_tables", new_table_count, "tables");
+}
+
 // Tests how long it takes to write and read a large database to and from disk.
 TEST_F(VisitedLink, TestLoad) {
   // create a big DB
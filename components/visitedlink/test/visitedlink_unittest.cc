@@ -107,9 +107,11 @@ class TrackingVisitedLinkEventListener : public VisitedLinkMaster::Listener {
  public:
   TrackingVisitedLinkEventListener()
       : reset_count_(0),
-        add_count_(0) {}
+        add_count_(0),
+        new_table_count_(0) {}
 
   virtual void NewTable(base::SharedMemory* table) OVERRIDE {
+    new_table_count_++;
     if (table) {
       for (std::vector<VisitedLinkSlave>::size_type i = 0;
            i < g_slaves.size(); i++) {
@@ -125,14 +127,17 @@ class TrackingVisitedLinkEventListener : public VisitedLinkMaster::Listener {
   void SetUp() {
     reset_count_ = 0;
     add_count_ = 0;
+    new_table_count_ = 0;
   }
 
   int reset_count() const { return reset_count_; }
   int add_count() const { return add_count_; }
+  int new_table_count() const { return new_table_count_; }
 
  private:
   int reset_count_;
   int add_count_;
+  int new_table_count_;
 };
 
 class VisitedLinkTest : public testing::Test {
@@ -400,6 +405,81 @@ TEST_F(VisitedLinkTest, Resizing) {
   Reload();
 }
 
+// Tests that the table is resized in place when the shared memory has room,
+// and that the slaves see every URL while the old table is being migrated.
+TEST_F(VisitedLinkTest, IncrementalResize) {
+  const int32 initial_size = 17;
+  ASSERT_TRUE(InitVisited(initial_size, true));
+
+  VisitedLinkSlave slave;
+  base::SharedMemoryHandle new_handle = base::SharedMemory::NULLHandle();
+  master_->shared_memory()->ShareToProcess(
+      base::GetCurrentProcessHandle(), &new_handle);
+  slave.OnUpdateVisitedLinks(new_handle);
+  g_slaves.push_back(&slave);
+
+  // Enough URLs to grow the table three times: out of the tiny initial
+  // shared memory, within the shared memory that replaces it, and out of
+  // that one.
+  const int total_count = VisitedLinkMaster::kDefaultTableSize * 2 - 100;
+  int resize_count = 0;
+  bool saw_migration = false;
+  int32 table_length = master_->table_length_;
+  for (int i = 0; i < total_count; i++) {
+    master_->AddURL(TestURL(i));
+    ASSERT_EQ(i + 1, master_->GetUsedCount());
+    if (master_->table_length_ != table_length) {
+      table_length = master_->table_length_;
+      resize_count++;
+    }
+    if (master_->old_hash_table_) {
+      saw_migration = true;
+      EXPECT_TRUE(slave.IsVisited(TestURL(i)));
+      for (int j = i % 97; j < i; j += 97)
+        ASSERT_TRUE(slave.IsVisited(TestURL(j))) << "URL " << j;
+    }
+  }
+  master_->DebugValidate();
+  EXPECT_TRUE(saw_migration);
+  EXPECT_EQ(3, resize_count);
+
+  // Only the resizes which needed bigger shared memory sent a new table.
+  TrackingVisitedLinkEventListener* listener =
+      static_cast<TrackingVisitedLinkEventListener*>(master_->GetListener());
+  EXPECT_EQ(2, listener->new_table_count());
+  for (int i = 0; i < total_count; i++)
+    ASSERT_TRUE(slave.IsVisited(TestURL(i))) << "URL " << i;
+  g_slaves.clear();
+
+  // The table is written out even if a migration was still in progress.
+  ClearDB();
+  ASSERT_TRUE(InitVisited(0, true));
+  EXPECT_EQ(total_count, master_->GetUsedCount());
+  EXPECT_TRUE(master_->IsVisited(TestURL(0)));
+  EXPECT_TRUE(master_->IsVisited(TestURL(total_count - 1)));
+}
+
+// URLs added while a resize is migrating the table must reach the file before
+// the migration is done, so that a crash in the middle of it loses none.
+TEST_F(VisitedLinkTest, AddDuringMigrationIsWritten) {
+  ASSERT_TRUE(InitVisited(0, true));
+  int count = 0;
+  while (!master_->old_hash_table_)
+    master_->AddURL(TestURL(count++));
+  master_->AddURL(TestURL(count++));
+  ASSERT_TRUE(master_->old_hash_table_);
+  master_->DebugValidate();
+  BrowserThread::GetBlockingPool()->FlushForTesting();
+
+  // Load the file as it is now, with the migration still in progress.
+  VisitedLinkMaster crashed(new TrackingVisitedLinkEventListener(),
+                            &delegate_, true, true, visited_file_, 0);
+  ASSERT_TRUE(crashed.Init());
+  EXPECT_EQ(count, crashed.GetUsedCount());
+  for (int i = 0; i < count; i++)
+    ASSERT_TRUE(crashed.IsVisited(TestURL(i))) << "URL " << i;
+}
+
 // Tests that if the database doesn't exist, it will be rebuilt from history.
 TEST_F(VisitedLinkTest, Rebuild) {
   // Add half of our URLs to history. This needs to be done before we
@@ -9,6 +9,7 @@
 #include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/run_loop.h"
+#include "base/strings/stringprintf.h"
 #include "base/time/time.h"
 #include "content/public/test/test_file_system_context.h"
 #include "net/base/io_buffer.h"
@@ -56,7 +57,8 @@ class BlobURLRequestJobTest : public testing::Test {
   class MockURLRequestDelegate : public net::URLRequest::Delegate {
    public:
     MockURLRequestDelegate()
-        : received_data_(new net::IOBuffer(kBufferSize)) {}
+        : received_data_(new net::IOBuffer(kBufferSize)),
+          buffer_size_(kBufferSize) {}
 
     virtual void OnResponseStarted(net::URLRequest* request) OVERRIDE {
       if (request->status().is_success()) {
@@ -77,6 +79,11 @@ class BlobURLRequestJobTest : public testing::Test {
 
     const std::string& response_data() const { return response_data_; }
 
+    void set_buffer_size(int buffer_size) {
+      received_data_ = new net::IOBuffer(buffer_size);
+      buffer_size_ = buffer_size;
+    }
+
    private:
     void ReadSome(net::URLRequest* request) {
       if (!request->is_pending()) {
@@ -85,7 +92,7 @@ class BlobURLRequestJobTest : public testing::Test {
       }
 
       int bytes_read = 0;
-      if (!request->Read(received_data_.get(), kBufferSize, &bytes_read)) {
+      if (!request->Read(received_data_.get(), buffer_size_, &bytes_read)) {
         if (!request->status().is_io_pending()) {
           RequestComplete();
         }
@@ -110,6 +117,7 @@ class BlobURLRequestJobTest : public testing::Test {
     }
 
     scoped_refptr<net::IOBuffer> received_data_;
+    int buffer_size_;
     std::string response_data_;
   };
 
@@ -255,6 +263,35 @@ class BlobURLRequestJobTest : public testing::Test {
     EXPECT_EQ(expected_response_, url_request_delegate_.response_data());
   }
 
+  // Writes |size| bytes of patterned data to a new file named |name| and
+  // returns its path.
+  base::FilePath CreateLargeFile(const char* name, int size,
+                                 std::string* data) {
+    data->clear();
+    data->reserve(size);
+    for (int i = 0; i < size; ++i)
+      data->append(1, static_cast<char>((i * 7 + name[0]) % 256));
+    base::FilePath path = temp_dir_.path().AppendASCII(name);
+    EXPECT_EQ(size, file_util::WriteFile(path, data->data(), size));
+    return path;
+  }
+
+  // Builds a blob of large file items, which take several reads each,
+  // separated by small data items.
+  void BuildLargeMixedData(std::string* expected_result) {
+    expected_result->clear();
+    const char* kNames[] = { "Large1.dat", "Large2.dat", "Large3.dat" };
+    for (size_t i = 0; i < arraysize(kNames); ++i) {
+      std::string file_data;
+      base::FilePath path =
+          CreateLargeFile(kNames[i], kBufferSize * 3 + 17, &file_data);
+      blob_data_->AppendFile(path, 5, kBufferSize * 3, base::Time());
+      *expected_result += file_data.substr(5, kBufferSize * 3);
+      blob_data_->AppendData(kTestData2);
+      *expected_result += kTestData2;
+    }
+  }
+
   void BuildComplicatedData(std::string* expected_result) {
     blob_data_->AppendData(kTestData1 + 1, 2);
     blob_data_->AppendFile(temp_file1_, 2, 3, temp_file_modification_time1_);
@@ -417,6 +454,53 @@ TEST_F(BlobURLRequestJobTest, TestGetRangeRequest2) {
   TestRequest("GET", extra_headers);
 }
 
+TEST_F(BlobURLRequestJobTest, TestGetLargeMixedRequest) {
+  std::string result;
+  BuildLargeMixedData(&result);
+  TestSuccessRequest(result);
+}
+
+TEST_F(BlobURLRequestJobTest, TestGetLargeMixedRangeRequest) {
+  std::string result;
+  BuildLargeMixedData(&result);
+  net::HttpRequestHeaders extra_headers;
+  const int64 kFirst = kBufferSize + 3;
+  const int64 kLast = kBufferSize * 7;
+  extra_headers.SetHeader(
+      net::HttpRequestHeaders::kRange,
+      net::HttpByteRange::Bounded(kFirst, kLast).GetHeaderValue());
+  expected_status_code_ = 206;
+  expected_response_ = result.substr(kFirst, kLast - kFirst + 1);
+  TestRequest("GET", extra_headers);
+}
+
+// Reads a blob of large files separated by large memory items, and logs
+// the throughput.
+TEST_F(BlobURLRequestJobTest, DISABLED_ReadThroughput) {
+  const int kFileSize = 16 * 1024 * 1024;
+  const int kReadSize = 64 * 1024;
+  const std::string memory_data(1024 * 1024, 'm');
+  const char* kNames[] = { "Perf1.dat", "Perf2.dat", "Perf3.dat" };
+  std::string expected;
+  for (size_t i = 0; i < arraysize(kNames); ++i) {
+    std::string file_data;
+    base::FilePath path = CreateLargeFile(kNames[i], kFileSize, &file_data);
+    blob_data_->AppendFile(path, 0, -1, base::Time());
+    expected += file_data;
+    blob_data_->AppendData(memory_data);
+    expected += memory_data;
+  }
+
+  url_request_delegate_.set_buffer_size(kReadSize);
+  base::TimeTicks start = base::TimeTicks::Now();
+  TestSuccessRequest(expected);
+  base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+  LOG(INFO) << base::StringPrintf(
+      "Read %d bytes in %.2f ms (%.1f MB/s)",
+      static_cast<int>(expected.size()), elapsed.InMillisecondsF(),
+      expected.size() / (1024.0 * 1024.0) / elapsed.InSecondsF());
+}
+
 TEST_F(BlobURLRequestJobTest, TestExtraHeaders) {
   blob_data_->set_content_type(kTestContentType);
   blob_data_->set_content_disposition(kTestContentDisposition);
@@ -12,6 +12,7 @@
 #include "base/files/file_path.h"
 #include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/sequenced_task_runner.h"
 #include "base/timer/timer.h"
 #include "content/browser/indexed_db/indexed_db.h"
 #include "content/browser/indexed_db/indexed_db_metadata.h"
@@ -49,6 +50,16 @@ class CONTENT_EXPORT IndexedDBBackingStore
     return &close_timer_;
   }
 
+  // Transactions are committed on this sequence when it is set, and on the
+  // calling thread otherwise. Nothing else touches a transaction while its
+  // commit is in flight; reads on the calling thread may continue.
+  base::SequencedTaskRunner* commit_task_runner() const {
+    return commit_task_runner_.get();
+  }
+  void set_commit_task_runner(base::SequencedTaskRunner* task_runner) {
+    commit_task_runner_ = task_runner;
+  }
+
   static scoped_refptr<IndexedDBBackingStore> Open(
       const GURL& origin_url,
       const base::FilePath& path_base,
@@ -333,6 +344,7 @@ class CONTENT_EXPORT IndexedDBBackingStore
   scoped_ptr<LevelDBDatabase> db_;
   scoped_ptr<LevelDBComparator> comparator_;
   base::OneShotTimer<IndexedDBBackingStore> close_timer_;
+  scoped_refptr<base::SequencedTaskRunner> commit_task_runner_;
 };
 
 }  // namespace content
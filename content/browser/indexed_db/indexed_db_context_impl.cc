@@ -7,6 +7,7 @@
 #include <algorithm>
 
 #include "base/bind.h"
+#include "base/bind_helpers.h"
 #include "base/command_line.h"
 #include "base/file_util.h"
 #include "base/files/file_enumerator.h"
@@ -14,6 +15,7 @@
 #include "base/sequenced_task_runner.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/threading/sequenced_worker_pool.h"
 #include "base/threading/thread_restrictions.h"
 #include "base/time/time.h"
 #include "base/values.h"
@@ -102,11 +104,13 @@ IndexedDBContextImpl::IndexedDBContextImpl(
     const base::FilePath& data_path,
     quota::SpecialStoragePolicy* special_storage_policy,
     quota::QuotaManagerProxy* quota_manager_proxy,
-    base::SequencedTaskRunner* task_runner)
+    base::SequencedTaskRunner* task_runner,
+    base::SequencedWorkerPool* backing_store_pool)
     : force_keep_session_state_(false),
       special_storage_policy_(special_storage_policy),
       quota_manager_proxy_(quota_manager_proxy),
-      task_runner_(task_runner) {
+      task_runner_(task_runner),
+      backing_store_pool_(backing_store_pool) {
   IDB_TRACE("init");
   if (!data_path.empty())
     data_path_ = data_path.Append(kIndexedDBDirectory);
@@ -308,6 +312,28 @@ void IndexedDBContextImpl::DeleteForOrigin(const GURL& origin_url) {
   if (data_path_.empty() || !IsInOriginSet(origin_url))
     return;
 
+  // Commits in flight on the origin's commit sequence hold the backing store,
+  // and with it the LevelDB lock, past the forced close. Their completions are
+  // posted back here before the reply below, so by then the backing store has
+  // been released.
+  base::SequencedTaskRunner* commit_task_runner =
+      factory_ ? factory_->GetCommitTaskRunner(origin_url) : NULL;
+  if (commit_task_runner) {
+    commit_task_runner->PostTaskAndReply(
+        FROM_HERE,
+        base::Bind(&base::DoNothing),
+        base::Bind(&IndexedDBContextImpl::DeleteClosedOrigin, this,
+                   origin_url));
+    return;
+  }
+  DeleteClosedOrigin(origin_url);
+}
+
+void IndexedDBContextImpl::DeleteClosedOrigin(const GURL& origin_url) {
+  DCHECK(TaskRunner()->RunsTasksOnCurrentThread());
+  if (data_path_.empty() || !IsInOriginSet(origin_url))
+    return;
+
   base::FilePath idb_directory = GetFilePath(origin_url);
   EnsureDiskUsageCacheInitialized(origin_url);
   bool deleted = LevelDBDatabase::Destroy(idb_directory);
@@ -368,6 +394,20 @@ base::FilePath IndexedDBContextImpl::GetFilePath(const GURL& origin_url) const {
   return GetIndexedDBFilePath(origin_id);
 }
 
+scoped_refptr<base::SequencedTaskRunner>
+IndexedDBContextImpl::GetBackingStoreTaskRunner(const GURL& origin_url) {
+  if (!backing_store_pool_)
+    return NULL;
+  // Named tokens map the same origin to the same sequence for as long as the
+  // pool lives, so commits within an origin stay ordered. Blocking shutdown
+  // lets commits that were already handed off reach the disk.
+  base::SequencedWorkerPool::SequenceToken token =
+      backing_store_pool_->GetNamedSequenceToken(
+          "IndexedDB/" + webkit_database::GetIdentifierFromOrigin(origin_url));
+  return backing_store_pool_->GetSequencedTaskRunnerWithShutdownBehavior(
+      token, base::SequencedWorkerPool::BLOCK_SHUTDOWN);
+}
+
 base::FilePath IndexedDBContextImpl::GetFilePathForTesting(
     const std::string& origin_id) const {
   return GetIndexedDBFilePath(origin_id);
@@ -25,6 +25,7 @@ namespace base {
 class ListValue;
 class FilePath;
 class SequencedTaskRunner;
+class SequencedWorkerPool;
 }
 
 namespace quota {
@@ -39,11 +40,15 @@ class IndexedDBConnection;
 class CONTENT_EXPORT IndexedDBContextImpl
     : NON_EXPORTED_BASE(public IndexedDBContext) {
  public:
-  // If |data_path| is empty, nothing will be saved to disk.
+  // If |data_path| is empty, nothing will be saved to disk. If
+  // |backing_store_pool| is given, each origin's backing store commits its
+  // transactions on its own sequence of that pool rather than on
+  // |task_runner|, so one origin's writes do not hold up the others.
   IndexedDBContextImpl(const base::FilePath& data_path,
                        quota::SpecialStoragePolicy* special_storage_policy,
                        quota::QuotaManagerProxy* quota_manager_proxy,
-                       base::SequencedTaskRunner* task_runner);
+                       base::SequencedTaskRunner* task_runner,
+                       base::SequencedWorkerPool* backing_store_pool);
 
   IndexedDBFactory* GetIDBFactory();
 
@@ -76,9 +81,14 @@ class CONTENT_EXPORT IndexedDBContextImpl
   base::Time GetOriginLastModified(const GURL& origin_url);
   base::ListValue* GetAllOriginsDetails();
   // ForceClose takes a value rather than a reference since it may release the
-  // owning object.
+  // owning object. Read-write commits already handed to the origin's commit
+  // sequence keep the backing store open until they land.
   void ForceClose(const GURL origin_url);
   base::FilePath GetFilePath(const GURL& origin_url) const;
+  // Returns the sequence |origin_url|'s backing store commits on, or NULL if
+  // commits run on TaskRunner().
+  scoped_refptr<base::SequencedTaskRunner> GetBackingStoreTaskRunner(
+      const GURL& origin_url);
   base::FilePath data_path() const { return data_path_; }
   bool IsInOriginSet(const GURL& origin_url) {
     std::set<GURL>* set = GetOriginSet();
@@ -105,6 +115,8 @@ class CONTENT_EXPORT IndexedDBContextImpl
   class IndexedDBGetUsageAndQuotaCallback;
 
   base::FilePath GetIndexedDBFilePath(const std::string& origin_id) const;
+  // Destroys the files of |origin_url|, whose backing store must be closed.
+  void DeleteClosedOrigin(const GURL& origin_url);
   int64 ReadUsageFromDisk(const GURL& origin_url) const;
   void EnsureDiskUsageCacheInitialized(const GURL& origin_url);
   void QueryDiskAndUpdateQuotaUsage(const GURL& origin_url);
@@ -133,6 +145,7 @@ class CONTENT_EXPORT IndexedDBContextImpl
   scoped_refptr<quota::SpecialStoragePolicy> special_storage_policy_;
   scoped_refptr<quota::QuotaManagerProxy> quota_manager_proxy_;
   base::SequencedTaskRunner* task_runner_;
+  scoped_refptr<base::SequencedWorkerPool> backing_store_pool_;
   scoped_ptr<std::set<GURL> > origin_set_;
   OriginToSizeMap origin_size_map_;
   OriginToSizeMap space_available_map_;
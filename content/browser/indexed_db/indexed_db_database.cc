@@ -140,7 +140,9 @@ IndexedDBDatabase::IndexedDBDatabase(const base::string16& name,
                 kInvalidId),
       identifier_(unique_identifier),
       factory_(factory),
-      running_version_change_transaction_(NULL) {
+      running_version_change_transaction_(NULL),
+      release_after_commits_(false),
+      release_forced_(false) {
   DCHECK(!metadata_.name.empty());
 }
 
@@ -1277,6 +1279,18 @@ void IndexedDBDatabase::TransactionFinished(IndexedDBTransaction* transaction) {
     DCHECK_EQ(transaction, running_version_change_transaction_);
     running_version_change_transaction_ = NULL;
   }
+
+  if (release_after_commits_ && transactions_.empty()) {
+    const bool forced = release_forced_;
+    release_after_commits_ = false;
+    release_forced_ = false;
+    // A connection opened since the close releases the backing store itself
+    // when it closes.
+    if (!ConnectionCount()) {
+      ProcessPendingCalls();
+      ReleaseBackingStoreIfUnused(forced);
+    }
+  }
 }
 
 void IndexedDBDatabase::TransactionFinishedAndAbortFired(
@@ -1630,7 +1644,10 @@ void IndexedDBDatabase::DeleteDatabase(
     // TODO(jsbell): Only fire OnBlocked if there are open
     // connections after the VersionChangeEvents are received, not
     // just set up to fire.  http://crbug.com/100123
-    callbacks->OnBlocked(metadata_.int_version);
+    // A delete waiting only for commits of closed connections is not blocked
+    // by anything the page can act on.
+    if (ConnectionCount())
+      callbacks->OnBlocked(metadata_.int_version);
     pending_delete_calls_.push_back(new PendingDeleteCall(callbacks));
     return;
   }
@@ -1638,7 +1655,10 @@ void IndexedDBDatabase::DeleteDatabase(
 }
 
 bool IndexedDBDatabase::IsDeleteDatabaseBlocked() const {
-  return !!ConnectionCount();
+  // Read-write transactions may still be committing on the backing store's
+  // commit sequence after their connection has closed. Deleting the database
+  // before they finish would let their writes land after the delete.
+  return ConnectionCount() || !transactions_.empty();
 }
 
 void IndexedDBDatabase::DeleteDatabaseFinal(
@@ -1691,11 +1711,24 @@ void IndexedDBDatabase::Close(IndexedDBConnection* connection, bool forced) {
 
   ProcessPendingCalls();
 
-  // TODO(jsbell): Add a test for the pending_open_calls_ cases below.
-  if (!ConnectionCount() && !pending_open_calls_.size() &&
-      !pending_delete_calls_.size()) {
-    DCHECK(transactions_.empty());
+  ReleaseBackingStoreIfUnused(forced);
+}
 
+void IndexedDBDatabase::ReleaseBackingStoreIfUnused(bool forced) {
+  if (ConnectionCount())
+    return;
+
+  // Commits of closed connections still use the backing store, and block any
+  // pending delete. The last of them to finish picks up from here; see
+  // TransactionFinished().
+  if (!transactions_.empty()) {
+    release_after_commits_ = true;
+    release_forced_ = release_forced_ || forced;
+    return;
+  }
+
+  // TODO(jsbell): Add a test for the pending_open_calls_ cases below.
+  if (!pending_open_calls_.size() && !pending_delete_calls_.size()) {
     const GURL origin_url = backing_store_->origin_url();
     backing_store_ = NULL;
 
@@ -271,6 +271,9 @@ class CONTENT_EXPORT IndexedDBDatabase
       blink::WebIDBDataLoss data_loss,
       std::string data_loss_message);
   void ProcessPendingCalls();
+  // Drops the backing store and leaves the factory once no connection, open
+  // or delete call can use this database any more.
+  void ReleaseBackingStoreIfUnused(bool forced);
 
   bool IsDeleteDatabaseBlocked() const;
   void DeleteDatabaseFinal(scoped_refptr<IndexedDBCallbacks> callbacks);
@@ -295,6 +298,11 @@ class CONTENT_EXPORT IndexedDBDatabase
 
   IndexedDBTransactionCoordinator transaction_coordinator_;
   IndexedDBTransaction* running_version_change_transaction_;
+  // Set when the last connection closed while read-write transactions were
+  // still committing. Pending calls and the release of the backing store wait
+  // for those commits; see TransactionFinished().
+  bool release_after_commits_;
+  bool release_forced_;
 
   typedef std::map<int64, IndexedDBTransaction*> TransactionMap;
   TransactionMap transactions_;
@@ -5,9 +5,12 @@
 #include "content/browser/indexed_db/indexed_db_database.h"
 
 #include "base/auto_reset.h"
+#include "base/bind.h"
 #include "base/logging.h"
+#include "base/message_loop/message_loop.h"
 #include "base/strings/string16.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/test/test_simple_task_runner.h"
 #include "content/browser/indexed_db/indexed_db.h"
 #include "content/browser/indexed_db/indexed_db_backing_store.h"
 #include "content/browser/indexed_db/indexed_db_callbacks.h"
@@ -139,6 +142,7 @@ class MockDeleteCallbacks : public IndexedDBCallbacks {
   virtual void OnSuccess() OVERRIDE { success_void_called_ = true; }
 
   bool blocked_called() const { return blocked_called_; }
+  bool success_void_called() const { return success_void_called_; }
 
  private:
   virtual ~MockDeleteCallbacks() { EXPECT_TRUE(success_void_called_); }
@@ -184,4 +188,63 @@ TEST(IndexedDBDatabaseTest, PendingDelete) {
   EXPECT_TRUE(backing_store->HasOneRef());  // local
 }
 
+static void DummyOperation(IndexedDBTransaction* transaction) {}
+
+// A connection which goes away, e.g. because its renderer exited, while one of
+// its read-write transactions is still being written on the commit sequence
+// must not let a pending delete run before the write is done.
+TEST(IndexedDBDatabaseTest, PendingDeleteWaitsForCommit) {
+  base::MessageLoop message_loop;
+  scoped_refptr<base::TestSimpleTaskRunner> commit_task_runner(
+      new base::TestSimpleTaskRunner());
+  scoped_refptr<IndexedDBFakeBackingStore> backing_store =
+      new IndexedDBFakeBackingStore();
+  backing_store->set_commit_task_runner(commit_task_runner.get());
+
+  IndexedDBFactory* factory = 0;
+  scoped_refptr<IndexedDBDatabase> db =
+      IndexedDBDatabase::Create(ASCIIToUTF16("db"),
+                                backing_store,
+                                factory,
+                                IndexedDBDatabase::Identifier());
+
+  scoped_refptr<MockIndexedDBCallbacks> request1(new MockIndexedDBCallbacks());
+  scoped_refptr<MockIndexedDBDatabaseCallbacks> callbacks1(
+      new MockIndexedDBDatabaseCallbacks());
+  const int64 transaction_id1 = 1;
+  db->OpenConnection(request1,
+                     callbacks1,
+                     transaction_id1,
+                     IndexedDBDatabaseMetadata::DEFAULT_INT_VERSION);
+
+  const int64 transaction_id2 = 2;
+  const bool commit_success = true;
+  scoped_refptr<IndexedDBTransaction> transaction = new IndexedDBTransaction(
+      transaction_id2,
+      request1->connection()->callbacks(),
+      std::set<int64>(),
+      indexed_db::TRANSACTION_READ_WRITE,
+      db,
+      new IndexedDBFakeBackingStore::FakeTransaction(commit_success));
+  db->TransactionCreated(transaction);
+  transaction->ScheduleTask(base::Bind(&DummyOperation));
+  message_loop.RunUntilIdle();
+  transaction->Commit();
+  EXPECT_TRUE(commit_task_runner->HasPendingTask());
+
+  scoped_refptr<MockDeleteCallbacks> request2(new MockDeleteCallbacks());
+  db->DeleteDatabase(request2);
+  EXPECT_TRUE(request2->blocked_called());
+
+  request1->connection()->Close();
+  EXPECT_FALSE(request2->success_void_called());
+  EXPECT_TRUE(db->backing_store());
+
+  commit_task_runner->RunPendingTasks();
+  message_loop.RunUntilIdle();
+  EXPECT_EQ(IndexedDBTransaction::FINISHED, transaction->state());
+  EXPECT_TRUE(request2->success_void_called());
+  EXPECT_FALSE(db->backing_store());
+}
+
 }  // namespace content
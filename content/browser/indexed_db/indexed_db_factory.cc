@@ -95,6 +95,15 @@ void IndexedDBFactory::ForceClose(const GURL& origin_url) {
     ReleaseBackingStore(origin_url, true /* immediate */);
 }
 
+base::SequencedTaskRunner* IndexedDBFactory::GetCommitTaskRunner(
+    const GURL& origin_url) const {
+  IndexedDBBackingStoreMap::const_iterator it =
+      backing_store_map_.find(origin_url);
+  if (it == backing_store_map_.end())
+    return NULL;
+  return it->second->commit_task_runner();
+}
+
 void IndexedDBFactory::ContextDestroyed() {
   // Timers on backing stores hold a reference to this factory. When the
   // context (which nominally owns this factory) is destroyed during thread
@@ -238,6 +247,10 @@ scoped_refptr<IndexedDBBackingStore> IndexedDBFactory::OpenBackingStore(
   }
 
   if (backing_store.get()) {
+    if (context_) {
+      backing_store->set_commit_task_runner(
+          context_->GetBackingStoreTaskRunner(origin_url).get());
+    }
     backing_store_map_[origin_url] = backing_store;
     // If an in-memory database, bind lifetime to this factory instance.
     if (open_in_memory)
@@ -18,6 +18,10 @@
 #include "content/common/content_export.h"
 #include "url/gurl.h"
 
+namespace base {
+class SequencedTaskRunner;
+}
+
 namespace content {
 
 class IndexedDBBackingStore;
@@ -59,6 +63,10 @@ class CONTENT_EXPORT IndexedDBFactory
   // ensure the backing store closed immediately.
   void ForceClose(const GURL& origin_url);
 
+  // Returns the sequence the open backing store for |origin_url| commits on,
+  // or NULL if it is closed or commits inline.
+  base::SequencedTaskRunner* GetCommitTaskRunner(const GURL& origin_url) const;
+
   // Called by the IndexedDBContext destructor so the factory can do cleanup.
   void ContextDestroyed();
 
@@ -55,7 +55,8 @@ class IndexedDBQuotaClientTest : public testing::Test {
         new IndexedDBContextImpl(browser_context_->GetPath(),
                                  browser_context_->GetSpecialStoragePolicy(),
                                  quota_manager->proxy(),
-                                 task_runner_);
+                                 task_runner_,
+                                 NULL);
     base::MessageLoop::current()->RunUntilIdle();
     setup_temp_dir();
   }
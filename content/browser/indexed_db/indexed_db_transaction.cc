@@ -8,6 +8,7 @@
 #include "base/logging.h"
 #include "base/message_loop/message_loop.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/task_runner_util.h"
 #include "content/browser/indexed_db/indexed_db_backing_store.h"
 #include "content/browser/indexed_db/indexed_db_cursor.h"
 #include "content/browser/indexed_db/indexed_db_database.h"
@@ -230,16 +231,42 @@ void IndexedDBTransaction::Commit() {
   if (HasPendingTasks())
     return;
 
-  // The last reference to this object may be released while performing the
-  // commit steps below. We therefore take a self reference to keep ourselves
-  // alive while executing this method.
-  scoped_refptr<IndexedDBTransaction> protect(this);
-
   timeout_timer_.Stop();
 
   state_ = FINISHED;
 
-  bool committed = !used_ || transaction_->Commit();
+  base::SequencedTaskRunner* commit_task_runner =
+      database_->backing_store()->commit_task_runner();
+  // Only read-write transactions have data to write. Version change
+  // transactions finish synchronously, since completing them resumes the
+  // open that started them.
+  if (used_ && commit_task_runner &&
+      mode_ == indexed_db::TRANSACTION_READ_WRITE) {
+    // Cursors iterate over the backing store transaction, so they have to be
+    // closed before it is written on another thread. The transaction stays
+    // active in the coordinator until the write is done, which keeps
+    // overlapping transactions waiting as before.
+    CloseOpenCursors();
+    base::PostTaskAndReplyWithResult(
+        commit_task_runner,
+        FROM_HERE,
+        base::Bind(&IndexedDBBackingStore::Transaction::Commit,
+                   base::Unretained(transaction_.get())),
+        base::Bind(&IndexedDBTransaction::DidCommit, this));
+    return;
+  }
+
+  DidCommit(!used_ || transaction_->Commit());
+}
+
+void IndexedDBTransaction::DidCommit(bool committed) {
+  IDB_TRACE("IndexedDBTransaction::DidCommit");
+  DCHECK_EQ(FINISHED, state_);
+
+  // The last reference to this object may be released while performing the
+  // commit steps below. We therefore take a self reference to keep ourselves
+  // alive while executing this method.
+  scoped_refptr<IndexedDBTransaction> protect(this);
 
   // Backing store resources (held via cursors) must be released
   // before script callbacks are fired, as the script callbacks may
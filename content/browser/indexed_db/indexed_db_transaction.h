@@ -94,6 +94,8 @@ class CONTENT_EXPORT IndexedDBTransaction
   bool HasPendingTasks() const;
 
   void ProcessTaskQueue();
+  // Finishes a commit once the backing store transaction has been written.
+  void DidCommit(bool committed);
   void CloseOpenCursors();
   void Timeout();
 
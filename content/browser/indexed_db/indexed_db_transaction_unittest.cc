@@ -8,6 +8,7 @@
 #include "base/logging.h"
 #include "base/message_loop/message_loop.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/test/test_simple_task_runner.h"
 #include "content/browser/indexed_db/indexed_db_fake_backing_store.h"
 #include "content/browser/indexed_db/mock_indexed_db_database_callbacks.h"
 #include "testing/gtest/include/gtest/gtest.h"
@@ -120,6 +121,51 @@ TEST_F(IndexedDBTransactionTest, AbortTasks) {
   EXPECT_TRUE(observer.abort_task_called());
 }
 
+TEST_F(IndexedDBTransactionTest, CommitOnBackingStoreTaskRunner) {
+  scoped_refptr<base::TestSimpleTaskRunner> commit_task_runner(
+      new base::TestSimpleTaskRunner());
+  backing_store_->set_commit_task_runner(commit_task_runner.get());
+
+  std::set<int64> scope;
+  scope.insert(1);
+  const bool commit_success = true;
+  scoped_refptr<IndexedDBTransaction> transaction = new IndexedDBTransaction(
+      0,
+      new MockIndexedDBDatabaseCallbacks(),
+      scope,
+      indexed_db::TRANSACTION_READ_WRITE,
+      db_,
+      new IndexedDBFakeBackingStore::FakeTransaction(commit_success));
+  db_->TransactionCreated(transaction);
+  transaction->ScheduleTask(base::Bind(
+      &IndexedDBTransactionTest::DummyOperation, base::Unretained(this)));
+  RunPostedTasks();
+
+  transaction->Commit();
+  EXPECT_EQ(IndexedDBTransaction::FINISHED, transaction->state());
+  EXPECT_TRUE(commit_task_runner->HasPendingTask());
+
+  // A transaction over the same object store waits for the write.
+  scoped_refptr<IndexedDBTransaction> next_transaction =
+      new IndexedDBTransaction(
+          1,
+          new MockIndexedDBDatabaseCallbacks(),
+          scope,
+          indexed_db::TRANSACTION_READ_WRITE,
+          db_,
+          new IndexedDBFakeBackingStore::FakeTransaction(commit_success));
+  db_->TransactionCreated(next_transaction);
+  EXPECT_EQ(IndexedDBTransaction::CREATED, next_transaction->state());
+  EXPECT_EQ(2UL, db_->transaction_coordinator().GetTransactions().size());
+
+  commit_task_runner->RunPendingTasks();
+  RunPostedTasks();
+  EXPECT_EQ(IndexedDBTransaction::STARTED, next_transaction->state());
+  EXPECT_EQ(1UL, db_->transaction_coordinator().GetTransactions().size());
+
+  next_transaction->Abort();
+}
+
 }  // namespace
 
 }  // namespace content
@@ -2,13 +2,19 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include "base/bind.h"
 #include "base/file_util.h"
 #include "base/files/scoped_temp_dir.h"
+#include "base/strings/utf_string_conversions.h"
 #include "base/test/test_simple_task_runner.h"
 #include "base/threading/thread.h"
 #include "content/browser/browser_thread_impl.h"
+#include "content/browser/indexed_db/indexed_db_backing_store.h"
 #include "content/browser/indexed_db/indexed_db_connection.h"
 #include "content/browser/indexed_db/indexed_db_context_impl.h"
+#include "content/browser/indexed_db/indexed_db_database.h"
+#include "content/browser/indexed_db/indexed_db_factory.h"
+#include "content/browser/indexed_db/indexed_db_transaction.h"
 #include "content/browser/indexed_db/mock_indexed_db_callbacks.h"
 #include "content/browser/indexed_db/mock_indexed_db_database_callbacks.h"
 #include "content/public/browser/storage_partition.h"
@@ -63,7 +69,7 @@ TEST_F(IndexedDBTest, ClearSessionOnlyDatabases) {
   // which should trigger the clean up.
   {
     scoped_refptr<IndexedDBContextImpl> idb_context = new IndexedDBContextImpl(
-        temp_dir.path(), special_storage_policy_, NULL, task_runner_);
+        temp_dir.path(), special_storage_policy_, NULL, task_runner_, NULL);
 
     normal_path = idb_context->GetFilePathForTesting(
         webkit_database::GetIdentifierFromOrigin(kNormalOrigin));
@@ -94,7 +100,7 @@ TEST_F(IndexedDBTest, SetForceKeepSessionState) {
     // Create some indexedDB paths.
     // With the levelDB backend, these are directories.
     scoped_refptr<IndexedDBContextImpl> idb_context = new IndexedDBContextImpl(
-        temp_dir.path(), special_storage_policy_, NULL, task_runner_);
+        temp_dir.path(), special_storage_policy_, NULL, task_runner_, NULL);
 
     // Save session state. This should bypass the destruction-time deletion.
     idb_context->SetForceKeepSessionState();
@@ -154,7 +160,7 @@ TEST_F(IndexedDBTest, ForceCloseOpenDatabasesOnDelete) {
     const GURL kTestOrigin("http://test/");
 
     scoped_refptr<IndexedDBContextImpl> idb_context = new IndexedDBContextImpl(
-        temp_dir.path(), special_storage_policy_, NULL, task_runner_);
+        temp_dir.path(), special_storage_policy_, NULL, task_runner_, NULL);
 
     test_path = idb_context->GetFilePathForTesting(
         webkit_database::GetIdentifierFromOrigin(kTestOrigin));
@@ -204,7 +210,7 @@ TEST_F(IndexedDBTest, DeleteFailsIfDirectoryLocked) {
   const GURL kTestOrigin("http://test/");
 
   scoped_refptr<IndexedDBContextImpl> idb_context = new IndexedDBContextImpl(
-      temp_dir.path(), special_storage_policy_, NULL, task_runner_);
+      temp_dir.path(), special_storage_policy_, NULL, task_runner_, NULL);
 
   base::FilePath test_path = idb_context->GetFilePathForTesting(
       webkit_database::GetIdentifierFromOrigin(kTestOrigin));
@@ -230,7 +236,7 @@ TEST_F(IndexedDBTest, ForceCloseOpenDatabasesOnCommitFailure) {
   ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
 
   scoped_refptr<IndexedDBContextImpl> context = new IndexedDBContextImpl(
-      temp_dir.path(), special_storage_policy_, NULL, task_runner_);
+      temp_dir.path(), special_storage_policy_, NULL, task_runner_, NULL);
 
   scoped_refptr<IndexedDBFactory> factory = context->GetIDBFactory();
 
@@ -260,4 +266,67 @@ TEST_F(IndexedDBTest, ForceCloseOpenDatabasesOnCommitFailure) {
   EXPECT_FALSE(factory->IsBackingStoreOpen(kTestOrigin));
 }
 
+static void DummyOperation(IndexedDBTransaction* transaction) {}
+
+// A commit already handed to the origin's commit sequence keeps the backing
+// store, and with it the LevelDB lock, past the forced close, so deleting the
+// origin must wait for it.
+TEST_F(IndexedDBTest, DeleteForOriginWaitsForCommit) {
+  const GURL kTestOrigin("http://test/");
+
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+
+  scoped_refptr<IndexedDBContextImpl> context = new IndexedDBContextImpl(
+      temp_dir.path(), special_storage_policy_, NULL, task_runner_, NULL);
+
+  scoped_refptr<IndexedDBFactory> factory = context->GetIDBFactory();
+
+  scoped_refptr<MockIndexedDBCallbacks> callbacks(new MockIndexedDBCallbacks());
+  scoped_refptr<MockIndexedDBDatabaseCallbacks> db_callbacks(
+      new MockIndexedDBDatabaseCallbacks());
+  const int64 transaction_id1 = 1;
+  factory->Open(ASCIIToUTF16("db"),
+                IndexedDBDatabaseMetadata::DEFAULT_INT_VERSION,
+                transaction_id1,
+                callbacks,
+                db_callbacks,
+                kTestOrigin,
+                temp_dir.path());
+  ASSERT_TRUE(callbacks->connection());
+  context->ConnectionOpened(kTestOrigin, callbacks->connection());
+
+  base::FilePath test_path = context->GetFilePathForTesting(
+      webkit_database::GetIdentifierFromOrigin(kTestOrigin));
+  EXPECT_TRUE(base::DirectoryExists(test_path));
+
+  IndexedDBDatabase* database = callbacks->connection()->database();
+  scoped_refptr<base::TestSimpleTaskRunner> commit_task_runner(
+      new base::TestSimpleTaskRunner);
+  database->backing_store()->set_commit_task_runner(commit_task_runner.get());
+
+  const int64 transaction_id2 = 2;
+  scoped_refptr<IndexedDBTransaction> transaction = new IndexedDBTransaction(
+      transaction_id2,
+      callbacks->connection()->callbacks(),
+      std::set<int64>(),
+      indexed_db::TRANSACTION_READ_WRITE,
+      database,
+      new IndexedDBBackingStore::Transaction(database->backing_store()));
+  database->TransactionCreated(transaction);
+  transaction->ScheduleTask(base::Bind(&DummyOperation));
+  message_loop_.RunUntilIdle();
+  transaction->Commit();
+  ASSERT_TRUE(commit_task_runner->HasPendingTask());
+
+  context->DeleteForOrigin(kTestOrigin);
+  EXPECT_TRUE(db_callbacks->forced_close_called());
+  EXPECT_TRUE(base::DirectoryExists(test_path));
+
+  commit_task_runner->RunPendingTasks();
+  message_loop_.RunUntilIdle();
+  EXPECT_EQ(IndexedDBTransaction::FINISHED, transaction->state());
+  EXPECT_FALSE(base::DirectoryExists(test_path));
+}
+
 }  // namespace content
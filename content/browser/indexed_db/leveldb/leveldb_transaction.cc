@@ -4,6 +4,8 @@
 
 #include "content/browser/indexed_db/leveldb/leveldb_transaction.h"
 
+#include <algorithm>
+
 #include "base/logging.h"
 #include "content/browser/indexed_db/leveldb/leveldb_database.h"
 #include "content/browser/indexed_db/leveldb/leveldb_write_batch.h"
@@ -13,44 +15,203 @@ using base::StringPiece;
 
 namespace content {
 
+namespace {
+
+// Blocks are sized like LevelDB's own arena; larger requests get a block of
+// their own so that the current block is not wasted.
+const size_t kArenaBlockSize = 4096;
+
+}  // namespace
+
+LevelDBTransaction::Arena::Arena() : next_(NULL), remaining_(0) {}
+
+LevelDBTransaction::Arena::~Arena() { Reset(); }
+
+char* LevelDBTransaction::Arena::Allocate(size_t bytes) {
+  const size_t kAlignment = sizeof(void*);
+  bytes = (bytes + kAlignment - 1) & ~(kAlignment - 1);
+  if (bytes > remaining_) {
+    if (bytes > kArenaBlockSize / 4) {
+      blocks_.push_back(new char[bytes]);
+      return blocks_.back();
+    }
+    blocks_.push_back(new char[kArenaBlockSize]);
+    next_ = blocks_.back();
+    remaining_ = kArenaBlockSize;
+  }
+  char* result = next_;
+  next_ += bytes;
+  remaining_ -= bytes;
+  return result;
+}
+
+void LevelDBTransaction::Arena::Reset() {
+  for (size_t i = 0; i < blocks_.size(); ++i)
+    delete[] blocks_[i];
+  blocks_.clear();
+  next_ = NULL;
+  remaining_ = 0;
+}
+
 LevelDBTransaction::LevelDBTransaction(LevelDBDatabase* db)
     : db_(db),
       snapshot_(db),
       comparator_(db->Comparator()),
-      data_comparator_(comparator_),
-      data_(data_comparator_),
-      finished_(false) {}
+      head_memory_(new char[RecordSize(kMaxHeight)]),
+      head_(new (head_memory_.get()) Record),
+      max_height_(1),
+      random_(0xdeadbeef),
+      finished_(false) {
+  head_->deleted = false;
+  head_->height = kMaxHeight;
+  std::fill(head_->next, head_->next + kMaxHeight, static_cast<Record*>(NULL));
+  std::fill(fingers_, fingers_ + kFingerCount, static_cast<Record*>(NULL));
+}
+
+// static
+size_t LevelDBTransaction::RecordSize(int height) {
+  return sizeof(Record) + sizeof(Record*) * (height - 1);
+}
+
+LevelDBTransaction::Record* LevelDBTransaction::NewRecord(
+    const StringPiece& key,
+    int height) {
+  DCHECK_GE(height, 1);
+  DCHECK_LE(height, kMaxHeight);
+  Record* record = new (arena_.Allocate(RecordSize(height))) Record;
+  char* key_data = arena_.Allocate(key.size());
+  key.copy(key_data, key.size());
+  record->key.set(key_data, key.size());
+  record->deleted = false;
+  record->height = height;
+  std::fill(record->next, record->next + height, static_cast<Record*>(NULL));
+  return record;
+}
+
+int LevelDBTransaction::RandomHeight() {
+  // Each level holds a quarter of the records of the one below.
+  int height = 1;
+  while (height < kMaxHeight) {
+    random_ = random_ * 1103515245 + 12345;
+    if ((random_ >> 16) & 3)
+      break;
+    ++height;
+  }
+  return height;
+}
+
+LevelDBTransaction::Record* LevelDBTransaction::FindGreaterOrEqual(
+    const StringPiece& key,
+    Record** prev) const {
+  Record* record = head_;
+  // The record that ended the search on the level above; it need not be
+  // compared again.
+  Record* bound = NULL;
+  for (int level = max_height_ - 1; level >= 0; --level) {
+    Record* next = record->next[level];
+    while (next && next != bound && comparator_->Compare(next->key, key) < 0) {
+      record = next;
+      next = record->next[level];
+    }
+    bound = next;
+    if (prev)
+      prev[level] = record;
+  }
+  return record->next[0];
+}
+
+LevelDBTransaction::Record* LevelDBTransaction::FindLessThan(
+    const StringPiece& key) const {
+  Record* record = head_;
+  Record* bound = NULL;
+  for (int level = max_height_ - 1; level >= 0; --level) {
+    Record* next = record->next[level];
+    while (next && next != bound && comparator_->Compare(next->key, key) < 0) {
+      record = next;
+      next = record->next[level];
+    }
+    bound = next;
+  }
+  return record == head_ ? NULL : record;
+}
 
-LevelDBTransaction::Record::Record() : deleted(false) {}
-LevelDBTransaction::Record::~Record() {}
+LevelDBTransaction::Record* LevelDBTransaction::FindLast() const {
+  Record* record = head_;
+  for (int level = max_height_ - 1; level >= 0; --level) {
+    while (record->next[level])
+      record = record->next[level];
+  }
+  return record == head_ ? NULL : record;
+}
 
 void LevelDBTransaction::Clear() {
-  for (DataType::iterator it = data_.begin(); it != data_.end(); ++it) {
-    delete it->second;
+  // The arena only releases memory; the values need their destructors run.
+  for (Record* record = head_->next[0]; record;) {
+    Record* next = record->next[0];
+    record->~Record();
+    record = next;
   }
-  data_.clear();
+  arena_.Reset();
+  std::fill(head_->next, head_->next + kMaxHeight, static_cast<Record*>(NULL));
+  max_height_ = 1;
+  std::fill(fingers_, fingers_ + kFingerCount, static_cast<Record*>(NULL));
 }
 
-LevelDBTransaction::~LevelDBTransaction() { Clear(); }
+LevelDBTransaction::~LevelDBTransaction() {
+  Clear();
+  head_->~Record();
+}
+
+LevelDBTransaction::Record* LevelDBTransaction::FindAppendPoint(
+    const StringPiece& key,
+    int height) {
+  for (int i = 0; i < kFingerCount && fingers_[i]; ++i) {
+    Record* finger = fingers_[i];
+    if (finger->height < height ||
+        comparator_->Compare(key, finger->key) <= 0 ||
+        (finger->next[0] &&
+         comparator_->Compare(key, finger->next[0]->key) >= 0))
+      continue;
+    std::copy_backward(fingers_, fingers_ + i, fingers_ + i + 1);
+    return finger;
+  }
+  return NULL;
+}
 
 void LevelDBTransaction::Set(const StringPiece& key,
                              std::string* value,
                              bool deleted) {
   DCHECK(!finished_);
-  DataType::iterator it = data_.find(key);
-
-  if (it == data_.end()) {
-    Record* record = new Record();
-    record->key.assign(key.begin(), key.end() - key.begin());
-    record->value.swap(*value);
-    record->deleted = deleted;
-    data_[record->key] = record;
-    NotifyIterators();
-    return;
+  const int height = RandomHeight();
+  Record* prev[kMaxHeight];
+  if (Record* finger = FindAppendPoint(key, height)) {
+    // |key| goes right after |finger|, which is at least as tall as the new
+    // record and so precedes it on every level it is linked into.
+    std::fill(prev, prev + height, finger);
+  } else {
+    Record* record = FindGreaterOrEqual(key, prev);
+    if (record && !comparator_->Compare(record->key, key)) {
+      record->value.swap(*value);
+      record->deleted = deleted;
+      return;
+    }
+    for (int level = max_height_; level < height; ++level)
+      prev[level] = head_;
+    max_height_ = std::max(max_height_, height);
+    std::copy_backward(fingers_, fingers_ + kFingerCount - 1,
+                       fingers_ + kFingerCount);
   }
 
-  it->second->value.swap(*value);
-  it->second->deleted = deleted;
+  Record* record = NewRecord(key, height);
+  record->value.swap(*value);
+  record->deleted = deleted;
+  for (int level = 0; level < height; ++level) {
+    record->next[level] = prev[level]->next[level];
+    prev[level]->next[level] = record;
+  }
+  fingers_[0] = record;
+
+  NotifyIterators();
 }
 
 void LevelDBTransaction::Put(const StringPiece& key, std::string* value) {
@@ -67,14 +228,13 @@ bool LevelDBTransaction::Get(const StringPiece& key,
                              bool* found) {
   *found = false;
   DCHECK(!finished_);
-  std::string string_key(key.begin(), key.end() - key.begin());
-  DataType::const_iterator it = data_.find(string_key);
+  Record* record = FindGreaterOrEqual(key, NULL);
 
-  if (it != data_.end()) {
-    if (it->second->deleted)
+  if (record && !comparator_->Compare(record->key, key)) {
+    if (record->deleted)
       return true;
 
-    *value = it->second->value;
+    *value = record->value;
     *found = true;
     return true;
   }
@@ -90,19 +250,18 @@ bool LevelDBTransaction::Get(const StringPiece& key,
 bool LevelDBTransaction::Commit() {
   DCHECK(!finished_);
 
-  if (data_.empty()) {
+  if (!head_->next[0]) {
     finished_ = true;
     return true;
   }
 
   scoped_ptr<LevelDBWriteBatch> write_batch = LevelDBWriteBatch::Create();
 
-  for (DataType::iterator iterator = data_.begin(); iterator != data_.end();
-       ++iterator) {
-    if (!iterator->second->deleted)
-      write_batch->Put(iterator->first, iterator->second->value);
+  for (Record* record = head_->next[0]; record; record = record->next[0]) {
+    if (!record->deleted)
+      write_batch->Put(record->key, record->value);
     else
-      write_batch->Remove(iterator->first);
+      write_batch->Remove(record->key);
   }
 
   if (!db_->Write(*write_batch))
@@ -129,53 +288,49 @@ LevelDBTransaction::DataIterator::Create(LevelDBTransaction* transaction) {
 }
 
 bool LevelDBTransaction::DataIterator::IsValid() const {
-  return iterator_ != data_->end();
+  return !!record_;
 }
 
 void LevelDBTransaction::DataIterator::SeekToLast() {
-  iterator_ = data_->end();
-  if (iterator_ != data_->begin())
-    --iterator_;
+  record_ = transaction_->FindLast();
 }
 
 void LevelDBTransaction::DataIterator::Seek(const StringPiece& target) {
-  iterator_ = data_->lower_bound(target);
+  record_ = transaction_->FindGreaterOrEqual(target, NULL);
 }
 
 void LevelDBTransaction::DataIterator::Next() {
   DCHECK(IsValid());
-  ++iterator_;
+  record_ = record_->next[0];
 }
 
 void LevelDBTransaction::DataIterator::Prev() {
   DCHECK(IsValid());
-  if (iterator_ != data_->begin())
-    --iterator_;
-  else
-    iterator_ = data_->end();
+  // The list is singly linked; stepping back costs a search.
+  record_ = transaction_->FindLessThan(record_->key);
 }
 
 StringPiece LevelDBTransaction::DataIterator::Key() const {
   DCHECK(IsValid());
-  return iterator_->first;
+  return record_->key;
 }
 
 StringPiece LevelDBTransaction::DataIterator::Value() const {
   DCHECK(IsValid());
   DCHECK(!IsDeleted());
-  return iterator_->second->value;
+  return record_->value;
 }
 
 bool LevelDBTransaction::DataIterator::IsDeleted() const {
   DCHECK(IsValid());
-  return iterator_->second->deleted;
+  return record_->deleted;
 }
 
 LevelDBTransaction::DataIterator::~DataIterator() {}
 
 LevelDBTransaction::DataIterator::DataIterator(LevelDBTransaction* transaction)
-    : data_(&transaction->data_),
-      iterator_(data_->end()) {}
+    : transaction_(transaction),
+      record_(NULL) {}
 
 scoped_ptr<LevelDBTransaction::TransactionIterator>
 LevelDBTransaction::TransactionIterator::Create(
@@ -226,6 +381,15 @@ void LevelDBTransaction::TransactionIterator::Next() {
   if (data_changed_)
     RefreshDataIterator();
 
+  // Nothing buffered lies ahead (always the case for read-only transactions),
+  // so there is nothing to merge.
+  if (direction_ == FORWARD && current_ == db_iterator_.get() &&
+      !data_iterator_->IsValid()) {
+    db_iterator_->Next();
+    current_ = db_iterator_->IsValid() ? db_iterator_.get() : 0;
+    return;
+  }
+
   if (direction_ != FORWARD) {
     // Ensure the non-current iterator is positioned after Key().
 
@@ -256,6 +420,13 @@ void LevelDBTransaction::TransactionIterator::Prev() {
   if (data_changed_)
     RefreshDataIterator();
 
+  if (direction_ == REVERSE && current_ == db_iterator_.get() &&
+      !data_iterator_->IsValid()) {
+    db_iterator_->Prev();
+    current_ = db_iterator_->IsValid() ? db_iterator_.get() : 0;
+    return;
+  }
+
   if (direction_ != REVERSE) {
     // Ensure the non-current iterator is positioned before Key().
 
@@ -5,10 +5,11 @@
 #ifndef CONTENT_BROWSER_INDEXED_DB_LEVELDB_LEVELDB_TRANSACTION_H_
 #define CONTENT_BROWSER_INDEXED_DB_LEVELDB_LEVELDB_TRANSACTION_H_
 
-#include <map>
 #include <set>
 #include <string>
+#include <vector>
 
+#include "base/basictypes.h"
 #include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/strings/string_piece.h"
@@ -33,32 +34,44 @@ class CONTENT_EXPORT LevelDBTransaction
 
   scoped_ptr<LevelDBIterator> CreateIterator();
 
+  // Number of heap blocks holding the uncommitted writes.
+  size_t BufferBlockCountForTesting() const { return arena_.block_count(); }
+
  private:
   virtual ~LevelDBTransaction();
   friend class base::RefCounted<LevelDBTransaction>;
 
-  struct Record {
-    Record();
-    ~Record();
-    std::string key;
-    std::string value;
-    bool deleted;
-  };
-
-  class Comparator {
+  // Hands out memory from large blocks that are freed all at once, so
+  // buffering a write costs no heap allocation of its own.
+  class Arena {
    public:
-    explicit Comparator(const LevelDBComparator* comparator)
-        : comparator_(comparator) {}
-    bool operator()(const base::StringPiece& a,
-                    const base::StringPiece& b) const {
-      return comparator_->Compare(a, b) < 0;
-    }
+    Arena();
+    ~Arena();
+    // Returns pointer-aligned memory that stays valid until Reset().
+    char* Allocate(size_t bytes);
+    void Reset();
+    size_t block_count() const { return blocks_.size(); }
 
    private:
-    const LevelDBComparator* comparator_;
+    std::vector<char*> blocks_;
+    char* next_;
+    size_t remaining_;
+
+    DISALLOW_COPY_AND_ASSIGN(Arena);
   };
 
-  typedef std::map<base::StringPiece, Record*, Comparator> DataType;
+  // The uncommitted writes are kept sorted in a skip list whose records,
+  // keys included, live in |arena_|. Records are never unlinked; Remove()
+  // stores a delete marker.
+  struct Record {
+    base::StringPiece key;
+    std::string value;
+    bool deleted;
+    int height;
+    // Successors on levels 0 to |height| - 1; allocated to fit.
+    Record* next[1];
+  };
+  enum { kMaxHeight = 12, kFingerCount = 4 };
 
   class DataIterator : public LevelDBIterator {
    public:
@@ -76,8 +89,8 @@ class CONTENT_EXPORT LevelDBTransaction
 
    private:
     explicit DataIterator(LevelDBTransaction* transaction);
-    DataType* data_;
-    DataType::iterator iterator_;
+    LevelDBTransaction* transaction_;
+    Record* record_;
   };
 
   class TransactionIterator : public LevelDBIterator {
@@ -119,6 +132,18 @@ class CONTENT_EXPORT LevelDBTransaction
   };
 
   void Set(const base::StringPiece& key, std::string* value, bool deleted);
+  static size_t RecordSize(int height);
+  Record* NewRecord(const base::StringPiece& key, int height);
+  int RandomHeight();
+  // Returns the record |key| directly follows if that is one of the most
+  // recently inserted records and it is at least |height| tall, else NULL.
+  Record* FindAppendPoint(const base::StringPiece& key, int height);
+  // Returns the first record at or after |key|. If |prev| is given, it is
+  // filled with the last record before |key| on every level.
+  Record* FindGreaterOrEqual(const base::StringPiece& key,
+                             Record** prev) const;
+  Record* FindLessThan(const base::StringPiece& key) const;
+  Record* FindLast() const;
   void Clear();
   void RegisterIterator(TransactionIterator* iterator);
   void UnregisterIterator(TransactionIterator* iterator);
@@ -127,8 +152,15 @@ class CONTENT_EXPORT LevelDBTransaction
   LevelDBDatabase* db_;
   const LevelDBSnapshot snapshot_;
   const LevelDBComparator* comparator_;
-  Comparator data_comparator_;
-  DataType data_;
+  Arena arena_;
+  scoped_ptr<char[]> head_memory_;
+  Record* head_;
+  int max_height_;
+  uint32 random_;
+  // Bulk loads write a few runs of increasing keys at once: records, their
+  // existence entries and each index. The latest record of each run, most
+  // recent first, lets the next key of the run be linked in without a search.
+  Record* fingers_[kFingerCount];
   bool finished_;
   std::set<TransactionIterator*> iterators_;
 };
@@ -4,13 +4,17 @@
 
 #include <algorithm>
 #include <cstring>
+#include <map>
 #include <string>
 
 #include "base/files/file_path.h"
 #include "base/files/scoped_temp_dir.h"
+#include "base/logging.h"
 #include "base/platform_file.h"
 #include "base/strings/string16.h"
 #include "base/strings/string_piece.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
 #include "content/browser/indexed_db/leveldb/leveldb_comparator.h"
 #include "content/browser/indexed_db/leveldb/leveldb_database.h"
 #include "content/browser/indexed_db/leveldb/leveldb_iterator.h"
@@ -245,6 +249,129 @@ TEST(LevelDBDatabaseTest, TransactionCommitTest) {
   EXPECT_EQ(value3, got_value);
 }
 
+TEST(LevelDBDatabaseTest, TransactionMatchesModel) {
+  SimpleComparator comparator;
+  scoped_ptr<LevelDBDatabase> leveldb =
+      LevelDBDatabase::OpenInMemory(&comparator);
+  ASSERT_TRUE(leveldb);
+
+  // Keys are fixed width since SimpleComparator ignores length.
+  std::map<std::string, std::string> model;
+  uint32 random = 42;
+  for (int i = 0; i < 50; ++i) {
+    random = random * 1103515245 + 12345;
+    std::string key = base::StringPrintf("%04u", (random >> 16) % 400);
+    std::string value = base::StringPrintf("db%d", i);
+    model[key] = value;
+    ASSERT_TRUE(leveldb->Put(key, &value));
+  }
+
+  scoped_refptr<LevelDBTransaction> transaction =
+      new LevelDBTransaction(leveldb.get());
+  for (int i = 0; i < 2000; ++i) {
+    random = random * 1103515245 + 12345;
+    // Mix runs of increasing keys, which take the append fast path, with
+    // random ones.
+    uint32 n = (i % 3) ? (i / 3) % 400 : (random >> 16) % 400;
+    std::string key = base::StringPrintf("%04u", n);
+    if ((random >> 8) % 4 == 0) {
+      transaction->Remove(key);
+      model.erase(key);
+    } else {
+      std::string value = base::StringPrintf("txn%d", i);
+      model[key] = value;
+      transaction->Put(key, &value);
+    }
+  }
+
+  for (uint32 n = 0; n < 400; ++n) {
+    std::string key = base::StringPrintf("%04u", n);
+    std::string value;
+    bool found = false;
+    EXPECT_TRUE(transaction->Get(key, &value, &found));
+    std::map<std::string, std::string>::const_iterator it = model.find(key);
+    EXPECT_EQ(it != model.end(), found) << key;
+    if (found && it != model.end())
+      EXPECT_EQ(it->second, value);
+  }
+
+  scoped_ptr<LevelDBIterator> it = transaction->CreateIterator();
+  std::map<std::string, std::string>::const_iterator expected = model.begin();
+  for (it->Seek(std::string()); it->IsValid(); it->Next(), ++expected) {
+    ASSERT_TRUE(expected != model.end());
+    EXPECT_EQ(expected->first, it->Key().as_string());
+    EXPECT_EQ(expected->second, it->Value().as_string());
+  }
+  EXPECT_TRUE(expected == model.end());
+
+  std::map<std::string, std::string>::const_reverse_iterator reverse =
+      model.rbegin();
+  for (it->SeekToLast(); it->IsValid(); it->Prev(), ++reverse) {
+    ASSERT_TRUE(reverse != model.rend());
+    EXPECT_EQ(reverse->first, it->Key().as_string());
+  }
+  EXPECT_TRUE(reverse == model.rend());
+  it.reset();
+
+  EXPECT_TRUE(transaction->Commit());
+  it = leveldb->CreateIterator();
+  expected = model.begin();
+  for (it->Seek(std::string()); it->IsValid(); it->Next(), ++expected) {
+    ASSERT_TRUE(expected != model.end());
+    EXPECT_EQ(expected->first, it->Key().as_string());
+    EXPECT_EQ(expected->second, it->Value().as_string());
+  }
+  EXPECT_TRUE(expected == model.end());
+}
+
+// Simulates bulk-loading an object store with one index: each record writes
+// its data under an increasing primary key and an index entry under an
+// unrelated key.
+TEST(LevelDBDatabaseTest, DISABLED_TransactionBulkLoadPerf) {
+  const int kRecords = 100000;
+  SimpleComparator comparator;
+  scoped_ptr<LevelDBDatabase> leveldb =
+      LevelDBDatabase::OpenInMemory(&comparator);
+  ASSERT_TRUE(leveldb);
+
+  for (int scrambled = 0; scrambled < 2; ++scrambled) {
+    scoped_refptr<LevelDBTransaction> transaction =
+        new LevelDBTransaction(leveldb.get());
+    const std::string value(100, 'v');
+    base::TimeTicks start = base::TimeTicks::Now();
+    for (int i = 0; i < kRecords; ++i) {
+      std::string put_value = value;
+      transaction->Put(base::StringPrintf("d%d:%010d", scrambled, i),
+                       &put_value);
+      uint32 index_key = scrambled ? i * 2654435761u : i;
+      put_value = value;
+      transaction->Put(base::StringPrintf("i%d:%010u", scrambled, index_key),
+                       &put_value);
+    }
+    base::TimeDelta put_time = base::TimeTicks::Now() - start;
+
+    start = base::TimeTicks::Now();
+    scoped_ptr<LevelDBIterator> it = transaction->CreateIterator();
+    int count = 0;
+    for (it->Seek(std::string()); it->IsValid(); it->Next())
+      ++count;
+    base::TimeDelta walk_time = base::TimeTicks::Now() - start;
+    it.reset();
+
+    LOG(INFO) << base::StringPrintf(
+        "%s index keys: %.0f records/sec, %d buffer blocks for %d puts, "
+        "%d-entry walk in %.1f ms",
+        scrambled ? "scrambled" : "increasing",
+        kRecords / put_time.InSecondsF(),
+        static_cast<int>(transaction->BufferBlockCountForTesting()),
+        2 * kRecords,
+        count,
+        walk_time.InMillisecondsF());
+    EXPECT_EQ(2 * kRecords, count);
+    transaction->Rollback();
+  }
+}
+
 TEST(LevelDB, Locking) {
   base::ScopedTempDir temp_directory;
   ASSERT_TRUE(temp_directory.CreateUniqueTempDir());
@@ -40,6 +40,10 @@ static int kBufferSize = 1024 * 512;
 static int kMinAllocationSize = 1024 * 4;
 static int kMaxAllocationSize = 1024 * 32;
 
+// Allocations grow while reads keep filling them, but leave room for this many
+// in the buffer so that the renderer can drain some while others are filled.
+const int kMinAllocationsPerBuffer = 4;
+
 void GetNumericArg(const std::string& name, int* result) {
   const std::string& value =
       CommandLine::ForCurrentProcess()->GetSwitchValueASCII(name);
@@ -220,6 +224,39 @@ bool AsyncResourceHandler::OnWillStart(int request_id,
   return true;
 }
 
+// static
+int AsyncResourceHandler::GetBufferSizeForContentLength(int64 content_length) {
+  InitializeResourceBufferConstants();
+  if (content_length < 0 || content_length >= kBufferSize)
+    return kBufferSize;
+
+  // Leave room for bodies that decode to more than their Content-Length, as
+  // compressed ones do.  A buffer that turns out too small only makes the
+  // request wait for ACKs; it is shared memory that is wasted otherwise.
+  int size = std::max(static_cast<int>(content_length) * 2, kMaxAllocationSize);
+  size = (size + kMinAllocationSize - 1) / kMinAllocationSize *
+      kMinAllocationSize;
+  return std::min(size, kBufferSize);
+}
+
+// static
+int AsyncResourceHandler::GetNextMaxAllocationSize(int max_allocation_size,
+                                                   int allocation_size,
+                                                   int bytes_read,
+                                                   int buffer_size) {
+  // Only a read that filled a full-sized allocation suggests that the network
+  // produces data faster than we hand it out, i.e. that larger allocations
+  // would save DataReceived messages.
+  if (allocation_size < max_allocation_size || bytes_read < allocation_size)
+    return max_allocation_size;
+
+  InitializeResourceBufferConstants();
+  int limit = buffer_size / kMinAllocationsPerBuffer / kMinAllocationSize *
+      kMinAllocationSize;
+  return std::max(max_allocation_size,
+                  std::min(max_allocation_size * 2, limit));
+}
+
 bool AsyncResourceHandler::OnWillRead(int request_id,
                                       scoped_refptr<net::IOBuffer>* buf,
                                       int* buf_size,
@@ -254,6 +291,9 @@ bool AsyncResourceHandler::OnReadCompleted(int request_id, int bytes_read,
     return false;
 
   buffer_->ShrinkLastAllocation(bytes_read);
+  buffer_->SetMaxAllocationSize(GetNextMaxAllocationSize(
+      buffer_->max_allocation_size(), allocation_size_, bytes_read,
+      buffer_->buffer_size()));
 
   UMA_HISTOGRAM_CUSTOM_COUNTS(
       "Net.AsyncResourceHandler_SharedIOBuffer_Used",
@@ -370,10 +410,14 @@ bool AsyncResourceHandler::EnsureResourceBufferIsInitialized() {
     }
   }
 
+  // Size the buffer for the response, as hundreds of small responses may be
+  // loading at once.
+  int buffer_size =
+      GetBufferSizeForContentLength(request()->GetExpectedContentSize());
   buffer_ = new ResourceBuffer();
-  return buffer_->Initialize(kBufferSize,
+  return buffer_->Initialize(buffer_size,
                              kMinAllocationSize,
-                             kMaxAllocationSize);
+                             std::min(kMaxAllocationSize, buffer_size));
 }
 
 void AsyncResourceHandler::ResumeIfDeferred() {
@@ -63,6 +63,20 @@ class AsyncResourceHandler : public ResourceHandler,
   virtual void OnDataDownloaded(int request_id,
                                 int bytes_downloaded) OVERRIDE;
 
+  // Returns the size of the shared memory buffer for a response whose body is
+  // expected to be |content_length| bytes long, or of unknown length if
+  // |content_length| is negative.
+  static int GetBufferSizeForContentLength(int64 content_length);
+
+  // Returns the preferred allocation size for the next read, given that the
+  // last read put |bytes_read| bytes into an allocation of |allocation_size|
+  // bytes while allocations were capped at |max_allocation_size| bytes, in a
+  // buffer of |buffer_size| bytes.
+  static int GetNextMaxAllocationSize(int max_allocation_size,
+                                      int allocation_size,
+                                      int bytes_read,
+                                      int buffer_size);
+
  private:
   // IPC message handlers:
   void OnFollowRedirect(int request_id,
@@ -0,0 +1,133 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "content/browser/loader/async_resource_handler.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/strings/stringprintf.h"
+#include "content/browser/loader/resource_buffer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace content {
+
+namespace {
+
+const int kKB = 1024;
+
+// Counts the DataReceived messages and the shared memory needed to load a
+// response body of |body_size| bytes, with the network producing at most
+// |read_size| bytes per read and the renderer ACKing each message before the
+// next read. Fixed sizing uses a 512 KB buffer and 32 KB allocations for
+// every response.
+void LoadResponse(int body_size,
+                  int read_size,
+                  bool adaptive,
+                  int* messages,
+                  int* shared_memory_size) {
+  int buffer_size = adaptive ?
+      AsyncResourceHandler::GetBufferSizeForContentLength(body_size) :
+      512 * kKB;
+  scoped_refptr<ResourceBuffer> buffer = new ResourceBuffer();
+  ASSERT_TRUE(buffer->Initialize(buffer_size, 4 * kKB,
+                                 std::min(32 * kKB, buffer_size)));
+  *shared_memory_size = buffer_size;
+  *messages = 1;  // SetDataBuffer.
+
+  int bytes_left = body_size;
+  while (bytes_left > 0) {
+    int allocation_size = 0;
+    ASSERT_TRUE(buffer->Allocate(&allocation_size));
+    int bytes_read = std::min(std::min(allocation_size, read_size),
+                              bytes_left);
+    buffer->ShrinkLastAllocation(bytes_read);
+    if (adaptive) {
+      buffer->SetMaxAllocationSize(
+          AsyncResourceHandler::GetNextMaxAllocationSize(
+              buffer->max_allocation_size(), allocation_size, bytes_read,
+              buffer->buffer_size()));
+    }
+    buffer->RecycleLeastRecentlyAllocated();
+    bytes_left -= bytes_read;
+    ++*messages;
+  }
+}
+
+}  // namespace
+
+TEST(AsyncResourceHandlerTest, BufferSizeForContentLength) {
+  // Unknown and large bodies get the full buffer.
+  EXPECT_EQ(512 * kKB,
+            AsyncResourceHandler::GetBufferSizeForContentLength(-1));
+  EXPECT_EQ(512 * kKB,
+            AsyncResourceHandler::GetBufferSizeForContentLength(10000000));
+  EXPECT_EQ(512 * kKB,
+            AsyncResourceHandler::GetBufferSizeForContentLength(300 * kKB));
+
+  // Small bodies get room for twice their length, in whole allocations, and
+  // at least one full-sized allocation.
+  EXPECT_EQ(32 * kKB, AsyncResourceHandler::GetBufferSizeForContentLength(0));
+  EXPECT_EQ(32 * kKB,
+            AsyncResourceHandler::GetBufferSizeForContentLength(2 * kKB));
+  EXPECT_EQ(204 * kKB,
+            AsyncResourceHandler::GetBufferSizeForContentLength(
+                100 * kKB + 1));
+}
+
+TEST(AsyncResourceHandlerTest, NextMaxAllocationSize) {
+  // Reads which do not fill the allocation leave it alone.
+  EXPECT_EQ(32 * kKB, AsyncResourceHandler::GetNextMaxAllocationSize(
+      32 * kKB, 32 * kKB, 10 * kKB, 512 * kKB));
+  // So do allocations cut short by the space left in the buffer.
+  EXPECT_EQ(32 * kKB, AsyncResourceHandler::GetNextMaxAllocationSize(
+      32 * kKB, 8 * kKB, 8 * kKB, 512 * kKB));
+
+  // Full reads double it, up to a quarter of the buffer.
+  EXPECT_EQ(64 * kKB, AsyncResourceHandler::GetNextMaxAllocationSize(
+      32 * kKB, 32 * kKB, 32 * kKB, 512 * kKB));
+  EXPECT_EQ(128 * kKB, AsyncResourceHandler::GetNextMaxAllocationSize(
+      128 * kKB, 128 * kKB, 128 * kKB, 512 * kKB));
+
+  // It never shrinks, even when the buffer is small.
+  EXPECT_EQ(32 * kKB, AsyncResourceHandler::GetNextMaxAllocationSize(
+      32 * kKB, 32 * kKB, 32 * kKB, 32 * kKB));
+}
+
+// Compares the DataReceived messages and the shared memory used by a page of
+// many small resources and a few large ones with fixed and adaptive sizing.
+TEST(AsyncResourceHandlerTest, DISABLED_PageLoadPerf) {
+  std::vector<int> body_sizes;
+  for (int i = 0; i < 200; ++i)
+    body_sizes.push_back((1 + i % 10) * kKB);
+  for (int i = 0; i < 40; ++i)
+    body_sizes.push_back((20 + i * 2) * kKB);
+  for (int i = 0; i < 4; ++i)
+    body_sizes.push_back((1 + i) * 1024 * kKB);
+
+  const int kReadSizes[] = { 16 * kKB, 256 * kKB };
+  for (size_t i = 0; i < arraysize(kReadSizes); ++i) {
+    for (int adaptive = 0; adaptive < 2; ++adaptive) {
+      int total_messages = 0;
+      int64 total_shared_memory = 0;
+      for (size_t j = 0; j < body_sizes.size(); ++j) {
+        int messages = 0;
+        int shared_memory_size = 0;
+        LoadResponse(body_sizes[j], kReadSizes[i], adaptive != 0, &messages,
+                     &shared_memory_size);
+        total_messages += messages;
+        total_shared_memory += shared_memory_size;
+      }
+      LOG(INFO) << base::StringPrintf(
+          "%d responses, reads of up to %d KB, %s sizing: %d messages, "
+          "%d KB of shared memory",
+          static_cast<int>(body_sizes.size()), kReadSizes[i] / kKB,
+          adaptive ? "adaptive" : "fixed", total_messages,
+          static_cast<int>(total_shared_memory / kKB));
+    }
+  }
+}
+
+}  // namespace content
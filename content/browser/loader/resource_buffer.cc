@@ -178,4 +178,11 @@ void ResourceBuffer::RecycleLeastRecentlyAllocated() {
   }
 }
 
+void ResourceBuffer::SetMaxAllocationSize(int max_allocation_size) {
+  DCHECK(IsInitialized());
+  DCHECK_GE(max_allocation_size, min_alloc_size_);
+  DCHECK_EQ(0, max_allocation_size % min_alloc_size_);
+  max_alloc_size_ = max_allocation_size;
+}
+
 }  // namespace content
@@ -99,6 +99,14 @@ class CONTENT_EXPORT ResourceBuffer
   // above the class for more details about this method.
   void RecycleLeastRecentlyAllocated();
 
+  // Changes the preferred size of the segments returned by Allocate, e.g. to
+  // follow the rate at which data is produced.  It must be a multiple of the
+  // min_allocation_size given to Initialize.
+  void SetMaxAllocationSize(int max_allocation_size);
+
+  int buffer_size() const { return buf_size_; }
+  int max_allocation_size() const { return max_alloc_size_; }
+
  private:
   friend class base::RefCountedThreadSafe<ResourceBuffer>;
   ~ResourceBuffer();
@@ -134,4 +134,26 @@ TEST(ResourceBufferTest, Full) {
   EXPECT_FALSE(buf->CanAllocate());
 }
 
+TEST(ResourceBufferTest, SetMaxAllocationSize) {
+  scoped_refptr<ResourceBuffer> buf = new ResourceBuffer();
+  EXPECT_TRUE(buf->Initialize(100, 5, 10));
+  EXPECT_EQ(100, buf->buffer_size());
+
+  int size;
+  buf->Allocate(&size);
+  EXPECT_EQ(10, size);
+
+  buf->SetMaxAllocationSize(40);
+  EXPECT_EQ(40, buf->max_allocation_size());
+  buf->Allocate(&size);
+  EXPECT_EQ(40, size);
+  EXPECT_EQ(10, buf->GetLastAllocationOffset());
+
+  // Only the space left is handed out.
+  buf->SetMaxAllocationSize(60);
+  buf->Allocate(&size);
+  EXPECT_EQ(50, size);
+  EXPECT_FALSE(buf->CanAllocate());
+}
+
 }  // namespace content
@@ -746,6 +746,10 @@ void ResourceDispatcherHostImpl::DidReceiveResponse(ResourceLoader* loader) {
           render_process_id, render_view_id, base::Passed(&detail)));
 }
 
+void ResourceDispatcherHostImpl::DidCompleteResponse(ResourceLoader* loader) {
+  scheduler_->OnRequestCompleted(loader->request());
+}
+
 void ResourceDispatcherHostImpl::DidFinishLoading(ResourceLoader* loader) {
   ResourceRequestInfo* info = loader->GetRequestInfo();
 
@@ -269,6 +269,7 @@ class CONTENT_EXPORT ResourceDispatcherHostImpl
   virtual void DidReceiveRedirect(ResourceLoader* loader,
                                   const GURL& new_url) OVERRIDE;
   virtual void DidReceiveResponse(ResourceLoader* loader) OVERRIDE;
+  virtual void DidCompleteResponse(ResourceLoader* loader) OVERRIDE;
   virtual void DidFinishLoading(ResourceLoader* loader) OVERRIDE;
 
   // Extracts the render view/process host's identifiers from the given request
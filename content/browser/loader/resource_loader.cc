@@ -624,6 +624,8 @@ void ResourceLoader::ResponseCompleted() {
         ssl_info.connection_status, signed_certificate_timestamp_ids);
   }
 
+  delegate_->DidCompleteResponse(this);
+
   bool defer = false;
   handler_->OnResponseCompleted(info->GetRequestID(), request_->status(),
                                 security_info, &defer);
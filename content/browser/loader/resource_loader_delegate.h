@@ -36,6 +36,10 @@ class CONTENT_EXPORT ResourceLoaderDelegate {
                                   const GURL& new_url) = 0;
   virtual void DidReceiveResponse(ResourceLoader* loader) = 0;
 
+  // Called when the request has read its whole response or failed, before
+  // the resource handlers may defer finishing it.
+  virtual void DidCompleteResponse(ResourceLoader* loader) = 0;
+
   // This method informs the delegate that the loader is done, and the loader
   // expects to be destroyed as a side-effect of this call.
   virtual void DidFinishLoading(ResourceLoader* loader) = 0;
@@ -196,6 +196,7 @@ class ResourceLoaderTest : public testing::Test,
   virtual void DidReceiveRedirect(ResourceLoader* loader,
                                   const GURL& new_url) OVERRIDE {}
   virtual void DidReceiveResponse(ResourceLoader* loader) OVERRIDE {}
+  virtual void DidCompleteResponse(ResourceLoader* loader) OVERRIDE {}
   virtual void DidFinishLoading(ResourceLoader* loader) OVERRIDE {}
 
   content::TestBrowserThreadBundle thread_bundle_;
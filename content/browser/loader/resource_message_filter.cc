@@ -4,14 +4,45 @@
 
 #include "content/browser/loader/resource_message_filter.h"
 
+#include "base/bind.h"
+#include "base/message_loop/message_loop.h"
 #include "content/browser/appcache/chrome_appcache_service.h"
 #include "content/browser/fileapi/chrome_blob_storage_context.h"
 #include "content/browser/loader/resource_dispatcher_host_impl.h"
+#include "content/common/resource_messages.h"
 #include "content/public/browser/resource_context.h"
 #include "webkit/browser/fileapi/file_system_context.h"
 
 namespace content {
 
+namespace {
+
+// Upper bound on the number of messages nested in one batch, which keeps the
+// batch itself well under the IPC message size limit.
+const size_t kMaxBatchedMessages = 64;
+
+// Returns true if |message| may be delayed until the end of the current task
+// and nested in a ResourceMsg_MessageBatch. Messages which carry handles, such
+// as ResourceMsg_SetDataBuffer, cannot be nested.
+bool CanBatchMessage(const IPC::Message& message) {
+  switch (message.type()) {
+    case ResourceMsg_UploadProgress::ID:
+    case ResourceMsg_ReceivedResponse::ID:
+    case ResourceMsg_ReceivedCachedMetadata::ID:
+    case ResourceMsg_DataReceived::ID:
+    case ResourceMsg_DataDownloaded::ID:
+    case ResourceMsg_RequestComplete::ID:
+      return true;
+
+    default:
+      break;
+  }
+
+  return false;
+}
+
+}  // namespace
+
 ResourceMessageFilter::ResourceMessageFilter(
     int child_id,
     int process_type,
@@ -32,6 +63,9 @@ ResourceMessageFilter::~ResourceMessageFilter() {
 }
 
 void ResourceMessageFilter::OnChannelClosing() {
+  // Nobody is left to receive the queued messages.
+  pending_messages_.clear();
+
   // Unhook us from all pending network requests so they don't get sent to a
   // deleted object.
   ResourceDispatcherHostImpl::Get()->CancelRequestsForProcess(child_id_);
@@ -43,6 +77,29 @@ bool ResourceMessageFilter::OnMessageReceived(const IPC::Message& message,
       message, this, message_was_ok);
 }
 
+bool ResourceMessageFilter::Send(IPC::Message* message) {
+  // Messages sent from other threads are posted to the IO thread by
+  // BrowserMessageFilter, which then calls back into this method.
+  if (!BrowserThread::CurrentlyOn(BrowserThread::IO))
+    return SendImmediately(message);
+
+  if (!CanBatchMessage(*message)) {
+    FlushPendingMessages();
+    return SendImmediately(message);
+  }
+
+  if (pending_messages_.empty()) {
+    base::MessageLoop::current()->PostTask(
+        FROM_HERE,
+        base::Bind(&ResourceMessageFilter::FlushPendingMessages,
+                   weak_ptr_factory_.GetWeakPtr()));
+  }
+  pending_messages_.push_back(message);
+  if (pending_messages_.size() >= kMaxBatchedMessages)
+    FlushPendingMessages();
+  return true;
+}
+
 void ResourceMessageFilter::GetContexts(
     const ResourceHostMsg_Request& request,
     ResourceContext** resource_context,
@@ -54,4 +111,27 @@ base::WeakPtr<ResourceMessageFilter> ResourceMessageFilter::GetWeakPtr() {
   return weak_ptr_factory_.GetWeakPtr();
 }
 
+bool ResourceMessageFilter::SendImmediately(IPC::Message* message) {
+  return BrowserMessageFilter::Send(message);
+}
+
+void ResourceMessageFilter::FlushPendingMessages() {
+  if (pending_messages_.empty())
+    return;
+
+  if (pending_messages_.size() == 1) {
+    IPC::Message* message = pending_messages_[0];
+    pending_messages_.weak_clear();
+    SendImmediately(message);
+    return;
+  }
+
+  std::vector<IPC::Message> messages;
+  messages.reserve(pending_messages_.size());
+  for (size_t i = 0; i < pending_messages_.size(); ++i)
+    messages.push_back(*pending_messages_[i]);
+  pending_messages_.clear();
+  SendImmediately(new ResourceMsg_MessageBatch(messages));
+}
+
 }  // namespace content
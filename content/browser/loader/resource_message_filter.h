@@ -7,6 +7,7 @@
 
 #include "base/callback_forward.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
 #include "base/memory/weak_ptr.h"
 #include "content/common/content_export.h"
 #include "content/public/browser/browser_message_filter.h"
@@ -54,6 +55,13 @@ class CONTENT_EXPORT ResourceMessageFilter : public BrowserMessageFilter {
   virtual bool OnMessageReceived(const IPC::Message& message,
                                  bool* message_was_ok) OVERRIDE;
 
+  // Response messages sent on the IO thread (ReceivedResponse, DataReceived,
+  // RequestComplete and the like) are queued and sent at the end of the
+  // current IO thread task, as a single ResourceMsg_MessageBatch when more
+  // than one was queued. Any other message flushes the queue before it is
+  // sent, so the child sees all messages in the order they were sent.
+  virtual bool Send(IPC::Message* message) OVERRIDE;
+
   void GetContexts(const ResourceHostMsg_Request& request,
                    ResourceContext** resource_context,
                    net::URLRequestContext** request_context);
@@ -83,7 +91,13 @@ class CONTENT_EXPORT ResourceMessageFilter : public BrowserMessageFilter {
   // Protected destructor so that we can be overriden in tests.
   virtual ~ResourceMessageFilter();
 
+  // Sends |message| to the child without queueing it. Virtual for testing.
+  virtual bool SendImmediately(IPC::Message* message);
+
  private:
+  // Sends the queued response messages, if any.
+  void FlushPendingMessages();
+
   // The ID of the child process.
   int child_id_;
 
@@ -95,6 +109,10 @@ class CONTENT_EXPORT ResourceMessageFilter : public BrowserMessageFilter {
 
   GetContextsCallback get_contexts_callback_;
 
+  // Response messages waiting for FlushPendingMessages(). Only used on the IO
+  // thread.
+  ScopedVector<IPC::Message> pending_messages_;
+
   // This must come last to make sure weak pointers are invalidated first.
   base::WeakPtrFactory<ResourceMessageFilter> weak_ptr_factory_;
 
@@ -4,6 +4,8 @@
 
 #include "content/browser/loader/resource_scheduler.h"
 
+#include <algorithm>
+
 #include "base/stl_util.h"
 #include "content/common/resource_messages.h"
 #include "content/browser/loader/resource_message_delegate.h"
@@ -13,6 +15,7 @@
 #include "ipc/ipc_message_macros.h"
 #include "net/base/host_port_pair.h"
 #include "net/base/load_flags.h"
+#include "net/base/load_timing_info.h"
 #include "net/base/request_priority.h"
 #include "net/http/http_server_properties.h"
 #include "net/url_request/url_request.h"
@@ -22,6 +25,16 @@ namespace content {
 
 static const size_t kMaxNumDelayableRequestsPerClient = 10;
 static const size_t kMaxNumDelayableRequestsPerHost = 6;
+static const size_t kMinNumDelayableRequestsPerHost = 2;
+
+// Number of completed requests needed before a host's timings are trusted.
+static const int kMinHostLoadSamples = 3;
+
+// Weight of a new observation in the smoothed host timings, as a fraction.
+static const int kHostLoadSmoothingDivisor = 4;
+
+// Bounds the memory used by the host timings.
+static const size_t kMaxHostLoadStatsEntries = 256;
 
 // A thin wrapper around net::PriorityQueue that deals with
 // ScheduledResourceRequests instead of PriorityQueue::Pointers.
@@ -186,7 +199,8 @@ struct ResourceScheduler::Client {
   RequestSet in_flight_requests;
 };
 
-ResourceScheduler::ResourceScheduler() {
+ResourceScheduler::ResourceScheduler()
+    : host_load_stats_(kMaxHostLoadStatsEntries) {
 }
 
 ResourceScheduler::~ResourceScheduler() {
@@ -249,6 +263,83 @@ void ResourceScheduler::RemoveRequest(ScheduledResourceRequest* request) {
   }
 }
 
+void ResourceScheduler::OnRequestCompleted(
+    const net::URLRequest* url_request) {
+  DCHECK(CalledOnValidThread());
+  if (!url_request->url().SchemeIsHTTPOrHTTPS() ||
+      url_request->status().status() != net::URLRequestStatus::SUCCESS ||
+      url_request->is_pending() || url_request->was_cached()) {
+    return;
+  }
+
+  net::HostPortPair host_port_pair =
+      net::HostPortPair::FromURL(url_request->url());
+  if (url_request->context()->http_server_properties()->SupportsSpdy(
+          host_port_pair)) {
+    return;
+  }
+
+  net::LoadTimingInfo load_timing_info;
+  url_request->GetLoadTimingInfo(&load_timing_info);
+  if (load_timing_info.send_start.is_null() ||
+      load_timing_info.receive_headers_end.is_null()) {
+    return;
+  }
+
+  RecordHostLoadTimings(
+      host_port_pair,
+      load_timing_info.receive_headers_end - load_timing_info.send_start,
+      base::TimeTicks::Now() - load_timing_info.receive_headers_end);
+}
+
+void ResourceScheduler::RecordHostLoadTimings(
+    const net::HostPortPair& host_port_pair,
+    base::TimeDelta round_trip_time,
+    base::TimeDelta transfer_time) {
+  DCHECK(CalledOnValidThread());
+  HostLoadStatsCache::iterator it = host_load_stats_.Get(host_port_pair);
+  if (it == host_load_stats_.end())
+    it = host_load_stats_.Put(host_port_pair, HostLoadStats());
+
+  HostLoadStats& stats = it->second;
+  if (stats.samples == 0) {
+    stats.round_trip_time = round_trip_time;
+    stats.transfer_time = transfer_time;
+  } else {
+    stats.round_trip_time += (round_trip_time - stats.round_trip_time) /
+        kHostLoadSmoothingDivisor;
+    stats.transfer_time += (transfer_time - stats.transfer_time) /
+        kHostLoadSmoothingDivisor;
+  }
+  ++stats.samples;
+}
+
+// An HTTP/1.1 connection carries one request at a time, spending a round trip
+// waiting for the response headers and then the transfer time reading the
+// body. Parallel connections hide the round trips but not the transfers, which
+// all share the link. So a host serving bodies that are small next to its RTT
+// is latency bound and gets the full per-host limit, while a host whose bodies
+// take longer than a round trip to read is bandwidth bound: more connections
+// to it would only take bandwidth and client slots from other hosts.
+size_t ResourceScheduler::GetMaxDelayableRequestsForHost(
+    const net::HostPortPair& host_port_pair) const {
+  HostLoadStatsCache::const_iterator it =
+      host_load_stats_.Peek(host_port_pair);
+  if (it == host_load_stats_.end() || it->second.samples < kMinHostLoadSamples)
+    return kMaxNumDelayableRequestsPerHost;
+
+  int64 round_trip_us =
+      std::max<int64>(it->second.round_trip_time.InMicroseconds(), 0);
+  int64 transfer_us =
+      std::max<int64>(it->second.transfer_time.InMicroseconds(), 1);
+  // One connection per round trip that fits in a transfer, plus the one
+  // transferring.
+  int64 limit = 1 + (round_trip_us + transfer_us - 1) / transfer_us;
+  if (limit >= static_cast<int64>(kMaxNumDelayableRequestsPerHost))
+    return kMaxNumDelayableRequestsPerHost;
+  return std::max(static_cast<size_t>(limit), kMinNumDelayableRequestsPerHost);
+}
+
 void ResourceScheduler::OnClientCreated(int child_id, int route_id) {
   DCHECK(CalledOnValidThread());
   ClientId client_id = MakeClientId(child_id, route_id);
@@ -438,7 +529,9 @@ void ResourceScheduler::GetNumDelayableRequestsInFlight(
 //     requests.
 //   * Once the renderer has a <body>, start loading delayable requests.
 //   * Never exceed 10 delayable requests in flight per client.
-//   * Never exceed 6 delayable requests for a given host.
+//   * Never exceed 6 delayable requests for a given host, and fewer, down to
+//     2, for hosts whose observed timings show them to be bandwidth bound
+//     rather than latency bound. See GetMaxDelayableRequestsForHost().
 //   * Prior to <body>, allow one delayable request to load at a time.
 ResourceScheduler::ShouldStartReqResult ResourceScheduler::ShouldStartRequest(
     ScheduledResourceRequest* request,
@@ -479,7 +572,8 @@ ResourceScheduler::ShouldStartReqResult ResourceScheduler::ShouldStartRequest(
     return DO_NOT_START_REQUEST_AND_STOP_SEARCHING;
   }
 
-  if (num_requests_in_flight_for_host >= kMaxNumDelayableRequestsPerHost) {
+  if (num_requests_in_flight_for_host >=
+      GetMaxDelayableRequestsForHost(host_port_pair)) {
     // There may be other requests for other hosts we'd allow, so keep checking.
     return DO_NOT_START_REQUEST_AND_KEEP_SEARCHING;
   }
@@ -10,14 +10,16 @@
 
 #include "base/basictypes.h"
 #include "base/compiler_specific.h"
+#include "base/containers/mru_cache.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/threading/non_thread_safe.h"
+#include "base/time/time.h"
 #include "content/common/content_export.h"
+#include "net/base/host_port_pair.h"
 #include "net/base/priority_queue.h"
 #include "net/base/request_priority.h"
 
 namespace net {
-class HostPortPair;
 class URLRequest;
 }
 
@@ -78,18 +80,50 @@ class CONTENT_EXPORT ResourceScheduler : public base::NonThreadSafe {
   // resource loads won't interfere with first paint.
   void OnWillInsertBody(int child_id, int route_id);
 
+  // Signals from the ResourceDispatcherHost:
+
+  // Called when |url_request| has read its whole response, before the
+  // resource handlers may defer finishing it. Records the request's timings
+  // against its host if it went over the network to an HTTP/1.1 server.
+  void OnRequestCompleted(const net::URLRequest* url_request);
+
+  // Records the timings of a request that completed over the network against
+  // the HTTP/1.1 host |host_port_pair|, which sizes the host's share of the
+  // delayable requests. |round_trip_time| is the time from sending the request
+  // to receiving the response headers, and |transfer_time| the time spent
+  // reading the body. Called by OnRequestCompleted() and by tests.
+  void RecordHostLoadTimings(const net::HostPortPair& host_port_pair,
+                             base::TimeDelta round_trip_time,
+                             base::TimeDelta transfer_time);
+
  private:
   class RequestQueue;
   class ScheduledResourceRequest;
   struct Client;
 
+  // Smoothed timings of the delayable requests completed against an
+  // HTTP/1.1 host, used to size its share of the delayable request slots.
+  struct HostLoadStats {
+    HostLoadStats() : samples(0) {}
+
+    base::TimeDelta round_trip_time;
+    base::TimeDelta transfer_time;
+    int samples;
+  };
+
   typedef int64 ClientId;
   typedef std::map<ClientId, Client*> ClientMap;
   typedef std::set<ScheduledResourceRequest*> RequestSet;
+  typedef base::MRUCache<net::HostPortPair, HostLoadStats> HostLoadStatsCache;
 
   // Called when a ScheduledResourceRequest is destroyed.
   void RemoveRequest(ScheduledResourceRequest* request);
 
+  // Returns how many delayable requests may be in flight to the HTTP/1.1
+  // host |host_port_pair|.
+  size_t GetMaxDelayableRequestsForHost(
+      const net::HostPortPair& host_port_pair) const;
+
   // Unthrottles the |request| and adds it to |client|.
   void StartRequest(ScheduledResourceRequest* request, Client* client);
 
@@ -130,6 +164,9 @@ class CONTENT_EXPORT ResourceScheduler : public base::NonThreadSafe {
 
   ClientMap client_map_;
   RequestSet unowned_requests_;
+
+  // Evicts the host whose timings were least recently recorded once full.
+  HostLoadStatsCache host_load_stats_;
 };
 
 }  // namespace content
@@ -4,9 +4,13 @@
 
 #include "content/browser/loader/resource_scheduler.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "base/memory/scoped_vector.h"
 #include "base/message_loop/message_loop.h"
 #include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
 #include "content/browser/browser_thread_impl.h"
 #include "content/browser/loader/resource_dispatcher_host_impl.h"
 #include "content/browser/loader/resource_message_filter.h"
@@ -201,6 +205,19 @@ class ResourceSchedulerTest : public testing::Test {
     EXPECT_TRUE(ok);
   }
 
+  // Records |samples| completed loads from the host of |url|.
+  void RecordHostLoadTimings(const char* url,
+                             int round_trip_ms,
+                             int transfer_ms,
+                             int samples) {
+    for (int i = 0; i < samples; ++i) {
+      scheduler_.RecordHostLoadTimings(
+          net::HostPortPair::FromURL(GURL(url)),
+          base::TimeDelta::FromMilliseconds(round_trip_ms),
+          base::TimeDelta::FromMilliseconds(transfer_ms));
+    }
+  }
+
   int next_request_id_;
   base::MessageLoop message_loop_;
   BrowserThreadImpl ui_thread_;
@@ -464,6 +481,177 @@ TEST_F(ResourceSchedulerTest, NonHTTPSchedulesImmediately) {
   EXPECT_TRUE(request->started());
 }
 
+TEST_F(ResourceSchedulerTest, HostLimitFollowsObservedTimings) {
+  scheduler_.OnWillInsertBody(kChildId, kRouteId);
+
+  // Bodies take much longer than a round trip: bandwidth bound.
+  RecordHostLoadTimings("http://bulk/", 10, 100, 3);
+  // Bodies are read in a fraction of a round trip: latency bound.
+  RecordHostLoadTimings("http://small/", 200, 10, 3);
+  // Too few observations to act on.
+  RecordHostLoadTimings("http://new/", 10, 100, 2);
+
+  ScopedVector<TestRequest> bulk;
+  for (int i = 0; i < 3; ++i) {
+    string url = "http://bulk/" + base::IntToString(i);
+    bulk.push_back(NewRequest(url.c_str(), net::LOWEST));
+  }
+  EXPECT_TRUE(bulk[0]->started());
+  EXPECT_TRUE(bulk[1]->started());
+  EXPECT_FALSE(bulk[2]->started());
+
+  ScopedVector<TestRequest> small;
+  for (int i = 0; i < 6; ++i) {
+    string url = "http://small/" + base::IntToString(i);
+    small.push_back(NewRequest(url.c_str(), net::LOWEST));
+    EXPECT_TRUE(small[i]->started());
+  }
+  scoped_ptr<TestRequest> last_small(NewRequest("http://small/last",
+                                                net::LOWEST));
+  EXPECT_FALSE(last_small->started());
+
+  // Freeing a slot on the bandwidth bound host starts its next request.
+  bulk.erase(bulk.begin());
+  EXPECT_TRUE(bulk[1]->started());
+
+  // The per-client limit still applies: 2 + 6 are in flight.
+  scoped_ptr<TestRequest> new1(NewRequest("http://new/1", net::LOWEST));
+  scoped_ptr<TestRequest> new2(NewRequest("http://new/2", net::LOWEST));
+  scoped_ptr<TestRequest> new3(NewRequest("http://new/3", net::LOWEST));
+  EXPECT_TRUE(new1->started());
+  EXPECT_TRUE(new2->started());
+  EXPECT_FALSE(new3->started());
+}
+
+TEST_F(ResourceSchedulerTest, HostTimingsEvictLeastRecentlyRecorded) {
+  scheduler_.OnWillInsertBody(kChildId, kRouteId);
+
+  // Both hosts are bandwidth bound, but only "bulk" keeps being seen while
+  // many other hosts are recorded.
+  RecordHostLoadTimings("http://stale/", 10, 100, 3);
+  RecordHostLoadTimings("http://bulk/", 10, 100, 3);
+  for (int i = 0; i < 1000; ++i) {
+    string url = "http://host" + base::IntToString(i) + "/";
+    RecordHostLoadTimings(url.c_str(), 10, 100, 1);
+    RecordHostLoadTimings("http://bulk/", 10, 100, 1);
+  }
+
+  ScopedVector<TestRequest> bulk;
+  for (int i = 0; i < 3; ++i) {
+    string url = "http://bulk/" + base::IntToString(i);
+    bulk.push_back(NewRequest(url.c_str(), net::LOWEST));
+  }
+  EXPECT_TRUE(bulk[0]->started());
+  EXPECT_TRUE(bulk[1]->started());
+  EXPECT_FALSE(bulk[2]->started());
+
+  // The evicted host is back to the default limit.
+  ScopedVector<TestRequest> stale;
+  for (int i = 0; i < 3; ++i) {
+    string url = "http://stale/" + base::IntToString(i);
+    stale.push_back(NewRequest(url.c_str(), net::LOWEST));
+    EXPECT_TRUE(stale[i]->started());
+  }
+}
+
+// Replays a page load over a simulated network and reports how long it takes
+// with fixed per-host limits and with limits adapted to observed timings.
+// Each request waits one round trip to its host for the response headers and
+// then reads its body, with all bodies being read sharing the link bandwidth
+// equally.
+TEST_F(ResourceSchedulerTest, DISABLED_PageLoadReplay) {
+  struct MockHost {
+    const char* name;
+    int round_trip_ms;
+    int resources;
+    int resource_bytes;
+    bool spdy;
+  };
+  const MockHost kHosts[] = {
+    { "images.example", 40, 12, 150000, false },  // Bandwidth bound.
+    { "thumbs.example", 200, 60, 2000, false },   // Latency bound.
+    { "ads.example", 150, 20, 8000, false },
+    { "spdy.example", 80, 20, 20000, true },
+  };
+  const int kLinkBytesPerMs = 625;  // 5 Mbit/s.
+
+  for (size_t i = 0; i < arraysize(kHosts); ++i) {
+    if (kHosts[i].spdy) {
+      http_server_properties_.SetSupportsSpdy(
+          net::HostPortPair(kHosts[i].name, 80), true);
+    }
+  }
+  scheduler_.OnWillInsertBody(kChildId, kRouteId);
+
+  struct SimulatedRequest {
+    TestRequest* request;
+    const MockHost* host;
+    int bytes_left;
+    int start_ms;
+    int headers_ms;
+  };
+
+  // The fixed run goes first, as the adaptive one leaves timings behind.
+  for (int adaptive = 0; adaptive < 2; ++adaptive) {
+    std::vector<SimulatedRequest> requests;
+    for (size_t i = 0; i < arraysize(kHosts); ++i) {
+      for (int j = 0; j < kHosts[i].resources; ++j) {
+        std::string url = base::StringPrintf(
+            "http://%s/%d/%d", kHosts[i].name, adaptive, j);
+        SimulatedRequest request = {
+          NewRequest(url.c_str(), net::LOWEST), &kHosts[i],
+          kHosts[i].resource_bytes, -1, -1
+        };
+        requests.push_back(request);
+      }
+    }
+
+    size_t requests_left = requests.size();
+    int now_ms = 0;
+    for (; requests_left; ++now_ms) {
+      int reading = 0;
+      for (size_t i = 0; i < requests.size(); ++i) {
+        SimulatedRequest& request = requests[i];
+        if (!request.request)
+          continue;
+        if (request.start_ms < 0 && request.request->started())
+          request.start_ms = now_ms;
+        if (request.start_ms >= 0 &&
+            now_ms >= request.start_ms + request.host->round_trip_ms) {
+          ++reading;
+        }
+      }
+
+      for (size_t i = 0; i < requests.size() && reading; ++i) {
+        SimulatedRequest& request = requests[i];
+        if (!request.request || request.start_ms < 0 ||
+            now_ms < request.start_ms + request.host->round_trip_ms) {
+          continue;
+        }
+        if (request.headers_ms < 0)
+          request.headers_ms = now_ms;
+        request.bytes_left -= std::max(kLinkBytesPerMs / reading, 1);
+        if (request.bytes_left > 0)
+          continue;
+
+        if (adaptive) {
+          std::string url = base::StringPrintf("http://%s/",
+                                               request.host->name);
+          RecordHostLoadTimings(url.c_str(), request.host->round_trip_ms,
+                                now_ms - request.headers_ms + 1, 1);
+        }
+        // Finishing may start other requests, which begin on the next tick.
+        delete request.request;
+        request.request = NULL;
+        --requests_left;
+      }
+    }
+
+    LOG(INFO) << base::StringPrintf("%s limits: page loaded in %d ms",
+                                    adaptive ? "Adaptive" : "Fixed", now_ms);
+  }
+}
+
 }  // unnamed namespace
 
 }  // namespace content
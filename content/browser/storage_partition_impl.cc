@@ -6,6 +6,7 @@
 
 #include "base/sequenced_task_runner.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/threading/sequenced_worker_pool.h"
 #include "content/browser/browser_main_loop.h"
 #include "content/browser/fileapi/browser_file_system_helper.h"
 #include "content/browser/gpu/shader_disk_cache.h"
@@ -409,11 +410,16 @@ StoragePartitionImpl* StoragePartitionImpl::Create(
           ? BrowserMainLoop::GetInstance()->indexed_db_thread()
                 ->message_loop_proxy().get()
           : NULL;
+  // Backing stores commit on per-origin sequences of the blocking pool, so a
+  // busy origin does not hold up the others on the IndexedDB thread.
+  base::SequencedWorkerPool* idb_backing_store_pool =
+      idb_task_runner ? BrowserThread::GetBlockingPool() : NULL;
   scoped_refptr<IndexedDBContextImpl> indexed_db_context =
       new IndexedDBContextImpl(path,
                                context->GetSpecialStoragePolicy(),
                                quota_manager->proxy(),
-                               idb_task_runner);
+                               idb_task_runner,
+                               idb_backing_store_pool);
 
   scoped_refptr<ServiceWorkerContextWrapper> service_worker_context =
       new ServiceWorkerContextWrapper();
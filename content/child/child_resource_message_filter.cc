@@ -23,7 +23,8 @@ bool ChildResourceMessageFilter::OnMessageReceived(
     const IPC::Message& message) {
   if (message.type() == ResourceMsg_RequestComplete::ID ||
       message.type() == ResourceMsg_ReceivedResponse::ID ||
-      message.type() == ResourceMsg_ReceivedRedirect::ID) {
+      message.type() == ResourceMsg_ReceivedRedirect::ID ||
+      message.type() == ResourceMsg_MessageBatch::ID) {
     main_thread_task_runner_->PostTask(FROM_HERE, base::Bind(
         &ResourceDispatcher::set_io_timestamp,
         base::Unretained(resource_dispatcher_),
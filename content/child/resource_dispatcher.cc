@@ -279,6 +279,11 @@ ResourceDispatcher::~ResourceDispatcher() {
 // ResourceDispatcher implementation ------------------------------------------
 
 bool ResourceDispatcher::OnMessageReceived(const IPC::Message& message) {
+  if (message.type() == ResourceMsg_MessageBatch::ID) {
+    OnMessageBatch(message);
+    return true;
+  }
+
   if (!IsResourceDispatcherMessage(message)) {
     return false;
   }
@@ -329,6 +334,28 @@ ResourceDispatcher::GetPendingRequestInfo(int request_id) {
   return &(it->second);
 }
 
+void ResourceDispatcher::OnMessageBatch(const IPC::Message& message) {
+  ResourceMsg_MessageBatch::Param param;
+  if (!ResourceMsg_MessageBatch::Read(&message, &param)) {
+    NOTREACHED() << "malformed resource message";
+    return;
+  }
+
+  // The IO thread timestamp was taken when the batch arrived, so it applies
+  // to each of the nested messages rather than only the first one.
+  base::TimeTicks io_timestamp = io_timestamp_;
+  const std::vector<IPC::Message>& messages = param.a;
+  for (size_t i = 0; i < messages.size(); ++i) {
+    if (!IsResourceDispatcherMessage(messages[i])) {
+      NOTREACHED() << "unexpected message in resource message batch";
+      continue;
+    }
+    io_timestamp_ = io_timestamp;
+    OnMessageReceived(messages[i]);
+  }
+  io_timestamp_ = base::TimeTicks();
+}
+
 void ResourceDispatcher::OnUploadProgress(int request_id, int64 position,
                                           int64 size) {
   PendingRequestInfo* request_info = GetPendingRequestInfo(request_id);
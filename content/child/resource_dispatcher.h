@@ -123,6 +123,10 @@ class CONTENT_EXPORT ResourceDispatcher : public IPC::Listener {
   // Follows redirect, if any, for the given request.
   void FollowPendingRedirect(int request_id, PendingRequestInfo& request_info);
 
+  // Dispatches each of the messages nested in a ResourceMsg_MessageBatch as
+  // if it had been received on its own.
+  void OnMessageBatch(const IPC::Message& message);
+
   // Message response handlers, called by the message handler for this process.
   void OnUploadProgress(
       int request_id,
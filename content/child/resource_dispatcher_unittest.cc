@@ -226,6 +226,63 @@ TEST_F(ResourceDispatcherTest, SerializedPostData) {
   // FIXME
 }
 
+// Tests that the messages nested in a ResourceMsg_MessageBatch are dispatched
+// in order, as if each had been received on its own.
+TEST_F(ResourceDispatcherTest, MessageBatch) {
+  TestRequestCallback callback;
+  scoped_ptr<ResourceLoaderBridge> bridge(CreateBridge());
+  bridge->Start(&callback);
+
+  ASSERT_EQ(1U, message_queue_.size());
+  int request_id;
+  ResourceHostMsg_Request request;
+  ASSERT_TRUE(ResourceHostMsg_RequestResource::Read(
+      &message_queue_[0], &request_id, &request));
+  message_queue_.clear();
+
+  ResourceResponseHead response;
+  std::string raw_headers(test_page_headers);
+  std::replace(raw_headers.begin(), raw_headers.end(), '\n', '\0');
+  response.headers = new net::HttpResponseHeaders(raw_headers);
+  response.mime_type = test_page_mime_type;
+  response.charset = test_page_charset;
+  dispatcher_->OnMessageReceived(
+      ResourceMsg_ReceivedResponse(request_id, response));
+
+  base::SharedMemory shared_mem;
+  EXPECT_TRUE(shared_mem.CreateAndMapAnonymous(test_page_contents_len));
+  memcpy(shared_mem.memory(), test_page_contents, test_page_contents_len);
+  base::SharedMemoryHandle dup_handle;
+  EXPECT_TRUE(shared_mem.GiveToProcess(
+      base::Process::Current().handle(), &dup_handle));
+  dispatcher_->OnMessageReceived(ResourceMsg_SetDataBuffer(
+      request_id, dup_handle, test_page_contents_len, 0));
+
+  // The body arrives in two pieces, followed by the completion, in one batch.
+  const int kFirstLength = 10;
+  std::vector<IPC::Message> messages;
+  messages.push_back(ResourceMsg_DataReceived(
+      request_id, 0, kFirstLength, kFirstLength));
+  messages.push_back(ResourceMsg_DataReceived(
+      request_id, kFirstLength, test_page_contents_len - kFirstLength,
+      test_page_contents_len - kFirstLength));
+  messages.push_back(ResourceMsg_RequestComplete(
+      request_id, net::OK, false, std::string(), base::TimeTicks::Now()));
+  EXPECT_TRUE(dispatcher_->OnMessageReceived(
+      ResourceMsg_MessageBatch(messages)));
+
+  EXPECT_TRUE(callback.complete());
+  EXPECT_EQ(test_page_contents, callback.data());
+
+  // Each DataReceived message is ACKed.
+  ASSERT_EQ(2U, message_queue_.size());
+  for (size_t i = 0; i < message_queue_.size(); ++i) {
+    EXPECT_EQ(static_cast<uint32>(ResourceHostMsg_DataReceived_ACK::ID),
+              message_queue_[i].type());
+  }
+  message_queue_.clear();
+}
+
 // This class provides functionality to validate whether the ResourceDispatcher
 // object honors the deferred loading contract correctly, i.e. if deferred
 // loading is enabled it should queue up any responses received. If deferred
@@ -4,7 +4,8 @@
 
 // IPC messages for resource loading.
 //
-// NOTE: All messages must send an |int request_id| as their first parameter.
+// NOTE: All messages must send an |int request_id| as their first parameter,
+// except for ResourceMsg_MessageBatch, which only nests messages that do.
 
 // Multiply-included message file, hence no include guard.
 #include "base/memory/shared_memory.h"
@@ -278,6 +279,13 @@ IPC_MESSAGE_CONTROL5(ResourceMsg_RequestComplete,
                      std::string /* security info */,
                      base::TimeTicks /* completion_time */)
 
+// Carries resource messages for any number of requests, in the order in which
+// they were sent, so that the responses produced by one IO thread task reach
+// the child in a single IPC. The nested messages must not carry handles, so
+// ResourceMsg_SetDataBuffer is always sent on its own.
+IPC_MESSAGE_CONTROL1(ResourceMsg_MessageBatch,
+                     std::vector<IPC::Message> /* messages */)
+
 // Resource messages sent from the renderer to the browser.
 
 // Makes a resource request via the browser.
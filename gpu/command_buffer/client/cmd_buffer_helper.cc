@@ -31,6 +31,7 @@ CommandBufferHelper::CommandBufferHelper(CommandBuffer* command_buffer)
       usable_(true),
       context_lost_(false),
       flush_automatically_(true),
+      flush_limit_(0),
       last_flush_time_(0) {
 }
 
@@ -78,6 +79,8 @@ bool CommandBufferHelper::AllocateRingBuffer() {
 
   total_entry_count_ = num_ring_buffer_entries;
   put_ = state.put_offset;
+  flush_limit_ = 0;
+  AdjustFlushLimit(true);
   return true;
 }
 
@@ -115,12 +118,22 @@ bool CommandBufferHelper::FlushSync() {
 
 void CommandBufferHelper::Flush() {
   if (usable() && last_put_sent_ != put_) {
+    AdjustFlushLimit(get_offset() == last_put_sent_);
     last_flush_time_ = clock();
     last_put_sent_ = put_;
     command_buffer_->Flush(put_);
   }
 }
 
+void CommandBufferHelper::AdjustFlushLimit(bool reader_idle) {
+  int32 min_limit = std::max(total_entry_count_ / 16, 1);
+  int32 max_limit = std::max(total_entry_count_ / 2, min_limit);
+  if (reader_idle)
+    flush_limit_ = std::max(flush_limit_ / 2, min_limit);
+  else
+    flush_limit_ = std::min(flush_limit_ * 2, max_limit);
+}
+
 // Calls Flush() and then waits until the buffer is empty. Break early if the
 // error is set.
 bool CommandBufferHelper::Finish() {
@@ -237,12 +250,12 @@ void CommandBufferHelper::WaitForAvailableEntries(int32 count) {
         return;
     }
   }
-  // Force a flush if the buffer is getting half full, or even earlier if the
-  // reader is known to be idle.
+  // Force a flush once more is pending than the reader has been keeping up
+  // with, or even earlier if the reader is known to be idle.
   int32 pending =
       (put_ + total_entry_count_ - last_put_sent_) % total_entry_count_;
-  int32 limit = total_entry_count_ /
-      ((get_offset() == last_put_sent_) ? 16 : 2);
+  int32 limit = (get_offset() == last_put_sent_) ?
+      total_entry_count_ / 16 : flush_limit_;
   if (pending > limit) {
     Flush();
   } else if (flush_automatically_ &&
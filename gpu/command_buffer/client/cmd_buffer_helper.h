@@ -53,6 +53,8 @@ class GPU_EXPORT CommandBufferHelper {
   // Asynchronously flushes the commands, setting the put pointer to let the
   // buffer interface know that new commands have been added. After a flush
   // returns, the command buffer service is aware of all pending commands.
+  // Also adjusts how many commands are batched before the next automatic
+  // flush, depending on whether the service has consumed the previous ones.
   void Flush();
 
   // Flushes the commands, setting the put pointer to let the buffer interface
@@ -244,6 +246,10 @@ class GPU_EXPORT CommandBufferHelper {
   bool AllocateRingBuffer();
   void FreeResources();
 
+  // Halves |flush_limit_| if the reader had consumed everything sent to it
+  // when we flushed, and doubles it if it had not.
+  void AdjustFlushLimit(bool reader_idle);
+
   CommandBuffer* command_buffer_;
   int32 ring_buffer_id_;
   int32 ring_buffer_size_;
@@ -258,6 +264,12 @@ class GPU_EXPORT CommandBufferHelper {
   bool context_lost_;
   bool flush_automatically_;
 
+  // Number of pending entries which forces a flush while the reader is busy.
+  // It tracks the rate at which the reader consumes commands, between 1/16
+  // and 1/2 of the buffer, so that it is sent a new batch about when it runs
+  // out of work rather than on every command or only every half buffer.
+  int32 flush_limit_;
+
   // Using C runtime instead of base because this file cannot depend on base.
   clock_t last_flush_time_;
 
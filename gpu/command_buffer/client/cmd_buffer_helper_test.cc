@@ -135,6 +135,8 @@ class CommandBufferHelperTest : public testing::Test {
 
   CommandBufferOffset get_helper_put() { return helper_->put_; }
 
+  int32 get_helper_flush_limit() { return helper_->flush_limit_; }
+
 #if defined(OS_MACOSX)
   base::mac::ScopedNSAutoreleasePool autorelease_pool_;
 #endif
@@ -287,6 +289,42 @@ TEST_F(CommandBufferHelperTest, TestToken) {
   EXPECT_EQ(error::kNoError, GetError());
 }
 
+// Checks that more commands are batched per flush while the reader is behind,
+// and fewer once it catches up.
+TEST_F(CommandBufferHelperTest, TestFlushLimitTracksReader) {
+  EXPECT_EQ(1, get_helper_flush_limit());
+
+  // Keep the reader from consuming the commands.
+  gpu_scheduler_->SetScheduled(false);
+  AddCommandWithExpect(error::kNoError, kUnusedCommandId, 0, NULL);
+  helper_->Flush();
+  EXPECT_EQ(1, get_helper_flush_limit());
+  AddCommandWithExpect(error::kNoError, kUnusedCommandId, 0, NULL);
+  helper_->Flush();
+  EXPECT_EQ(2, get_helper_flush_limit());
+  AddCommandWithExpect(error::kNoError, kUnusedCommandId, 0, NULL);
+  helper_->Flush();
+  EXPECT_EQ(4, get_helper_flush_limit());
+  AddCommandWithExpect(error::kNoError, kUnusedCommandId, 0, NULL);
+  helper_->Flush();
+  EXPECT_EQ(kTotalNumCommandEntries / 2, get_helper_flush_limit());
+
+  // Let the reader catch up.
+  gpu_scheduler_->SetScheduled(true);
+  gpu_scheduler_->PutChanged();
+  EXPECT_EQ(GetPutOffset(), GetGetOffset());
+  AddCommandWithExpect(error::kNoError, kUnusedCommandId, 0, NULL);
+  helper_->Flush();
+  EXPECT_EQ(2, get_helper_flush_limit());
+  AddCommandWithExpect(error::kNoError, kUnusedCommandId, 0, NULL);
+  helper_->Flush();
+  EXPECT_EQ(1, get_helper_flush_limit());
+
+  helper_->Finish();
+  Mock::VerifyAndClearExpectations(api_mock_.get());
+  EXPECT_EQ(error::kNoError, GetError());
+}
+
 TEST_F(CommandBufferHelperTest, FreeRingBuffer) {
   EXPECT_TRUE(helper_->HaveRingBuffer());
 
@@ -8,6 +8,7 @@
 
 #include <algorithm>
 
+#include "base/bits.h"
 #include "gpu/command_buffer/client/cmd_buffer_helper.h"
 
 namespace gpu {
@@ -27,6 +28,11 @@ unsigned int RoundUp(unsigned int size) {
   return (size + (kAllocAlignment - 1)) & ~(kAllocAlignment - 1);
 }
 
+// Gets the size class of a free block of |size| bytes.
+int GetSizeClass(unsigned int size) {
+  return std::max(base::bits::Log2Floor(size), 0);
+}
+
 }  // namespace
 
 #ifndef _MSC_VER
@@ -37,20 +43,17 @@ FencedAllocator::FencedAllocator(unsigned int size,
                                  CommandBufferHelper *helper)
     : helper_(helper),
       bytes_in_use_(0) {
-  Block block = { FREE, 0, RoundDown(size), kUnusedToken };
-  blocks_.push_back(block);
+  Block block = { FREE, RoundDown(size), kUnusedToken };
+  InsertFreeBlock(blocks_.insert(std::make_pair(0u, block)).first);
 }
 
 FencedAllocator::~FencedAllocator() {
   // Free blocks pending tokens.
-  for (unsigned int i = 0; i < blocks_.size(); ++i) {
-    if (blocks_[i].state == FREE_PENDING_TOKEN) {
-      i = WaitForTokenAndFreeBlock(i);
-    }
-  }
+  while (!pending_offsets_.empty())
+    WaitForTokenAndFreeBlock(blocks_.find(*pending_offsets_.begin()));
   // These checks are not valid if the service has crashed or lost the context.
   // DCHECK_EQ(blocks_.size(), 1u);
-  // DCHECK_EQ(blocks_[0].state, FREE);
+  // DCHECK_EQ(blocks_.begin()->second.state, FREE);
 }
 
 // Looks for a non-allocated block that is big enough. Search in the FREE
@@ -68,22 +71,34 @@ FencedAllocator::Offset FencedAllocator::Alloc(unsigned int size) {
   // Round up the allocation size to ensure alignment.
   size = RoundUp(size);
 
-  // Try first to allocate in a free block.
-  for (unsigned int i = 0; i < blocks_.size(); ++i) {
-    Block &block = blocks_[i];
-    if (block.state == FREE && block.size >= size) {
-      return AllocInBlock(i, size);
+  // Try first to allocate in a free block. Every block in a larger size class
+  // fits, so only the first of each needs to be considered.
+  int size_class = GetSizeClass(size);
+  Offset first_fit = kInvalidOffset;
+  for (int i = size_class + 1; i < kSizeClasses; ++i) {
+    if (!free_blocks_[i].empty())
+      first_fit = std::min(first_fit, *free_blocks_[i].begin());
+  }
+  // Blocks in the same size class may be too small, so check each of those
+  // before |first_fit|.
+  const FreeBlockSet& same_class = free_blocks_[size_class];
+  for (FreeBlockSet::const_iterator it = same_class.begin();
+       it != same_class.end() && *it < first_fit; ++it) {
+    if (blocks_.find(*it)->second.size >= size) {
+      first_fit = *it;
+      break;
     }
   }
+  if (first_fit != kInvalidOffset)
+    return AllocInBlock(blocks_.find(first_fit), size);
 
   // No free block is available. Look for blocks pending tokens, and wait for
   // them to be re-usable.
-  for (unsigned int i = 0; i < blocks_.size(); ++i) {
-    if (blocks_[i].state != FREE_PENDING_TOKEN)
-      continue;
-    i = WaitForTokenAndFreeBlock(i);
-    if (blocks_[i].size >= size)
-      return AllocInBlock(i, size);
+  while (!pending_offsets_.empty()) {
+    BlockIterator block =
+        WaitForTokenAndFreeBlock(blocks_.find(*pending_offsets_.begin()));
+    if (block->second.size >= size)
+      return AllocInBlock(block, size);
   }
   return kInvalidOffset;
 }
@@ -91,38 +106,40 @@ FencedAllocator::Offset FencedAllocator::Alloc(unsigned int size) {
 // Looks for the corresponding block, mark it FREE, and collapse it if
 // necessary.
 void FencedAllocator::Free(FencedAllocator::Offset offset) {
-  BlockIndex index = GetBlockByOffset(offset);
-  DCHECK_NE(blocks_[index].state, FREE);
-  Block &block = blocks_[index];
-
-  if (block.state == IN_USE)
-    bytes_in_use_ -= block.size;
-
-  block.state = FREE;
-  CollapseFreeBlock(index);
+  BlockIterator block = GetBlockByOffset(offset);
+  DCHECK_NE(block->second.state, FREE);
+  FreeBlock(block);
 }
 
 // Looks for the corresponding block, mark it FREE_PENDING_TOKEN.
 void FencedAllocator::FreePendingToken(
     FencedAllocator::Offset offset, int32 token) {
-  BlockIndex index = GetBlockByOffset(offset);
-  Block &block = blocks_[index];
+  Block& block = GetBlockByOffset(offset)->second;
   if (block.state == IN_USE)
     bytes_in_use_ -= block.size;
+  else if (block.state == FREE_PENDING_TOKEN)
+    pending_blocks_.erase(std::make_pair(block.token, offset));
   block.state = FREE_PENDING_TOKEN;
   block.token = token;
+  pending_blocks_.insert(std::make_pair(token, offset));
+  pending_offsets_.insert(offset);
 }
 
 // Gets the max of the size of the blocks marked as free.
 unsigned int FencedAllocator::GetLargestFreeSize() {
   FreeUnused();
-  unsigned int max_size = 0;
-  for (unsigned int i = 0; i < blocks_.size(); ++i) {
-    Block &block = blocks_[i];
-    if (block.state == FREE)
-      max_size = std::max(max_size, block.size);
+  // The largest block is in the largest non-empty size class.
+  for (int i = kSizeClasses - 1; i >= 0; --i) {
+    if (free_blocks_[i].empty())
+      continue;
+    unsigned int max_size = 0;
+    for (FreeBlockSet::const_iterator it = free_blocks_[i].begin();
+         it != free_blocks_[i].end(); ++it) {
+      max_size = std::max(max_size, blocks_.find(*it)->second.size);
+    }
+    return max_size;
   }
-  return max_size;
+  return 0;
 }
 
 // Gets the size of the largest segment of blocks that are either FREE or
@@ -130,8 +147,9 @@ unsigned int FencedAllocator::GetLargestFreeSize() {
 unsigned int FencedAllocator::GetLargestFreeOrPendingSize() {
   unsigned int max_size = 0;
   unsigned int current_size = 0;
-  for (unsigned int i = 0; i < blocks_.size(); ++i) {
-    Block &block = blocks_[i];
+  for (Container::const_iterator it = blocks_.begin(); it != blocks_.end();
+       ++it) {
+    const Block& block = it->second;
     if (block.state == IN_USE) {
       max_size = std::max(max_size, current_size);
       current_size = 0;
@@ -147,102 +165,139 @@ unsigned int FencedAllocator::GetLargestFreeOrPendingSize() {
 // - there is at least one block.
 // - there are no contiguous FREE blocks (they should have been collapsed).
 // - the successive offsets match the block sizes, and they are in order.
+// - the free and pending block indices hold exactly the FREE and
+//   FREE_PENDING_TOKEN blocks.
 bool FencedAllocator::CheckConsistency() {
   if (blocks_.size() < 1) return false;
-  for (unsigned int i = 0; i < blocks_.size() - 1; ++i) {
-    Block &current = blocks_[i];
-    Block &next = blocks_[i + 1];
-    // This test is NOT included in the next one, because offset is unsigned.
-    if (next.offset <= current.offset)
-      return false;
-    if (next.offset != current.offset + current.size)
+  size_t free_count = 0;
+  size_t free_blocks_count = 0;
+  for (int i = 0; i < kSizeClasses; ++i)
+    free_blocks_count += free_blocks_[i].size();
+  size_t pending_count = 0;
+  for (Container::const_iterator it = blocks_.begin(); it != blocks_.end();
+       ++it) {
+    const Block& current = it->second;
+    if (current.state == FREE) {
+      ++free_count;
+      if (!free_blocks_[GetSizeClass(current.size)].count(it->first))
+        return false;
+    } else if (current.state == FREE_PENDING_TOKEN) {
+      ++pending_count;
+      if (!pending_blocks_.count(std::make_pair(current.token, it->first)) ||
+          !pending_offsets_.count(it->first)) {
+        return false;
+      }
+    }
+
+    Container::const_iterator next = it;
+    ++next;
+    if (next == blocks_.end())
+      break;
+    if (next->first != it->first + current.size)
       return false;
-    if (current.state == FREE && next.state == FREE)
+    if (current.state == FREE && next->second.state == FREE)
       return false;
   }
-  return true;
+  return free_count == free_blocks_count &&
+         pending_count == pending_blocks_.size() &&
+         pending_count == pending_offsets_.size();
 }
 
 // Returns false if all blocks are actually FREE, in which
 // case they would be coalesced into one block, true otherwise.
 bool FencedAllocator::InUse() {
-  return blocks_.size() != 1 || blocks_[0].state != FREE;
-}
-
-// Collapse the block to the next one, then to the previous one. Provided the
-// structure is consistent, those are the only blocks eligible for collapse.
-FencedAllocator::BlockIndex FencedAllocator::CollapseFreeBlock(
-    BlockIndex index) {
-  if (index + 1 < blocks_.size()) {
-    Block &next = blocks_[index + 1];
-    if (next.state == FREE) {
-      blocks_[index].size += next.size;
-      blocks_.erase(blocks_.begin() + index + 1);
-    }
+  return blocks_.size() != 1 || blocks_.begin()->second.state != FREE;
+}
+
+// Marks the block FREE, then collapses the next block into it, and it into
+// the previous one. Provided the structure is consistent, those are the only
+// blocks eligible for collapse.
+FencedAllocator::BlockIterator FencedAllocator::FreeBlock(BlockIterator it) {
+  Block& block = it->second;
+  DCHECK_NE(block.state, FREE);
+  if (block.state == IN_USE) {
+    bytes_in_use_ -= block.size;
+  } else {
+    pending_blocks_.erase(std::make_pair(block.token, it->first));
+    pending_offsets_.erase(it->first);
   }
-  if (index > 0) {
-    Block &prev = blocks_[index - 1];
-    if (prev.state == FREE) {
-      prev.size += blocks_[index].size;
-      blocks_.erase(blocks_.begin() + index);
-      --index;
+  block.state = FREE;
+
+  BlockIterator next = it;
+  ++next;
+  if (next != blocks_.end() && next->second.state == FREE) {
+    EraseFreeBlock(next);
+    block.size += next->second.size;
+    blocks_.erase(next);
+  }
+  if (it != blocks_.begin()) {
+    BlockIterator prev = it;
+    --prev;
+    if (prev->second.state == FREE) {
+      EraseFreeBlock(prev);
+      prev->second.size += block.size;
+      blocks_.erase(it);
+      it = prev;
     }
   }
-  return index;
+  InsertFreeBlock(it);
+  return it;
 }
 
 // Waits for the block's token, then mark the block as free, then collapse it.
-FencedAllocator::BlockIndex FencedAllocator::WaitForTokenAndFreeBlock(
-    BlockIndex index) {
-  Block &block = blocks_[index];
-  DCHECK_EQ(block.state, FREE_PENDING_TOKEN);
-  helper_->WaitForToken(block.token);
-  block.state = FREE;
-  return CollapseFreeBlock(index);
+FencedAllocator::BlockIterator FencedAllocator::WaitForTokenAndFreeBlock(
+    BlockIterator block) {
+  DCHECK_EQ(block->second.state, FREE_PENDING_TOKEN);
+  helper_->WaitForToken(block->second.token);
+  return FreeBlock(block);
 }
 
 // Frees any blocks pending a token for which the token has been read.
 void FencedAllocator::FreeUnused() {
   int32 last_token_read = helper_->last_token_read();
-  for (unsigned int i = 0; i < blocks_.size();) {
-    Block& block = blocks_[i];
-    if (block.state == FREE_PENDING_TOKEN && block.token <= last_token_read) {
-      block.state = FREE;
-      i = CollapseFreeBlock(i);
-    } else {
-      ++i;
-    }
+  while (!pending_blocks_.empty() &&
+         pending_blocks_.begin()->first <= last_token_read) {
+    FreeBlock(blocks_.find(pending_blocks_.begin()->second));
   }
 }
 
 // If the block is exactly the requested size, simply mark it IN_USE, otherwise
 // split it and mark the first one (of the requested size) IN_USE.
-FencedAllocator::Offset FencedAllocator::AllocInBlock(BlockIndex index,
+FencedAllocator::Offset FencedAllocator::AllocInBlock(BlockIterator it,
                                                       unsigned int size) {
-  Block &block = blocks_[index];
+  Block &block = it->second;
   DCHECK_GE(block.size, size);
   DCHECK_EQ(block.state, FREE);
-  Offset offset = block.offset;
+  Offset offset = it->first;
+  EraseFreeBlock(it);
   bytes_in_use_ += size;
-  if (block.size == size) {
-    block.state = IN_USE;
-    return offset;
-  }
-  Block newblock = { FREE, offset + size, block.size - size, kUnusedToken};
   block.state = IN_USE;
+  if (block.size == size)
+    return offset;
+
+  Block newblock = { FREE, block.size - size, kUnusedToken };
   block.size = size;
-  // this is the last thing being done because it may invalidate block;
-  blocks_.insert(blocks_.begin() + index + 1, newblock);
+  BlockIterator new_it =
+      blocks_.insert(std::make_pair(offset + size, newblock)).first;
+  InsertFreeBlock(new_it);
   return offset;
 }
 
-// The blocks are in offset order, so we can do a binary search.
-FencedAllocator::BlockIndex FencedAllocator::GetBlockByOffset(Offset offset) {
-  Block templ = { IN_USE, offset, 0, kUnusedToken };
-  Container::iterator it = std::lower_bound(blocks_.begin(), blocks_.end(),
-                                            templ, OffsetCmp());
-  DCHECK(it != blocks_.end() && it->offset == offset);
-  return it-blocks_.begin();
+void FencedAllocator::InsertFreeBlock(BlockIterator block) {
+  DCHECK_EQ(block->second.state, FREE);
+  free_blocks_[GetSizeClass(block->second.size)].insert(block->first);
+}
+
+void FencedAllocator::EraseFreeBlock(BlockIterator block) {
+  DCHECK_EQ(block->second.state, FREE);
+  free_blocks_[GetSizeClass(block->second.size)].erase(block->first);
+}
+
+FencedAllocator::BlockIterator FencedAllocator::GetBlockByOffset(
+    Offset offset) {
+  BlockIterator it = blocks_.find(offset);
+  DCHECK(it != blocks_.end());
+  return it;
 }
 
 }  // namespace gpu
@@ -7,7 +7,9 @@
 #ifndef GPU_COMMAND_BUFFER_CLIENT_FENCED_ALLOCATOR_H_
 #define GPU_COMMAND_BUFFER_CLIENT_FENCED_ALLOCATOR_H_
 
-#include <vector>
+#include <map>
+#include <set>
+#include <utility>
 
 #include "base/logging.h"
 #include "gpu/command_buffer/common/types.h"
@@ -22,6 +24,15 @@ class CommandBufferHelper;
 // that is, the memory won't be reused until the command buffer has processed
 // that token.
 //
+// Blocks are kept in a map ordered by offset, so that a block can be found
+// and merged with its neighbours in logarithmic time. The free blocks are
+// also segregated into power-of-two size classes, each ordered by offset, so
+// that allocations find the first free block which fits (first-fit, which
+// keeps streamed allocations packed) without scanning the whole buffer. Blocks
+// pending a token are indexed by token, so that FreeUnused() only visits those
+// whose token has passed, and by offset, the order in which Alloc() waits for
+// them.
+//
 // NOTE: Although this class is intended to be used in the command buffer
 // environment which is multi-process, this class isn't "thread safe", because
 // it isn't meant to be shared across modules. It is thread-compatible though
@@ -94,49 +105,59 @@ class GPU_EXPORT FencedAllocator {
     FREE_PENDING_TOKEN
   };
 
-  // Book-keeping sturcture that describes a block of memory.
+  // Book-keeping sturcture that describes a block of memory. The block's
+  // offset is its key in the Container.
   struct Block {
     State state;
-    Offset offset;
     unsigned int size;
     int32 token;  // token to wait for in the FREE_PENDING_TOKEN case.
   };
 
-  // Comparison functor for memory block sorting.
-  class OffsetCmp {
-   public:
-    bool operator() (const Block &left, const Block &right) {
-      return left.offset < right.offset;
-    }
-  };
+  typedef std::map<Offset, Block> Container;
+  typedef Container::iterator BlockIterator;
+
+  // Offsets of the FREE blocks of one size class.
+  typedef std::set<Offset> FreeBlockSet;
 
-  typedef std::vector<Block> Container;
-  typedef unsigned int BlockIndex;
+  // Free blocks of at least 2^n and less than 2^(n+1) bytes are in size class
+  // n. Empty blocks are in class 0.
+  static const int kSizeClasses = 32;
+
+  // FREE_PENDING_TOKEN blocks, ordered by token then offset.
+  typedef std::set<std::pair<int32, Offset> > PendingBlockSet;
+
+  // Offsets of the FREE_PENDING_TOKEN blocks.
+  typedef std::set<Offset> PendingOffsetSet;
 
   static const int32 kUnusedToken = 0;
 
-  // Gets the index of a memory block, given its offset.
-  BlockIndex GetBlockByOffset(Offset offset);
+  // Gets a memory block, given its offset.
+  BlockIterator GetBlockByOffset(Offset offset);
+
+  // Adds or removes a FREE block to or from |free_blocks_|.
+  void InsertFreeBlock(BlockIterator block);
+  void EraseFreeBlock(BlockIterator block);
 
-  // Collapse a free block with its neighbours if they are free. Returns the
-  // index of the collapsed block.
-  // NOTE: this will invalidate block indices.
-  BlockIndex CollapseFreeBlock(BlockIndex index);
+  // Marks a block which is not FREE as FREE, and collapses it with its
+  // neighbours if they are free. Returns the collapsed block.
+  // NOTE: this will invalidate iterators to the neighbouring blocks.
+  BlockIterator FreeBlock(BlockIterator block);
 
   // Waits for a FREE_PENDING_TOKEN block to be usable, and free it. Returns
-  // the new index of that block (since it may have been collapsed).
-  // NOTE: this will invalidate block indices.
-  BlockIndex WaitForTokenAndFreeBlock(BlockIndex index);
+  // the collapsed block.
+  // NOTE: this will invalidate iterators to the neighbouring blocks.
+  BlockIterator WaitForTokenAndFreeBlock(BlockIterator block);
 
-  // Allocates a block of memory inside a given block, splitting it in two
-  // (unless that block is of the exact requested size).
-  // NOTE: this will invalidate block indices.
-  // Returns the offset of the allocated block (NOTE: this is different from
-  // the other functions that return a block index).
-  Offset AllocInBlock(BlockIndex index, unsigned int size);
+  // Allocates a block of memory inside a given FREE block, splitting it in
+  // two (unless that block is of the exact requested size). Returns the
+  // offset of the allocated block.
+  Offset AllocInBlock(BlockIterator block, unsigned int size);
 
   CommandBufferHelper *helper_;
   Container blocks_;
+  FreeBlockSet free_blocks_[kSizeClasses];
+  PendingBlockSet pending_blocks_;
+  PendingOffsetSet pending_offsets_;
   size_t bytes_in_use_;
 
   DISALLOW_IMPLICIT_CONSTRUCTORS(FencedAllocator);
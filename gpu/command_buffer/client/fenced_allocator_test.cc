@@ -4,10 +4,15 @@
 
 // This file contains the tests for the FencedAllocator class.
 
+#include <deque>
+
 #include "base/bind.h"
 #include "base/bind_helpers.h"
+#include "base/logging.h"
 #include "base/memory/aligned_memory.h"
 #include "base/message_loop/message_loop.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
 #include "gpu/command_buffer/client/cmd_buffer_helper.h"
 #include "gpu/command_buffer/client/fenced_allocator.h"
 #include "gpu/command_buffer/service/cmd_buffer_engine.h"
@@ -391,6 +396,99 @@ TEST_F(FencedAllocatorTest, TestGetLargestFreeOrPendingSize) {
   EXPECT_EQ(kBufferSize, allocator_->GetLargestFreeSize());
 }
 
+// Checks that allocations take the free block with the lowest offset which
+// fits, whichever size class it is in.
+TEST_F(FencedAllocatorTest, TestFirstFit) {
+  const unsigned int kSize = 16;
+
+  // Open a hole of 3 * kSize, then a hole of kSize, in front of the rest of
+  // the buffer.
+  FencedAllocator::Offset offsets[6];
+  for (unsigned int i = 0; i < arraysize(offsets); ++i) {
+    offsets[i] = allocator_->Alloc(kSize);
+    ASSERT_NE(FencedAllocator::kInvalidOffset, offsets[i]);
+  }
+  allocator_->Free(offsets[0]);
+  allocator_->Free(offsets[1]);
+  allocator_->Free(offsets[2]);
+  allocator_->Free(offsets[4]);
+  EXPECT_TRUE(allocator_->CheckConsistency());
+
+  // Too big for the first hole, so the rest of the buffer is used.
+  FencedAllocator::Offset offset = allocator_->Alloc(4 * kSize);
+  EXPECT_EQ(offsets[5] + kSize, offset);
+
+  // These fit in the first hole, although the second one is a closer fit.
+  FencedAllocator::Offset offset1 = allocator_->Alloc(kSize);
+  EXPECT_EQ(offsets[0], offset1);
+  FencedAllocator::Offset offset2 = allocator_->Alloc(2 * kSize);
+  EXPECT_EQ(offsets[1], offset2);
+
+  // Only the second hole is left in front of |offset|.
+  FencedAllocator::Offset offset3 = allocator_->Alloc(kSize);
+  EXPECT_EQ(offsets[4], offset3);
+  EXPECT_TRUE(allocator_->CheckConsistency());
+
+  allocator_->Free(offset);
+  allocator_->Free(offset1);
+  allocator_->Free(offset2);
+  allocator_->Free(offset3);
+  allocator_->Free(offsets[3]);
+  allocator_->Free(offsets[5]);
+  EXPECT_FALSE(allocator_->InUse());
+}
+
+// Streams many small uploads of varied sizes through a large allocator,
+// freeing them pending tokens in a random order, as a client uploading
+// textures and vertex data would. Reports the allocation throughput and how
+// fragmented the free memory ends up.
+TEST_F(FencedAllocatorTest, DISABLED_StreamingPerf) {
+  const unsigned int kLargeBufferSize = 16 * 1024 * 1024;
+  const unsigned int kMaxLiveAllocations[] = { 64, 1024, 8192 };
+  const int kAllocations = 100000;
+
+  for (size_t i = 0; i < arraysize(kMaxLiveAllocations); ++i) {
+    FencedAllocator allocator(kLargeBufferSize, helper_.get());
+    std::deque<FencedAllocator::Offset> live;
+    uint32 seed = 1;
+    int failures = 0;
+    base::TimeTicks start = base::TimeTicks::Now();
+    for (int j = 0; j < kAllocations; ++j) {
+      seed = seed * 1103515245 + 12345;
+      FencedAllocator::Offset offset =
+          allocator.Alloc(16 + (seed >> 16) % 4096);
+      if (offset == FencedAllocator::kInvalidOffset)
+        ++failures;
+      else
+        live.push_back(offset);
+
+      if (live.size() > kMaxLiveAllocations[i]) {
+        size_t index = (seed >> 4) % live.size();
+        allocator.FreePendingToken(live[index], helper_->InsertToken());
+        live.erase(live.begin() + index);
+      }
+    }
+    base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+
+    // Let all the tokens pass, so that only the live allocations split up
+    // the free memory.
+    helper_->Finish();
+    unsigned int largest_free_size = allocator.GetLargestFreeSize();
+    size_t free_size = kLargeBufferSize - allocator.bytes_in_use();
+    EXPECT_TRUE(allocator.CheckConsistency());
+    LOG(INFO) << base::StringPrintf(
+        "%u live allocations: %d allocations in %.1f ms, %d failed; "
+        "largest free block is %.1f%% of %u KB free",
+        kMaxLiveAllocations[i], kAllocations, elapsed.InMillisecondsF(),
+        failures, 100.0 * largest_free_size / free_size,
+        static_cast<unsigned int>(free_size / 1024));
+
+    for (size_t j = 0; j < live.size(); ++j)
+      allocator.Free(live[j]);
+    EXPECT_FALSE(allocator.InUse());
+  }
+}
+
 // Test fixture for FencedAllocatorWrapper test - Creates a
 // FencedAllocatorWrapper, using a CommandBufferHelper with a mock
 // AsyncAPIInterface for its interface (calling it directly, not through the
@@ -0,0 +1,398 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures how fast commands get through GLES2Implementation to the command
+// buffer service. The service runs on a thread of its own, as it would in the
+// GPU process, with a stub in place of the decoder and the GL driver, so that
+// no GPU is needed.
+
+#include <GLES2/gl2.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/bind_helpers.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/stringprintf.h"
+#include "base/synchronization/lock.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/thread.h"
+#include "base/time/time.h"
+#include "gpu/command_buffer/client/client_test_helper.h"
+#include "gpu/command_buffer/client/gles2_cmd_helper.h"
+#include "gpu/command_buffer/client/gles2_implementation.h"
+#include "gpu/command_buffer/client/transfer_buffer.h"
+#include "gpu/command_buffer/common/capabilities.h"
+#include "gpu/command_buffer/common/gles2_cmd_format.h"
+#include "gpu/command_buffer/service/cmd_parser.h"
+#include "gpu/command_buffer/service/command_buffer_service.h"
+#include "gpu/command_buffer/service/gpu_scheduler.h"
+#include "gpu/command_buffer/service/transfer_buffer_manager.h"
+#include "testing/gmock/include/gmock/gmock.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+namespace gpu {
+
+namespace {
+
+const int32 kCommandBufferSize = 1024 * 1024;
+const unsigned int kStartTransferBufferSize = 256 * 1024;
+const unsigned int kMinTransferBufferSize = 256 * 1024;
+const unsigned int kMaxTransferBufferSize = 16 * 1024 * 1024;
+
+// Value returned for every GetIntegerv the client makes at startup.
+const GLint kStaticStateValue = 16;
+
+const int kFrames = 100;
+const int kDrawsPerFrame = 200;
+const int kVertexDataSize = 1024;
+const int kUploadsPerFrame = 8;
+const int kUploadSize = 128;  // Texels on a side, at 4 bytes per texel.
+
+// Stands in for the GLES2 decoder and the GL driver behind it. It accepts
+// every command, answers the queries GLES2Implementation makes when it is
+// initialized, and spends |cost| of busy time on every other command.
+class StubGLService : public AsyncAPIInterface {
+ public:
+  explicit StubGLService(base::TimeDelta cost)
+      : engine_(NULL),
+        cost_(cost),
+        commands_(0) {
+  }
+
+  void set_engine(CommandBufferEngine* engine) { engine_ = engine; }
+
+  int commands() const { return commands_; }
+
+  virtual error::Error DoCommand(unsigned int command,
+                                 unsigned int arg_count,
+                                 const void* cmd_data) OVERRIDE {
+    switch (command) {
+      case cmd::kNoop:
+        return error::kNoError;
+      case cmd::kSetToken:
+        engine_->set_token(static_cast<const cmd::SetToken*>(cmd_data)->token);
+        return error::kNoError;
+      case gles2::cmds::GetMultipleIntegervCHROMIUM::kCmdId:
+        return GetMultipleIntegerv(
+            *static_cast<const gles2::cmds::GetMultipleIntegervCHROMIUM*>(
+                cmd_data));
+    }
+
+    ++commands_;
+    if (cost_ > base::TimeDelta()) {
+      base::TimeTicks end = base::TimeTicks::HighResNow() + cost_;
+      while (base::TimeTicks::HighResNow() < end) {
+      }
+    }
+    return error::kNoError;
+  }
+
+  virtual const char* GetCommandName(unsigned int command_id) const OVERRIDE {
+    return "";
+  }
+
+ private:
+  error::Error GetMultipleIntegerv(
+      const gles2::cmds::GetMultipleIntegervCHROMIUM& c) {
+    Buffer buffer = engine_->GetSharedMemoryBuffer(c.results_shm_id);
+    uint32 size = static_cast<uint32>(c.size);
+    if (!buffer.ptr || c.results_shm_offset + size > buffer.size)
+      return error::kOutOfBounds;
+    GLint* results = reinterpret_cast<GLint*>(
+        static_cast<int8*>(buffer.ptr) + c.results_shm_offset);
+    for (size_t i = 0; i < size / sizeof(*results); ++i)
+      results[i] = kStaticStateValue;
+    return error::kNoError;
+  }
+
+  CommandBufferEngine* engine_;
+  base::TimeDelta cost_;
+  int commands_;
+
+  DISALLOW_COPY_AND_ASSIGN(StubGLService);
+};
+
+void RunAndSignal(const base::Closure& task, base::WaitableEvent* done) {
+  task.Run();
+  done->Signal();
+}
+
+// Runs a CommandBufferService and its GpuScheduler on a service thread. Flush
+// only posts the new put offset to it, and the state the client sees is
+// whatever the service last published, as with the GPU process.
+class ThreadedCommandBuffer : public CommandBuffer {
+ public:
+  explicit ThreadedCommandBuffer(StubGLService* handler)
+      : handler_(handler),
+        service_thread_("ServiceThread"),
+        flushes_(0) {
+  }
+
+  virtual ~ThreadedCommandBuffer() {
+    RunOnServiceThread(base::Bind(
+        &ThreadedCommandBuffer::DestroyOnServiceThread,
+        base::Unretained(this)));
+    service_thread_.Stop();
+  }
+
+  int flushes() const { return flushes_; }
+
+  virtual bool Initialize() OVERRIDE {
+    if (!service_thread_.Start())
+      return false;
+    bool result = false;
+    RunOnServiceThread(base::Bind(
+        &ThreadedCommandBuffer::InitializeOnServiceThread,
+        base::Unretained(this), &result));
+    return result;
+  }
+
+  virtual State GetState() OVERRIDE {
+    RunOnServiceThread(base::Bind(&ThreadedCommandBuffer::UpdateState,
+                                  base::Unretained(this)));
+    return GetLastState();
+  }
+
+  virtual State GetLastState() OVERRIDE {
+    base::AutoLock lock(lock_);
+    return last_state_;
+  }
+
+  virtual int32 GetLastToken() OVERRIDE {
+    return GetLastState().token;
+  }
+
+  virtual void Flush(int32 put_offset) OVERRIDE {
+    ++flushes_;
+    service_thread_.message_loop_proxy()->PostTask(
+        FROM_HERE,
+        base::Bind(&ThreadedCommandBuffer::FlushOnServiceThread,
+                   base::Unretained(this), put_offset));
+  }
+
+  // The service processes all the commands it is sent before it runs the
+  // next task, so everything has been consumed once the state comes back.
+  virtual State FlushSync(int32 put_offset, int32 last_known_get) OVERRIDE {
+    Flush(put_offset);
+    return GetState();
+  }
+
+  virtual void SetGetBuffer(int32 transfer_buffer_id) OVERRIDE {
+    RunOnServiceThread(base::Bind(
+        &ThreadedCommandBuffer::SetGetBufferOnServiceThread,
+        base::Unretained(this), transfer_buffer_id));
+  }
+
+  virtual void SetGetOffset(int32 get_offset) OVERRIDE {
+    NOTREACHED();
+  }
+
+  virtual Buffer CreateTransferBuffer(size_t size, int32* id) OVERRIDE {
+    Buffer buffer;
+    RunOnServiceThread(base::Bind(
+        &ThreadedCommandBuffer::CreateTransferBufferOnServiceThread,
+        base::Unretained(this), size, id, &buffer));
+    return buffer;
+  }
+
+  virtual void DestroyTransferBuffer(int32 id) OVERRIDE {
+    RunOnServiceThread(base::Bind(
+        &CommandBufferService::DestroyTransferBuffer,
+        base::Unretained(service_.get()), id));
+  }
+
+  virtual Buffer GetTransferBuffer(int32 id) OVERRIDE {
+    Buffer buffer;
+    RunOnServiceThread(base::Bind(
+        &ThreadedCommandBuffer::GetTransferBufferOnServiceThread,
+        base::Unretained(this), id, &buffer));
+    return buffer;
+  }
+
+  virtual void SetToken(int32 token) OVERRIDE {
+    NOTREACHED();
+  }
+
+  virtual void SetParseError(error::Error error) OVERRIDE {
+    NOTREACHED();
+  }
+
+  virtual void SetContextLostReason(
+      error::ContextLostReason reason) OVERRIDE {
+    NOTREACHED();
+  }
+
+ private:
+  void RunOnServiceThread(const base::Closure& task) {
+    base::WaitableEvent done(false, false);
+    service_thread_.message_loop_proxy()->PostTask(
+        FROM_HERE, base::Bind(&RunAndSignal, task, &done));
+    done.Wait();
+  }
+
+  void InitializeOnServiceThread(bool* result) {
+    TransferBufferManager* manager = new TransferBufferManager();
+    transfer_buffer_manager_.reset(manager);
+    *result = manager->Initialize();
+    service_.reset(new CommandBufferService(manager));
+    *result = *result && service_->Initialize();
+    scheduler_.reset(new GpuScheduler(service_.get(), handler_, NULL));
+    service_->SetPutOffsetChangeCallback(base::Bind(
+        &GpuScheduler::PutChanged, base::Unretained(scheduler_.get())));
+    service_->SetGetBufferChangeCallback(base::Bind(
+        &GpuScheduler::SetGetBuffer, base::Unretained(scheduler_.get())));
+    handler_->set_engine(scheduler_.get());
+    UpdateState();
+  }
+
+  void DestroyOnServiceThread() {
+    scheduler_.reset();
+    service_.reset();
+    transfer_buffer_manager_.reset();
+  }
+
+  void UpdateState() {
+    State state = service_->GetState();
+    base::AutoLock lock(lock_);
+    last_state_ = state;
+  }
+
+  void FlushOnServiceThread(int32 put_offset) {
+    service_->Flush(put_offset);
+    UpdateState();
+  }
+
+  void SetGetBufferOnServiceThread(int32 transfer_buffer_id) {
+    service_->SetGetBuffer(transfer_buffer_id);
+    UpdateState();
+  }
+
+  void CreateTransferBufferOnServiceThread(size_t size,
+                                           int32* id,
+                                           Buffer* buffer) {
+    *buffer = service_->CreateTransferBuffer(size, id);
+  }
+
+  void GetTransferBufferOnServiceThread(int32 id, Buffer* buffer) {
+    *buffer = service_->GetTransferBuffer(id);
+  }
+
+  StubGLService* handler_;
+  base::Thread service_thread_;
+
+  // Only used on the service thread.
+  scoped_ptr<TransferBufferManagerInterface> transfer_buffer_manager_;
+  scoped_ptr<CommandBufferService> service_;
+  scoped_ptr<GpuScheduler> scheduler_;
+
+  base::Lock lock_;
+  State last_state_;
+
+  // Only used on the client thread.
+  int flushes_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadedCommandBuffer);
+};
+
+// Draws |kFrames| frames, each made of many small draws with their vertex
+// data, a few texture uploads, and a glFlush, as a compositor would.
+void DrawFrames(gles2::GLES2Implementation* gl) {
+  std::vector<uint8> vertex_data(kVertexDataSize);
+  std::vector<uint8> texels(kUploadSize * kUploadSize * 4);
+
+  GLuint buffer = 0;
+  GLuint texture = 0;
+  gl->GenBuffers(1, &buffer);
+  gl->GenTextures(1, &texture);
+  gl->BindBuffer(GL_ARRAY_BUFFER, buffer);
+  gl->BufferData(GL_ARRAY_BUFFER, kVertexDataSize, NULL, GL_DYNAMIC_DRAW);
+  gl->BindTexture(GL_TEXTURE_2D, texture);
+  gl->TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, kUploadSize, kUploadSize, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+  for (int frame = 0; frame < kFrames; ++frame) {
+    for (int i = 0; i < kUploadsPerFrame; ++i) {
+      gl->TexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, kUploadSize, kUploadSize,
+                        GL_RGBA, GL_UNSIGNED_BYTE, &texels[0]);
+    }
+    for (int i = 0; i < kDrawsPerFrame; ++i) {
+      gl->BufferSubData(GL_ARRAY_BUFFER, 0, kVertexDataSize, &vertex_data[0]);
+      gl->Viewport(0, 0, i, i);
+      gl->DrawArrays(GL_TRIANGLES, 0, 3);
+    }
+    gl->Flush();
+  }
+  gl->Finish();
+
+  gl->DeleteTextures(1, &texture);
+  gl->DeleteBuffers(1, &buffer);
+}
+
+void RunThroughputTest(int cost_us) {
+  StubGLService service(base::TimeDelta::FromMicroseconds(cost_us));
+  scoped_ptr<ThreadedCommandBuffer> command_buffer(
+      new ThreadedCommandBuffer(&service));
+  ASSERT_TRUE(command_buffer->Initialize());
+
+  scoped_ptr<gles2::GLES2CmdHelper> helper(
+      new gles2::GLES2CmdHelper(command_buffer.get()));
+  ASSERT_TRUE(helper->Initialize(kCommandBufferSize));
+  scoped_ptr<TransferBuffer> transfer_buffer(new TransferBuffer(helper.get()));
+
+  testing::NiceMock<MockClientGpuControl> gpu_control;
+  ON_CALL(gpu_control, GetCapabilities())
+      .WillByDefault(testing::Return(Capabilities()));
+
+  scoped_ptr<gles2::GLES2Implementation> gl(new gles2::GLES2Implementation(
+      helper.get(),
+      NULL,
+      transfer_buffer.get(),
+      true  /* bind_generates_resource */,
+      false  /* free_everything_when_invisible */,
+      &gpu_control));
+  ASSERT_TRUE(gl->Initialize(kStartTransferBufferSize,
+                             kMinTransferBufferSize,
+                             kMaxTransferBufferSize,
+                             gles2::GLES2Implementation::kNoLimit));
+
+  int commands_before = service.commands();
+  int flushes_before = command_buffer->flushes();
+  base::TimeTicks start = base::TimeTicks::HighResNow();
+  DrawFrames(gl.get());
+  double elapsed_ms = (base::TimeTicks::HighResNow() - start).InMillisecondsF();
+  int commands = service.commands() - commands_before;
+  int flushes = command_buffer->flushes() - flushes_before;
+
+  std::string trace = base::StringPrintf("%d_us_per_command", cost_us);
+  perf_test::PrintResult("command_throughput", "", trace,
+                         commands / elapsed_ms, "commands/ms", true);
+  perf_test::PrintResult("commands_per_flush", "", trace,
+                         static_cast<double>(commands) / std::max(flushes, 1),
+                         "commands", false);
+  perf_test::PrintResult(
+      "transfer_buffer_size", "", trace,
+      static_cast<size_t>(
+          transfer_buffer->GetCurrentMaxAllocationWithoutRealloc() / 1024),
+      "KB", false);
+
+  gl.reset();
+  transfer_buffer.reset();
+  helper.reset();
+}
+
+}  // namespace
+
+// With a service that is faster than the client, the client should flush
+// often enough to keep it busy; with a slower one, it should batch more
+// commands per flush and use a larger transfer buffer.
+TEST(GLES2ImplementationPerfTest, CommandThroughput) {
+  const int kCostsUs[] = { 0, 1, 5 };
+  for (size_t i = 0; i < arraysize(kCostsUs); ++i)
+    RunThroughputTest(kCostsUs[i]);
+}
+
+}  // namespace gpu
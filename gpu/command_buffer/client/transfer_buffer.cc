@@ -11,6 +11,10 @@
 
 namespace gpu {
 
+// Number of allocations in a row that must wait for the service before the
+// buffer is expanded.
+const int kAllocationWaitsBeforeExpanding = 8;
+
 AlignedRingBuffer::~AlignedRingBuffer() {
 }
 
@@ -24,6 +28,7 @@ TransferBuffer::TransferBuffer(
       alignment_(0),
       size_to_flush_(0),
       bytes_since_last_flush_(0),
+      allocations_waited_(0),
       buffer_id_(-1),
       result_buffer_(NULL),
       result_shm_offset_(0),
@@ -62,6 +67,7 @@ void TransferBuffer::Free() {
     result_shm_offset_ = 0;
     ring_buffer_.reset();
     bytes_since_last_flush_ = 0;
+    allocations_waited_ = 0;
   }
 }
 
@@ -153,11 +159,31 @@ void TransferBuffer::ReallocateRingBuffer(unsigned int size) {
   }
 }
 
+void TransferBuffer::ExpandIfServiceIsBehind(unsigned int size) {
+  if (!HaveBuffer() || buffer_.size >= max_buffer_size_)
+    return;
+
+  size = std::min(size, ring_buffer_->GetLargestFreeOrPendingSize());
+  if (size <= ring_buffer_->GetLargestFreeSizeNoWaiting()) {
+    allocations_waited_ = 0;
+    return;
+  }
+  if (++allocations_waited_ < kAllocationWaitsBeforeExpanding)
+    return;
+
+  // The reallocation waits for the service to finish, which the allocation
+  // would have had to do anyway.
+  default_buffer_size_ = std::min(
+      static_cast<unsigned int>(buffer_.size * 2), max_buffer_size_);
+  ReallocateRingBuffer(size);
+}
+
 void* TransferBuffer::AllocUpTo(
     unsigned int size, unsigned int* size_allocated) {
   DCHECK(size_allocated);
 
   ReallocateRingBuffer(size);
+  ExpandIfServiceIsBehind(size);
 
   if (!HaveBuffer()) {
     return NULL;
@@ -171,6 +197,7 @@ void* TransferBuffer::AllocUpTo(
 
 void* TransferBuffer::Alloc(unsigned int size) {
   ReallocateRingBuffer(size);
+  ExpandIfServiceIsBehind(size);
 
   if (!HaveBuffer()) {
     return NULL;
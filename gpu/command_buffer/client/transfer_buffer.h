@@ -119,6 +119,11 @@ class GPU_EXPORT TransferBuffer : public TransferBufferInterface {
 
   void AllocateRingBuffer(unsigned int size);
 
+  // Doubles the buffer, up to |max_buffer_size_|, once allocations have had
+  // to wait for the service to consume earlier transfers several times in a
+  // row, since more data is then in flight than the buffer can hold.
+  void ExpandIfServiceIsBehind(unsigned int size);
+
   CommandBufferHelper* helper_;
   scoped_ptr<AlignedRingBuffer> ring_buffer_;
 
@@ -143,6 +148,9 @@ class GPU_EXPORT TransferBuffer : public TransferBufferInterface {
   // Number of bytes since we last flushed.
   unsigned int bytes_since_last_flush_;
 
+  // Number of allocations in a row which had to wait for the service.
+  int allocations_waited_;
+
   // the current buffer.
   gpu::Buffer buffer_;
 
@@ -20,12 +20,18 @@ static const int kDefaultNumHostsToRemember = 200;
 HttpServerPropertiesImpl::HttpServerPropertiesImpl()
     : pipeline_capability_map_(
         new CachedPipelineCapabilityMap(kDefaultNumHostsToRemember)),
+      delegate_(NULL),
       weak_ptr_factory_(this) {
 }
 
 HttpServerPropertiesImpl::~HttpServerPropertiesImpl() {
 }
 
+void HttpServerPropertiesImpl::SetDelegate(Delegate* delegate) {
+  DCHECK(CalledOnValidThread());
+  delegate_ = delegate;
+}
+
 void HttpServerPropertiesImpl::InitializeSpdyServers(
     std::vector<std::string>* spdy_servers,
     bool support_spdy) {
@@ -123,6 +129,7 @@ void HttpServerPropertiesImpl::Clear() {
   alternate_protocol_map_.clear();
   spdy_settings_map_.clear();
   pipeline_capability_map_->Clear();
+  DirtyNotify();
 }
 
 bool HttpServerPropertiesImpl::SupportsSpdy(
@@ -155,6 +162,7 @@ void HttpServerPropertiesImpl::SetSupportsSpdy(
   }
   // Cache the data.
   spdy_servers_table_[spdy_server] = support_spdy;
+  DirtyNotify();
 }
 
 bool HttpServerPropertiesImpl::HasAlternateProtocol(
@@ -212,12 +220,19 @@ void HttpServerPropertiesImpl::SetAlternateProtocol(
     }
   }
 
+  AlternateProtocolMap::const_iterator it =
+      alternate_protocol_map_.find(server);
+  if (it != alternate_protocol_map_.end() && it->second.Equals(alternate))
+    return;
   alternate_protocol_map_[server] = alternate;
+  DirtyNotify();
 }
 
 void HttpServerPropertiesImpl::SetBrokenAlternateProtocol(
     const HostPortPair& server) {
   alternate_protocol_map_[server].protocol = ALTERNATE_PROTOCOL_BROKEN;
+  // Broken entries are not persisted, but the one they replace may have been.
+  DirtyNotify();
 }
 
 const AlternateProtocolMap&
@@ -246,16 +261,21 @@ bool HttpServerPropertiesImpl::SetSpdySetting(
   SettingsMap& settings_map = spdy_settings_map_[host_port_pair];
   SettingsFlagsAndValue flags_and_value(SETTINGS_FLAG_PERSISTED, value);
   settings_map[id] = flags_and_value;
+  DirtyNotify();
   return true;
 }
 
 void HttpServerPropertiesImpl::ClearSpdySettings(
     const HostPortPair& host_port_pair) {
-  spdy_settings_map_.erase(host_port_pair);
+  if (spdy_settings_map_.erase(host_port_pair))
+    DirtyNotify();
 }
 
 void HttpServerPropertiesImpl::ClearAllSpdySettings() {
+  if (spdy_settings_map_.empty())
+    return;
   spdy_settings_map_.clear();
+  DirtyNotify();
 }
 
 const SpdySettingsMap&
@@ -281,12 +301,17 @@ void HttpServerPropertiesImpl::SetPipelineCapability(
       pipeline_capability_map_->Peek(origin);
   if (it == pipeline_capability_map_->end() ||
       it->second != PIPELINE_INCAPABLE) {
+    bool changed = it == pipeline_capability_map_->end() ||
+        it->second != capability;
     pipeline_capability_map_->Put(origin, capability);
+    if (changed)
+      DirtyNotify();
   }
 }
 
 void HttpServerPropertiesImpl::ClearPipelineCapabilities() {
   pipeline_capability_map_->Clear();
+  DirtyNotify();
 }
 
 PipelineCapabilityMap
@@ -300,4 +325,9 @@ HttpServerPropertiesImpl::GetPipelineCapabilityMap() const {
   return result;
 }
 
+void HttpServerPropertiesImpl::DirtyNotify() {
+  if (delegate_)
+    delegate_->StateIsDirty(this);
+}
+
 }  // namespace net
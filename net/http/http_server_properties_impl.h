@@ -27,13 +27,31 @@ class ListValue;
 namespace net {
 
 // The implementation for setting/retrieving the HTTP server properties.
+//
+// This object manages the in-memory store. Register a Delegate with
+// |SetDelegate| to persist the properties to disk.
 class NET_EXPORT HttpServerPropertiesImpl
     : public HttpServerProperties,
       NON_EXPORTED_BASE(public base::NonThreadSafe) {
  public:
+  class NET_EXPORT Delegate {
+   public:
+    // Called whenever a property which is worth persisting changes. This
+    // function must not block or reenter the HttpServerPropertiesImpl.
+    virtual void StateIsDirty(HttpServerPropertiesImpl* properties) = 0;
+
+   protected:
+    virtual ~Delegate() {}
+  };
+
   HttpServerPropertiesImpl();
   virtual ~HttpServerPropertiesImpl();
 
+  // Assigns a |Delegate| for persisting the properties. If |NULL|, the
+  // properties will not be persisted. The caller retains ownership of
+  // |delegate|. The Initialize* methods below do not notify the delegate.
+  void SetDelegate(Delegate* delegate);
+
   // Initializes |spdy_servers_table_| with the servers (host/port) from
   // |spdy_servers| that either support SPDY or not.
   void InitializeSpdyServers(std::vector<std::string>* spdy_servers,
@@ -145,12 +163,17 @@ class NET_EXPORT HttpServerPropertiesImpl
   // pair) that either support or not support SPDY protocol.
   typedef base::hash_map<std::string, bool> SpdyServerHostPortTable;
 
+  // Tells the delegate, if any, that the properties have changed.
+  void DirtyNotify();
+
   SpdyServerHostPortTable spdy_servers_table_;
 
   AlternateProtocolMap alternate_protocol_map_;
   SpdySettingsMap spdy_settings_map_;
   scoped_ptr<CachedPipelineCapabilityMap> pipeline_capability_map_;
 
+  Delegate* delegate_;
+
   base::WeakPtrFactory<HttpServerPropertiesImpl> weak_ptr_factory_;
 
   DISALLOW_COPY_AND_ASSIGN(HttpServerPropertiesImpl);
@@ -0,0 +1,302 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net/http/http_server_properties_persister.h"
+
+#include <vector>
+
+#include "base/bind.h"
+#include "base/file_util.h"
+#include "base/message_loop/message_loop.h"
+#include "base/message_loop/message_loop_proxy.h"
+#include "base/pickle.h"
+#include "base/sequenced_task_runner.h"
+#include "base/task_runner_util.h"
+#include "base/values.h"
+#include "net/base/host_port_pair.h"
+
+using net::HostPortPair;
+
+namespace {
+
+// Bump this whenever the serialization format changes. Files written with
+// another version are ignored and overwritten.
+const int kVersion = 1;
+
+void WriteHostPortPair(const HostPortPair& server, Pickle* pickle) {
+  pickle->WriteString(server.host());
+  pickle->WriteUInt16(server.port());
+}
+
+bool ReadHostPortPair(PickleIterator* iter, HostPortPair* server) {
+  std::string host;
+  uint16 port;
+  if (!iter->ReadString(&host) || !iter->ReadUInt16(&port))
+    return false;
+  *server = HostPortPair(host, port);
+  return true;
+}
+
+std::string LoadState(const base::FilePath& path) {
+  std::string result;
+  if (!base::ReadFileToString(path, &result)) {
+    return "";
+  }
+  return result;
+}
+
+}  // namespace
+
+
+namespace net {
+
+HttpServerPropertiesPersister::HttpServerPropertiesPersister(
+    HttpServerPropertiesImpl* properties,
+    const base::FilePath& profile_path,
+    base::SequencedTaskRunner* background_runner,
+    bool readonly)
+    : properties_(properties),
+      writer_(profile_path.AppendASCII("HttpServerProperties"),
+              background_runner),
+      foreground_runner_(base::MessageLoop::current()->message_loop_proxy()),
+      background_runner_(background_runner),
+      readonly_(readonly),
+      loaded_(false),
+      dirty_before_load_(false),
+      weak_ptr_factory_(this) {
+  properties_->SetDelegate(this);
+
+  base::PostTaskAndReplyWithResult(
+      background_runner_,
+      FROM_HERE,
+      base::Bind(&::LoadState, writer_.path()),
+      base::Bind(&HttpServerPropertiesPersister::CompleteLoad,
+                 weak_ptr_factory_.GetWeakPtr()));
+}
+
+HttpServerPropertiesPersister::~HttpServerPropertiesPersister() {
+  DCHECK(foreground_runner_->RunsTasksOnCurrentThread());
+
+  if (writer_.HasPendingWrite())
+    writer_.DoScheduledWrite();
+
+  properties_->SetDelegate(NULL);
+}
+
+void HttpServerPropertiesPersister::StateIsDirty(
+    HttpServerPropertiesImpl* properties) {
+  DCHECK(foreground_runner_->RunsTasksOnCurrentThread());
+  DCHECK_EQ(properties_, properties);
+
+  if (readonly_)
+    return;
+
+  if (!loaded_) {
+    dirty_before_load_ = true;
+    return;
+  }
+  writer_.ScheduleWrite(this);
+}
+
+bool HttpServerPropertiesPersister::SerializeData(std::string* output) {
+  DCHECK(foreground_runner_->RunsTasksOnCurrentThread());
+
+  Pickle pickle;
+  pickle.WriteInt(kVersion);
+
+  base::ListValue spdy_servers;
+  properties_->GetSpdyServerList(&spdy_servers);
+  pickle.WriteInt(static_cast<int>(spdy_servers.GetSize()));
+  for (size_t i = 0; i < spdy_servers.GetSize(); ++i) {
+    std::string spdy_server;
+    spdy_servers.GetString(i, &spdy_server);
+    pickle.WriteString(spdy_server);
+  }
+
+  const AlternateProtocolMap& alternate_protocol_map =
+      properties_->alternate_protocol_map();
+  int alternate_protocol_count = 0;
+  for (AlternateProtocolMap::const_iterator it =
+           alternate_protocol_map.begin();
+       it != alternate_protocol_map.end(); ++it) {
+    if (IsAlternateProtocolValid(it->second.protocol))
+      ++alternate_protocol_count;
+  }
+  pickle.WriteInt(alternate_protocol_count);
+  for (AlternateProtocolMap::const_iterator it =
+           alternate_protocol_map.begin();
+       it != alternate_protocol_map.end(); ++it) {
+    if (!IsAlternateProtocolValid(it->second.protocol))
+      continue;
+    WriteHostPortPair(it->first, &pickle);
+    pickle.WriteUInt16(it->second.port);
+    pickle.WriteInt(it->second.protocol);
+  }
+
+  const SpdySettingsMap& spdy_settings_map = properties_->spdy_settings_map();
+  pickle.WriteInt(static_cast<int>(spdy_settings_map.size()));
+  for (SpdySettingsMap::const_iterator it = spdy_settings_map.begin();
+       it != spdy_settings_map.end(); ++it) {
+    WriteHostPortPair(it->first, &pickle);
+    pickle.WriteInt(static_cast<int>(it->second.size()));
+    for (SettingsMap::const_iterator setting = it->second.begin();
+         setting != it->second.end(); ++setting) {
+      pickle.WriteInt(setting->first);
+      pickle.WriteUInt32(setting->second.second);
+    }
+  }
+
+  PipelineCapabilityMap pipeline_capability_map =
+      properties_->GetPipelineCapabilityMap();
+  pickle.WriteInt(static_cast<int>(pipeline_capability_map.size()));
+  for (PipelineCapabilityMap::const_iterator it =
+           pipeline_capability_map.begin();
+       it != pipeline_capability_map.end(); ++it) {
+    WriteHostPortPair(it->first, &pickle);
+    pickle.WriteInt(it->second);
+  }
+
+  output->assign(static_cast<const char*>(pickle.data()), pickle.size());
+  return true;
+}
+
+bool HttpServerPropertiesPersister::LoadEntries(const std::string& serialized,
+                                                bool* dirty) {
+  DCHECK(foreground_runner_->RunsTasksOnCurrentThread());
+
+  Pickle pickle(serialized.data(), serialized.size());
+  PickleIterator iter(pickle);
+  int version;
+  if (!iter.ReadInt(&version) || version != kVersion)
+    return false;
+
+  bool dirtied = false;
+  int count;
+
+  std::vector<std::string> spdy_servers;
+  if (!iter.ReadInt(&count))
+    return false;
+  for (int i = 0; i < count; ++i) {
+    std::string spdy_server;
+    if (!iter.ReadString(&spdy_server))
+      return false;
+    spdy_servers.push_back(spdy_server);
+  }
+
+  AlternateProtocolMap alternate_protocol_map;
+  if (!iter.ReadInt(&count))
+    return false;
+  for (int i = 0; i < count; ++i) {
+    HostPortPair server;
+    PortAlternateProtocolPair alternate;
+    int protocol;
+    if (!ReadHostPortPair(&iter, &server) ||
+        !iter.ReadUInt16(&alternate.port) ||
+        !iter.ReadInt(&protocol)) {
+      return false;
+    }
+    alternate.protocol = static_cast<AlternateProtocol>(protocol);
+    if (!IsAlternateProtocolValid(alternate.protocol)) {
+      dirtied = true;
+      continue;
+    }
+    alternate_protocol_map[server] = alternate;
+  }
+
+  SpdySettingsMap spdy_settings_map;
+  if (!iter.ReadInt(&count))
+    return false;
+  for (int i = 0; i < count; ++i) {
+    HostPortPair server;
+    int settings_count;
+    if (!ReadHostPortPair(&iter, &server) || !iter.ReadInt(&settings_count))
+      return false;
+    SettingsMap& settings_map = spdy_settings_map[server];
+    for (int j = 0; j < settings_count; ++j) {
+      int id;
+      uint32 value;
+      if (!iter.ReadInt(&id) || !iter.ReadUInt32(&value))
+        return false;
+      settings_map[static_cast<SpdySettingsIds>(id)] =
+          SettingsFlagsAndValue(SETTINGS_FLAG_PERSISTED, value);
+    }
+  }
+
+  PipelineCapabilityMap pipeline_capability_map;
+  if (!iter.ReadInt(&count))
+    return false;
+  for (int i = 0; i < count; ++i) {
+    HostPortPair server;
+    int capability;
+    if (!ReadHostPortPair(&iter, &server) || !iter.ReadInt(&capability))
+      return false;
+    if (capability < PIPELINE_UNKNOWN ||
+        capability > PIPELINE_PROBABLY_CAPABLE) {
+      dirtied = true;
+      continue;
+    }
+    pipeline_capability_map[server] =
+        static_cast<HttpPipelinedHostCapability>(capability);
+  }
+
+  // Anything learned since startup is more recent than what was stored.
+  base::ListValue current_spdy_servers;
+  properties_->GetSpdyServerList(&current_spdy_servers);
+  for (size_t i = 0; i < current_spdy_servers.GetSize(); ++i) {
+    std::string spdy_server;
+    current_spdy_servers.GetString(i, &spdy_server);
+    spdy_servers.push_back(spdy_server);
+  }
+  properties_->InitializeSpdyServers(&spdy_servers, true);
+
+  const AlternateProtocolMap& current_alternate_protocol_map =
+      properties_->alternate_protocol_map();
+  for (AlternateProtocolMap::const_iterator it =
+           current_alternate_protocol_map.begin();
+       it != current_alternate_protocol_map.end(); ++it) {
+    alternate_protocol_map[it->first] = it->second;
+  }
+  properties_->InitializeAlternateProtocolServers(&alternate_protocol_map);
+
+  const SpdySettingsMap& current_spdy_settings_map =
+      properties_->spdy_settings_map();
+  for (SpdySettingsMap::const_iterator it = current_spdy_settings_map.begin();
+       it != current_spdy_settings_map.end(); ++it) {
+    spdy_settings_map[it->first] = it->second;
+  }
+  properties_->InitializeSpdySettingsServers(&spdy_settings_map);
+
+  PipelineCapabilityMap current_pipeline_capability_map =
+      properties_->GetPipelineCapabilityMap();
+  for (PipelineCapabilityMap::const_iterator it =
+           current_pipeline_capability_map.begin();
+       it != current_pipeline_capability_map.end(); ++it) {
+    pipeline_capability_map[it->first] = it->second;
+  }
+  properties_->InitializePipelineCapabilities(&pipeline_capability_map);
+
+  *dirty = dirtied;
+  return true;
+}
+
+void HttpServerPropertiesPersister::CompleteLoad(const std::string& state) {
+  DCHECK(foreground_runner_->RunsTasksOnCurrentThread());
+
+  loaded_ = true;
+  bool dirty = dirty_before_load_;
+  dirty_before_load_ = false;
+  if (!state.empty()) {
+    bool dropped_entries = false;
+    if (LoadEntries(state, &dropped_entries)) {
+      dirty |= dropped_entries;
+    } else {
+      LOG(ERROR) << "Failed to deserialize HTTP server properties";
+      dirty = true;
+    }
+  }
+  if (dirty)
+    StateIsDirty(properties_);
+}
+
+}  // namespace net
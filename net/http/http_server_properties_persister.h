@@ -0,0 +1,105 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// HttpServerPropertiesImpl keeps what has been learned about servers (SPDY
+// support, Alternate-Protocol, SPDY settings and pipelining capability) in
+// memory only. This object writes those properties out to disk as they
+// change and loads them back at startup, so that the first connection to a
+// SPDY or QUIC capable server after a restart does not need to rediscover the
+// protocol. Embedders with their own pref-based store need not use it.
+//
+// Loading is done on the background task runner and does not block startup.
+// Properties learned before the load completes take precedence over the
+// loaded ones. Writes go through an ImportantFileWriter, which batches all
+// the changes made within its commit interval into one write on the
+// background task runner.
+
+#ifndef NET_HTTP_HTTP_SERVER_PROPERTIES_PERSISTER_H_
+#define NET_HTTP_HTTP_SERVER_PROPERTIES_PERSISTER_H_
+
+#include <string>
+
+#include "base/files/file_path.h"
+#include "base/files/important_file_writer.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/weak_ptr.h"
+#include "net/base/net_export.h"
+#include "net/http/http_server_properties_impl.h"
+
+namespace base {
+class SequencedTaskRunner;
+}
+
+namespace net {
+
+// Reads and updates the on-disk HTTP server properties. Clients of this class
+// should create, destroy, and call into it from the thread which uses
+// |properties|.
+//
+// |background_runner| is the task runner this class should use internally to
+// perform file IO, and can optionally be associated with a different thread.
+class NET_EXPORT HttpServerPropertiesPersister
+    : public HttpServerPropertiesImpl::Delegate,
+      public base::ImportantFileWriter::DataSerializer {
+ public:
+  HttpServerPropertiesPersister(HttpServerPropertiesImpl* properties,
+                                const base::FilePath& profile_path,
+                                base::SequencedTaskRunner* background_runner,
+                                bool readonly);
+  virtual ~HttpServerPropertiesPersister();
+
+  // Called by the HttpServerPropertiesImpl when it changes its state.
+  virtual void StateIsDirty(HttpServerPropertiesImpl* properties) OVERRIDE;
+
+  // ImportantFileWriter::DataSerializer:
+  //
+  // Serializes |properties_| into |*output|. The format is a Pickle holding
+  // a version number followed by four tables, each of which starts with its
+  // entry count:
+  //
+  //     SPDY servers:       "host:port"
+  //     Alternate-Protocol: host, port, alternate port, protocol
+  //     SPDY settings:      host, port, count, then (id, value) per setting
+  //     Pipelining:         host, port, capability
+  //
+  // Broken alternate protocols are not persisted.
+  virtual bool SerializeData(std::string* output) OVERRIDE;
+
+  // Merges the properties in |serialized| into |properties_|, keeping any
+  // which are already known. Returns false if |serialized| could not be
+  // parsed, in which case |properties_| is not modified.
+  //
+  // Sets |*dirty| to true if |serialized| held entries which were dropped;
+  // false otherwise.
+  bool LoadEntries(const std::string& serialized, bool* dirty);
+
+ private:
+  void CompleteLoad(const std::string& state);
+
+  HttpServerPropertiesImpl* properties_;
+
+  // Helper for safely writing the data.
+  base::ImportantFileWriter writer_;
+
+  scoped_refptr<base::SequencedTaskRunner> foreground_runner_;
+  scoped_refptr<base::SequencedTaskRunner> background_runner_;
+
+  // Whether or not we're in read-only mode.
+  const bool readonly_;
+
+  // Whether the properties on disk have been merged into |properties_|. No
+  // write is started before then, since it would drop the stored properties.
+  bool loaded_;
+
+  // Whether |properties_| changed before |loaded_| was set.
+  bool dirty_before_load_;
+
+  base::WeakPtrFactory<HttpServerPropertiesPersister> weak_ptr_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(HttpServerPropertiesPersister);
+};
+
+}  // namespace net
+
+#endif  // NET_HTTP_HTTP_SERVER_PROPERTIES_PERSISTER_H_
@@ -0,0 +1,150 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net/http/http_server_properties_persister.h"
+
+#include <string>
+
+#include "base/files/scoped_temp_dir.h"
+#include "base/message_loop/message_loop.h"
+#include "net/base/host_port_pair.h"
+#include "net/http/http_server_properties_impl.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace net {
+
+namespace {
+
+class HttpServerPropertiesPersisterTest : public testing::Test {
+ public:
+  virtual ~HttpServerPropertiesPersisterTest() {
+    persister_.reset();
+    base::MessageLoopForIO::current()->RunUntilIdle();
+  }
+
+  virtual void SetUp() OVERRIDE {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    CreatePersister();
+  }
+
+ protected:
+  void CreatePersister() {
+    persister_.reset(new HttpServerPropertiesPersister(
+        &properties_,
+        temp_dir_.path(),
+        base::MessageLoopForIO::current()->message_loop_proxy(),
+        false));
+    // Let the initial load finish.
+    base::MessageLoopForIO::current()->RunUntilIdle();
+  }
+
+  base::MessageLoopForIO message_loop_;
+  base::ScopedTempDir temp_dir_;
+  HttpServerPropertiesImpl properties_;
+  scoped_ptr<HttpServerPropertiesPersister> persister_;
+};
+
+TEST_F(HttpServerPropertiesPersisterTest, SerializeEmpty) {
+  std::string output;
+  bool dirty;
+
+  EXPECT_TRUE(persister_->SerializeData(&output));
+  EXPECT_TRUE(persister_->LoadEntries(output, &dirty));
+  EXPECT_FALSE(dirty);
+}
+
+TEST_F(HttpServerPropertiesPersisterTest, SerializeRoundTrip) {
+  HostPortPair spdy_server("spdy.example.com", 443);
+  HostPortPair quic_server("quic.example.com", 80);
+  HostPortPair broken_server("broken.example.com", 80);
+  HostPortPair pipelined_server("pipelined.example.com", 80);
+
+  properties_.SetSupportsSpdy(spdy_server, true);
+  properties_.SetAlternateProtocol(quic_server, 443, QUIC);
+  properties_.SetAlternateProtocol(broken_server, 443, NPN_SPDY_3);
+  properties_.SetBrokenAlternateProtocol(broken_server);
+  properties_.SetSpdySetting(spdy_server, SETTINGS_UPLOAD_BANDWIDTH,
+                             SETTINGS_FLAG_PLEASE_PERSIST, 1000);
+  properties_.SetPipelineCapability(pipelined_server, PIPELINE_CAPABLE);
+
+  std::string output;
+  EXPECT_TRUE(persister_->SerializeData(&output));
+  properties_.Clear();
+
+  bool dirty;
+  EXPECT_TRUE(persister_->LoadEntries(output, &dirty));
+  EXPECT_FALSE(dirty);
+
+  EXPECT_TRUE(properties_.SupportsSpdy(spdy_server));
+  ASSERT_TRUE(properties_.HasAlternateProtocol(quic_server));
+  PortAlternateProtocolPair alternate =
+      properties_.GetAlternateProtocol(quic_server);
+  EXPECT_EQ(443, alternate.port);
+  EXPECT_EQ(QUIC, alternate.protocol);
+  // Broken alternate protocols only last for the session.
+  EXPECT_FALSE(properties_.HasAlternateProtocol(broken_server));
+
+  const SettingsMap& settings = properties_.GetSpdySettings(spdy_server);
+  ASSERT_EQ(1U, settings.size());
+  SettingsMap::const_iterator it = settings.find(SETTINGS_UPLOAD_BANDWIDTH);
+  ASSERT_TRUE(it != settings.end());
+  EXPECT_EQ(SETTINGS_FLAG_PERSISTED, it->second.first);
+  EXPECT_EQ(1000U, it->second.second);
+
+  EXPECT_EQ(PIPELINE_CAPABLE,
+            properties_.GetPipelineCapability(pipelined_server));
+}
+
+TEST_F(HttpServerPropertiesPersisterTest, LoadKeepsNewerProperties) {
+  HostPortPair server("www.example.com", 80);
+  properties_.SetAlternateProtocol(server, 443, NPN_SPDY_3);
+  std::string output;
+  EXPECT_TRUE(persister_->SerializeData(&output));
+
+  properties_.Clear();
+  properties_.SetAlternateProtocol(server, 443, QUIC);
+  properties_.SetSupportsSpdy(HostPortPair("other.example.com", 443), true);
+
+  bool dirty;
+  EXPECT_TRUE(persister_->LoadEntries(output, &dirty));
+  EXPECT_EQ(QUIC, properties_.GetAlternateProtocol(server).protocol);
+  EXPECT_TRUE(properties_.SupportsSpdy(HostPortPair("other.example.com", 443)));
+}
+
+TEST_F(HttpServerPropertiesPersisterTest, RejectsMalformedData) {
+  HostPortPair server("www.example.com", 80);
+  properties_.SetSupportsSpdy(server, true);
+  std::string output;
+  EXPECT_TRUE(persister_->SerializeData(&output));
+
+  bool dirty;
+  EXPECT_FALSE(persister_->LoadEntries(std::string(), &dirty));
+  EXPECT_FALSE(persister_->LoadEntries("not a pickle", &dirty));
+  EXPECT_FALSE(persister_->LoadEntries(output.substr(0, output.size() - 4),
+                                       &dirty));
+  EXPECT_TRUE(properties_.SupportsSpdy(server));
+}
+
+// Properties written by one persister are loaded by the next, as they would
+// be across a restart.
+TEST_F(HttpServerPropertiesPersisterTest, PersistsAcrossRestart) {
+  HostPortPair spdy_server("spdy.example.com", 443);
+  HostPortPair quic_server("quic.example.com", 80);
+  properties_.SetSupportsSpdy(spdy_server, true);
+  properties_.SetAlternateProtocol(quic_server, 443, QUIC);
+
+  // Destroying the persister writes out the pending changes.
+  persister_.reset();
+  base::MessageLoopForIO::current()->RunUntilIdle();
+
+  properties_.Clear();
+  CreatePersister();
+  EXPECT_TRUE(properties_.SupportsSpdy(spdy_server));
+  ASSERT_TRUE(properties_.HasAlternateProtocol(quic_server));
+  EXPECT_EQ(QUIC, properties_.GetAlternateProtocol(quic_server).protocol);
+}
+
+}  // namespace
+
+}  // namespace net
@@ -8,6 +8,7 @@
 #include "base/bind.h"
 #include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/time/time.h"
 #include "media/base/video_frame.h"
 #include "remoting/codec/codec_test.h"
 #include "remoting/codec/video_decoder.h"
@@ -381,4 +382,33 @@ void TestVideoEncoderDecoderGradient(VideoEncoder* encoder,
                                      max_error_limit, mean_error_limit);
 }
 
+float MeasureVideoEncoderFps(
+    VideoEncoder* encoder,
+    const DesktopSize& size,
+    const std::vector<DesktopRegion>& updated_regions) {
+  const base::TimeDelta kTestTime = base::TimeDelta::FromSeconds(1);
+  DCHECK(!updated_regions.empty());
+
+  scoped_ptr<webrtc::DesktopFrame> frame = PrepareFrame(size);
+
+  // The first frame sets the encoder up for |size|, so it isn't counted.
+  frame->mutable_updated_region()->SetRect(DesktopRect::MakeSize(size));
+  encoder->Encode(*frame);
+
+  base::TimeTicks start_time = base::TimeTicks::Now();
+  base::TimeDelta elapsed;
+  int frame_count = 0;
+  for (; elapsed < kTestTime ||
+         frame_count < static_cast<int>(updated_regions.size());
+       ++frame_count) {
+    *frame->mutable_updated_region() =
+        updated_regions[frame_count % updated_regions.size()];
+    scoped_ptr<VideoPacket> packet = encoder->Encode(*frame);
+    EXPECT_TRUE(packet);
+    elapsed = base::TimeTicks::Now() - start_time;
+  }
+
+  return frame_count / elapsed.InSecondsF();
+}
+
 }  // namespace remoting
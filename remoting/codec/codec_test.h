@@ -5,9 +5,12 @@
 #ifndef REMOTING_CODEC_CODEC_TEST_H_
 #define REMOTING_CODEC_CODEC_TEST_H_
 
+#include <vector>
+
 #include "base/memory/ref_counted.h"
 
 namespace webrtc {
+class DesktopRegion;
 class DesktopSize;
 }
 
@@ -40,6 +43,14 @@ void TestVideoEncoderDecoderGradient(VideoEncoder* encoder,
                                      double max_error_limit,
                                      double mean_error_limit);
 
+// Returns the number of frames of |size| per second which |encoder| encodes,
+// when the updated region of successive frames cycles through
+// |updated_regions|.
+float MeasureVideoEncoderFps(
+    VideoEncoder* encoder,
+    const webrtc::DesktopSize& size,
+    const std::vector<webrtc::DesktopRegion>& updated_regions);
+
 }  // namespace remoting
 
 #endif  // REMOTING_CODEC_CODEC_TEST_H_
@@ -43,6 +43,12 @@ TEST_F(VideoDecoderVpxTest, Gradient) {
   TestGradient(320, 240, 320, 240, 0.04, 0.02);
 }
 
+// Large frames are prepared for encoding on several threads on multi-core
+// machines.
+TEST_F(VideoDecoderVpxTest, GradientLargeFrame) {
+  TestGradient(1920, 1080, 1920, 1080, 0.04, 0.02);
+}
+
 TEST_F(VideoDecoderVpxTest, GradientScaleUpEvenToEven) {
   TestGradient(320, 240, 640, 480, 0.04, 0.02);
 }
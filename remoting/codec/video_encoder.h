@@ -23,6 +23,11 @@ class VideoEncoder {
 
   // Encode an image stored in |frame|.
   virtual scoped_ptr<VideoPacket> Encode(const webrtc::DesktopFrame& frame) = 0;
+
+  // Sets the bitrate which the network is estimated to sustain, so that the
+  // encoder can trade quality for size when the link is slow. A value of 0
+  // removes the limit. Encoders which cannot adapt may ignore it.
+  virtual void SetTargetBitrate(int kilobits_per_second) {}
 };
 
 }  // namespace remoting
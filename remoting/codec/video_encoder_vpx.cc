@@ -4,9 +4,13 @@
 
 #include "remoting/codec/video_encoder_vpx.h"
 
+#include <algorithm>
+
 #include "base/bind.h"
 #include "base/logging.h"
+#include "base/synchronization/waitable_event.h"
 #include "base/sys_info.h"
+#include "base/threading/thread.h"
 #include "base/time/time.h"
 #include "media/base/yuv_convert.h"
 #include "remoting/base/util.h"
@@ -29,39 +33,133 @@ namespace {
 // map for the encoder.
 const int kMacroBlockSize = 16;
 
-ScopedVpxCodec CreateVP8Codec(const webrtc::DesktopSize& size) {
+// Frames get one thread per this many pixels, since the cost of splitting
+// work between threads outweighs the gain for smaller frames.
+const int kPixelsPerThread = 640 * 360;
+
+// Upper bound on the threads used for one frame. libvpx splits the frame
+// into at most 8 token partitions, so more threads gain little.
+const int kMaxThreads = 8;
+
+// Quantizer range used while the network keeps up with the default bitrate.
+const unsigned int kMinQuantizer = 20;
+const unsigned int kMaxQuantizer = 30;
+
+// Highest quantizer the rate control may pick to fit a frame into a lower
+// target bitrate. Above this, text becomes hard to read.
+const unsigned int kLowBandwidthMaxQuantizer = 56;
+
+// Returns the number of threads to use to prepare and encode frames of
+// |size|.
+int GetThreadCount(const webrtc::DesktopSize& size) {
+  // Going to multiple threads on low end windows systems can really hurt
+  // performance.
+  // http://crbug.com/99179
+  int processors = base::SysInfo::NumberOfProcessors();
+  if (processors <= 2)
+    return 1;
+
+  // Using 2 threads gives a great boost in performance for most systems with
+  // adequate processing power, so never use fewer than that.
+  int threads = size.width() * size.height() / kPixelsPerThread;
+  threads = std::min(threads, std::min(processors, kMaxThreads));
+  return std::max(threads, 2);
+}
+
+// Returns the VP8E_SET_TOKEN_PARTITIONS value, log2 of the number of token
+// partitions, which lets each of |threads| encoder threads write its own
+// partition.
+int GetTokenPartitions(int threads) {
+  int log2_partitions = 0;
+  while (log2_partitions < 3 && (2 << log2_partitions) <= threads)
+    ++log2_partitions;
+  return log2_partitions;
+}
+
+// Converts the parts of |updated_region| which lie within the macroblock rows
+// [|first_row|, |end_row|) of |frame| to YUV in |image|, and marks them in
+// those rows of |active_map|. Bands of whole macroblock rows never share a
+// byte of the active map, so bands can be prepared in parallel. Signals
+// |done|, if not NULL, when finished.
+void PrepareRows(const webrtc::DesktopFrame* frame,
+                 const webrtc::DesktopRegion* updated_region,
+                 int first_row,
+                 int end_row,
+                 vpx_image_t* image,
+                 uint8* active_map,
+                 base::WaitableEvent* done) {
+  const int active_map_width =
+      (image->w + kMacroBlockSize - 1) / kMacroBlockSize;
+  memset(active_map + first_row * active_map_width, 0,
+         (end_row - first_row) * active_map_width);
+
+  const webrtc::DesktopRect band = webrtc::DesktopRect::MakeLTRB(
+      0, first_row * kMacroBlockSize, image->w, end_row * kMacroBlockSize);
+  const int y_stride = image->stride[0];
+  DCHECK_EQ(image->stride[1], image->stride[2]);
+  const int uv_stride = image->stride[1];
+  for (webrtc::DesktopRegion::Iterator r(*updated_region); !r.IsAtEnd();
+       r.Advance()) {
+    webrtc::DesktopRect rect = r.rect();
+    rect.IntersectWith(band);
+    if (rect.is_empty())
+      continue;
+
+    // |band| starts on a macroblock row, so |rect| keeps the even-aligned
+    // top-left which ConvertRGB32ToYUVWithRect() requires.
+    ConvertRGB32ToYUVWithRect(
+        frame->data(), image->planes[0], image->planes[1], image->planes[2],
+        rect.left(), rect.top(), rect.width(), rect.height(),
+        frame->stride(), y_stride, uv_stride);
+
+    int left = rect.left() / kMacroBlockSize;
+    int right = (rect.right() - 1) / kMacroBlockSize;
+    int top = rect.top() / kMacroBlockSize;
+    int bottom = (rect.bottom() - 1) / kMacroBlockSize;
+    DCHECK_LT(right, active_map_width);
+    DCHECK_LT(bottom, end_row);
+
+    uint8* map = active_map + top * active_map_width;
+    for (int y = top; y <= bottom; ++y) {
+      for (int x = left; x <= right; ++x)
+        map[x] = 1;
+      map += active_map_width;
+    }
+  }
+
+  if (done)
+    done->Signal();
+}
+
+ScopedVpxCodec CreateVP8Codec(const webrtc::DesktopSize& size,
+                              vpx_codec_enc_cfg_t* config) {
   ScopedVpxCodec codec(new vpx_codec_ctx_t);
 
   // Configure the encoder.
-  vpx_codec_enc_cfg_t config;
   const vpx_codec_iface_t* algo = vpx_codec_vp8_cx();
   CHECK(algo);
-  vpx_codec_err_t ret = vpx_codec_enc_config_default(algo, &config, 0);
+  vpx_codec_err_t ret = vpx_codec_enc_config_default(algo, config, 0);
   if (ret != VPX_CODEC_OK)
     return ScopedVpxCodec();
 
-  config.rc_target_bitrate = size.width() * size.height() *
-      config.rc_target_bitrate / config.g_w / config.g_h;
-  config.g_w = size.width();
-  config.g_h = size.height();
-  config.g_pass = VPX_RC_ONE_PASS;
+  config->rc_target_bitrate = size.width() * size.height() *
+      config->rc_target_bitrate / config->g_w / config->g_h;
+  config->g_w = size.width();
+  config->g_h = size.height();
+  config->g_pass = VPX_RC_ONE_PASS;
 
   // Value of 2 means using the real time profile. This is basically a
   // redundant option since we explicitly select real time mode when doing
   // encoding.
-  config.g_profile = 2;
+  config->g_profile = 2;
 
-  // Using 2 threads gives a great boost in performance for most systems with
-  // adequate processing power. NB: Going to multiple threads on low end
-  // windows systems can really hurt performance.
-  // http://crbug.com/99179
-  config.g_threads = (base::SysInfo::NumberOfProcessors() > 2) ? 2 : 1;
-  config.rc_min_quantizer = 20;
-  config.rc_max_quantizer = 30;
-  config.g_timebase.num = 1;
-  config.g_timebase.den = 20;
+  config->g_threads = GetThreadCount(size);
+  config->rc_min_quantizer = kMinQuantizer;
+  config->rc_max_quantizer = kMaxQuantizer;
+  config->g_timebase.num = 1;
+  config->g_timebase.den = 20;
 
-  if (vpx_codec_enc_init(codec.get(), algo, &config, 0))
+  if (vpx_codec_enc_init(codec.get(), algo, config, 0))
     return ScopedVpxCodec();
 
   // Value of 16 will have the smallest CPU load. This turns off subpixel
@@ -74,6 +172,13 @@ ScopedVpxCodec CreateVP8Codec(const webrtc::DesktopSize& size) {
   if (vpx_codec_control(codec.get(), VP8E_SET_NOISE_SENSITIVITY, 0))
     return ScopedVpxCodec();
 
+  // Split the coefficient data into a partition per thread, so that the
+  // threads don't serialize on writing it out.
+  if (vpx_codec_control(codec.get(), VP8E_SET_TOKEN_PARTITIONS,
+                        GetTokenPartitions(config->g_threads))) {
+    return ScopedVpxCodec();
+  }
+
   return codec.Pass();
 }
 
@@ -101,13 +206,11 @@ scoped_ptr<VideoPacket> VideoEncoderVpx::Encode(
     CHECK(ret) << "Initialization of encoder failed";
   }
 
-  // Convert the updated capture data ready for encode.
+  // Convert the updated capture data ready for encode, and update the active
+  // map based on the updated region.
   webrtc::DesktopRegion updated_region;
   PrepareImage(frame, &updated_region);
 
-  // Update active map based on updated region.
-  PrepareActiveMap(updated_region);
-
   // Apply active map to the encoder.
   vpx_active_map_t act_map;
   act_map.rows = active_map_height_;
@@ -176,8 +279,27 @@ scoped_ptr<VideoPacket> VideoEncoderVpx::Encode(
   return packet.Pass();
 }
 
+void VideoEncoderVpx::SetTargetBitrate(int kilobits_per_second) {
+  DCHECK_GE(kilobits_per_second, 0);
+  if (target_bitrate_kbps_ == kilobits_per_second)
+    return;
+  target_bitrate_kbps_ = kilobits_per_second;
+  if (codec_)
+    ApplyTargetBitrate();
+}
+
+unsigned int VideoEncoderVpx::ConfiguredBitrateKbpsForTesting() const {
+  return codec_ ? config_->rc_target_bitrate : 0;
+}
+
+unsigned int VideoEncoderVpx::ConfiguredMaxQuantizerForTesting() const {
+  return codec_ ? config_->rc_max_quantizer : 0;
+}
+
 VideoEncoderVpx::VideoEncoderVpx(const InitializeCodecCallback& init_codec)
     : init_codec_(init_codec),
+      default_bitrate_kbps_(0),
+      target_bitrate_kbps_(0),
       active_map_width_(0),
       active_map_height_(0),
       last_timestamp_(0) {
@@ -241,16 +363,56 @@ bool VideoEncoderVpx::Initialize(const webrtc::DesktopSize& size) {
   image_->stride[1] = uv_width;
   image_->stride[2] = uv_width;
 
+  // Start one thread fewer than are used for the frame, since the encode
+  // thread prepares a band too.
+  int thread_count = std::min(GetThreadCount(size), active_map_height_);
+  prepare_threads_.clear();
+  for (int i = 1; i < thread_count; ++i) {
+    scoped_ptr<base::Thread> thread(new base::Thread("VpxPrepareThread"));
+    if (!thread->Start())
+      break;
+    prepare_threads_.push_back(thread.release());
+  }
+
   // Initialize the codec.
-  codec_ = init_codec_.Run(size);
+  config_.reset(new vpx_codec_enc_cfg_t());
+  codec_ = init_codec_.Run(size, config_.get());
+  if (!codec_)
+    return false;
+
+  default_bitrate_kbps_ = config_->rc_target_bitrate;
+  if (target_bitrate_kbps_)
+    ApplyTargetBitrate();
+
+  return true;
+}
+
+void VideoEncoderVpx::ApplyTargetBitrate() {
+  // The default bitrate already gives good quality, so a faster link is not
+  // used to raise it.
+  unsigned int bitrate = default_bitrate_kbps_;
+  unsigned int max_quantizer = kMaxQuantizer;
+  if (target_bitrate_kbps_ > 0 &&
+      static_cast<unsigned int>(target_bitrate_kbps_) < bitrate) {
+    bitrate = target_bitrate_kbps_;
+    max_quantizer = kLowBandwidthMaxQuantizer;
+  }
+  if (config_->rc_target_bitrate == bitrate &&
+      config_->rc_max_quantizer == max_quantizer) {
+    return;
+  }
 
-  return codec_;
+  config_->rc_target_bitrate = bitrate;
+  config_->rc_max_quantizer = max_quantizer;
+  if (vpx_codec_enc_config_set(codec_.get(), config_.get()))
+    LOG(ERROR) << "Unable to set the target bitrate";
 }
 
 void VideoEncoderVpx::PrepareImage(const webrtc::DesktopFrame& frame,
                                    webrtc::DesktopRegion* updated_region) {
   if (frame.updated_region().is_empty()) {
     updated_region->Clear();
+    memset(active_map_.get(), 0, active_map_width_ * active_map_height_);
     return;
   }
 
@@ -274,48 +436,50 @@ void VideoEncoderVpx::PrepareImage(const webrtc::DesktopFrame& frame,
   updated_region->IntersectWith(
       webrtc::DesktopRect::MakeWH(image_->w, image_->h));
 
-  // Convert the updated region to YUV ready for encoding.
-  const uint8* rgb_data = frame.data();
-  const int rgb_stride = frame.stride();
-  const int y_stride = image_->stride[0];
-  DCHECK_EQ(image_->stride[1], image_->stride[2]);
-  const int uv_stride = image_->stride[1];
-  uint8* y_data = image_->planes[0];
-  uint8* u_data = image_->planes[1];
-  uint8* v_data = image_->planes[2];
+  // Split the macroblock rows into one band per thread, with about the same
+  // updated area in each.
+  std::vector<int> row_areas(active_map_height_, 0);
+  int total_area = 0;
   for (webrtc::DesktopRegion::Iterator r(*updated_region); !r.IsAtEnd();
        r.Advance()) {
     const webrtc::DesktopRect& rect = r.rect();
-    ConvertRGB32ToYUVWithRect(
-        rgb_data, y_data, u_data, v_data,
-        rect.left(), rect.top(), rect.width(), rect.height(),
-        rgb_stride, y_stride, uv_stride);
+    for (int y = rect.top(); y < rect.bottom();) {
+      int row = y / kMacroBlockSize;
+      int row_bottom = std::min((row + 1) * kMacroBlockSize, rect.bottom());
+      int area = rect.width() * (row_bottom - y);
+      row_areas[row] += area;
+      total_area += area;
+      y = row_bottom;
+    }
   }
-}
-
-void VideoEncoderVpx::PrepareActiveMap(
-    const webrtc::DesktopRegion& updated_region) {
-  // Clear active map first.
-  memset(active_map_.get(), 0, active_map_width_ * active_map_height_);
-
-  // Mark updated areas active.
-  for (webrtc::DesktopRegion::Iterator r(updated_region); !r.IsAtEnd();
-       r.Advance()) {
-    const webrtc::DesktopRect& rect = r.rect();
-    int left = rect.left() / kMacroBlockSize;
-    int right = (rect.right() - 1) / kMacroBlockSize;
-    int top = rect.top() / kMacroBlockSize;
-    int bottom = (rect.bottom() - 1) / kMacroBlockSize;
-    DCHECK_LT(right, active_map_width_);
-    DCHECK_LT(bottom, active_map_height_);
 
-    uint8* map = active_map_.get() + top * active_map_width_;
-    for (int y = top; y <= bottom; ++y) {
-      for (int x = left; x <= right; ++x)
-        map[x] = 1;
-      map += active_map_width_;
-    }
+  const int band_count = static_cast<int>(prepare_threads_.size()) + 1;
+  std::vector<int> band_ends;
+  int row = 0;
+  int area = 0;
+  for (int band = 1; band < band_count; ++band) {
+    int64 target_area = static_cast<int64>(total_area) * band / band_count;
+    while (row < active_map_height_ && area < target_area)
+      area += row_areas[row++];
+    band_ends.push_back(row);
+  }
+  band_ends.push_back(active_map_height_);
+
+  // Post all but the first band to the prepare threads, then prepare the
+  // first band here and wait for the others.
+  ScopedVector<base::WaitableEvent> done_events;
+  for (int band = 1; band < band_count; ++band) {
+    base::WaitableEvent* done = new base::WaitableEvent(false, false);
+    done_events.push_back(done);
+    prepare_threads_[band - 1]->message_loop()->PostTask(
+        FROM_HERE,
+        base::Bind(&PrepareRows, &frame, updated_region, band_ends[band - 1],
+                   band_ends[band], image_.get(), active_map_.get(), done));
   }
+  PrepareRows(&frame, updated_region, 0, band_ends[0], image_.get(),
+              active_map_.get(), NULL);
+  for (size_t i = 0; i < done_events.size(); ++i)
+    done_events[i]->Wait();
 }
 
 }  // namespace remoting
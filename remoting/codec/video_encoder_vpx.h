@@ -6,11 +6,17 @@
 #define REMOTING_CODEC_VIDEO_ENCODER_VPX_H_
 
 #include "base/callback.h"
+#include "base/memory/scoped_vector.h"
 #include "remoting/codec/scoped_vpx_codec.h"
 #include "remoting/codec/video_encoder.h"
 
+typedef struct vpx_codec_enc_cfg vpx_codec_enc_cfg_t;
 typedef struct vpx_image vpx_image_t;
 
+namespace base {
+class Thread;
+}  // namespace base
+
 namespace webrtc {
 class DesktopRegion;
 class DesktopSize;
@@ -28,9 +34,18 @@ class VideoEncoderVpx : public VideoEncoder {
   // VideoEncoder interface.
   virtual scoped_ptr<VideoPacket> Encode(
       const webrtc::DesktopFrame& frame) OVERRIDE;
+  virtual void SetTargetBitrate(int kilobits_per_second) OVERRIDE;
+
+  // Return the bitrate and maximum quantizer the codec is configured with, or
+  // 0 if no frame has been encoded yet.
+  unsigned int ConfiguredBitrateKbpsForTesting() const;
+  unsigned int ConfiguredMaxQuantizerForTesting() const;
 
  private:
-  typedef base::Callback<ScopedVpxCodec(const webrtc::DesktopSize&)>
+  // Creates a codec for frames of the given size, and returns the
+  // configuration it was created with in the vpx_codec_enc_cfg_t.
+  typedef base::Callback<ScopedVpxCodec(const webrtc::DesktopSize&,
+                                        vpx_codec_enc_cfg_t*)>
       InitializeCodecCallback;
 
   VideoEncoderVpx(const InitializeCodecCallback& init_codec);
@@ -38,18 +53,30 @@ class VideoEncoderVpx : public VideoEncoder {
   // Initializes the codec for frames of |size|. Returns true if successful.
   bool Initialize(const webrtc::DesktopSize& size);
 
-  // Prepares |image_| for encoding. Writes updated rectangles into
-  // |updated_region|.
+  // Reconfigures |codec_| for |target_bitrate_kbps_|.
+  void ApplyTargetBitrate();
+
+  // Prepares |image_| and |active_map_| for encoding. Writes updated
+  // rectangles into |updated_region|. The frame is split into bands of
+  // macroblock rows holding about the same updated area, which are converted
+  // to YUV and marked in the active map in parallel on |prepare_threads_| and
+  // the calling thread. The active map is given to the encoder to speed up
+  // encoding.
   void PrepareImage(const webrtc::DesktopFrame& frame,
                     webrtc::DesktopRegion* updated_region);
 
-  // Updates the active map according to |updated_region|. Active map is then
-  // given to the encoder to speed up encoding.
-  void PrepareActiveMap(const webrtc::DesktopRegion& updated_region);
-
   InitializeCodecCallback init_codec_;
 
   ScopedVpxCodec codec_;
+  scoped_ptr<vpx_codec_enc_cfg_t> config_;
+
+  // Bitrate chosen by |init_codec_| for the current frame size, which is
+  // used while the network can carry it.
+  unsigned int default_bitrate_kbps_;
+
+  // Bitrate the network is estimated to sustain, or 0 if unknown.
+  int target_bitrate_kbps_;
+
   scoped_ptr<vpx_image_t> image_;
   scoped_ptr<uint8[]> active_map_;
   int active_map_width_;
@@ -59,6 +86,10 @@ class VideoEncoderVpx : public VideoEncoder {
   // Buffer for storing the yuv image.
   scoped_ptr<uint8[]> yuv_image_;
 
+  // Threads which prepare parts of each frame alongside the encode thread.
+  // Empty when frames of the current size are prepared on one thread.
+  ScopedVector<base::Thread> prepare_threads_;
+
   DISALLOW_COPY_AND_ASSIGN(VideoEncoderVpx);
 };
 
@@ -7,11 +7,14 @@
 #include <limits>
 #include <vector>
 
+#include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/strings/stringprintf.h"
 #include "remoting/codec/codec_test.h"
 #include "remoting/proto/video.pb.h"
 #include "testing/gtest/include/gtest/gtest.h"
 #include "third_party/webrtc/modules/desktop_capture/desktop_frame.h"
+#include "third_party/webrtc/modules/desktop_capture/desktop_region.h"
 
 namespace {
 
@@ -63,4 +66,99 @@ TEST(VideoEncoderVpxTest, TestDpiPropagation) {
   EXPECT_EQ(packet->format().y_dpi(), 97);
 }
 
+// Test that a target bitrate below the default lowers the bitrate the codec
+// is configured with and lets it use coarser quantizers, and that a target
+// above the default, or none, restores the defaults.
+TEST(VideoEncoderVpxTest, TestTargetBitrate) {
+  scoped_ptr<VideoEncoderVpx> encoder(VideoEncoderVpx::CreateForVP8());
+  scoped_ptr<webrtc::DesktopFrame> frame(
+      new webrtc::BasicDesktopFrame(webrtc::DesktopSize(640, 480)));
+  frame->mutable_updated_region()->SetRect(
+      webrtc::DesktopRect::MakeSize(frame->size()));
+  scoped_ptr<VideoPacket> packet = encoder->Encode(*frame);
+  ASSERT_TRUE(packet);
+
+  const unsigned int default_bitrate =
+      encoder->ConfiguredBitrateKbpsForTesting();
+  const unsigned int default_max_quantizer =
+      encoder->ConfiguredMaxQuantizerForTesting();
+  ASSERT_GT(default_bitrate, 4u);
+
+  encoder->SetTargetBitrate(default_bitrate / 4);
+  EXPECT_EQ(default_bitrate / 4, encoder->ConfiguredBitrateKbpsForTesting());
+  EXPECT_GT(encoder->ConfiguredMaxQuantizerForTesting(),
+            default_max_quantizer);
+  packet = encoder->Encode(*frame);
+  EXPECT_TRUE(packet);
+
+  encoder->SetTargetBitrate(default_bitrate * 2);
+  EXPECT_EQ(default_bitrate, encoder->ConfiguredBitrateKbpsForTesting());
+  EXPECT_EQ(default_max_quantizer,
+            encoder->ConfiguredMaxQuantizerForTesting());
+
+  encoder->SetTargetBitrate(default_bitrate / 2);
+  encoder->SetTargetBitrate(0);
+  EXPECT_EQ(default_bitrate, encoder->ConfiguredBitrateKbpsForTesting());
+  EXPECT_EQ(default_max_quantizer,
+            encoder->ConfiguredMaxQuantizerForTesting());
+}
+
+// Test that a target bitrate set before the first frame is applied when the
+// codec is created.
+TEST(VideoEncoderVpxTest, TestTargetBitrateBeforeFirstFrame) {
+  scoped_ptr<VideoEncoderVpx> encoder(VideoEncoderVpx::CreateForVP8());
+  encoder->SetTargetBitrate(50);
+  EXPECT_EQ(0u, encoder->ConfiguredBitrateKbpsForTesting());
+
+  scoped_ptr<webrtc::DesktopFrame> frame(
+      new webrtc::BasicDesktopFrame(webrtc::DesktopSize(640, 480)));
+  scoped_ptr<VideoPacket> packet = encoder->Encode(*frame);
+  EXPECT_TRUE(packet);
+  EXPECT_EQ(50u, encoder->ConfiguredBitrateKbpsForTesting());
+}
+
+// Reports the frame rate at 1080p and 4K for full-screen updates, a window
+// moving across the screen, and small updates scattered over the screen.
+TEST(VideoEncoderVpxTest, DISABLED_EncodePerf) {
+  const webrtc::DesktopSize kSizes[] = {
+    webrtc::DesktopSize(1920, 1080),
+    webrtc::DesktopSize(3840, 2160),
+  };
+  for (size_t i = 0; i < arraysize(kSizes); ++i) {
+    const int width = kSizes[i].width();
+    const int height = kSizes[i].height();
+
+    std::vector<webrtc::DesktopRegion> full_screen;
+    full_screen.push_back(webrtc::DesktopRegion(
+        webrtc::DesktopRect::MakeSize(kSizes[i])));
+
+    std::vector<webrtc::DesktopRegion> moving_window;
+    for (int step = 0; step < 8; ++step) {
+      moving_window.push_back(webrtc::DesktopRegion(
+          webrtc::DesktopRect::MakeXYWH(step * width / 16, step * height / 16,
+                                        width / 2, height / 2)));
+    }
+
+    std::vector<webrtc::DesktopRegion> scattered;
+    for (int step = 0; step < 8; ++step) {
+      webrtc::DesktopRegion region;
+      for (int j = 0; j < 32; ++j) {
+        int x = ((step * 32 + j) * 397) % (width - 64);
+        int y = ((step * 32 + j) * 211) % (height - 32);
+        region.AddRect(webrtc::DesktopRect::MakeXYWH(x, y, 64, 32));
+      }
+      scattered.push_back(region);
+    }
+
+    scoped_ptr<VideoEncoderVpx> encoder(VideoEncoderVpx::CreateForVP8());
+    LOG(INFO) << base::StringPrintf(
+        "%dx%d: full screen %.1f fps, moving window %.1f fps, "
+        "scattered %.1f fps",
+        width, height,
+        MeasureVideoEncoderFps(encoder.get(), kSizes[i], full_screen),
+        MeasureVideoEncoderFps(encoder.get(), kSizes[i], moving_window),
+        MeasureVideoEncoderFps(encoder.get(), kSizes[i], scattered));
+  }
+}
+
 }  // namespace remoting
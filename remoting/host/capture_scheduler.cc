@@ -32,7 +32,9 @@ namespace remoting {
 CaptureScheduler::CaptureScheduler()
     : num_of_processors_(base::SysInfo::NumberOfProcessors()),
       capture_time_(kStatisticsWindow),
-      encode_time_(kStatisticsWindow) {
+      encode_time_(kStatisticsWindow),
+      send_size_(kStatisticsWindow),
+      send_time_us_(kStatisticsWindow) {
   DCHECK(num_of_processors_);
 }
 
@@ -47,6 +49,10 @@ base::TimeDelta CaptureScheduler::NextCaptureDelay() {
       (capture_time_.Average() + encode_time_.Average()) /
       (kRecordingCpuConsumption * num_of_processors_);
 
+  // Capturing faster than frames can be sent only builds up a queue.
+  delay = std::max(delay, send_time_us_.Average() /
+                              base::Time::kMicrosecondsPerMillisecond);
+
   if (delay < kMinimumRecordingDelay)
     return base::TimeDelta::FromMilliseconds(kMinimumRecordingDelay);
   return base::TimeDelta::FromMilliseconds(delay);
@@ -60,6 +66,20 @@ void CaptureScheduler::RecordEncodeTime(base::TimeDelta encode_time) {
   encode_time_.Record(encode_time.InMilliseconds());
 }
 
+void CaptureScheduler::RecordSendTime(int size, base::TimeDelta send_time) {
+  send_size_.Record(size);
+  send_time_us_.Record(send_time.InMicroseconds());
+}
+
+int CaptureScheduler::EstimatedBandwidthKbps() {
+  double send_time_us = send_time_us_.Average();
+  if (send_time_us <= 0)
+    return 0;
+
+  // Bytes per microsecond to kilobits per second.
+  return static_cast<int>(send_size_.Average() * 8 * 1000 / send_time_us);
+}
+
 void CaptureScheduler::SetNumOfProcessorsForTest(int num_of_processors) {
   num_of_processors_ = num_of_processors;
 }
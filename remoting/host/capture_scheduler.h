@@ -4,7 +4,9 @@
 
 // This class chooses a capture interval so as to limit CPU usage to not exceed
 // a specified %age. It bases this on the CPU usage of recent capture and encode
-// operations, and on the number of available CPUs.
+// operations, and on the number of available CPUs. It also paces captures to
+// the rate at which recent frames were sent, and estimates the bandwidth of
+// the connection from them, which the encoder can be asked to stay within.
 
 #ifndef REMOTING_HOST_CAPTURE_SCHEDULER_H_
 #define REMOTING_HOST_CAPTURE_SCHEDULER_H_
@@ -27,6 +29,14 @@ class CaptureScheduler {
   void RecordCaptureTime(base::TimeDelta capture_time);
   void RecordEncodeTime(base::TimeDelta encode_time);
 
+  // Records that a frame of |size| bytes kept the network busy for
+  // |send_time|. This excludes time it spent queued behind earlier frames.
+  void RecordSendTime(int size, base::TimeDelta send_time);
+
+  // Returns the bitrate, in kilobits per second, which the connection is
+  // estimated to sustain, or 0 if nothing has been sent yet.
+  int EstimatedBandwidthKbps();
+
   // Overrides the number of processors for testing.
   void SetNumOfProcessorsForTest(int num_of_processors);
 
@@ -34,6 +44,8 @@ class CaptureScheduler {
   int num_of_processors_;
   RunningAverage capture_time_;
   RunningAverage encode_time_;
+  RunningAverage send_size_;
+  RunningAverage send_time_us_;
 
   DISALLOW_COPY_AND_ASSIGN(CaptureScheduler);
 };
@@ -77,4 +77,34 @@ TEST(CaptureSchedulerTest, RollingAverageDifferentTimes) {
   }
 }
 
+TEST(CaptureSchedulerTest, SendTimeLimitsCaptureRate) {
+  CaptureScheduler scheduler;
+  scheduler.SetNumOfProcessorsForTest(8);
+  scheduler.RecordCaptureTime(base::TimeDelta::FromMilliseconds(10));
+  scheduler.RecordEncodeTime(base::TimeDelta::FromMilliseconds(10));
+  EXPECT_EQ(50, scheduler.NextCaptureDelay().InMilliseconds());
+
+  scheduler.RecordSendTime(100000, base::TimeDelta::FromMilliseconds(200));
+  EXPECT_EQ(200, scheduler.NextCaptureDelay().InMilliseconds());
+
+  // Quick sends leave the delay to the CPU usage limit.
+  for (int i = 0; i < 3; ++i)
+    scheduler.RecordSendTime(1000, base::TimeDelta::FromMilliseconds(1));
+  EXPECT_EQ(50, scheduler.NextCaptureDelay().InMilliseconds());
+}
+
+TEST(CaptureSchedulerTest, EstimatedBandwidth) {
+  CaptureScheduler scheduler;
+  EXPECT_EQ(0, scheduler.EstimatedBandwidthKbps());
+
+  // 10 KB in 80 ms is 1000 kbps.
+  scheduler.RecordSendTime(10000, base::TimeDelta::FromMilliseconds(80));
+  EXPECT_EQ(1000, scheduler.EstimatedBandwidthKbps());
+
+  // Frames are weighted by size, so a small frame sent quickly doesn't
+  // dominate the estimate.
+  scheduler.RecordSendTime(100, base::TimeDelta::FromMicroseconds(100));
+  EXPECT_EQ(1008, scheduler.EstimatedBandwidthKbps());
+}
+
 }  // namespace remoting
@@ -4,6 +4,8 @@
 
 #include "remoting/host/video_scheduler.h"
 
+#include <stdlib.h>
+
 #include <algorithm>
 
 #include "base/bind.h"
@@ -27,9 +29,23 @@
 
 namespace remoting {
 
-// Maximum number of frames that can be processed simultaneously.
+// Maximum number of frames that can be processed simultaneously: one being
+// captured, one being encoded and one being sent.
 // TODO(hclam): Move this value to CaptureScheduler.
-static const int kMaxPendingFrames = 2;
+static const int kMaxPendingFrames = 3;
+
+// Maximum number of frames being captured or encoded. Screen capturers keep
+// two frame buffers, so the next frame can be captured while the previous one
+// is encoded, but no further ahead.
+static const int kMaxPendingEncodes = 2;
+
+// Maximum number of encoded frames waiting to be sent. Frames captured while
+// the network is this far behind are dropped.
+static const int kMaxPendingSends = 2;
+
+// Fraction of the estimated bandwidth which the encoder is asked to use,
+// leaving room for estimation error and other traffic.
+static const double kBandwidthUsage = 0.8;
 
 VideoScheduler::VideoScheduler(
     scoped_refptr<base::SingleThreadTaskRunner> capture_task_runner,
@@ -47,10 +63,12 @@ VideoScheduler::VideoScheduler(
       cursor_stub_(cursor_stub),
       video_stub_(video_stub),
       pending_frames_(0),
+      pending_encodes_(0),
       capture_pending_(false),
       did_skip_frame_(false),
       is_paused_(false),
-      sequence_number_(0) {
+      sequence_number_(0),
+      target_bitrate_kbps_(0) {
   DCHECK(network_task_runner_->BelongsToCurrentThread());
   DCHECK(capturer_);
   DCHECK(encoder_);
@@ -74,6 +92,24 @@ void VideoScheduler::OnCaptureCompleted(webrtc::DesktopFrame* frame) {
   if (frame) {
     scheduler_.RecordCaptureTime(
         base::TimeDelta::FromMilliseconds(frame->capture_time_ms()));
+
+    // Updates from dropped frames haven't reached the client yet.
+    if (!dropped_region_.is_empty()) {
+      frame->mutable_updated_region()->AddRegion(dropped_region_);
+      dropped_region_.Clear();
+    }
+
+    // If the network fell behind while this frame was captured, it would only
+    // be queued behind the frames already waiting, and be stale by the time
+    // it was sent. Drop it, and send its updates with the next frame.
+    if (pending_frames_ - pending_encodes_ >= kMaxPendingSends) {
+      dropped_region_.AddRegion(frame->updated_region());
+      owned_frame.reset();
+      pending_encodes_--;
+      pending_frames_--;
+      did_skip_frame_ = true;
+      return;
+    }
   }
 
   encode_task_runner_->PostTask(
@@ -205,10 +241,13 @@ void VideoScheduler::CaptureNextFrame() {
   if (!capturer_ || is_paused_)
     return;
 
-  // Make sure we have at most two outstanding recordings. We can simply return
-  // if we can't make a capture now, the next capture will be started by the
-  // end of an encode operation.
-  if (pending_frames_ >= kMaxPendingFrames || capture_pending_) {
+  // Make sure we have a bounded number of outstanding recordings at each
+  // stage. We can simply return if we can't make a capture now, the next
+  // capture will be started by the end of an encode or send operation.
+  if (pending_frames_ >= kMaxPendingFrames ||
+      pending_encodes_ >= kMaxPendingEncodes ||
+      pending_frames_ - pending_encodes_ >= kMaxPendingSends ||
+      capture_pending_) {
     did_skip_frame_ = true;
     return;
   }
@@ -217,7 +256,9 @@ void VideoScheduler::CaptureNextFrame() {
 
   // At this point we are going to perform one capture so save the current time.
   pending_frames_++;
+  pending_encodes_++;
   DCHECK_LE(pending_frames_, kMaxPendingFrames);
+  DCHECK_LE(pending_encodes_, kMaxPendingEncodes);
 
   // Before doing a capture schedule for the next one.
   ScheduleNextCapture();
@@ -228,6 +269,18 @@ void VideoScheduler::CaptureNextFrame() {
   capturer_->Capture(webrtc::DesktopRegion());
 }
 
+void VideoScheduler::FrameEncoded() {
+  DCHECK(capture_task_runner_->BelongsToCurrentThread());
+
+  pending_encodes_--;
+  DCHECK_GE(pending_encodes_, 0);
+
+  // The capturer has a buffer free, so capture any frame which was skipped
+  // while waiting for the encoder.
+  if (did_skip_frame_)
+    CaptureNextFrame();
+}
+
 void VideoScheduler::FrameCaptureCompleted() {
   DCHECK(capture_task_runner_->BelongsToCurrentThread());
 
@@ -249,16 +302,26 @@ void VideoScheduler::SendVideoPacket(scoped_ptr<VideoPacket> packet) {
   if (!video_stub_)
     return;
 
+  int size = packet->ByteSize();
   video_stub_->ProcessVideoPacket(
-      packet.Pass(), base::Bind(&VideoScheduler::VideoFrameSentCallback, this));
+      packet.Pass(), base::Bind(&VideoScheduler::VideoFrameSentCallback, this,
+                                size, base::TimeTicks::Now()));
 }
 
-void VideoScheduler::VideoFrameSentCallback() {
+void VideoScheduler::VideoFrameSentCallback(int size,
+                                            base::TimeTicks send_start_time) {
   DCHECK(network_task_runner_->BelongsToCurrentThread());
 
   if (!video_stub_)
     return;
 
+  // A frame may have been queued behind the previous one, so only the time
+  // since that finished was spent sending it.
+  base::TimeTicks now = base::TimeTicks::Now();
+  scheduler_.RecordSendTime(
+      size, now - std::max(send_start_time, last_frame_sent_time_));
+  last_frame_sent_time_ = now;
+
   capture_task_runner_->PostTask(
       FROM_HERE, base::Bind(&VideoScheduler::FrameCaptureCompleted, this));
 }
@@ -288,16 +351,22 @@ void VideoScheduler::EncodeFrame(
         FROM_HERE, base::Bind(&VideoScheduler::SendVideoPacket, this,
                               base::Passed(&packet)));
     capture_task_runner_->DeleteSoon(FROM_HERE, frame.release());
+    capture_task_runner_->PostTask(
+        FROM_HERE, base::Bind(&VideoScheduler::FrameEncoded, this));
     return;
   }
 
+  UpdateTargetBitrate();
+
   scoped_ptr<VideoPacket> packet = encoder_->Encode(*frame);
   packet->set_client_sequence_number(sequence_number);
 
-  // Destroy the frame before sending |packet| because SendVideoPacket() may
-  // trigger another frame to be captured, and the screen capturer expects the
-  // old frame to be freed by then.
+  // Destroy the frame before sending |packet| because FrameEncoded() and
+  // SendVideoPacket() may trigger another frame to be captured, and the screen
+  // capturer expects the old frame to be freed by then.
   frame.reset();
+  capture_task_runner_->PostTask(
+      FROM_HERE, base::Bind(&VideoScheduler::FrameEncoded, this));
 
   scheduler_.RecordEncodeTime(
       base::TimeDelta::FromMilliseconds(packet->encode_time_ms()));
@@ -306,4 +375,20 @@ void VideoScheduler::EncodeFrame(
                             base::Passed(&packet)));
 }
 
+void VideoScheduler::UpdateTargetBitrate() {
+  DCHECK(encode_task_runner_->BelongsToCurrentThread());
+
+  int bitrate_kbps = static_cast<int>(
+      scheduler_.EstimatedBandwidthKbps() * kBandwidthUsage);
+
+  // Reconfiguring the encoder isn't free, so ignore changes of less than 10%.
+  if (abs(bitrate_kbps - target_bitrate_kbps_) * 10 <=
+      target_bitrate_kbps_) {
+    return;
+  }
+
+  target_bitrate_kbps_ = bitrate_kbps;
+  encoder_->SetTargetBitrate(target_bitrate_kbps_);
+}
+
 }  // namespace remoting
@@ -15,6 +15,7 @@
 #include "remoting/codec/video_encoder.h"
 #include "remoting/host/capture_scheduler.h"
 #include "remoting/proto/video.pb.h"
+#include "third_party/webrtc/modules/desktop_capture/desktop_region.h"
 #include "third_party/webrtc/modules/desktop_capture/screen_capturer.h"
 
 namespace base {
@@ -43,8 +44,8 @@ class VideoStub;
 // THREADING
 //
 // This class is supplied TaskRunners to use for capture, encode and network
-// operations.  Capture, encode and network transmission tasks are interleaved
-// as illustrated below:
+// operations.  Capture, encode and network transmission tasks are pipelined
+// as illustrated below, so that each thread can work on a different frame:
 //
 // |       CAPTURE       ENCODE     NETWORK
 // |    .............
@@ -71,6 +72,14 @@ class VideoStub;
 // of the capture, encode and network processes.  However, it also needs to
 // rate-limit captures to avoid overloading the host system, either by consuming
 // too much CPU, or hogging the host's graphics subsystem.
+//
+// The stages are decoupled by bounded queues: the next frame may be captured
+// while the previous one is being encoded, and encoded frames may wait for the
+// network. When more frames are waiting for the network than it can usefully
+// hold, a newly captured frame would be stale by the time it was sent, so it
+// is dropped and its updated region is sent with the next frame instead. The
+// time taken to send each frame is used both to pace captures and to estimate
+// the bandwidth of the connection, which the encoder is asked to stay within.
 
 class VideoScheduler : public base::RefCountedThreadSafe<VideoScheduler>,
                        public webrtc::DesktopCapturer::Callback,
@@ -130,6 +139,9 @@ class VideoScheduler : public base::RefCountedThreadSafe<VideoScheduler>,
   // Starts the next frame capture, unless there are already too many pending.
   void CaptureNextFrame();
 
+  // Called when the encoder has finished with a captured frame.
+  void FrameEncoded();
+
   // Called when a frame capture has been encoded & sent to the client.
   void FrameCaptureCompleted();
 
@@ -139,8 +151,9 @@ class VideoScheduler : public base::RefCountedThreadSafe<VideoScheduler>,
   void SendVideoPacket(scoped_ptr<VideoPacket> packet);
 
   // Callback passed to |video_stub_| for the last packet in each frame, to
-  // rate-limit frame captures to network throughput.
-  void VideoFrameSentCallback();
+  // rate-limit frame captures to network throughput. |size| is the size of
+  // the packet, which was passed to |video_stub_| at |send_start_time|.
+  void VideoFrameSentCallback(int size, base::TimeTicks send_start_time);
 
   // Send updated cursor shape to client.
   void SendCursorShape(scoped_ptr<protocol::CursorShapeInfo> cursor_shape);
@@ -154,6 +167,9 @@ class VideoScheduler : public base::RefCountedThreadSafe<VideoScheduler>,
   void EncodedDataAvailableCallback(int64 sequence_number,
                                     scoped_ptr<VideoPacket> packet);
 
+  // Asks |encoder_| to stay within the estimated bandwidth of the connection.
+  void UpdateTargetBitrate();
+
   // Task runners used by this class.
   scoped_refptr<base::SingleThreadTaskRunner> capture_task_runner_;
   scoped_refptr<base::SingleThreadTaskRunner> encode_task_runner_;
@@ -174,10 +190,17 @@ class VideoScheduler : public base::RefCountedThreadSafe<VideoScheduler>,
   scoped_ptr<base::OneShotTimer<VideoScheduler> > capture_timer_;
 
   // The number of frames being processed, i.e. frames that we are currently
-  // capturing, encoding or sending. The value is capped at 2 to minimize
-  // latency.
+  // capturing, encoding or sending. The value is capped to minimize latency.
   int pending_frames_;
 
+  // The number of frames being captured or encoded. These hold the capturer's
+  // buffers, so capture can run at most one frame ahead of the encoder.
+  int pending_encodes_;
+
+  // Updates in captured frames which were dropped under network backpressure,
+  // to be sent with the next captured frame.
+  webrtc::DesktopRegion dropped_region_;
+
   // Set when the capturer is capturing a frame.
   bool capture_pending_;
 
@@ -190,7 +213,16 @@ class VideoScheduler : public base::RefCountedThreadSafe<VideoScheduler>,
   // This is a number updated by client to trace performance.
   int64 sequence_number_;
 
-  // An object to schedule capturing.
+  // The time at which |video_stub_| last finished sending a frame. Always
+  // accessed on the network thread.
+  base::TimeTicks last_frame_sent_time_;
+
+  // The bitrate |encoder_| was last asked to stay within, or 0 if it is not
+  // limited. Always accessed on the encode thread.
+  int target_bitrate_kbps_;
+
+  // An object to schedule capturing. It is fed timings from all three
+  // threads.
   CaptureScheduler scheduler_;
 
   DISALLOW_COPY_AND_ASSIGN(VideoScheduler);
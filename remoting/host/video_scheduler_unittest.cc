@@ -4,11 +4,23 @@
 
 #include "remoting/host/video_scheduler.h"
 
+#include <algorithm>
+#include <map>
+#include <vector>
+
 #include "base/bind.h"
+#include "base/logging.h"
+#include "base/memory/weak_ptr.h"
 #include "base/message_loop/message_loop.h"
 #include "base/run_loop.h"
+#include "base/strings/stringprintf.h"
+#include "base/synchronization/lock.h"
+#include "base/test/test_simple_task_runner.h"
+#include "base/threading/thread.h"
+#include "base/time/time.h"
 #include "remoting/base/auto_thread_task_runner.h"
 #include "remoting/codec/video_encoder.h"
+#include "remoting/codec/video_encoder_vpx.h"
 #include "remoting/proto/video.pb.h"
 #include "remoting/protocol/protocol_mock_objects.h"
 #include "testing/gmock/include/gmock/gmock.h"
@@ -26,6 +38,7 @@ using ::testing::DeleteArg;
 using ::testing::DoAll;
 using ::testing::Expectation;
 using ::testing::InSequence;
+using ::testing::Invoke;
 using ::testing::InvokeWithoutArgs;
 using ::testing::Return;
 using ::testing::ReturnRef;
@@ -44,6 +57,136 @@ ACTION(FinishSend) {
   arg1.Run();
 }
 
+// Stands in for the host's desktop, on which a window moves by a few pixels
+// in each captured frame. Records when each frame's capture started, keyed
+// by the sequence number given to the VideoScheduler for it.
+class FakeDesktop {
+ public:
+  static const int kWindowStep = 8;
+
+  explicit FakeDesktop(const webrtc::DesktopSize& size)
+      : size_(size),
+        window_(webrtc::DesktopRect::MakeXYWH(0, 0, size.width() / 3,
+                                              size.height() / 3)),
+        scheduler_(NULL),
+        callback_(NULL),
+        sequence_number_(0) {
+  }
+
+  void set_scheduler(VideoScheduler* scheduler) { scheduler_ = scheduler; }
+
+  // webrtc::ScreenCapturer mocks, called on the capture thread.
+  void OnCapturerStart(webrtc::ScreenCapturer::Callback* callback) {
+    callback_ = callback;
+  }
+
+  void Capture(const webrtc::DesktopRegion& region) {
+    base::TimeTicks start_time = base::TimeTicks::Now();
+    {
+      base::AutoLock lock(lock_);
+      capture_start_times_[++sequence_number_] = start_time;
+    }
+    scheduler_->UpdateSequenceNumber(sequence_number_);
+
+    scoped_ptr<webrtc::DesktopFrame> frame(
+        new webrtc::BasicDesktopFrame(size_));
+    memset(frame->data(), 0x80, frame->stride() * size_.height());
+    frame->mutable_updated_region()->SetRect(window_);
+    if (window_.right() + kWindowStep > size_.width())
+      window_.Translate(-window_.left(), 0);
+    else
+      window_.Translate(kWindowStep, 0);
+    frame->mutable_updated_region()->AddRect(window_);
+    for (int y = window_.top(); y < window_.bottom(); ++y) {
+      uint8* row = frame->data() + y * frame->stride() +
+          window_.left() * webrtc::DesktopFrame::kBytesPerPixel;
+      for (int x = 0; x < window_.width(); ++x) {
+        row[x * webrtc::DesktopFrame::kBytesPerPixel] = x + y;
+        row[x * webrtc::DesktopFrame::kBytesPerPixel + 1] = x * y;
+        row[x * webrtc::DesktopFrame::kBytesPerPixel + 2] = x - y;
+      }
+    }
+    frame->set_capture_time_ms(
+        (base::TimeTicks::Now() - start_time).InMilliseconds());
+    callback_->OnCaptureCompleted(frame.release());
+  }
+
+  int64 captured_frames() {
+    base::AutoLock lock(lock_);
+    return sequence_number_;
+  }
+
+  base::TimeTicks GetCaptureStartTime(int64 sequence_number) {
+    base::AutoLock lock(lock_);
+    return capture_start_times_[sequence_number];
+  }
+
+ private:
+  webrtc::DesktopSize size_;
+  webrtc::DesktopRect window_;
+  VideoScheduler* scheduler_;
+  webrtc::ScreenCapturer::Callback* callback_;
+
+  base::Lock lock_;
+  int64 sequence_number_;
+  std::map<int64, base::TimeTicks> capture_start_times_;
+
+  DISALLOW_COPY_AND_ASSIGN(FakeDesktop);
+};
+
+// A VideoStub which delivers packets to the client over a link of limited
+// bandwidth, one after another, and measures how long after the start of the
+// capture each frame arrives. A |bandwidth_kbps| of 0 means unlimited.
+class ThrottledVideoStub : public protocol::VideoStub {
+ public:
+  ThrottledVideoStub(FakeDesktop* desktop, int bandwidth_kbps)
+      : desktop_(desktop),
+        bandwidth_kbps_(bandwidth_kbps),
+        received_frames_(0),
+        weak_factory_(this) {
+  }
+
+  virtual void ProcessVideoPacket(scoped_ptr<VideoPacket> packet,
+                                  const base::Closure& done) OVERRIDE {
+    base::TimeTicks now = base::TimeTicks::Now();
+    base::TimeTicks sent_time = now;
+    if (bandwidth_kbps_) {
+      sent_time = std::max(now, link_free_time_) +
+          base::TimeDelta::FromMicroseconds(
+              static_cast<int64>(packet->ByteSize()) * 8000 / bandwidth_kbps_);
+      link_free_time_ = sent_time;
+    }
+    base::MessageLoop::current()->PostDelayedTask(
+        FROM_HERE,
+        base::Bind(&ThrottledVideoStub::OnPacketSent,
+                   weak_factory_.GetWeakPtr(),
+                   packet->client_sequence_number(), done),
+        sent_time - now);
+  }
+
+  int received_frames() const { return received_frames_; }
+  base::TimeDelta total_latency() const { return total_latency_; }
+
+ private:
+  void OnPacketSent(int64 sequence_number, const base::Closure& done) {
+    ++received_frames_;
+    total_latency_ += base::TimeTicks::Now() -
+        desktop_->GetCaptureStartTime(sequence_number);
+    done.Run();
+  }
+
+  FakeDesktop* desktop_;
+  int bandwidth_kbps_;
+  base::TimeTicks link_free_time_;
+  int received_frames_;
+  base::TimeDelta total_latency_;
+
+  // Packets still on the link when the stream stops are never delivered.
+  base::WeakPtrFactory<ThrottledVideoStub> weak_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThrottledVideoStub);
+};
+
 }  // namespace
 
 static const int kWidth = 640;
@@ -81,10 +224,29 @@ class VideoSchedulerTest : public testing::Test {
   void OnCapturerStart(webrtc::ScreenCapturer::Callback* callback);
   void OnCaptureFrame(const webrtc::DesktopRegion& region);
 
+  // Counts calls to webrtc::ScreenCapturer::Capture() without completing
+  // them, so that the test can complete each capture when it chooses to.
+  void OnCaptureStarted();
+
+  // Runs the message loop until the capturer has been asked for |count|
+  // frames in total.
+  void WaitForCaptures(int count);
+
+  // Completes the pending capture with a frame in which |rect| was updated.
+  void CompleteCapture(const webrtc::DesktopRect& rect);
+
+  // VideoEncoder and VideoStub mocks which record the updated region of each
+  // encoded frame and hold on to the callback for each packet sent.
+  VideoPacket* OnEncode(const webrtc::DesktopFrame& frame);
+  void OnVideoPacket(const VideoPacket* packet, const base::Closure& done);
+
  protected:
   base::MessageLoop message_loop_;
   base::RunLoop run_loop_;
   scoped_refptr<AutoThreadTaskRunner> task_runner_;
+
+  // If set, encode tasks are queued here instead of on |task_runner_|.
+  scoped_refptr<base::TestSimpleTaskRunner> encode_task_runner_;
   scoped_refptr<VideoScheduler> scheduler_;
 
   MockClientStub client_stub_;
@@ -98,13 +260,19 @@ class VideoSchedulerTest : public testing::Test {
   // Points to the callback passed to webrtc::ScreenCapturer::Start().
   webrtc::ScreenCapturer::Callback* capturer_callback_;
 
+  int captures_started_;
+  base::Closure capture_started_closure_;
+  std::vector<webrtc::DesktopRegion> encoded_regions_;
+  std::vector<base::Closure> pending_sends_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(VideoSchedulerTest);
 };
 
 VideoSchedulerTest::VideoSchedulerTest()
     : encoder_(NULL),
-      capturer_callback_(NULL) {
+      capturer_callback_(NULL),
+      captures_started_(0) {
 }
 
 void VideoSchedulerTest::SetUp() {
@@ -116,9 +284,13 @@ void VideoSchedulerTest::SetUp() {
 
 void VideoSchedulerTest::StartVideoScheduler(
     scoped_ptr<webrtc::ScreenCapturer> capturer) {
+  scoped_refptr<base::SingleThreadTaskRunner> encode_task_runner =
+      task_runner_;
+  if (encode_task_runner_)
+    encode_task_runner = encode_task_runner_;
   scheduler_ = new VideoScheduler(
       task_runner_, // Capture
-      task_runner_, // Encode
+      encode_task_runner, // Encode
       task_runner_, // Network
       capturer.Pass(),
       scoped_ptr<VideoEncoder>(encoder_),
@@ -146,6 +318,38 @@ void VideoSchedulerTest::OnCaptureFrame(const webrtc::DesktopRegion& region) {
   capturer_callback_->OnCaptureCompleted(frame_.release());
 }
 
+void VideoSchedulerTest::OnCaptureStarted() {
+  ++captures_started_;
+  if (!capture_started_closure_.is_null())
+    capture_started_closure_.Run();
+}
+
+void VideoSchedulerTest::WaitForCaptures(int count) {
+  while (captures_started_ < count) {
+    base::RunLoop run_loop;
+    capture_started_closure_ = run_loop.QuitClosure();
+    run_loop.Run();
+  }
+  capture_started_closure_.Reset();
+}
+
+void VideoSchedulerTest::CompleteCapture(const webrtc::DesktopRect& rect) {
+  scoped_ptr<webrtc::DesktopFrame> frame(new webrtc::BasicDesktopFrame(
+      webrtc::DesktopSize(kWidth, kHeight)));
+  frame->mutable_updated_region()->SetRect(rect);
+  capturer_callback_->OnCaptureCompleted(frame.release());
+}
+
+VideoPacket* VideoSchedulerTest::OnEncode(const webrtc::DesktopFrame& frame) {
+  encoded_regions_.push_back(frame.updated_region());
+  return new VideoPacket();
+}
+
+void VideoSchedulerTest::OnVideoPacket(const VideoPacket* packet,
+                                       const base::Closure& done) {
+  pending_sends_.push_back(done);
+}
+
 // This test mocks capturer, encoder and network layer to simulate one capture
 // cycle. When the first encoded packet is submitted to the network
 // VideoScheduler is instructed to come to a complete stop. We expect the stop
@@ -188,4 +392,130 @@ TEST_F(VideoSchedulerTest, StartAndStop) {
   run_loop_.Run();
 }
 
+// Stalls the network with two frames queued for sending, and checks that a
+// frame whose capture completes meanwhile is dropped rather than encoded, and
+// that its updated region is sent with the next frame instead.
+TEST_F(VideoSchedulerTest, DropsFramesWhileNetworkIsBehind) {
+  encode_task_runner_ = new base::TestSimpleTaskRunner();
+
+  scoped_ptr<webrtc::MockScreenCapturer> capturer(
+      new webrtc::MockScreenCapturer());
+  EXPECT_CALL(*capturer, Start(_))
+      .WillOnce(Invoke(this, &VideoSchedulerTest::OnCapturerStart));
+  EXPECT_CALL(*capturer, Capture(_))
+      .WillRepeatedly(InvokeWithoutArgs(
+          this, &VideoSchedulerTest::OnCaptureStarted));
+  EXPECT_CALL(*encoder_, EncodePtr(_))
+      .WillRepeatedly(Invoke(this, &VideoSchedulerTest::OnEncode));
+  EXPECT_CALL(video_stub_, ProcessVideoPacketPtr(_, _))
+      .WillRepeatedly(Invoke(this, &VideoSchedulerTest::OnVideoPacket));
+
+  const webrtc::DesktopRect kRect1 = webrtc::DesktopRect::MakeXYWH(0, 0, 8, 8);
+  const webrtc::DesktopRect kRect2 = webrtc::DesktopRect::MakeXYWH(16, 0, 8, 8);
+  const webrtc::DesktopRect kRect3 = webrtc::DesktopRect::MakeXYWH(32, 0, 8, 8);
+  const webrtc::DesktopRect kRect4 = webrtc::DesktopRect::MakeXYWH(0, 32, 8, 8);
+
+  StartVideoScheduler(capturer.PassAs<webrtc::ScreenCapturer>());
+
+  // The first frame is encoded and waits for the network.
+  WaitForCaptures(1);
+  CompleteCapture(kRect1);
+  encode_task_runner_->RunPendingTasks();
+  base::RunLoop().RunUntilIdle();
+  ASSERT_EQ(1u, pending_sends_.size());
+
+  // The second frame is captured, but its encode is held back until the third
+  // capture has started.
+  WaitForCaptures(2);
+  CompleteCapture(kRect2);
+  WaitForCaptures(3);
+  encode_task_runner_->RunPendingTasks();
+  base::RunLoop().RunUntilIdle();
+  ASSERT_EQ(2u, pending_sends_.size());
+
+  // With two frames waiting for the network, the third frame is dropped.
+  CompleteCapture(kRect3);
+  EXPECT_FALSE(encode_task_runner_->HasPendingTask());
+  EXPECT_EQ(2u, encoded_regions_.size());
+
+  // Once the network catches up the next frame is captured, and carries the
+  // dropped frame's update along with its own.
+  pending_sends_[0].Run();
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(4, captures_started_);
+  CompleteCapture(kRect4);
+  encode_task_runner_->RunPendingTasks();
+  ASSERT_EQ(3u, encoded_regions_.size());
+  webrtc::DesktopRegion expected_region;
+  expected_region.AddRect(kRect3);
+  expected_region.AddRect(kRect4);
+  EXPECT_TRUE(encoded_regions_[2].Equals(expected_region));
+
+  StopVideoScheduler();
+  pending_sends_.clear();
+  base::RunLoop().RunUntilIdle();
+  encode_task_runner_->RunUntilIdle();
+  base::RunLoop().RunUntilIdle();
+
+  task_runner_ = NULL;
+  run_loop_.Run();
+}
+
+// Streams a 720p desktop with a moving window through the VP8 encoder to a
+// client over links of different bandwidths, with capture, encode and
+// network on separate threads, and reports the frame rate at the client, the
+// latency from capture to arrival, and how many captured frames were dropped.
+TEST(VideoSchedulerPerfTest, DISABLED_Loopback) {
+  const int kBandwidthsKbps[] = { 0, 20000, 5000, 1000 };
+  const base::TimeDelta kDuration = base::TimeDelta::FromSeconds(5);
+
+  base::MessageLoop message_loop;
+  MockClientStub client_stub;
+  for (size_t i = 0; i < arraysize(kBandwidthsKbps); ++i) {
+    base::Thread capture_thread("Capture");
+    base::Thread encode_thread("Encode");
+    ASSERT_TRUE(capture_thread.Start());
+    ASSERT_TRUE(encode_thread.Start());
+
+    FakeDesktop desktop(webrtc::DesktopSize(1280, 720));
+    ThrottledVideoStub video_stub(&desktop, kBandwidthsKbps[i]);
+
+    scoped_ptr<webrtc::MockScreenCapturer> capturer(
+        new webrtc::MockScreenCapturer());
+    EXPECT_CALL(*capturer, Start(_))
+        .WillOnce(Invoke(&desktop, &FakeDesktop::OnCapturerStart));
+    EXPECT_CALL(*capturer, Capture(_))
+        .WillRepeatedly(Invoke(&desktop, &FakeDesktop::Capture));
+
+    scoped_refptr<VideoScheduler> scheduler = new VideoScheduler(
+        capture_thread.message_loop_proxy(),
+        encode_thread.message_loop_proxy(),
+        message_loop.message_loop_proxy(),
+        capturer.PassAs<webrtc::ScreenCapturer>(),
+        VideoEncoderVpx::CreateForVP8().PassAs<VideoEncoder>(),
+        &client_stub,
+        &video_stub);
+    desktop.set_scheduler(scheduler.get());
+    scheduler->Start();
+
+    base::RunLoop run_loop;
+    message_loop.PostDelayedTask(FROM_HERE, run_loop.QuitClosure(), kDuration);
+    run_loop.Run();
+
+    scheduler->Stop();
+    capture_thread.Stop();
+    encode_thread.Stop();
+    scheduler = NULL;
+
+    int frames = video_stub.received_frames();
+    LOG(INFO) << base::StringPrintf(
+        "%d kbps link: %.1f fps, %.1f ms mean latency, "
+        "%d of %d captured frames not delivered",
+        kBandwidthsKbps[i], frames / kDuration.InSecondsF(),
+        frames ? video_stub.total_latency().InMillisecondsF() / frames : 0.0,
+        static_cast<int>(desktop.captured_frames()) - frames,
+        static_cast<int>(desktop.captured_frames()));
+  }
+}
+
 }  // namespace remoting
@@ -4,8 +4,15 @@
 
 #include <algorithm>
 
+#include "base/atomicops.h"
+#include "base/bind.h"
+#include "base/location.h"
 #include "base/logging.h"
+#include "base/memory/ref_counted.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/worker_pool.h"
 #include "skia/ext/convolver.h"
+#include "skia/ext/convolver_AVX2.h"
 #include "skia/ext/convolver_SSE2.h"
 #include "skia/ext/convolver_mips_dspr2.h"
 #include "third_party/skia/include/core/SkSize.h"
@@ -363,7 +370,12 @@ struct ConvolveProcs {
 void SetupSIMD(ConvolveProcs *procs) {
 #ifdef SIMD_SSE2
   base::CPU cpu;
-  if (cpu.has_sse2()) {
+  if (cpu.has_avx2()) {
+    procs->extra_horizontal_reads = 3;
+    procs->convolve_vertically = &ConvolveVertically_AVX2;
+    procs->convolve_4rows_horizontally = &Convolve4RowsHorizontally_AVX2;
+    procs->convolve_horizontally = &ConvolveHorizontally_AVX2;
+  } else if (cpu.has_sse2()) {
     procs->extra_horizontal_reads = 3;
     procs->convolve_vertically = &ConvolveVertically_SSE2;
     procs->convolve_4rows_horizontally = &Convolve4RowsHorizontally_SSE2;
@@ -376,22 +388,36 @@ void SetupSIMD(ConvolveProcs *procs) {
 #endif
 }
 
-void BGRAConvolve2D(const unsigned char* source_data,
-                    int source_byte_row_stride,
-                    bool source_has_alpha,
-                    const ConvolutionFilter1D& filter_x,
-                    const ConvolutionFilter1D& filter_y,
-                    int output_byte_row_stride,
-                    unsigned char* output,
-                    bool use_simd_if_possible) {
+namespace {
+
+// Everything a band of output rows needs to run one part of a
+// BGRAConvolve2D. The filters and image buffers are owned by the caller, which
+// does not return until every band is done, so they are shared rather than
+// copied.
+struct ConvolveParams {
+  const unsigned char* source_data;
+  int source_byte_row_stride;
+  bool source_has_alpha;
+  const ConvolutionFilter1D* filter_x;
+  const ConvolutionFilter1D* filter_y;
+  int output_byte_row_stride;
+  unsigned char* output;
   ConvolveProcs simd;
-  simd.extra_horizontal_reads = 0;
-  simd.convolve_vertically = NULL;
-  simd.convolve_4rows_horizontally = NULL;
-  simd.convolve_horizontally = NULL;
-  if (use_simd_if_possible) {
-    SetupSIMD(&simd);
-  }
+};
+
+// Produces output rows [|first_output_row|, |end_output_row|). Every band
+// keeps its own circular buffer of horizontally convolved rows, starting at
+// the first input row its first vertical filter needs, so bands are
+// independent and produce exactly the rows a single pass would.
+void ConvolveRows(const ConvolveParams& params,
+                  int first_output_row,
+                  int end_output_row) {
+  const unsigned char* source_data = params.source_data;
+  int source_byte_row_stride = params.source_byte_row_stride;
+  bool source_has_alpha = params.source_has_alpha;
+  const ConvolutionFilter1D& filter_x = *params.filter_x;
+  const ConvolutionFilter1D& filter_y = *params.filter_y;
+  const ConvolveProcs& simd = params.simd;
 
   int max_y_filter_size = filter_y.max_filter();
 
@@ -402,7 +428,7 @@ void BGRAConvolve2D(const unsigned char* source_data,
   // row for convolution as the first pixel for the first vertical filter.
   int filter_offset, filter_length;
   const ConvolutionFilter1D::Fixed* filter_values =
-      filter_y.FilterForValue(0, &filter_offset, &filter_length);
+      filter_y.FilterForValue(first_output_row, &filter_offset, &filter_length);
   int next_x_row = filter_offset;
 
   // We loop over each row in the input doing a horizontal convolution. This
@@ -424,7 +450,7 @@ void BGRAConvolve2D(const unsigned char* source_data,
 
   // Loop over every possible output row, processing just enough horizontal
   // convolutions to run each subsequent vertical convolution.
-  SkASSERT(output_byte_row_stride >= filter_x.num_values() * 4);
+  SkASSERT(params.output_byte_row_stride >= filter_x.num_values() * 4);
   int num_output_rows = filter_y.num_values();
 
   // We need to check which is the last line to convolve before we advance 4
@@ -446,7 +472,7 @@ void BGRAConvolve2D(const unsigned char* source_data,
   filter_y.FilterForValue(num_output_rows - 1, &last_filter_offset,
                           &last_filter_length);
 
-  for (int out_y = 0; out_y < num_output_rows; out_y++) {
+  for (int out_y = first_output_row; out_y < end_output_row; out_y++) {
     filter_values = filter_y.FilterForValue(out_y,
                                             &filter_offset, &filter_length);
 
@@ -487,7 +513,8 @@ void BGRAConvolve2D(const unsigned char* source_data,
     }
 
     // Compute where in the output image this row of final data will go.
-    unsigned char* cur_output_row = &output[out_y * output_byte_row_stride];
+    unsigned char* cur_output_row =
+        &params.output[out_y * params.output_byte_row_stride];
 
     // Get the list of rows that the circular buffer has, in order.
     int first_row_in_circular_buffer;
@@ -513,6 +540,138 @@ void BGRAConvolve2D(const unsigned char* source_data,
   }
 }
 
+// Splits the output rows of a BGRAConvolve2D into bands which the calling
+// thread and a few worker pool threads claim one at a time. Workers that start
+// after all bands have been claimed return without touching |params_|, which
+// is why the caller only has to wait for claimed bands to finish.
+class ConvolveJob : public base::RefCountedThreadSafe<ConvolveJob> {
+ public:
+  ConvolveJob(const ConvolveParams& params, int num_bands)
+      : params_(params),
+        num_output_rows_(params.filter_y->num_values()),
+        num_bands_(num_bands),
+        next_band_(0),
+        bands_done_(0),
+        done_(true, false) {
+  }
+
+  // Runs bands until none are left.
+  void RunBands() {
+    for (;;) {
+      int band = base::subtle::NoBarrier_AtomicIncrement(&next_band_, 1) - 1;
+      if (band >= num_bands_)
+        return;
+      ConvolveRows(params_,
+                   num_output_rows_ * band / num_bands_,
+                   num_output_rows_ * (band + 1) / num_bands_);
+      if (base::subtle::Barrier_AtomicIncrement(&bands_done_, 1) ==
+          num_bands_) {
+        done_.Signal();
+      }
+    }
+  }
+
+  // Blocks until every band has been written.
+  void Wait() {
+    done_.Wait();
+  }
+
+ private:
+  friend class base::RefCountedThreadSafe<ConvolveJob>;
+  ~ConvolveJob() {}
+
+  const ConvolveParams params_;
+  const int num_output_rows_;
+  const int num_bands_;
+  base::subtle::Atomic32 next_band_;
+  base::subtle::Atomic32 bands_done_;
+  base::WaitableEvent done_;
+
+  DISALLOW_COPY_AND_ASSIGN(ConvolveJob);
+};
+
+// Returns how many bands to split a convolution into for |max_threads|
+// threads. Small convolutions are not worth handing to other threads, and
+// every band has to redo the horizontal pass for the rows its first vertical
+// filter overlaps with the previous band, so bands are kept reasonably tall.
+int NumBandsForConvolution(const ConvolutionFilter1D& filter_x,
+                           const ConvolutionFilter1D& filter_y,
+                           int max_threads) {
+  // Rough number of multiply-adds each thread should at least get.
+  const int64 kMinWorkPerThread = 1 << 20;
+  const int kMinRowsPerBand = 16;
+  // More bands than threads lets the calling thread pick up the slack when a
+  // worker starts late.
+  const int kBandsPerThread = 2;
+
+  if (max_threads <= 1)
+    return 1;
+  int64 work = static_cast<int64>(filter_x.num_values()) *
+      filter_y.num_values() * (filter_x.max_filter() + filter_y.max_filter());
+  int64 threads = std::min<int64>(max_threads, work / kMinWorkPerThread);
+  threads = std::min<int64>(threads, filter_y.num_values() / kMinRowsPerBand);
+  if (threads <= 1)
+    return 1;
+  return static_cast<int>(std::min<int64>(
+      threads * kBandsPerThread, filter_y.num_values() / kMinRowsPerBand));
+}
+
+}  // namespace
+
+void BGRAConvolve2D(const unsigned char* source_data,
+                    int source_byte_row_stride,
+                    bool source_has_alpha,
+                    const ConvolutionFilter1D& filter_x,
+                    const ConvolutionFilter1D& filter_y,
+                    int output_byte_row_stride,
+                    unsigned char* output,
+                    bool use_simd_if_possible) {
+  BGRAConvolve2D(source_data, source_byte_row_stride, source_has_alpha,
+                 filter_x, filter_y, output_byte_row_stride, output,
+                 use_simd_if_possible, 1);
+}
+
+void BGRAConvolve2D(const unsigned char* source_data,
+                    int source_byte_row_stride,
+                    bool source_has_alpha,
+                    const ConvolutionFilter1D& filter_x,
+                    const ConvolutionFilter1D& filter_y,
+                    int output_byte_row_stride,
+                    unsigned char* output,
+                    bool use_simd_if_possible,
+                    int max_threads) {
+  ConvolveParams params;
+  params.source_data = source_data;
+  params.source_byte_row_stride = source_byte_row_stride;
+  params.source_has_alpha = source_has_alpha;
+  params.filter_x = &filter_x;
+  params.filter_y = &filter_y;
+  params.output_byte_row_stride = output_byte_row_stride;
+  params.output = output;
+  params.simd.extra_horizontal_reads = 0;
+  params.simd.convolve_vertically = NULL;
+  params.simd.convolve_4rows_horizontally = NULL;
+  params.simd.convolve_horizontally = NULL;
+  if (use_simd_if_possible) {
+    SetupSIMD(&params.simd);
+  }
+
+  int num_bands = NumBandsForConvolution(filter_x, filter_y, max_threads);
+  if (num_bands <= 1) {
+    ConvolveRows(params, 0, filter_y.num_values());
+    return;
+  }
+
+  scoped_refptr<ConvolveJob> job(new ConvolveJob(params, num_bands));
+  int num_workers = std::min(max_threads, num_bands) - 1;
+  for (int i = 0; i < num_workers; ++i) {
+    base::WorkerPool::PostTask(
+        FROM_HERE, base::Bind(&ConvolveJob::RunBands, job), false);
+  }
+  job->RunBands();
+  job->Wait();
+}
+
 void SingleChannelConvolveX1D(const unsigned char* source_data,
                               int source_byte_row_stride,
                               int input_channel_index,
@@ -191,6 +191,22 @@ SK_API void BGRAConvolve2D(const unsigned char* source_data,
                            unsigned char* output,
                            bool use_simd_if_possible);
 
+// Same as above, but splits the output rows across up to |max_threads|
+// threads: the calling thread plus tasks on base::WorkerPool. Both filters are
+// shared by all threads and the result is identical to the single-threaded
+// version. Convolutions too small to benefit run on the calling thread only.
+// This blocks until the whole output has been written, so |max_threads| must be
+// 1 on threads which disallow waiting, such as the UI and IO threads.
+SK_API void BGRAConvolve2D(const unsigned char* source_data,
+                           int source_byte_row_stride,
+                           bool source_has_alpha,
+                           const ConvolutionFilter1D& xfilter,
+                           const ConvolutionFilter1D& yfilter,
+                           int output_byte_row_stride,
+                           unsigned char* output,
+                           bool use_simd_if_possible,
+                           int max_threads);
+
 // Does a 1D convolution of the given source image along the X dimension on
 // a single channel of the bitmap.
 //
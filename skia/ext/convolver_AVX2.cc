@@ -0,0 +1,406 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "skia/ext/convolver_AVX2.h"
+
+#include <immintrin.h>  // ARCH_CPU_X86_FAMILY was defined in build/config.h
+
+#include "skia/ext/convolver.h"
+#include "third_party/skia/include/core/SkTypes.h"
+
+// The rest of the library is built for the baseline instruction set, so the
+// AVX2 code paths are enabled per function. They are only reached after
+// base::CPU reports AVX2 support.
+#if defined(_MSC_VER)
+#define AVX2_FUNCTION
+#else
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+
+namespace skia {
+
+namespace {
+
+// Accumulates four horizontal taps of one row into |accum|, exactly like one
+// iteration of ConvolveHorizontally_SSE2. |coeff| holds the four coefficients
+// in its low 64 bits.
+AVX2_FUNCTION inline void AccumulateFourTaps(const unsigned char* src,
+                                             __m128i coeff,
+                                             __m128i* accum) {
+  __m128i zero = _mm_setzero_si128();
+  // [16] c1 c1 c1 c1 c0 c0 c0 c0
+  __m128i coeff16 = _mm_shufflelo_epi16(coeff, _MM_SHUFFLE(1, 1, 0, 0));
+  coeff16 = _mm_unpacklo_epi16(coeff16, coeff16);
+
+  // [8] a3 b3 g3 r3 a2 b2 g2 r2 a1 b1 g1 r1 a0 b0 g0 r0
+  __m128i src8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+  // [16] a1 b1 g1 r1 a0 b0 g0 r0
+  __m128i src16 = _mm_unpacklo_epi8(src8, zero);
+  __m128i mul_hi = _mm_mulhi_epi16(src16, coeff16);
+  __m128i mul_lo = _mm_mullo_epi16(src16, coeff16);
+  __m128i t = _mm_unpacklo_epi16(mul_lo, mul_hi);
+  *accum = _mm_add_epi32(*accum, t);
+  t = _mm_unpackhi_epi16(mul_lo, mul_hi);
+  *accum = _mm_add_epi32(*accum, t);
+
+  // [16] c3 c3 c3 c3 c2 c2 c2 c2
+  coeff16 = _mm_shufflelo_epi16(coeff, _MM_SHUFFLE(3, 3, 2, 2));
+  coeff16 = _mm_unpacklo_epi16(coeff16, coeff16);
+  // [16] a3 b3 g3 r3 a2 b2 g2 r2
+  src16 = _mm_unpackhi_epi8(src8, zero);
+  mul_hi = _mm_mulhi_epi16(src16, coeff16);
+  mul_lo = _mm_mullo_epi16(src16, coeff16);
+  t = _mm_unpacklo_epi16(mul_lo, mul_hi);
+  *accum = _mm_add_epi32(*accum, t);
+  t = _mm_unpackhi_epi16(mul_lo, mul_hi);
+  *accum = _mm_add_epi32(*accum, t);
+}
+
+// Accumulates eight horizontal taps of one row into |accum|. The low 128-bit
+// lane handles taps 0-3 and the high lane taps 4-7; the lanes are summed once
+// all taps are done. |coeff| holds the eight coefficients.
+AVX2_FUNCTION inline void AccumulateEightTaps(const unsigned char* src,
+                                              __m256i coeff,
+                                              __m256i* accum) {
+  __m256i zero = _mm256_setzero_si256();
+  // [16] c5 c5 c5 c5 c4 c4 c4 c4 | c1 c1 c1 c1 c0 c0 c0 c0
+  __m256i coeff16 = _mm256_shufflelo_epi16(coeff, _MM_SHUFFLE(1, 1, 0, 0));
+  coeff16 = _mm256_unpacklo_epi16(coeff16, coeff16);
+
+  // [8] pixels 7 6 5 4 | pixels 3 2 1 0
+  __m256i src8 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+  // [16] pixels 5 4 | pixels 1 0
+  __m256i src16 = _mm256_unpacklo_epi8(src8, zero);
+  __m256i mul_hi = _mm256_mulhi_epi16(src16, coeff16);
+  __m256i mul_lo = _mm256_mullo_epi16(src16, coeff16);
+  __m256i t = _mm256_unpacklo_epi16(mul_lo, mul_hi);
+  *accum = _mm256_add_epi32(*accum, t);
+  t = _mm256_unpackhi_epi16(mul_lo, mul_hi);
+  *accum = _mm256_add_epi32(*accum, t);
+
+  // [16] c7 c7 c7 c7 c6 c6 c6 c6 | c3 c3 c3 c3 c2 c2 c2 c2
+  coeff16 = _mm256_shufflelo_epi16(coeff, _MM_SHUFFLE(3, 3, 2, 2));
+  coeff16 = _mm256_unpacklo_epi16(coeff16, coeff16);
+  // [16] pixels 7 6 | pixels 3 2
+  src16 = _mm256_unpackhi_epi8(src8, zero);
+  mul_hi = _mm256_mulhi_epi16(src16, coeff16);
+  mul_lo = _mm256_mullo_epi16(src16, coeff16);
+  t = _mm256_unpacklo_epi16(mul_lo, mul_hi);
+  *accum = _mm256_add_epi32(*accum, t);
+  t = _mm256_unpackhi_epi16(mul_lo, mul_hi);
+  *accum = _mm256_add_epi32(*accum, t);
+}
+
+// Loads eight coefficients, placing taps 0-3 in the low lane and taps 4-7 in
+// the low half of the high lane to match AccumulateEightTaps.
+AVX2_FUNCTION inline __m256i LoadEightCoefficients(
+    const ConvolutionFilter1D::Fixed* filter_values) {
+  __m128i coeff =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(filter_values));
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(coeff),
+                                 _mm_srli_si128(coeff, 8), 1);
+}
+
+// Shifts, saturates and packs a 32-bit accumulator down to one BGRA pixel.
+AVX2_FUNCTION inline int PackPixel(__m128i accum) {
+  __m128i zero = _mm_setzero_si128();
+  accum = _mm_srai_epi32(accum, ConvolutionFilter1D::kShiftBits);
+  accum = _mm_packs_epi32(accum, zero);
+  accum = _mm_packus_epi16(accum, zero);
+  return _mm_cvtsi128_si32(accum);
+}
+
+// Sums the two lanes of a horizontal accumulator.
+AVX2_FUNCTION inline __m128i FoldLanes(__m256i accum) {
+  return _mm_add_epi32(_mm256_castsi256_si128(accum),
+                       _mm256_extracti128_si256(accum, 1));
+}
+
+// Returns the mask that clears the coefficients loaded past the last |r| taps
+// of a filter, for 0 < r < 4.
+AVX2_FUNCTION inline __m128i TailMask(int r) {
+  switch (r) {
+    case 1:
+      return _mm_set_epi16(0, 0, 0, 0, 0, 0, 0, -1);
+    case 2:
+      return _mm_set_epi16(0, 0, 0, 0, 0, 0, -1, -1);
+    default:
+      return _mm_set_epi16(0, 0, 0, 0, 0, -1, -1, -1);
+  }
+}
+
+// Applies the alpha fix-up or opaque alpha of ConvolveVertically_SSE2 to
+// packed pixels.
+template<bool has_alpha>
+AVX2_FUNCTION inline __m256i FixAlpha(__m256i pixels) {
+  if (has_alpha) {
+    // Make sure the value of alpha channel is always larger than maximum
+    // value of color channels.
+    __m256i a = _mm256_srli_epi32(pixels, 8);
+    __m256i b = _mm256_max_epu8(a, pixels);  // Max of r and g.
+    a = _mm256_srli_epi32(pixels, 16);
+    b = _mm256_max_epu8(a, b);  // Max of r and g and b.
+    b = _mm256_slli_epi32(b, 24);
+    return _mm256_max_epu8(b, pixels);
+  }
+  return _mm256_or_si256(pixels, _mm256_set1_epi32(0xff000000));
+}
+
+template<bool has_alpha>
+AVX2_FUNCTION inline __m128i FixAlpha(__m128i pixels) {
+  if (has_alpha) {
+    __m128i a = _mm_srli_epi32(pixels, 8);
+    __m128i b = _mm_max_epu8(a, pixels);
+    a = _mm_srli_epi32(pixels, 16);
+    b = _mm_max_epu8(a, b);
+    b = _mm_slli_epi32(b, 24);
+    return _mm_max_epu8(b, pixels);
+  }
+  return _mm_or_si128(pixels, _mm_set1_epi32(0xff000000));
+}
+
+// Vertically convolves the four pixels starting at |out_x|. The rows are
+// padded (see BGRAConvolve2D), so reading four pixels is always safe.
+template<bool has_alpha>
+AVX2_FUNCTION __m128i ConvolveFourPixelsVertically(
+    const ConvolutionFilter1D::Fixed* filter_values,
+    int filter_length,
+    unsigned char* const* source_data_rows,
+    int out_x) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i accum0 = _mm_setzero_si128();
+  __m128i accum1 = _mm_setzero_si128();
+  __m128i accum2 = _mm_setzero_si128();
+  __m128i accum3 = _mm_setzero_si128();
+  for (int filter_y = 0; filter_y < filter_length; filter_y++) {
+    __m128i coeff16 = _mm_set1_epi16(filter_values[filter_y]);
+    __m128i src8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+        &source_data_rows[filter_y][out_x << 2]));
+    __m128i src16 = _mm_unpacklo_epi8(src8, zero);
+    __m128i mul_hi = _mm_mulhi_epi16(src16, coeff16);
+    __m128i mul_lo = _mm_mullo_epi16(src16, coeff16);
+    accum0 = _mm_add_epi32(accum0, _mm_unpacklo_epi16(mul_lo, mul_hi));
+    accum1 = _mm_add_epi32(accum1, _mm_unpackhi_epi16(mul_lo, mul_hi));
+    src16 = _mm_unpackhi_epi8(src8, zero);
+    mul_hi = _mm_mulhi_epi16(src16, coeff16);
+    mul_lo = _mm_mullo_epi16(src16, coeff16);
+    accum2 = _mm_add_epi32(accum2, _mm_unpacklo_epi16(mul_lo, mul_hi));
+    accum3 = _mm_add_epi32(accum3, _mm_unpackhi_epi16(mul_lo, mul_hi));
+  }
+  accum0 = _mm_srai_epi32(accum0, ConvolutionFilter1D::kShiftBits);
+  accum1 = _mm_srai_epi32(accum1, ConvolutionFilter1D::kShiftBits);
+  accum2 = _mm_srai_epi32(accum2, ConvolutionFilter1D::kShiftBits);
+  accum3 = _mm_srai_epi32(accum3, ConvolutionFilter1D::kShiftBits);
+  accum0 = _mm_packs_epi32(accum0, accum1);
+  accum2 = _mm_packs_epi32(accum2, accum3);
+  accum0 = _mm_packus_epi16(accum0, accum2);
+  return FixAlpha<has_alpha>(accum0);
+}
+
+template<bool has_alpha>
+AVX2_FUNCTION void ConvolveVertically_AVX2(
+    const ConvolutionFilter1D::Fixed* filter_values,
+    int filter_length,
+    unsigned char* const* source_data_rows,
+    int pixel_width,
+    unsigned char* out_row) {
+  int width = pixel_width & ~7;
+
+  __m256i zero = _mm256_setzero_si256();
+  // Output eight pixels per iteration (32 bytes). The unpack and pack
+  // instructions work within 128-bit lanes, so each lane computes the same
+  // four pixels as one SSE2 iteration and the results come out in order.
+  for (int out_x = 0; out_x < width; out_x += 8) {
+    __m256i accum0 = _mm256_setzero_si256();
+    __m256i accum1 = _mm256_setzero_si256();
+    __m256i accum2 = _mm256_setzero_si256();
+    __m256i accum3 = _mm256_setzero_si256();
+
+    for (int filter_y = 0; filter_y < filter_length; filter_y++) {
+      __m256i coeff16 = _mm256_set1_epi16(filter_values[filter_y]);
+      // [8] pixels 7 6 5 4 | pixels 3 2 1 0
+      __m256i src8 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+          &source_data_rows[filter_y][out_x << 2]));
+
+      // [16] pixels 5 4 | pixels 1 0
+      __m256i src16 = _mm256_unpacklo_epi8(src8, zero);
+      __m256i mul_hi = _mm256_mulhi_epi16(src16, coeff16);
+      __m256i mul_lo = _mm256_mullo_epi16(src16, coeff16);
+      // [32] pixel 4 | pixel 0
+      accum0 = _mm256_add_epi32(accum0,
+                                _mm256_unpacklo_epi16(mul_lo, mul_hi));
+      // [32] pixel 5 | pixel 1
+      accum1 = _mm256_add_epi32(accum1,
+                                _mm256_unpackhi_epi16(mul_lo, mul_hi));
+
+      // [16] pixels 7 6 | pixels 3 2
+      src16 = _mm256_unpackhi_epi8(src8, zero);
+      mul_hi = _mm256_mulhi_epi16(src16, coeff16);
+      mul_lo = _mm256_mullo_epi16(src16, coeff16);
+      // [32] pixel 6 | pixel 2
+      accum2 = _mm256_add_epi32(accum2,
+                                _mm256_unpacklo_epi16(mul_lo, mul_hi));
+      // [32] pixel 7 | pixel 3
+      accum3 = _mm256_add_epi32(accum3,
+                                _mm256_unpackhi_epi16(mul_lo, mul_hi));
+    }
+
+    accum0 = _mm256_srai_epi32(accum0, ConvolutionFilter1D::kShiftBits);
+    accum1 = _mm256_srai_epi32(accum1, ConvolutionFilter1D::kShiftBits);
+    accum2 = _mm256_srai_epi32(accum2, ConvolutionFilter1D::kShiftBits);
+    accum3 = _mm256_srai_epi32(accum3, ConvolutionFilter1D::kShiftBits);
+
+    // [16] pixels 5 4 | pixels 1 0
+    accum0 = _mm256_packs_epi32(accum0, accum1);
+    // [16] pixels 7 6 | pixels 3 2
+    accum2 = _mm256_packs_epi32(accum2, accum3);
+    // [8] pixels 7 6 5 4 | pixels 3 2 1 0
+    accum0 = _mm256_packus_epi16(accum0, accum2);
+    accum0 = FixAlpha<has_alpha>(accum0);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out_row), accum0);
+    out_row += 32;
+  }
+
+  // At most seven pixels are left; do them four at a time.
+  for (int out_x = width; out_x < pixel_width; out_x += 4) {
+    __m128i pixels = ConvolveFourPixelsVertically<has_alpha>(
+        filter_values, filter_length, source_data_rows, out_x);
+    if (out_x + 4 <= pixel_width) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out_row), pixels);
+      out_row += 16;
+      continue;
+    }
+    for (int x = out_x; x < pixel_width; x++) {
+      *(reinterpret_cast<int*>(out_row)) = _mm_cvtsi128_si32(pixels);
+      pixels = _mm_srli_si128(pixels, 4);
+      out_row += 4;
+    }
+  }
+}
+
+}  // namespace
+
+// Convolves horizontally along a single row. Eight taps are accumulated per
+// iteration; the remaining taps are done four at a time exactly as the SSE2
+// version does, so the reads past the end of the filter stay the same.
+AVX2_FUNCTION void ConvolveHorizontally_AVX2(const unsigned char* src_data,
+                                             const ConvolutionFilter1D& filter,
+                                             unsigned char* out_row,
+                                             bool /*has_alpha*/) {
+  int num_values = filter.num_values();
+  int filter_offset, filter_length;
+
+  for (int out_x = 0; out_x < num_values; out_x++) {
+    const ConvolutionFilter1D::Fixed* filter_values =
+        filter.FilterForValue(out_x, &filter_offset, &filter_length);
+    const unsigned char* row_to_filter = &src_data[filter_offset << 2];
+
+    __m256i accum256 = _mm256_setzero_si256();
+    for (int filter_x = 0; filter_x < filter_length >> 3; filter_x++) {
+      AccumulateEightTaps(row_to_filter, LoadEightCoefficients(filter_values),
+                          &accum256);
+      row_to_filter += 32;
+      filter_values += 8;
+    }
+    __m128i accum = FoldLanes(accum256);
+
+    if (filter_length & 4) {
+      AccumulateFourTaps(row_to_filter,
+                         _mm_loadl_epi64(
+                             reinterpret_cast<const __m128i*>(filter_values)),
+                         &accum);
+      row_to_filter += 16;
+      filter_values += 4;
+    }
+
+    int r = filter_length & 3;
+    if (r) {
+      // Note: filter_values must be padded to align_up(filter_offset, 8).
+      __m128i coeff =
+          _mm_loadl_epi64(reinterpret_cast<const __m128i*>(filter_values));
+      AccumulateFourTaps(row_to_filter, _mm_and_si128(coeff, TailMask(r)),
+                         &accum);
+    }
+
+    *(reinterpret_cast<int*>(out_row)) = PackPixel(accum);
+    out_row += 4;
+  }
+}
+
+// Convolves horizontally along four rows. See ConvolveHorizontally_AVX2.
+AVX2_FUNCTION void Convolve4RowsHorizontally_AVX2(
+    const unsigned char* src_data[4],
+    const ConvolutionFilter1D& filter,
+    unsigned char* out_row[4]) {
+  int num_values = filter.num_values();
+  int filter_offset, filter_length;
+
+  for (int out_x = 0; out_x < num_values; out_x++) {
+    const ConvolutionFilter1D::Fixed* filter_values =
+        filter.FilterForValue(out_x, &filter_offset, &filter_length);
+    int start = filter_offset << 2;
+
+    __m256i accum256[4];
+    for (int i = 0; i < 4; ++i)
+      accum256[i] = _mm256_setzero_si256();
+    for (int filter_x = 0; filter_x < filter_length >> 3; filter_x++) {
+      __m256i coeff = LoadEightCoefficients(filter_values);
+      for (int i = 0; i < 4; ++i)
+        AccumulateEightTaps(src_data[i] + start, coeff, &accum256[i]);
+      start += 32;
+      filter_values += 8;
+    }
+    __m128i accum[4];
+    for (int i = 0; i < 4; ++i)
+      accum[i] = FoldLanes(accum256[i]);
+
+    if (filter_length & 4) {
+      __m128i coeff =
+          _mm_loadl_epi64(reinterpret_cast<const __m128i*>(filter_values));
+      for (int i = 0; i < 4; ++i)
+        AccumulateFourTaps(src_data[i] + start, coeff, &accum[i]);
+      start += 16;
+      filter_values += 4;
+    }
+
+    int r = filter_length & 3;
+    if (r) {
+      // Note: filter_values must be padded to align_up(filter_offset, 8).
+      __m128i coeff =
+          _mm_loadl_epi64(reinterpret_cast<const __m128i*>(filter_values));
+      coeff = _mm_and_si128(coeff, TailMask(r));
+      for (int i = 0; i < 4; ++i)
+        AccumulateFourTaps(src_data[i] + start, coeff, &accum[i]);
+    }
+
+    for (int i = 0; i < 4; ++i) {
+      *(reinterpret_cast<int*>(out_row[i])) = PackPixel(accum[i]);
+      out_row[i] += 4;
+    }
+  }
+}
+
+void ConvolveVertically_AVX2(const ConvolutionFilter1D::Fixed* filter_values,
+                             int filter_length,
+                             unsigned char* const* source_data_rows,
+                             int pixel_width,
+                             unsigned char* out_row,
+                             bool has_alpha) {
+  if (has_alpha) {
+    ConvolveVertically_AVX2<true>(filter_values,
+                                  filter_length,
+                                  source_data_rows,
+                                  pixel_width,
+                                  out_row);
+  } else {
+    ConvolveVertically_AVX2<false>(filter_values,
+                                   filter_length,
+                                   source_data_rows,
+                                   pixel_width,
+                                   out_row);
+  }
+}
+
+}  // namespace skia
@@ -332,6 +332,51 @@ TEST(Convolver, MAYBE_SIMDVerification) {
   }
 }
 
+// Splitting the output rows across threads must not change a single pixel.
+TEST(Convolver, ThreadedMatchesSingleThreaded) {
+  const int kSourceWidth = 1999;
+  const int kSourceHeight = 1501;
+  const int kDestWidth = 1000;
+  const int kDestHeight = 750;
+  float filter[] = { 0.05f, -0.15f, 0.6f, 0.6f, -0.15f, 0.05f };
+
+  ConvolutionFilter1D x_filter, y_filter;
+  for (int p = 0; p < kDestWidth; ++p) {
+    int offset = kSourceWidth * p / kDestWidth;
+    x_filter.AddFilter(offset, filter,
+                       std::min<int>(arraysize(filter), kSourceWidth - offset));
+  }
+  x_filter.PaddingForSIMD();
+  for (int p = 0; p < kDestHeight; ++p) {
+    int offset = kSourceHeight * p / kDestHeight;
+    y_filter.AddFilter(offset, filter,
+                       std::min<int>(arraysize(filter),
+                                     kSourceHeight - offset));
+  }
+  y_filter.PaddingForSIMD();
+
+  std::vector<unsigned char> source(kSourceWidth * kSourceHeight * 4);
+  for (size_t i = 0; i < source.size(); ++i)
+    source[i] = static_cast<unsigned char>((i * 7919) >> 3);
+
+  for (int alpha = 0; alpha < 2; alpha++) {
+    for (int simd = 0; simd < 2; simd++) {
+      std::vector<unsigned char> expected(kDestWidth * kDestHeight * 4);
+      BGRAConvolve2D(&source[0], kSourceWidth * 4, alpha != 0,
+                     x_filter, y_filter, kDestWidth * 4, &expected[0],
+                     simd != 0);
+      for (int threads = 2; threads <= 8; threads *= 2) {
+        std::vector<unsigned char> output(expected.size());
+        BGRAConvolve2D(&source[0], kSourceWidth * 4, alpha != 0,
+                       x_filter, y_filter, kDestWidth * 4, &output[0],
+                       simd != 0, threads);
+        EXPECT_TRUE(expected == output) << "alpha " << alpha << " simd "
+                                        << simd << " threads " << threads;
+      }
+    }
+  }
+}
+
 TEST(Convolver, SeparableSingleConvolution) {
   static const int kImgWidth = 1024;
   static const int kImgHeight = 1024;
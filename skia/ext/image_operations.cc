@@ -344,10 +344,10 @@ SkBitmap ImageOperations::Resize(const SkBitmap& source,
                                  SkBitmap::Allocator* allocator) {
   if (method == ImageOperations::RESIZE_SUBPIXEL) {
     return ResizeSubpixel(source, dest_width, dest_height,
-                          dest_subset, allocator);
+                          dest_subset, 1, allocator);
   } else {
     return ResizeBasic(source, method, dest_width, dest_height, dest_subset,
-                       allocator);
+                       1, allocator);
   }
 }
 
@@ -355,6 +355,7 @@ SkBitmap ImageOperations::Resize(const SkBitmap& source,
 SkBitmap ImageOperations::ResizeSubpixel(const SkBitmap& source,
                                          int dest_width, int dest_height,
                                          const SkIRect& dest_subset,
+                                         int max_threads,
                                          SkBitmap::Allocator* allocator) {
   TRACE_EVENT2("skia", "ImageOperations::ResizeSubpixel",
                "src_pixels", source.width()*source.height(),
@@ -386,7 +387,7 @@ SkBitmap ImageOperations::ResizeSubpixel(const SkBitmap& source,
                      dest_subset.fLeft + dest_subset.width() * w,
                      dest_subset.fTop + dest_subset.height() * h };
   SkBitmap img = ResizeBasic(source, ImageOperations::RESIZE_LANCZOS3, width,
-                             height, subset, allocator);
+                             height, subset, max_threads, allocator);
   const int row_words = img.rowBytes() / 4;
   if (w == 1 && h == 1)
     return img;
@@ -466,6 +467,7 @@ SkBitmap ImageOperations::ResizeBasic(const SkBitmap& source,
                                       ResizeMethod method,
                                       int dest_width, int dest_height,
                                       const SkIRect& dest_subset,
+                                      int max_threads,
                                       SkBitmap::Allocator* allocator) {
   TRACE_EVENT2("skia", "ImageOperations::ResizeBasic",
                "src_pixels", source.width()*source.height(),
@@ -519,7 +521,7 @@ SkBitmap ImageOperations::ResizeBasic(const SkBitmap& source,
                  !source.isOpaque(), filter.x_filter(), filter.y_filter(),
                  static_cast<int>(result.rowBytes()),
                  static_cast<unsigned char*>(result.getPixels()),
-                 true);
+                 true, max_threads);
 
   base::TimeDelta delta = base::TimeTicks::Now() - resize_start;
   UMA_HISTOGRAM_TIMES("Image.ResampleMS", delta);
@@ -527,6 +529,7 @@ SkBitmap ImageOperations::ResizeBasic(const SkBitmap& source,
   return result;
 }
 
+
 // static
 SkBitmap ImageOperations::Resize(const SkBitmap& source,
                                  ResizeMethod method,
@@ -537,4 +540,20 @@ SkBitmap ImageOperations::Resize(const SkBitmap& source,
                 allocator);
 }
 
+// static
+SkBitmap ImageOperations::ResizeWithThreads(const SkBitmap& source,
+                                            ResizeMethod method,
+                                            int dest_width, int dest_height,
+                                            int max_threads,
+                                            SkBitmap::Allocator* allocator) {
+  DCHECK_GE(max_threads, 1);
+  SkIRect dest_subset = { 0, 0, dest_width, dest_height };
+  if (method == ImageOperations::RESIZE_SUBPIXEL) {
+    return ResizeSubpixel(source, dest_width, dest_height, dest_subset,
+                          max_threads, allocator);
+  }
+  return ResizeBasic(source, method, dest_width, dest_height, dest_subset,
+                     max_threads, allocator);
+}
+
 }  // namespace skia
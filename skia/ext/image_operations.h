@@ -111,6 +111,18 @@ class SK_API ImageOperations {
                          int dest_width, int dest_height,
                          SkBitmap::Allocator* allocator = NULL);
 
+  // Same as above, but a large resize may split its output rows between the
+  // calling thread and the worker pool, using up to |max_threads| threads in
+  // all. The output does not depend on the thread count. The calling thread
+  // blocks until the worker pool is done, so only callers on threads which
+  // allow waiting may pass more than 1; Resize() never leaves the calling
+  // thread.
+  static SkBitmap ResizeWithThreads(const SkBitmap& source,
+                                    ResizeMethod method,
+                                    int dest_width, int dest_height,
+                                    int max_threads,
+                                    SkBitmap::Allocator* allocator = NULL);
+
  private:
   ImageOperations();  // Class for scoping only.
 
@@ -119,12 +131,14 @@ class SK_API ImageOperations {
                               ResizeMethod method,
                               int dest_width, int dest_height,
                               const SkIRect& dest_subset,
+                              int max_threads,
                               SkBitmap::Allocator* allocator = NULL);
 
   // Subpixel renderer.
   static SkBitmap ResizeSubpixel(const SkBitmap& source,
                                  int dest_width, int dest_height,
                                  const SkIRect& dest_subset,
+                                 int max_threads,
                                  SkBitmap::Allocator* allocator = NULL);
 };
 
@@ -12,10 +12,14 @@
 // To present a single number in MB/s, it calculates the 'speed' by taking
 // source surface + destination surface and dividing by the elapsed time.
 // This number is somewhat reasonable way to measure this, given our current
-// implementation which somewhat scales this way.
+// implementation which somewhat scales this way. The same surfaces are also
+// reported in megapixels/s, once for every method and thread count measured.
 
 #include <stdio.h>
 
+#include <vector>
+
+#include "base/at_exit.h"
 #include "base/basictypes.h"
 #include "base/command_line.h"
 #include "base/format_macros.h"
@@ -23,6 +27,7 @@
 #include "base/strings/string_split.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/sys_info.h"
 #include "base/time/time.h"
 #include "skia/ext/image_operations.h"
 #include "third_party/skia/include/core/SkBitmap.h"
@@ -93,6 +98,11 @@ int GetBitmapSize(const SkBitmap* bitmap) {
   return bitmap->height() * bitmap->bytesPerPixel() * bitmap->width();
 }
 
+// Same as above, in pixels.
+int GetBitmapPixels(const SkBitmap* bitmap) {
+  return bitmap->height() * bitmap->width();
+}
+
 // Simple class to represent dimensions of a bitmap (width, height).
 class Dimensions {
  public:
@@ -141,6 +151,8 @@ class Benchmark {
 
   Benchmark()
       : num_iterations_(kDefaultNumberIterations),
+        num_threads_(0),
+        all_methods_(false),
         method_(kDefaultResizeMethod) {}
 
   // Returns true if command line parsing was successful, false otherwise.
@@ -151,7 +163,16 @@ class Benchmark {
 
   static void Usage();
  private:
+  // Times |num_iterations_| resizes with |method| on up to |num_threads|
+  // threads and prints the throughput.
+  void RunOne(const SkBitmap& source,
+              skia::ImageOperations::ResizeMethod method,
+              int num_threads) const;
+
   int num_iterations_;
+  // 0 runs with 1, 2, 4... threads up to the number of processors.
+  int num_threads_;
+  bool all_methods_;
   skia::ImageOperations::ResizeMethod method_;
   Dimensions source_;
   Dimensions dest_;
@@ -165,11 +186,14 @@ const skia::ImageOperations::ResizeMethod Benchmark::kDefaultResizeMethod =
 // argument management
 void Benchmark::Usage() {
   printf("image_operations_bench -source wxh -destination wxh "
-         "[-iterations i] [-method m] [-help]\n"
+         "[-iterations i] [-method m] [-threads t] [-help]\n"
          "  -source wxh: specify source width and height\n"
          "  -destination wxh: specify destination width and height\n"
          "  -iter i: perform i iterations (default:%d)\n"
-         "  -method m: use method m (default:%s), which can be:",
+         "  -threads t: resize on up to t threads (default: 1, 2, 4... up to\n"
+         "              the number of processors)\n"
+         "  -method m: use method m (default:%s), or all of them with 'all';\n"
+         "             the methods are:",
          Benchmark::kDefaultNumberIterations,
          MethodToString(Benchmark::kDefaultResizeMethod));
   PrintMethods();
@@ -198,8 +222,15 @@ bool Benchmark::ParseArgs(const CommandLine* command_line) {
       if (base::StringToInt(value, &num_iterations_) == false) {
         fNeedHelp = true;
       }
+    } else if (s == "threads") {
+      if (!base::StringToInt(value, &num_threads_) || num_threads_ < 0) {
+        printf("Invalid number of threads '%s' specified\n", value.c_str());
+        fNeedHelp = true;
+      }
     } else if (s == "method") {
-      if (!StringToMethod(value, &method_)) {
+      if (base::strcasecmp(value.c_str(), "all") == 0) {
+        all_methods_ = true;
+      } else if (!StringToMethod(value, &method_)) {
         printf("Invalid method '%s' specified\n", value.c_str());
         fNeedHelp = true;
       }
@@ -234,27 +265,61 @@ bool Benchmark::Run() const {
   source.allocPixels();
   source.eraseARGB(0, 0, 0, 0);
 
+  std::vector<skia::ImageOperations::ResizeMethod> methods;
+  if (all_methods_) {
+    for (size_t i = 0; i < arraysize(resize_methods); ++i)
+      methods.push_back(resize_methods[i].method);
+  } else {
+    methods.push_back(method_);
+  }
+
+  std::vector<int> thread_counts;
+  if (num_threads_ > 0) {
+    thread_counts.push_back(num_threads_);
+  } else {
+    int num_processors = base::SysInfo::NumberOfProcessors();
+    for (int threads = 1; threads < num_processors; threads *= 2)
+      thread_counts.push_back(threads);
+    thread_counts.push_back(num_processors);
+  }
+
+  for (size_t i = 0; i < methods.size(); ++i) {
+    for (size_t j = 0; j < thread_counts.size(); ++j)
+      RunOne(source, methods[i], thread_counts[j]);
+  }
+  return true;
+}
+
+void Benchmark::RunOne(const SkBitmap& source,
+                       skia::ImageOperations::ResizeMethod method,
+                       int num_threads) const {
   SkBitmap dest;
 
   const base::TimeTicks start = base::TimeTicks::Now();
 
   for (int i = 0; i < num_iterations_; ++i) {
-    dest = skia::ImageOperations::Resize(source,
-                                         method_,
-                                         dest_.width(), dest_.height());
+    dest = skia::ImageOperations::ResizeWithThreads(source,
+                                                    method,
+                                                    dest_.width(),
+                                                    dest_.height(),
+                                                    num_threads);
   }
 
   const int64 elapsed_us = (base::TimeTicks::Now() - start).InMicroseconds();
 
   const uint64 num_bytes = static_cast<uint64>(num_iterations_) *
       (GetBitmapSize(&source) + GetBitmapSize(&dest));
-
-  printf("%" PRIu64 " MB/s,\telapsed = %" PRIu64 " source=%d dest=%d\n",
+  const uint64 num_pixels = static_cast<uint64>(num_iterations_) *
+      (GetBitmapPixels(&source) + GetBitmapPixels(&dest));
+
+  // Pixels per microsecond are megapixels per second.
+  printf("%-8s threads=%d:\t%.2f MP/s,\t%" PRIu64 " MB/s,\telapsed = %"
+         PRIu64 " source=%d dest=%d\n",
+         MethodToString(method), num_threads,
+         elapsed_us == 0 ? 0.0 : static_cast<double>(num_pixels) / elapsed_us,
          static_cast<uint64>(elapsed_us == 0 ? 0 : num_bytes / elapsed_us),
          static_cast<uint64>(elapsed_us),
          GetBitmapSize(&source), GetBitmapSize(&dest));
-
-  return true;
 }
 
 // A small class to automatically call Reset on the global command line to
@@ -276,6 +341,8 @@ class CommandLineAutoReset {
 }  // namespace
 
 int main(int argc, char** argv) {
+  // The worker pool used by multi-threaded resizes needs this.
+  base::AtExitManager at_exit_manager;
   Benchmark bench;
   CommandLineAutoReset command_line(argc, argv);
 
@@ -4,15 +4,25 @@
 
 #include "sql/recovery.h"
 
+#include <algorithm>
+#include <deque>
+
+#include "base/compiler_specific.h"
 #include "base/files/file_path.h"
 #include "base/format_macros.h"
 #include "base/logging.h"
+#include "base/memory/scoped_vector.h"
 #include "base/metrics/histogram.h"
 #include "base/metrics/sparse_histogram.h"
+#include "base/stl_util.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/simple_thread.h"
 #include "sql/connection.h"
 #include "sql/statement.h"
+#include "sql/transaction.h"
 #include "third_party/sqlite/sqlite3.h"
 
 namespace sql {
@@ -81,6 +91,19 @@ enum RecoveryEventType {
   // No version key in recovery meta table.
   RECOVERY_FAILED_META_NO_VERSION,
 
+  // AutoRecoverTables() successfully completed.
+  RECOVERY_SUCCESS_AUTORECOVER_TABLES,
+
+  // Failed to open or setup a reader handle for AutoRecoverTables().
+  RECOVERY_FAILED_AUTORECOVER_TABLES_READER,
+
+  // A reader thread stopped early on an error from the recover virtual
+  // table.  The rows read before the error are still recovered.
+  RECOVERY_FAILED_AUTORECOVER_TABLES_READ,
+
+  // Writing rows into the recovery database failed.
+  RECOVERY_FAILED_AUTORECOVER_TABLES_INSERT,
+
   // Always keep this at the end.
   RECOVERY_EVENT_MAX,
 };
@@ -90,6 +113,215 @@ void RecordRecoveryEvent(RecoveryEventType recovery_event) {
                             recovery_event, RECOVERY_EVENT_MAX);
 }
 
+// Number of rows AutoRecoverTables() reader threads accumulate before
+// handing them to the writer.
+const size_t kRowsPerBatch = 512;
+
+// Maximum number of batches queued for the writer before readers
+// block.  Bounds memory use when reading outpaces writing.
+const size_t kMaxQueuedBatches = 32;
+
+// A column value read from a recover virtual table on a reader thread,
+// held until it can be bound on the writer thread.
+struct RecoveredValue {
+  RecoveredValue()
+      : type(COLUMN_TYPE_NULL),
+        int_value(0),
+        double_value(0.0) {
+  }
+
+  ColType type;
+  int64 int_value;
+  double double_value;
+  std::string bytes;  // Contents for COLUMN_TYPE_TEXT and COLUMN_TYPE_BLOB.
+};
+
+typedef std::vector<RecoveredValue> RecoveredRow;
+
+struct RecoveredBatch {
+  size_t table_index;
+  std::vector<RecoveredRow> rows;
+};
+
+// Hands batches of rows from the reader threads to the writer.  Readers
+// block in Push() while too many batches are outstanding, the writer
+// blocks in Pop() until a batch arrives or all readers are done.
+class RecoveredBatchQueue {
+ public:
+  explicit RecoveredBatchQueue(size_t reader_count)
+      : cv_(&lock_),
+        readers_remaining_(reader_count),
+        cancelled_(false),
+        read_failed_(false) {
+  }
+
+  ~RecoveredBatchQueue() {
+    STLDeleteElements(&batches_);
+  }
+
+  // Queue |batch| for the writer.  Returns false if the writer has
+  // given up, in which case the reader should stop.
+  bool Push(scoped_ptr<RecoveredBatch> batch) {
+    base::AutoLock lock(lock_);
+    while (!cancelled_ && batches_.size() >= kMaxQueuedBatches)
+      cv_.Wait();
+    if (cancelled_)
+      return false;
+    batches_.push_back(batch.release());
+    cv_.Broadcast();
+    return true;
+  }
+
+  // Called once by each reader when it will not Push() any more.
+  void ReaderDone(bool succeeded) {
+    base::AutoLock lock(lock_);
+    DCHECK_GT(readers_remaining_, 0u);
+    --readers_remaining_;
+    if (!succeeded)
+      read_failed_ = true;
+    cv_.Broadcast();
+  }
+
+  // Returns the next batch, or NULL once every reader is done and all
+  // batches have been returned.
+  scoped_ptr<RecoveredBatch> Pop() {
+    base::AutoLock lock(lock_);
+    while (batches_.empty() && readers_remaining_ > 0)
+      cv_.Wait();
+    if (batches_.empty())
+      return scoped_ptr<RecoveredBatch>();
+    scoped_ptr<RecoveredBatch> batch(batches_.front());
+    batches_.pop_front();
+    cv_.Broadcast();
+    return batch.Pass();
+  }
+
+  // Release any blocked readers and make future Push() calls fail.
+  void Cancel() {
+    base::AutoLock lock(lock_);
+    cancelled_ = true;
+    cv_.Broadcast();
+  }
+
+  bool read_failed() {
+    base::AutoLock lock(lock_);
+    return read_failed_;
+  }
+
+ private:
+  base::Lock lock_;
+  base::ConditionVariable cv_;
+  std::deque<RecoveredBatch*> batches_;
+  size_t readers_remaining_;
+  bool cancelled_;
+  bool read_failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(RecoveredBatchQueue);
+};
+
+// Reads every row of one recover virtual table on a worker thread.
+// |connection| is setup by the creator, after which it is only touched
+// by Run().
+class RecoveredTableReader : public base::DelegateSimpleThread::Delegate {
+ public:
+  RecoveredTableReader(size_t table_index,
+                       Connection* connection,
+                       const std::string& select_sql,
+                       RecoveredBatchQueue* queue)
+      : table_index_(table_index),
+        connection_(connection),
+        select_sql_(select_sql),
+        queue_(queue) {
+  }
+
+  virtual void Run() OVERRIDE {
+    Statement s(connection_->GetUniqueStatement(select_sql_.c_str()));
+    scoped_ptr<RecoveredBatch> batch;
+    while (s.Step()) {
+      if (!batch) {
+        batch.reset(new RecoveredBatch);
+        batch->table_index = table_index_;
+        batch->rows.reserve(kRowsPerBatch);
+      }
+      batch->rows.push_back(RecoveredRow(s.ColumnCount()));
+      ReadRow(s, &batch->rows.back());
+      if (batch->rows.size() == kRowsPerBatch &&
+          !queue_->Push(batch.Pass())) {
+        queue_->ReaderDone(true);
+        return;
+      }
+    }
+    if (batch && !queue_->Push(batch.Pass())) {
+      queue_->ReaderDone(true);
+      return;
+    }
+    queue_->ReaderDone(s.Succeeded());
+  }
+
+ private:
+  static void ReadRow(Statement& s, RecoveredRow* row) {
+    for (size_t i = 0; i < row->size(); ++i) {
+      const int col = static_cast<int>(i);
+      RecoveredValue& value = (*row)[i];
+      value.type = s.ColumnType(col);
+      switch (value.type) {
+        case COLUMN_TYPE_INTEGER:
+          value.int_value = s.ColumnInt64(col);
+          break;
+        case COLUMN_TYPE_FLOAT:
+          value.double_value = s.ColumnDouble(col);
+          break;
+        case COLUMN_TYPE_TEXT:
+          value.bytes = s.ColumnString(col);
+          break;
+        case COLUMN_TYPE_BLOB:
+          s.ColumnBlobAsString(col, &value.bytes);
+          break;
+        case COLUMN_TYPE_NULL:
+          break;
+      }
+    }
+  }
+
+  const size_t table_index_;
+  Connection* connection_;
+  const std::string select_sql_;
+  RecoveredBatchQueue* queue_;
+
+  DISALLOW_COPY_AND_ASSIGN(RecoveredTableReader);
+};
+
+// Bind |row| to the parameters of |s|, an INSERT prepared on the
+// recovery database.
+bool BindRecoveredRow(const RecoveredRow& row, Statement* s) {
+  for (size_t i = 0; i < row.size(); ++i) {
+    const int col = static_cast<int>(i);
+    const RecoveredValue& value = row[i];
+    bool bound = false;
+    switch (value.type) {
+      case COLUMN_TYPE_INTEGER:
+        bound = s->BindInt64(col, value.int_value);
+        break;
+      case COLUMN_TYPE_FLOAT:
+        bound = s->BindDouble(col, value.double_value);
+        break;
+      case COLUMN_TYPE_TEXT:
+        bound = s->BindString(col, value.bytes);
+        break;
+      case COLUMN_TYPE_BLOB:
+        bound = s->BindBlob(col, value.bytes.data(),
+                            static_cast<int>(value.bytes.size()));
+        break;
+      case COLUMN_TYPE_NULL:
+        bound = s->BindNull(col);
+        break;
+    }
+    if (!bound)
+      return false;
+  }
+  return true;
+}
+
 }  // namespace
 
 // static
@@ -165,6 +397,7 @@ bool Recovery::Init(const base::FilePath& db_path) {
   // one database and stored to the other possibly could, but would be
   // more complicated.
   db_->RollbackAllTransactions();
+  db_path_ = db_path;
 
   // Disable exclusive locking mode so that the attached database can
   // access things.  The locking_mode change is not active until the
@@ -225,6 +458,25 @@ bool Recovery::Init(const base::FilePath& db_path) {
   return true;
 }
 
+bool Recovery::InitReader(Connection* connection) {
+  DCHECK(!connection->is_open());
+  if (!connection->OpenInMemory())
+    return false;
+
+#if !defined(USE_SYSTEM_SQLITE)
+  if (recoverVtableInit(connection->db_) != SQLITE_OK) {
+    LOG(ERROR) << "Failed to initialize recover module: "
+               << connection->GetErrorMessage();
+    return false;
+  }
+#endif
+
+  if (!connection->Execute("PRAGMA writable_schema=1"))
+    return false;
+
+  return connection->AttachDatabase(db_path_, "corrupt");
+}
+
 bool Recovery::Backup() {
   CHECK(db_);
   CHECK(recover_db_.is_open());
@@ -333,21 +585,19 @@ void Recovery::Shutdown(Recovery::Disposition raze) {
   db_ = NULL;
 }
 
-bool Recovery::AutoRecoverTable(const char* table_name,
-                                size_t extend_columns,
-                                size_t* rows_recovered) {
+bool Recovery::GetRecoverColumns(
+    const char* table_name,
+    size_t extend_columns,
+    std::vector<std::string>* create_column_decls,
+    std::vector<std::string>* insert_columns) {
+  DCHECK(create_column_decls->empty());
+  DCHECK(insert_columns->empty());
+
   // Query the info for the recovered table in database [main].
   std::string query(
       base::StringPrintf("PRAGMA main.table_info(%s)", table_name));
   Statement s(db()->GetUniqueStatement(query.c_str()));
 
-  // The columns of the recover virtual table.
-  std::vector<std::string> create_column_decls;
-
-  // The columns to select from the recover virtual table when copying
-  // to the recovered table.
-  std::vector<std::string> insert_columns;
-
   // If PRIMARY KEY is a single INTEGER column, then it is an alias
   // for ROWID.  The primary key can be compound, so this can only be
   // determined after processing all column data and tracking what is
@@ -390,7 +640,7 @@ bool Recovery::AutoRecoverTable(const char* table_name,
     // mismatches could be detected by which rows are filtered.
     if (column_type.find("INT") != std::string::npos) {
       if (pk_column == 1) {
-        rowid_ofs = create_column_decls.size();
+        rowid_ofs = create_column_decls->size();
         rowid_decl = column_name + " ROWID";
       }
       column_decl += " INTEGER";
@@ -423,40 +673,58 @@ bool Recovery::AutoRecoverTable(const char* table_name,
     if (not_null && default_is_null)
       column_decl += " NOT NULL";
 
-    create_column_decls.push_back(column_decl);
+    create_column_decls->push_back(column_decl);
 
     // Per the NOTE in the header file, convert NULL values to the
     // DEFAULT.  All columns could be IFNULL(column_name,default), but
     // the NULL case would require special handling either way.
     if (default_is_null) {
-      insert_columns.push_back(column_name);
+      insert_columns->push_back(column_name);
     } else {
       // The default value appears to be pre-quoted, as if it is
       // literally from the sqlite_master CREATE statement.
       std::string default_value = s.ColumnString(4);
-      insert_columns.push_back(base::StringPrintf(
+      insert_columns->push_back(base::StringPrintf(
           "IFNULL(%s,%s)", column_name.c_str(), default_value.c_str()));
     }
   }
 
   // Receiving no column information implies that the table doesn't exist.
-  if (create_column_decls.empty()) {
+  if (create_column_decls->empty()) {
     RecordRecoveryEvent(RECOVERY_FAILED_AUTORECOVER_MISSING_TABLE);
     return false;
   }
 
   // If the PRIMARY KEY was a single INTEGER column, convert it to ROWID.
   if (pk_column_count == 1 && !rowid_decl.empty())
-    create_column_decls[rowid_ofs] = rowid_decl;
+    (*create_column_decls)[rowid_ofs] = rowid_decl;
 
   // Additional columns accept anything.
   // TODO(shess): ignoreN isn't well namespaced.  But it will fail to
   // execute in case of conflicts.
   for (size_t i = 0; i < extend_columns; ++i) {
-    create_column_decls.push_back(
+    create_column_decls->push_back(
         base::StringPrintf("ignore%" PRIuS " ANY", i));
   }
 
+  return true;
+}
+
+bool Recovery::AutoRecoverTable(const char* table_name,
+                                size_t extend_columns,
+                                size_t* rows_recovered) {
+  // The columns of the recover virtual table.
+  std::vector<std::string> create_column_decls;
+
+  // The columns to select from the recover virtual table when copying
+  // to the recovered table.
+  std::vector<std::string> insert_columns;
+
+  if (!GetRecoverColumns(table_name, extend_columns,
+                         &create_column_decls, &insert_columns)) {
+    return false;
+  }
+
   std::string recover_create(base::StringPrintf(
       "CREATE VIRTUAL TABLE temp.recover_%s USING recover(corrupt.%s, %s)",
       table_name,
@@ -494,6 +762,123 @@ bool Recovery::AutoRecoverTable(const char* table_name,
   return true;
 }
 
+bool Recovery::AutoRecoverTables(const std::vector<std::string>& table_names,
+                                 size_t extend_columns,
+                                 size_t max_threads,
+                                 const ProgressCallback& progress,
+                                 size_t* rows_recovered) {
+  DCHECK_GT(max_threads, 0u);
+  *rows_recovered = 0;
+  if (table_names.empty())
+    return true;
+
+  // Setup a reader handle with a recover virtual table for each table,
+  // and the statement to write its rows into the recovery database.
+  // This all happens on this thread, so that failures are detected
+  // before any threads are started.
+  RecoveredBatchQueue queue(table_names.size());
+  ScopedVector<Connection> readers;
+  ScopedVector<RecoveredTableReader> table_readers;
+  ScopedVector<Statement> inserts;
+  for (size_t i = 0; i < table_names.size(); ++i) {
+    const char* table_name = table_names[i].c_str();
+    std::vector<std::string> create_column_decls;
+    std::vector<std::string> insert_columns;
+    if (!GetRecoverColumns(table_name, extend_columns,
+                           &create_column_decls, &insert_columns)) {
+      return false;
+    }
+
+    readers.push_back(new Connection);
+    if (!InitReader(readers.back())) {
+      RecordRecoveryEvent(RECOVERY_FAILED_AUTORECOVER_TABLES_READER);
+      return false;
+    }
+
+    std::string recover_create(base::StringPrintf(
+        "CREATE VIRTUAL TABLE temp.recover_%s USING recover(corrupt.%s, %s)",
+        table_name,
+        table_name,
+        JoinString(create_column_decls, ',').c_str()));
+    if (!readers.back()->Execute(recover_create.c_str())) {
+      RecordRecoveryEvent(RECOVERY_FAILED_AUTORECOVER_CREATE);
+      return false;
+    }
+
+    std::string recover_select(base::StringPrintf(
+        "SELECT %s FROM temp.recover_%s",
+        JoinString(insert_columns, ',').c_str(),
+        table_name));
+    table_readers.push_back(
+        new RecoveredTableReader(i, readers.back(), recover_select, &queue));
+
+    std::vector<std::string> params(insert_columns.size(), "?");
+    std::string recover_insert(base::StringPrintf(
+        "INSERT OR REPLACE INTO main.%s VALUES (%s)",
+        table_name,
+        JoinString(params, ',').c_str()));
+    inserts.push_back(
+        new Statement(db()->GetUniqueStatement(recover_insert.c_str())));
+    if (!inserts.back()->is_valid()) {
+      RecordRecoveryEvent(RECOVERY_FAILED_AUTORECOVER_TABLES_INSERT);
+      return false;
+    }
+  }
+
+  Transaction transaction(db());
+  if (!transaction.Begin()) {
+    RecordRecoveryEvent(RECOVERY_FAILED_AUTORECOVER_TABLES_INSERT);
+    return false;
+  }
+
+  const int thread_count =
+      static_cast<int>(std::min(max_threads, table_readers.size()));
+  base::DelegateSimpleThreadPool pool("SQLRecovery", thread_count);
+  for (size_t i = 0; i < table_readers.size(); ++i)
+    pool.AddWork(table_readers[i]);
+  pool.Start();
+
+  // Write batches as the readers produce them.  On failure the readers
+  // are released by Cancel(), and the remaining batches are discarded.
+  std::vector<size_t> table_rows(table_names.size(), 0);
+  size_t total_rows = 0;
+  bool ok = true;
+  while (ok) {
+    scoped_ptr<RecoveredBatch> batch = queue.Pop();
+    if (!batch)
+      break;
+
+    Statement* insert = inserts[batch->table_index];
+    for (size_t i = 0; ok && i < batch->rows.size(); ++i) {
+      insert->Reset(true);
+      ok = BindRecoveredRow(batch->rows[i], insert) && insert->Run();
+    }
+    if (!ok) {
+      RecordRecoveryEvent(RECOVERY_FAILED_AUTORECOVER_TABLES_INSERT);
+      break;
+    }
+
+    table_rows[batch->table_index] += batch->rows.size();
+    total_rows += batch->rows.size();
+    if (!progress.is_null())
+      progress.Run(table_names[batch->table_index],
+                   table_rows[batch->table_index]);
+  }
+  queue.Cancel();
+  pool.JoinAll();
+
+  // A table which could not be read to the end keeps the rows read
+  // before the error, so this is recorded but does not fail recovery.
+  if (queue.read_failed())
+    RecordRecoveryEvent(RECOVERY_FAILED_AUTORECOVER_TABLES_READ);
+  if (!ok || !transaction.Commit())
+    return false;
+
+  *rows_recovered = total_rows;
+  RecordRecoveryEvent(RECOVERY_SUCCESS_AUTORECOVER_TABLES);
+  return true;
+}
+
 bool Recovery::SetupMeta() {
   const char kCreateSql[] =
       "CREATE VIRTUAL TABLE temp.recover_meta USING recover"
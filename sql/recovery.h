@@ -5,14 +5,14 @@
 #ifndef SQL_RECOVERY_H_
 #define SQL_RECOVERY_H_
 
-#include "base/basictypes.h"
+#include <string>
+#include <vector>
 
+#include "base/basictypes.h"
+#include "base/callback.h"
+#include "base/files/file_path.h"
 #include "sql/connection.h"
 
-namespace base {
-class FilePath;
-}
-
 namespace sql {
 
 // Recovery module for sql/.  The basic idea is to create a fresh
@@ -137,6 +137,39 @@ class SQL_EXPORT Recovery {
                         size_t extend_columns,
                         size_t* rows_recovered);
 
+  // Called by AutoRecoverTables() on the calling thread after each
+  // batch of rows is written, with the name of the table the batch
+  // belonged to and the total number of rows written so far for that
+  // table.
+  typedef base::Callback<void(const std::string& table_name,
+                              size_t rows_recovered)> ProgressCallback;
+
+  // Bulk version of AutoRecoverTable() for large databases.  Each of
+  // |table_names| must already exist in [main], just as for
+  // AutoRecoverTable().  The corrupt database is read through separate
+  // read-only handles on up to |max_threads| worker threads (one table
+  // per worker at a time), while rows are written in batches into the
+  // recovery database on the calling thread using a cached prepared
+  // INSERT OR REPLACE inside a single transaction.  |progress| may be
+  // null.
+  //
+  // The recover virtual table has no notion of partial scans, so the
+  // unit of parallelism is the table rather than a range of pages.
+  // Pages the recover virtual table cannot parse are skipped.  If
+  // reading a table fails outright, the rows read from it up to that
+  // point are kept and the remaining tables are still recovered, where
+  // AutoRecoverTable() would fail and keep nothing.
+  //
+  // Returns true if the recover virtual tables could be setup and all
+  // rows read were written, with the total number of rows written in
+  // |*rows_recovered|.  On failure the transaction is rolled back, so
+  // none of the tables contain recovered rows.
+  bool AutoRecoverTables(const std::vector<std::string>& table_names,
+                         size_t extend_columns,
+                         size_t max_threads,
+                         const ProgressCallback& progress,
+                         size_t* rows_recovered);
+
   // Setup a recover virtual table at temp.recover_meta, reading from
   // corrupt.meta.  Returns true if created.
   // TODO(shess): Perhaps integrate into Begin().
@@ -158,6 +191,22 @@ class SQL_EXPORT Recovery {
   // case anything failed.
   bool Init(const base::FilePath& db_path) WARN_UNUSED_RESULT;
 
+  // Setup |connection| the same way Init() sets up |recover_db_|, so
+  // that it can read the corrupt database through the recover virtual
+  // table module.  |connection| must not already be open.
+  bool InitReader(Connection* connection) WARN_UNUSED_RESULT;
+
+  // Query the schema of |table_name| in [main], filling
+  // |create_column_decls| with the column declarations for a recover
+  // virtual table over corrupt.|table_name|, and |insert_columns| with
+  // the expressions to select from that virtual table when copying to
+  // main.|table_name|.  Returns false if the table does not exist or
+  // uses an unsupported column type.
+  bool GetRecoverColumns(const char* table_name,
+                         size_t extend_columns,
+                         std::vector<std::string>* create_column_decls,
+                         std::vector<std::string>* insert_columns);
+
   // Copy the recovered database over the original database.
   bool Backup() WARN_UNUSED_RESULT;
 
@@ -173,6 +222,9 @@ class SQL_EXPORT Recovery {
   Connection* db_;         // Original database connection.
   Connection recover_db_;  // Recovery connection.
 
+  // Path to the original database, attached at [corrupt].
+  base::FilePath db_path_;
+
   DISALLOW_COPY_AND_ASSIGN(Recovery);
 };
 
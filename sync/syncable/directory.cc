@@ -759,6 +759,7 @@ void Directory::HandleSaveChangesFailure(const SaveChangesSnapshot& snapshot) {
         kernel_->metahandles_map.find((*i)->ref(META_HANDLE));
     if (found != kernel_->metahandles_map.end()) {
       found->second->mark_dirty(&kernel_->dirty_metahandles);
+      found->second->mark_fields_dirty((*i)->dirty_fields());
     }
   }
 
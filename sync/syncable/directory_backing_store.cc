@@ -34,44 +34,52 @@ namespace syncable {
 // modifies all the columns in the entry table.
 static const string::size_type kUpdateStatementBufferSize = 2048;
 
+// Bound on the number of distinct partial UPDATE statements kept prepared.
+// Saves normally touch only a handful of column combinations.
+static const size_t kMaxCachedUpdateStatements = 64;
+
+COMPILE_ASSERT(FIELD_COUNT <= 32, field_set_must_fit_in_an_unsigned_long);
+
 // Increment this version whenever updating DB tables.
 const int32 kCurrentDBVersion = 86;
 
-// Iterate over the fields of |entry| and bind each to |statement| for
-// updating.  Returns the number of args bound.
-void BindFields(const EntryKernel& entry,
-                sql::Statement* statement) {
-  int index = 0;
-  int i = 0;
-  for (i = BEGIN_FIELDS; i < INT64_FIELDS_END; ++i) {
-    statement->BindInt64(index++, entry.ref(static_cast<Int64Field>(i)));
-  }
-  for ( ; i < TIME_FIELDS_END; ++i) {
-    statement->BindInt64(index++,
+// Binds field |i| of |entry| to argument |index| of |statement|.
+void BindField(const EntryKernel& entry,
+               int i,
+               int index,
+               sql::Statement* statement) {
+  if (i < INT64_FIELDS_END) {
+    statement->BindInt64(index, entry.ref(static_cast<Int64Field>(i)));
+  } else if (i < TIME_FIELDS_END) {
+    statement->BindInt64(index,
                          TimeToProtoTime(
                              entry.ref(static_cast<TimeField>(i))));
-  }
-  for ( ; i < ID_FIELDS_END; ++i) {
-    statement->BindString(index++, entry.ref(static_cast<IdField>(i)).s_);
-  }
-  for ( ; i < BIT_FIELDS_END; ++i) {
-    statement->BindInt(index++, entry.ref(static_cast<BitField>(i)));
-  }
-  for ( ; i < STRING_FIELDS_END; ++i) {
-    statement->BindString(index++, entry.ref(static_cast<StringField>(i)));
-  }
-  for ( ; i < PROTO_FIELDS_END; ++i) {
-    std::string temp;
-    entry.ref(static_cast<ProtoField>(i)).SerializeToString(&temp);
-    statement->BindBlob(index++, temp.data(), temp.length());
-  }
-  for ( ; i < UNIQUE_POSITION_FIELDS_END; ++i) {
+  } else if (i < ID_FIELDS_END) {
+    statement->BindString(index, entry.ref(static_cast<IdField>(i)).s_);
+  } else if (i < BIT_FIELDS_END) {
+    statement->BindInt(index, entry.ref(static_cast<BitField>(i)));
+  } else if (i < STRING_FIELDS_END) {
+    statement->BindString(index, entry.ref(static_cast<StringField>(i)));
+  } else if (i < PROTO_FIELDS_END) {
+    const std::string& blob =
+        entry.GetSerializedSpecifics(static_cast<ProtoField>(i));
+    statement->BindBlob(index, blob.data(), blob.length());
+  } else {
+    DCHECK_LT(i, static_cast<int>(UNIQUE_POSITION_FIELDS_END));
     std::string temp;
     entry.ref(static_cast<UniquePositionField>(i)).SerializeToString(&temp);
-    statement->BindBlob(index++, temp.data(), temp.length());
+    statement->BindBlob(index, temp.data(), temp.length());
   }
 }
 
+// Iterate over the fields of |entry| and bind each to |statement| for
+// updating.
+void BindFields(const EntryKernel& entry,
+                sql::Statement* statement) {
+  for (int i = BEGIN_FIELDS; i < FIELD_COUNT; ++i)
+    BindField(entry, i, i, statement);
+}
+
 // The caller owns the returned EntryKernel*.  Assumes the statement currently
 // points to a valid row in the metas table. Returns NULL to indicate that
 // it detected a corruption in the data on unpacking.
@@ -114,6 +122,8 @@ scoped_ptr<EntryKernel> UnpackEntry(sql::Statement* statement) {
     kernel->mutable_ref(static_cast<UniquePositionField>(i)) =
         UniquePosition::FromProto(proto);
   }
+  // Everything matches the database at this point.
+  kernel->clear_dirty_fields();
   return kernel.Pass();
 }
 
@@ -221,7 +231,7 @@ bool DirectoryBackingStore::SaveChanges(
   for (EntryKernelSet::const_iterator i = snapshot.dirty_metas.begin();
        i != snapshot.dirty_metas.end(); ++i) {
     DCHECK((*i)->is_dirty());
-    if (!SaveEntryToDB(&save_meta_statment_, **i))
+    if (!UpdateEntryToDB(**i))
       return false;
   }
 
@@ -598,6 +608,30 @@ bool DirectoryBackingStore::SaveEntryToDB(sql::Statement* save_statement,
   return save_statement->Run();
 }
 
+bool DirectoryBackingStore::UpdateEntryToDB(const EntryKernel& entry) {
+  const EntryKernel::FieldSet& fields = entry.dirty_fields();
+  // New entries need the whole row. So does the occasional entry that was
+  // marked dirty without any field being written.
+  if (fields.none() || fields.test(META_HANDLE))
+    return SaveEntryToDB(&save_meta_statment_, entry);
+
+  sql::Statement* statement = GetUpdateEntryStatement(fields);
+  statement->Reset(true);
+  int index = 0;
+  for (int i = BEGIN_FIELDS; i < FIELD_COUNT; ++i) {
+    if (fields.test(i))
+      BindField(entry, i, index++, statement);
+  }
+  statement->BindInt64(index, entry.ref(META_HANDLE));
+  if (!statement->Run())
+    return false;
+
+  // If the row is somehow missing, fall back to inserting all of it.
+  if (db_->GetLastChangeCount() == 0)
+    return SaveEntryToDB(&save_meta_statment_, entry);
+  return true;
+}
+
 bool DirectoryBackingStore::DropDeletedEntries() {
   if (!db_->Execute("DELETE FROM metas "
                     "WHERE is_del > 0 "
@@ -1500,5 +1534,35 @@ void DirectoryBackingStore::PrepareSaveEntryStatement(
       base::StringPrintf(query.c_str(), "metas").c_str()));
 }
 
+sql::Statement* DirectoryBackingStore::GetUpdateEntryStatement(
+    const EntryKernel::FieldSet& fields) {
+  UpdateStatementMap::iterator it =
+      update_entry_statements_.find(fields.to_ulong());
+  if (it != update_entry_statements_.end())
+    return it->second.get();
+
+  if (update_entry_statements_.size() >= kMaxCachedUpdateStatements)
+    update_entry_statements_.clear();
+
+  string query;
+  query.reserve(kUpdateStatementBufferSize);
+  query.append("UPDATE metas SET ");
+  const char* separator = "";
+  for (int i = BEGIN_FIELDS; i < FIELD_COUNT; ++i) {
+    if (!fields.test(i))
+      continue;
+    query.append(separator);
+    separator = ", ";
+    query.append(ColumnName(i));
+    query.append(" = ?");
+  }
+  query.append(" WHERE metahandle = ?");
+
+  linked_ptr<sql::Statement> statement(
+      new sql::Statement(db_->GetUniqueStatement(query.c_str())));
+  update_entry_statements_[fields.to_ulong()] = statement;
+  return statement.get();
+}
+
 }  // namespace syncable
 }  // namespace syncer
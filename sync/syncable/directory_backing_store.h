@@ -5,8 +5,10 @@
 #ifndef SYNC_SYNCABLE_DIRECTORY_BACKING_STORE_H_
 #define SYNC_SYNCABLE_DIRECTORY_BACKING_STORE_H_
 
+#include <map>
 #include <string>
 
+#include "base/memory/linked_ptr.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/threading/non_thread_safe.h"
 #include "sql/connection.h"
@@ -104,6 +106,8 @@ class SYNC_EXPORT_PRIVATE DirectoryBackingStore : public base::NonThreadSafe {
   static bool SaveEntryToDB(sql::Statement* save_statement,
                             const EntryKernel& entry);
   bool SaveNewEntryToDB(const EntryKernel& entry);
+  // Writes only the entry's dirty fields to its existing row in metas, or the
+  // whole row for new entries.
   bool UpdateEntryToDB(const EntryKernel& entry);
 
   // Close save_dbhandle_.  Broken out for testing.
@@ -185,6 +189,15 @@ class SYNC_EXPORT_PRIVATE DirectoryBackingStore : public base::NonThreadSafe {
   void PrepareSaveEntryStatement(EntryTable table,
                                  sql::Statement* save_statement);
 
+  // Returns a prepared "UPDATE metas" statement that sets the columns in
+  // |fields|, in field order, followed by the metahandle to match.
+  sql::Statement* GetUpdateEntryStatement(const EntryKernel::FieldSet& fields);
+
+  // Statements from GetUpdateEntryStatement(), keyed by field set.
+  typedef std::map<unsigned long, linked_ptr<sql::Statement> >
+      UpdateStatementMap;
+  UpdateStatementMap update_entry_statements_;
+
   DISALLOW_COPY_AND_ASSIGN(DirectoryBackingStore);
 };
 
@@ -17,10 +17,22 @@ EntryKernel::EntryKernel() : dirty_(false) {
   for (int i = INT64_FIELDS_BEGIN; i < INT64_FIELDS_END; ++i) {
     int64_fields[i] = 0;
   }
+  // Nothing of a new entry is in the database yet.
+  dirty_fields_.set();
 }
 
 EntryKernel::~EntryKernel() {}
 
+const std::string& EntryKernel::GetSerializedSpecifics(
+    ProtoField field) const {
+  int index = field - PROTO_FIELDS_BEGIN;
+  if (!serialized_specifics_valid_[index]) {
+    specifics_fields[index].SerializeToString(&serialized_specifics_[index]);
+    serialized_specifics_valid_.set(index);
+  }
+  return serialized_specifics_[index];
+}
+
 ModelType EntryKernel::GetModelType() const {
   ModelType specifics_type = GetModelTypeFromSpecifics(ref(SPECIFICS));
   if (specifics_type != UNSPECIFIED)
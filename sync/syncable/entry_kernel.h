@@ -5,6 +5,7 @@
 #ifndef SYNC_SYNCABLE_ENTRY_KERNEL_H_
 #define SYNC_SYNCABLE_ENTRY_KERNEL_H_
 
+#include <bitset>
 #include <set>
 
 #include "base/time/time.h"
@@ -176,6 +177,9 @@ enum {
 
 
 struct SYNC_EXPORT_PRIVATE EntryKernel {
+  // A set of persisted fields, indexed by their enum values.
+  typedef std::bitset<FIELD_COUNT> FieldSet;
+
  private:
   std::string string_fields[STRING_FIELDS_COUNT];
   sync_pb::EntitySpecifics specifics_fields[PROTO_FIELDS_COUNT];
@@ -210,47 +214,85 @@ struct SYNC_EXPORT_PRIVATE EntryKernel {
       dirty_index->erase(ref(META_HANDLE));
     }
     dirty_ = false;
+    dirty_fields_.reset();
   }
 
   inline bool is_dirty() const {
     return dirty_;
   }
 
+  // The persisted fields written since the entry was loaded or last saved,
+  // so the backing store can update only those columns. A new kernel starts
+  // with every field dirty.
+  inline const FieldSet& dirty_fields() const {
+    return dirty_fields_;
+  }
+
+  // Adds |fields| to dirty_fields(), e.g. to retry them after a failed save.
+  inline void mark_fields_dirty(const FieldSet& fields) {
+    dirty_fields_ |= fields;
+  }
+
+  // Empties dirty_fields(); used for kernels just read from the database.
+  inline void clear_dirty_fields() {
+    dirty_fields_.reset();
+  }
+
   // Setters.
   inline void put(MetahandleField field, int64 value) {
+    dirty_fields_.set(field);
     int64_fields[field - INT64_FIELDS_BEGIN] = value;
   }
   inline void put(Int64Field field, int64 value) {
+    dirty_fields_.set(field);
     int64_fields[field - INT64_FIELDS_BEGIN] = value;
   }
   inline void put(TimeField field, const base::Time& value) {
+    dirty_fields_.set(field);
     // Round-trip to proto time format and back so that we have
     // consistent time resolutions (ms).
     time_fields[field - TIME_FIELDS_BEGIN] =
         ProtoTimeToTime(TimeToProtoTime(value));
   }
   inline void put(IdField field, const Id& value) {
+    dirty_fields_.set(field);
     id_fields[field - ID_FIELDS_BEGIN] = value;
   }
   inline void put(BaseVersion field, int64 value) {
+    dirty_fields_.set(field);
     int64_fields[field - INT64_FIELDS_BEGIN] = value;
   }
   inline void put(IndexedBitField field, bool value) {
+    dirty_fields_.set(field);
     bit_fields[field - BIT_FIELDS_BEGIN] = value;
   }
   inline void put(IsDelField field, bool value) {
+    dirty_fields_.set(field);
     bit_fields[field - BIT_FIELDS_BEGIN] = value;
   }
   inline void put(BitField field, bool value) {
+    dirty_fields_.set(field);
     bit_fields[field - BIT_FIELDS_BEGIN] = value;
   }
   inline void put(StringField field, const std::string& value) {
+    dirty_fields_.set(field);
     string_fields[field - STRING_FIELDS_BEGIN] = value;
   }
   inline void put(ProtoField field, const sync_pb::EntitySpecifics& value) {
+    dirty_fields_.set(field);
     specifics_fields[field - PROTO_FIELDS_BEGIN].CopyFrom(value);
+    serialized_specifics_valid_.reset(field - PROTO_FIELDS_BEGIN);
+  }
+  // As above, for callers that already have |value| serialized; it is kept
+  // for GetSerializedSpecifics().
+  inline void put(ProtoField field, const sync_pb::EntitySpecifics& value,
+                  const std::string& serialized_value) {
+    put(field, value);
+    serialized_specifics_[field - PROTO_FIELDS_BEGIN] = serialized_value;
+    serialized_specifics_valid_.set(field - PROTO_FIELDS_BEGIN);
   }
   inline void put(UniquePositionField field, const UniquePosition& value) {
+    dirty_fields_.set(field);
     unique_position_fields[field - UNIQUE_POSITION_FIELDS_BEGIN] = value;
   }
   inline void put(BitTemp field, bool value) {
@@ -295,17 +337,27 @@ struct SYNC_EXPORT_PRIVATE EntryKernel {
     return bit_temps[field - BIT_TEMPS_BEGIN];
   }
 
-  // Non-const, mutable ref getters for object types only.
+  // Returns the serialized form of a specifics field. It is computed on first
+  // use and kept until the field is written again.
+  const std::string& GetSerializedSpecifics(ProtoField field) const;
+
+  // Non-const, mutable ref getters for object types only. These count as
+  // writes to the field.
   inline std::string& mutable_ref(StringField field) {
+    dirty_fields_.set(field);
     return string_fields[field - STRING_FIELDS_BEGIN];
   }
   inline sync_pb::EntitySpecifics& mutable_ref(ProtoField field) {
+    dirty_fields_.set(field);
+    serialized_specifics_valid_.reset(field - PROTO_FIELDS_BEGIN);
     return specifics_fields[field - PROTO_FIELDS_BEGIN];
   }
   inline Id& mutable_ref(IdField field) {
+    dirty_fields_.set(field);
     return id_fields[field - ID_FIELDS_BEGIN];
   }
   inline UniquePosition& mutable_ref(UniquePositionField field) {
+    dirty_fields_.set(field);
     return unique_position_fields[field - UNIQUE_POSITION_FIELDS_BEGIN];
   }
 
@@ -323,6 +375,13 @@ struct SYNC_EXPORT_PRIVATE EntryKernel {
  private:
   // Tracks whether this entry needs to be saved to the database.
   bool dirty_;
+
+  // Which fields need to be saved; see dirty_fields().
+  FieldSet dirty_fields_;
+
+  // Cache for GetSerializedSpecifics(), valid where the bit is set.
+  mutable std::string serialized_specifics_[PROTO_FIELDS_COUNT];
+  mutable std::bitset<PROTO_FIELDS_COUNT> serialized_specifics_valid_;
 };
 
 class EntryKernelLessByMetaHandle {
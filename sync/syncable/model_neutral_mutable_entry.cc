@@ -297,10 +297,8 @@ void ModelNeutralMutableEntry::PutServerSpecifics(
   DCHECK(kernel_);
   CHECK(!value.password().has_client_only_encrypted_data());
   base_write_transaction_->TrackChangesTo(kernel_);
-  // TODO(ncarter): This is unfortunately heavyweight.  Can we do
-  // better?
-  if (kernel_->ref(SERVER_SPECIFICS).SerializeAsString() !=
-      value.SerializeAsString()) {
+  std::string serialized_value = value.SerializeAsString();
+  if (kernel_->GetSerializedSpecifics(SERVER_SPECIFICS) != serialized_value) {
     if (kernel_->ref(IS_UNAPPLIED_UPDATE)) {
       // Remove ourselves from unapplied_update_metahandles with our
       // old server type.
@@ -312,7 +310,7 @@ void ModelNeutralMutableEntry::PutServerSpecifics(
       DCHECK_EQ(erase_count, 1u);
     }
 
-    kernel_->put(SERVER_SPECIFICS, value);
+    kernel_->put(SERVER_SPECIFICS, value, serialized_value);
     kernel_->mark_dirty(&dir()->kernel_->dirty_metahandles);
 
     if (kernel_->ref(IS_UNAPPLIED_UPDATE)) {
@@ -331,11 +329,10 @@ void ModelNeutralMutableEntry::PutBaseServerSpecifics(
   DCHECK(kernel_);
   CHECK(!value.password().has_client_only_encrypted_data());
   base_write_transaction_->TrackChangesTo(kernel_);
-  // TODO(ncarter): This is unfortunately heavyweight.  Can we do
-  // better?
-  if (kernel_->ref(BASE_SERVER_SPECIFICS).SerializeAsString()
-      != value.SerializeAsString()) {
-    kernel_->put(BASE_SERVER_SPECIFICS, value);
+  std::string serialized_value = value.SerializeAsString();
+  if (kernel_->GetSerializedSpecifics(BASE_SERVER_SPECIFICS) !=
+      serialized_value) {
+    kernel_->put(BASE_SERVER_SPECIFICS, value, serialized_value);
     kernel_->mark_dirty(&dir()->kernel_->dirty_metahandles);
   }
 }
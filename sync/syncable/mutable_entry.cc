@@ -202,11 +202,11 @@ void MutableEntry::PutSpecifics(const sync_pb::EntitySpecifics& value) {
   DCHECK(kernel_);
   CHECK(!value.password().has_client_only_encrypted_data());
   write_transaction()->TrackChangesTo(kernel_);
-  // TODO(ncarter): This is unfortunately heavyweight.  Can we do
-  // better?
-  if (kernel_->ref(SPECIFICS).SerializeAsString() !=
-      value.SerializeAsString()) {
-    kernel_->put(SPECIFICS, value);
+  // The kernel keeps its side of the comparison serialized, and the new
+  // value is handed over in serialized form for the next comparison and save.
+  std::string serialized_value = value.SerializeAsString();
+  if (kernel_->GetSerializedSpecifics(SPECIFICS) != serialized_value) {
+    kernel_->put(SPECIFICS, value, serialized_value);
     kernel_->mark_dirty(&dir()->kernel_->dirty_metahandles);
   }
 }
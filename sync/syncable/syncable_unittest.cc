@@ -18,8 +18,10 @@
 #include "base/synchronization/condition_variable.h"
 #include "base/test/values_test_util.h"
 #include "base/threading/platform_thread.h"
+#include "base/time/time.h"
 #include "base/values.h"
 #include "sync/protocol/bookmark_specifics.pb.h"
+#include "sync/protocol/history_delete_directive_specifics.pb.h"
 #include "sync/syncable/directory_backing_store.h"
 #include "sync/syncable/directory_change_delegate.h"
 #include "sync/syncable/in_memory_directory_backing_store.h"
@@ -62,6 +64,57 @@ TEST_F(SyncableKernelTest, ToValue) {
   }
 }
 
+TEST_F(SyncableKernelTest, DirtyFields) {
+  EntryKernel kernel;
+  // None of a new entry is in the database yet.
+  EXPECT_TRUE(kernel.dirty_fields().all());
+
+  kernel.put(META_HANDLE, 1);
+  kernel.mark_dirty(NULL);
+  kernel.clear_dirty(NULL);
+  EXPECT_TRUE(kernel.dirty_fields().none());
+
+  EntryKernel::FieldSet expected;
+  kernel.put(NON_UNIQUE_NAME, "name");
+  expected.set(NON_UNIQUE_NAME);
+  kernel.put(IS_UNSYNCED, true);
+  expected.set(IS_UNSYNCED);
+  kernel.mutable_ref(SPECIFICS).mutable_bookmark()->set_url("http://a/");
+  expected.set(SPECIFICS);
+  // Temporaries are never saved.
+  kernel.put(SYNCING, true);
+  EXPECT_EQ(expected, kernel.dirty_fields());
+
+  // A copy, like the one SaveChanges() writes out, keeps the dirty fields.
+  EntryKernel copy(kernel);
+  kernel.clear_dirty(NULL);
+  EXPECT_EQ(expected, copy.dirty_fields());
+  kernel.mark_fields_dirty(copy.dirty_fields());
+  EXPECT_EQ(expected, kernel.dirty_fields());
+}
+
+TEST_F(SyncableKernelTest, SerializedSpecifics) {
+  EntryKernel kernel;
+  EXPECT_EQ(std::string(), kernel.GetSerializedSpecifics(SPECIFICS));
+
+  sync_pb::EntitySpecifics specifics;
+  specifics.mutable_bookmark()->set_url("http://a/");
+  kernel.put(SPECIFICS, specifics);
+  EXPECT_EQ(specifics.SerializeAsString(),
+            kernel.GetSerializedSpecifics(SPECIFICS));
+
+  // Writing through mutable_ref() invalidates the cached copy.
+  kernel.mutable_ref(SPECIFICS).mutable_bookmark()->set_url("http://b/");
+  EXPECT_EQ(kernel.ref(SPECIFICS).SerializeAsString(),
+            kernel.GetSerializedSpecifics(SPECIFICS));
+
+  // So does put().
+  kernel.put(SPECIFICS, specifics);
+  EXPECT_EQ(specifics.SerializeAsString(),
+            kernel.GetSerializedSpecifics(SPECIFICS));
+  EXPECT_EQ(std::string(), kernel.GetSerializedSpecifics(SERVER_SPECIFICS));
+}
+
 namespace {
 void PutDataAsBookmarkFavicon(WriteTransaction* wtrans,
                               MutableEntry* e,
@@ -2039,6 +2092,143 @@ TEST_F(OnDiskSyncableDirectoryTest, TestSaveChangesFailureWithPurge) {
   EXPECT_TRUE(IsInMetahandlesToPurge(handle1));
 }
 
+// Test that saving only the changed columns of existing rows loses nothing.
+TEST_F(OnDiskSyncableDirectoryTest, TestPartialUpdatesSurviveReload) {
+  int64 handle = 0;
+  {
+    WriteTransaction trans(FROM_HERE, UNITTEST, dir_.get());
+    MutableEntry e(&trans, CREATE, BOOKMARKS, trans.root_id(), "britney");
+    ASSERT_TRUE(e.good());
+    handle = e.GetMetahandle();
+    e.PutId(TestIdFactory::FromNumber(101));
+    e.PutBaseVersion(1);
+    sync_pb::EntitySpecifics specifics;
+    specifics.mutable_bookmark()->set_url("http://toxic/");
+    e.PutSpecifics(specifics);
+    e.PutServerSpecifics(specifics);
+  }
+  SaveAndReloadDir();
+
+  scoped_ptr<base::DictionaryValue> before;
+  {
+    WriteTransaction trans(FROM_HERE, UNITTEST, dir_.get());
+    MutableEntry e(&trans, GET_BY_HANDLE, handle);
+    ASSERT_TRUE(e.good());
+    EXPECT_TRUE(e.GetKernelCopy().dirty_fields().none());
+    e.PutNonUniqueName("spears");
+    sync_pb::EntitySpecifics specifics;
+    specifics.mutable_bookmark()->set_url("http://womanizer/");
+    e.PutSpecifics(specifics);
+    e.PutIsUnsynced(true);
+    e.PutMtime(base::Time::FromDoubleT(1234));
+
+    EntryKernel::FieldSet dirty_fields = e.GetKernelCopy().dirty_fields();
+    EXPECT_TRUE(dirty_fields.test(NON_UNIQUE_NAME));
+    EXPECT_TRUE(dirty_fields.test(SPECIFICS));
+    EXPECT_FALSE(dirty_fields.test(SERVER_SPECIFICS));
+    EXPECT_FALSE(dirty_fields.test(ID));
+  }
+  {
+    ReadTransaction trans(FROM_HERE, dir_.get());
+    Entry e(&trans, GET_BY_HANDLE, handle);
+    before.reset(e.GetKernelCopy().ToValue(NULL));
+  }
+  SaveAndReloadDir();
+
+  {
+    ReadTransaction trans(FROM_HERE, dir_.get());
+    Entry e(&trans, GET_BY_HANDLE, handle);
+    ASSERT_TRUE(e.good());
+    scoped_ptr<base::DictionaryValue> after(e.GetKernelCopy().ToValue(NULL));
+    // |before| was still dirty.
+    before->SetBoolean("isDirty", false);
+    EXPECT_TRUE(before->Equals(after.get()));
+  }
+}
+
+// Test that a failed save leaves the unsaved fields dirty for the next one.
+TEST_F(OnDiskSyncableDirectoryTest, TestSaveChangesFailureKeepsDirtyFields) {
+  int64 handle = 0;
+  {
+    WriteTransaction trans(FROM_HERE, UNITTEST, dir_.get());
+    MutableEntry e(&trans, CREATE, BOOKMARKS, trans.root_id(), "aguilera");
+    ASSERT_TRUE(e.good());
+    handle = e.GetMetahandle();
+    e.PutId(TestIdFactory::FromNumber(101));
+  }
+  ASSERT_TRUE(dir_->SaveChanges());
+
+  StartFailingSaveChanges();
+  {
+    WriteTransaction trans(FROM_HERE, UNITTEST, dir_.get());
+    MutableEntry e(&trans, GET_BY_HANDLE, handle);
+    ASSERT_TRUE(e.good());
+    e.PutNonUniqueName("christina");
+  }
+  ASSERT_FALSE(dir_->SaveChanges());
+
+  {
+    ReadTransaction trans(FROM_HERE, dir_.get());
+    Entry e(&trans, GET_BY_HANDLE, handle);
+    ASSERT_TRUE(e.good());
+    EXPECT_TRUE(e.GetKernelCopy().dirty_fields().test(NON_UNIQUE_NAME));
+    EXPECT_FALSE(e.GetKernelCopy().dirty_fields().test(ID));
+  }
+}
+
+// Measures SaveChanges() on a large directory after small batches of edits.
+TEST_F(OnDiskSyncableDirectoryTest, DISABLED_SaveChangesPerf) {
+  const int kNumEntries = 100000;
+  const int kEditsPerSave = 100;
+  const int kNumSaves = 20;
+
+  std::vector<int64> handles;
+  handles.reserve(kNumEntries);
+  {
+    WriteTransaction trans(FROM_HERE, UNITTEST, dir_.get());
+    for (int i = 0; i < kNumEntries; ++i) {
+      MutableEntry e(&trans, CREATE, HISTORY_DELETE_DIRECTIVES,
+                     trans.root_id(), base::StringPrintf("directive%d", i));
+      ASSERT_TRUE(e.good());
+      handles.push_back(e.GetMetahandle());
+      e.PutId(TestIdFactory::FromNumber(i + 1));
+      e.PutBaseVersion(1);
+      sync_pb::EntitySpecifics specifics;
+      sync_pb::GlobalIdDirective* directive = specifics
+          .mutable_history_delete_directive()->mutable_global_id_directive();
+      for (int j = 0; j < 20; ++j)
+        directive->add_global_id(static_cast<int64>(i) * 100 + j);
+      e.PutSpecifics(specifics);
+      e.PutServerSpecifics(specifics);
+    }
+  }
+  base::TimeTicks start = base::TimeTicks::Now();
+  ASSERT_TRUE(dir_->SaveChanges());
+  LOG(INFO) << base::StringPrintf(
+      "Initial save of %d entries: %.1f ms", kNumEntries,
+      (base::TimeTicks::Now() - start).InMillisecondsF());
+
+  base::TimeDelta total;
+  for (int round = 0; round < kNumSaves; ++round) {
+    {
+      WriteTransaction trans(FROM_HERE, UNITTEST, dir_.get());
+      for (int i = 0; i < kEditsPerSave; ++i) {
+        int64 handle = handles[(round * 7919 + i * 104729) % kNumEntries];
+        MutableEntry e(&trans, GET_BY_HANDLE, handle);
+        ASSERT_TRUE(e.good());
+        e.PutIsUnsynced(!e.GetIsUnsynced());
+        e.PutMtime(base::Time::FromDoubleT(round * 1000 + i));
+      }
+    }
+    start = base::TimeTicks::Now();
+    ASSERT_TRUE(dir_->SaveChanges());
+    total += base::TimeTicks::Now() - start;
+  }
+  LOG(INFO) << base::StringPrintf(
+      "Saving %d edited entries out of %d: %.2f ms per save",
+      kEditsPerSave, kNumEntries, total.InMillisecondsF() / kNumSaves);
+}
+
 }  // namespace
 
 void SyncableDirectoryTest::ValidateEntry(BaseTransaction* trans,
@@ -6,6 +6,8 @@
 
 #include <setjmp.h>
 
+#include <algorithm>
+
 #include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
 #include "third_party/skia/include/core/SkBitmap.h"
@@ -404,28 +406,35 @@ void TermSource(j_decompress_ptr cinfo) {
 
 #if !defined(JCS_EXTENSIONS)
 // Converts one row of rgb data to rgba data by adding a fully-opaque alpha
-// value.
+// value. Pixels are converted from the end of the row backwards, so |rgb| may
+// point at the start of |rgba| to expand a row in place.
 void AddAlpha(const unsigned char* rgb, int pixel_width, unsigned char* rgba) {
-  for (int x = 0; x < pixel_width; x++) {
+  for (int x = pixel_width - 1; x >= 0; x--) {
     const unsigned char* pixel_in = &rgb[x * 3];
     unsigned char* pixel_out = &rgba[x * 4];
-    pixel_out[0] = pixel_in[0];
-    pixel_out[1] = pixel_in[1];
-    pixel_out[2] = pixel_in[2];
+    unsigned char r = pixel_in[0];
+    unsigned char g = pixel_in[1];
+    unsigned char b = pixel_in[2];
+    pixel_out[0] = r;
+    pixel_out[1] = g;
+    pixel_out[2] = b;
     pixel_out[3] = 0xff;
   }
 }
 
 // Converts one row of RGB data to BGRA by reordering the color components and
-// adding alpha values of 0xff.
-void RGBtoBGRA(const unsigned char* bgra, int pixel_width, unsigned char* rgb)
+// adding alpha values of 0xff. Like AddAlpha(), this works in place.
+void RGBtoBGRA(const unsigned char* rgb, int pixel_width, unsigned char* bgra)
 {
-  for (int x = 0; x < pixel_width; x++) {
-    const unsigned char* pixel_in = &bgra[x * 3];
-    unsigned char* pixel_out = &rgb[x * 4];
-    pixel_out[0] = pixel_in[2];
-    pixel_out[1] = pixel_in[1];
-    pixel_out[2] = pixel_in[0];
+  for (int x = pixel_width - 1; x >= 0; x--) {
+    const unsigned char* pixel_in = &rgb[x * 3];
+    unsigned char* pixel_out = &bgra[x * 4];
+    unsigned char r = pixel_in[0];
+    unsigned char g = pixel_in[1];
+    unsigned char b = pixel_in[2];
+    pixel_out[0] = b;
+    pixel_out[1] = g;
+    pixel_out[2] = r;
     pixel_out[3] = 0xff;
   }
 }
@@ -455,15 +464,37 @@ class DecompressDestroyer {
   jpeg_decompress_struct* cinfo_;
 };
 
-}  // namespace
+// Returns the libjpeg scale denominator to decode |region| with so that the
+// result is no smaller than |min_size|. The numerator is always 1: scaling by
+// 1/2, 1/4 and 1/8 is supported by every libjpeg variant we build against.
+int ScaleDenominatorFor(const gfx::Rect& region, const gfx::Size& min_size) {
+  if (min_size.IsEmpty())
+    return 1;
+  for (int denom = 8; denom > 1; denom /= 2) {
+    if ((region.width() + denom - 1) / denom >= min_size.width() &&
+        (region.height() + denom - 1) / denom >= min_size.height())
+      return denom;
+  }
+  return 1;
+}
 
-bool JPEGCodec::Decode(const unsigned char* input, size_t input_size,
-                       ColorFormat format, std::vector<unsigned char>* output,
-                       int* w, int* h) {
+// Does the work for all the JPEGCodec::Decode variants. The pixels go to
+// |output_vector|, resized to fit, or, if that is NULL, into newly allocated
+// pixels of |output_bitmap|.
+bool DoDecode(const unsigned char* input, size_t input_size,
+              JPEGCodec::ColorFormat format,
+              const JPEGCodec::DecodeOptions& options,
+              std::vector<unsigned char>* output_vector,
+              SkBitmap* output_bitmap,
+              int* w, int* h) {
   jpeg_decompress_struct cinfo;
   DecompressDestroyer destroyer;
   destroyer.SetManagedObject(&cinfo);
-  output->clear();
+  if (output_vector)
+    output_vector->clear();
+
+  // Allocated before setjmp() so it is not leaked by an error exit.
+  std::vector<unsigned char> scratch_row;
 
   // We set up the normal JPEG error routines, then override error_exit.
   // This must be done before the call to create_decompress.
@@ -509,15 +540,17 @@ bool JPEGCodec::Decode(const unsigned char* input, size_t input_size,
       // Same as JPEGCodec::Encode(), libjpeg-turbo supports all input formats
       // used by Chromium (i.e. RGB, RGBA, and BGRA) and we just map the input
       // parameters to a colorspace.
-      if (format == FORMAT_RGB) {
+      if (format == JPEGCodec::FORMAT_RGB) {
         cinfo.out_color_space = JCS_RGB;
         cinfo.output_components = 3;
-      } else if (format == FORMAT_RGBA ||
-                 (format == FORMAT_SkBitmap && SK_R32_SHIFT == 0)) {
+      } else if (format == JPEGCodec::FORMAT_RGBA ||
+                 (format == JPEGCodec::FORMAT_SkBitmap &&
+                  SK_R32_SHIFT == 0)) {
         cinfo.out_color_space = JCS_EXT_RGBX;
         cinfo.output_components = 4;
-      } else if (format == FORMAT_BGRA ||
-                 (format == FORMAT_SkBitmap && SK_B32_SHIFT == 0)) {
+      } else if (format == JPEGCodec::FORMAT_BGRA ||
+                 (format == JPEGCodec::FORMAT_SkBitmap &&
+                  SK_B32_SHIFT == 0)) {
         cinfo.out_color_space = JCS_EXT_BGRX;
         cinfo.output_components = 4;
       } else {
@@ -542,91 +575,174 @@ bool JPEGCodec::Decode(const unsigned char* input, size_t input_size,
   cinfo.output_components = 3;
 #endif
 
+  // Pick the row converter and the number of bytes per output pixel.
+  void (*converter)(const unsigned char* in, int w, unsigned char* out);
+  int output_bytes_per_pixel;
+#ifdef JCS_EXTENSIONS
+  converter = NULL;
+  output_bytes_per_pixel = cinfo.output_components;
+#else
+  if (format == JPEGCodec::FORMAT_RGB) {
+    converter = NULL;
+    output_bytes_per_pixel = 3;
+  } else if (format == JPEGCodec::FORMAT_RGBA ||
+             (format == JPEGCodec::FORMAT_SkBitmap && SK_R32_SHIFT == 0)) {
+    converter = AddAlpha;
+    output_bytes_per_pixel = 4;
+  } else if (format == JPEGCodec::FORMAT_BGRA ||
+             (format == JPEGCodec::FORMAT_SkBitmap && SK_B32_SHIFT == 0)) {
+    converter = RGBtoBGRA;
+    output_bytes_per_pixel = 4;
+  } else {
+    NOTREACHED() << "Invalid pixel format";
+    return false;
+  }
+#endif
+  if (output_bitmap && output_bytes_per_pixel != 4) {
+    NOTREACHED() << "SkBitmap output needs a 4 byte format";
+    return false;
+  }
+
+  // Clip the requested region to the image and pick the scale.
+  gfx::Rect image_rect(cinfo.image_width, cinfo.image_height);
+  gfx::Rect region = image_rect;
+  if (!options.region.IsEmpty()) {
+    region.Intersect(options.region);
+    if (region.IsEmpty())
+      return false;
+  }
+  int denom = ScaleDenominatorFor(region, options.min_size);
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = denom;
   jpeg_calc_output_dimensions(&cinfo);
-  *w = cinfo.output_width;
-  *h = cinfo.output_height;
+
+  // The region in output (scaled) pixels. Partially covered pixels on the
+  // edges are included.
+  int scaled_x = region.x() / denom;
+  int scaled_y = region.y() / denom;
+  int scaled_right = std::min(static_cast<int>(cinfo.output_width),
+                              (region.right() + denom - 1) / denom);
+  int scaled_bottom = std::min(static_cast<int>(cinfo.output_height),
+                               (region.bottom() + denom - 1) / denom);
+  *w = scaled_right - scaled_x;
+  *h = scaled_bottom - scaled_y;
 
   jpeg_start_decompress(&cinfo);
 
-  // FIXME(brettw) we may want to allow the capability for callers to request
-  // how to align row lengths as we do for the compressor.
+  // Offset of the region within each decoded scanline, in pixels.
+  int column_offset = scaled_x;
+  int rows_to_skip = scaled_y;
+#if defined(LIBJPEG_TURBO_VERSION_NUMBER)
+  // libjpeg-turbo can avoid decoding the columns and rows outside the region.
+  // Cropping is done in whole iMCUs, so it may give us a few extra columns on
+  // the left.
+  if (*w != static_cast<int>(cinfo.output_width)) {
+    JDIMENSION crop_x = scaled_x;
+    JDIMENSION crop_width = *w;
+    jpeg_crop_scanline(&cinfo, &crop_x, &crop_width);
+    column_offset = scaled_x - crop_x;
+  }
+  if (rows_to_skip) {
+    if (jpeg_skip_scanlines(&cinfo, rows_to_skip) !=
+        static_cast<JDIMENSION>(rows_to_skip))
+      return false;
+    rows_to_skip = 0;
+  }
+#endif
+
   int row_read_stride = cinfo.output_width * cinfo.output_components;
+  int row_write_bytes = *w * output_bytes_per_pixel;
+
+  unsigned char* output_pixels;
+  int row_write_stride;
+  if (output_vector) {
+    row_write_stride = row_write_bytes;
+    output_vector->resize(row_write_stride * *h);
+    output_pixels = &(*output_vector)[0];
+  } else {
+    output_bitmap->setConfig(SkBitmap::kARGB_8888_Config, *w, *h);
+    if (!output_bitmap->allocPixels())
+      return false;
+    output_pixels = static_cast<unsigned char*>(output_bitmap->getPixels());
+    row_write_stride = output_bitmap->rowBytes();
+  }
 
-#ifdef JCS_EXTENSIONS
-  // Create memory for a decoded image and write decoded lines to the memory
-  // without conversions same as JPEGCodec::Encode().
-  int row_write_stride = row_read_stride;
-  output->resize(row_write_stride * cinfo.output_height);
+  // When the decoded scanline is exactly the output row, libjpeg writes into
+  // the output and any RGB expansion happens in place. Otherwise scanlines go
+  // through a scratch row and only the region is copied out.
+  bool read_in_place = column_offset == 0 &&
+      static_cast<int>(cinfo.output_width) == *w;
+  if (!read_in_place || rows_to_skip)
+    scratch_row.resize(row_read_stride);
 
-  for (int row = 0; row < static_cast<int>(cinfo.output_height); row++) {
-    unsigned char* rowptr = &(*output)[row * row_write_stride];
+  for (int row = 0; row < rows_to_skip; row++) {
+    unsigned char* rowptr = &scratch_row[0];
     if (!jpeg_read_scanlines(&cinfo, &rowptr, 1))
       return false;
   }
-#else
-  if (format == FORMAT_RGB) {
-    // easy case, row needs no conversion
-    int row_write_stride = row_read_stride;
-    output->resize(row_write_stride * cinfo.output_height);
 
-    for (int row = 0; row < static_cast<int>(cinfo.output_height); row++) {
-      unsigned char* rowptr = &(*output)[row * row_write_stride];
-      if (!jpeg_read_scanlines(&cinfo, &rowptr, 1))
-        return false;
-    }
-  } else {
-    // Rows need conversion to output format: read into a temporary buffer and
-    // expand to the final one. Performance: we could avoid the extra
-    // allocation by doing the expansion in-place.
-    int row_write_stride;
-    void (*converter)(const unsigned char* rgb, int w, unsigned char* out);
-    if (format == FORMAT_RGBA ||
-        (format == FORMAT_SkBitmap && SK_R32_SHIFT == 0)) {
-      row_write_stride = cinfo.output_width * 4;
-      converter = AddAlpha;
-    } else if (format == FORMAT_BGRA ||
-               (format == FORMAT_SkBitmap && SK_B32_SHIFT == 0)) {
-      row_write_stride = cinfo.output_width * 4;
-      converter = RGBtoBGRA;
-    } else {
-      NOTREACHED() << "Invalid pixel format";
-      jpeg_destroy_decompress(&cinfo);
+  for (int row = 0; row < *h; row++) {
+    unsigned char* out = output_pixels + row * row_write_stride;
+    unsigned char* rowptr = read_in_place ? out : &scratch_row[0];
+    if (!jpeg_read_scanlines(&cinfo, &rowptr, 1))
       return false;
-    }
-
-    output->resize(row_write_stride * cinfo.output_height);
-
-    scoped_ptr<unsigned char[]> row_data(new unsigned char[row_read_stride]);
-    unsigned char* rowptr = row_data.get();
-    for (int row = 0; row < static_cast<int>(cinfo.output_height); row++) {
-      if (!jpeg_read_scanlines(&cinfo, &rowptr, 1))
-        return false;
-      converter(rowptr, *w, &(*output)[row * row_write_stride]);
-    }
+    const unsigned char* in = rowptr + column_offset * cinfo.output_components;
+    if (converter)
+      converter(in, *w, out);
+    else if (!read_in_place)
+      memcpy(out, in, row_write_bytes);
   }
-#endif
 
-  jpeg_finish_decompress(&cinfo);
+  // Stop early if the region ended above the bottom of the image;
+  // jpeg_finish_decompress() insists that every scanline has been read.
+  if (cinfo.output_scanline < cinfo.output_height)
+    jpeg_abort_decompress(&cinfo);
+  else
+    jpeg_finish_decompress(&cinfo);
   jpeg_destroy_decompress(&cinfo);
   return true;
 }
 
+}  // namespace
+
+JPEGCodec::DecodeOptions::DecodeOptions() {
+}
+
+JPEGCodec::DecodeOptions::~DecodeOptions() {
+}
+
+bool JPEGCodec::Decode(const unsigned char* input, size_t input_size,
+                       ColorFormat format, std::vector<unsigned char>* output,
+                       int* w, int* h) {
+  return DoDecode(input, input_size, format, DecodeOptions(), output, NULL,
+                  w, h);
+}
+
 // static
 SkBitmap* JPEGCodec::Decode(const unsigned char* input, size_t input_size) {
-  int w, h;
-  std::vector<unsigned char> data_vector;
-  if (!Decode(input, input_size, FORMAT_SkBitmap, &data_vector, &w, &h))
-    return NULL;
-
-  // Skia only handles 32 bit images.
-  int data_length = w * h * 4;
+  return DecodeWithOptions(input, input_size, DecodeOptions());
+}
 
-  SkBitmap* bitmap = new SkBitmap();
-  bitmap->setConfig(SkBitmap::kARGB_8888_Config, w, h);
-  bitmap->allocPixels();
-  memcpy(bitmap->getAddr32(0, 0), &data_vector[0], data_length);
+// static
+bool JPEGCodec::DecodeWithOptions(const unsigned char* input,
+                                  size_t input_size,
+                                  ColorFormat format,
+                                  const DecodeOptions& options,
+                                  std::vector<unsigned char>* output,
+                                  int* w, int* h) {
+  return DoDecode(input, input_size, format, options, output, NULL, w, h);
+}
 
-  return bitmap;
+// static
+SkBitmap* JPEGCodec::DecodeWithOptions(const unsigned char* input,
+                                       size_t input_size,
+                                       const DecodeOptions& options) {
+  int w, h;
+  scoped_ptr<SkBitmap> bitmap(new SkBitmap());
+  if (!DoDecode(input, input_size, FORMAT_SkBitmap, options, NULL,
+                bitmap.get(), &w, &h))
+    return NULL;
+  return bitmap.release();
 }
 
 }  // namespace gfx
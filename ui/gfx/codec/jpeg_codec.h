@@ -9,6 +9,7 @@
 #include <vector>
 
 #include "ui/gfx/gfx_export.h"
+#include "ui/gfx/rect.h"
 
 class SkBitmap;
 
@@ -43,6 +44,27 @@ class GFX_EXPORT JPEGCodec {
     IJG_LIBJPEG,
   };
 
+  // Controls how much of the image DecodeWithOptions() produces. Decoding a
+  // thumbnail this way lets libjpeg skip most of the IDCT work (it scales in
+  // the DCT domain by 1/2, 1/4 or 1/8) instead of decoding the full image and
+  // throwing most of it away in a resize.
+  struct GFX_EXPORT DecodeOptions {
+    DecodeOptions();
+    ~DecodeOptions();
+
+    // The smallest output the caller can use. The decoder picks the
+    // strongest DCT scaling that keeps the decoded region at least this large
+    // in both dimensions, so the result typically still needs a final resize.
+    // An empty size (the default) decodes at full resolution.
+    gfx::Size min_size;
+
+    // The part of the image to decode, in full-resolution pixels. It is
+    // clipped to the image bounds. An empty rect (the default) decodes the
+    // whole image. Rows below the region are never decoded, and rows above it
+    // and columns outside it are skipped when the library supports it.
+    gfx::Rect region;
+  };
+
   // This method helps identify at run time which library chromium is using.
   static LibraryVariant JpegLibraryVariant();
 
@@ -72,6 +94,22 @@ class GFX_EXPORT JPEGCodec {
   // successful, a SkBitmap is created and returned. It is up to the caller
   // to delete the returned bitmap.
   static SkBitmap* Decode(const unsigned char* input, size_t input_size);
+
+  // Like Decode() above, but only decodes the region of the image given in
+  // |options|, at the smallest scale that satisfies |options.min_size|.
+  // *w and *h receive the dimensions of the decoded data. The pixels are
+  // written in the requested |format| directly by libjpeg where possible.
+  static bool DecodeWithOptions(const unsigned char* input, size_t input_size,
+                                ColorFormat format,
+                                const DecodeOptions& options,
+                                std::vector<unsigned char>* output,
+                                int* w, int* h);
+
+  // Like DecodeWithOptions() above, but decodes straight into the pixels of
+  // a new SkBitmap, which the caller owns. Returns NULL on failure.
+  static SkBitmap* DecodeWithOptions(const unsigned char* input,
+                                     size_t input_size,
+                                     const DecodeOptions& options);
 };
 
 }  // namespace gfx
@@ -5,7 +5,13 @@
 #include <math.h>
 
 #include "base/basictypes.h"
+#include "base/logging.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+#include "skia/ext/image_operations.h"
 #include "testing/gtest/include/gtest/gtest.h"
+#include "third_party/skia/include/core/SkBitmap.h"
 #include "ui/gfx/codec/jpeg_codec.h"
 
 namespace {
@@ -98,6 +104,34 @@ static void MakeRGBImage(int w, int h, std::vector<unsigned char>* dat) {
   }
 }
 
+// Makes a photo-like RGB image: smooth gradients with a little noise, which
+// unlike MakeRGBImage() does not wrap around on wide images.
+static void MakePhotoImage(int w, int h, std::vector<unsigned char>* dat) {
+  dat->resize(w * h * 3);
+  uint32 noise = 1;
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      noise = noise * 1103515245 + 12345;
+      unsigned char* org_px = &(*dat)[(y * w + x) * 3];
+      org_px[0] = x * 200 / w + (noise >> 16) % 8;        // r
+      org_px[1] = y * 200 / h + (noise >> 20) % 8;        // g
+      org_px[2] = (x + y) * 100 / (w + h) + (noise >> 24) % 8;  // b
+    }
+  }
+}
+
+// Copies |rect| out of an image that is |w| pixels wide.
+static void CropImage(const std::vector<unsigned char>& image, int w,
+                      int bytes_per_pixel, const Rect& rect,
+                      std::vector<unsigned char>* cropped) {
+  cropped->clear();
+  for (int y = rect.y(); y < rect.bottom(); y++) {
+    const unsigned char* row = &image[(y * w + rect.x()) * bytes_per_pixel];
+    cropped->insert(cropped->end(), row,
+                    row + rect.width() * bytes_per_pixel);
+  }
+}
+
 TEST(JPEGCodec, EncodeDecodeRGB) {
   int w = 20, h = 20;
 
@@ -214,4 +248,222 @@ TEST(JPEGCodec, InvalidRead) {
                     &outw, &outh);
 }
 
+// Test that the decoder picks the strongest DCT scaling that still satisfies
+// the minimum size, and that the result looks like the full image.
+TEST(JPEGCodec, DecodeWithOptionsScaled) {
+  const int w = 320, h = 240;
+  std::vector<unsigned char> original;
+  MakePhotoImage(w, h, &original);
+  std::vector<unsigned char> encoded;
+  ASSERT_TRUE(JPEGCodec::Encode(&original[0], JPEGCodec::FORMAT_RGB, w, h,
+                                w * 3, jpeg_quality, &encoded));
+
+  const struct {
+    int min_width, min_height;
+    int expected_width, expected_height;
+  } kCases[] = {
+    { 0, 0, 320, 240 },
+    { 40, 30, 40, 30 },
+    { 41, 30, 80, 60 },
+    { 80, 61, 160, 120 },
+    { 200, 10, 320, 240 },
+    { 400, 400, 320, 240 },
+  };
+  for (size_t i = 0; i < arraysize(kCases); ++i) {
+    JPEGCodec::DecodeOptions options;
+    options.min_size = Size(kCases[i].min_width, kCases[i].min_height);
+    std::vector<unsigned char> decoded;
+    int outw, outh;
+    ASSERT_TRUE(JPEGCodec::DecodeWithOptions(&encoded[0], encoded.size(),
+                                             JPEGCodec::FORMAT_RGBA, options,
+                                             &decoded, &outw, &outh));
+    EXPECT_EQ(kCases[i].expected_width, outw);
+    EXPECT_EQ(kCases[i].expected_height, outh);
+    ASSERT_EQ(static_cast<size_t>(outw * outh * 4), decoded.size());
+
+    // Compare against a box-filtered copy of the original.
+    int scale = w / outw;
+    std::vector<unsigned char> expected;
+    for (int y = 0; y < outh; y++) {
+      for (int x = 0; x < outw; x++) {
+        for (int c = 0; c < 3; c++) {
+          int sum = 0;
+          for (int dy = 0; dy < scale; dy++) {
+            for (int dx = 0; dx < scale; dx++) {
+              sum += original[((y * scale + dy) * w + x * scale + dx) * 3 + c];
+            }
+          }
+          expected.push_back(sum / (scale * scale));
+        }
+        expected.push_back(0xff);
+      }
+    }
+    EXPECT_GE(4.0, AveragePixelDelta(expected, decoded));
+  }
+}
+
+// Test that decoding a region gives the same pixels as cropping the full
+// decode, with and without scaling.
+TEST(JPEGCodec, DecodeWithOptionsRegion) {
+  const int w = 320, h = 240;
+  std::vector<unsigned char> original;
+  MakePhotoImage(w, h, &original);
+  std::vector<unsigned char> encoded;
+  ASSERT_TRUE(JPEGCodec::Encode(&original[0], JPEGCodec::FORMAT_RGB, w, h,
+                                w * 3, jpeg_quality, &encoded));
+
+  const JPEGCodec::ColorFormat kFormats[] = {
+    JPEGCodec::FORMAT_RGB, JPEGCodec::FORMAT_RGBA, JPEGCodec::FORMAT_BGRA
+  };
+  for (size_t i = 0; i < arraysize(kFormats); ++i) {
+    int bytes_per_pixel = kFormats[i] == JPEGCodec::FORMAT_RGB ? 3 : 4;
+    std::vector<unsigned char> full;
+    int fullw, fullh;
+    ASSERT_TRUE(JPEGCodec::Decode(&encoded[0], encoded.size(), kFormats[i],
+                                  &full, &fullw, &fullh));
+
+    // Full resolution.
+    JPEGCodec::DecodeOptions options;
+    options.region = Rect(37, 21, 100, 80);
+    std::vector<unsigned char> decoded;
+    int outw, outh;
+    ASSERT_TRUE(JPEGCodec::DecodeWithOptions(&encoded[0], encoded.size(),
+                                             kFormats[i], options,
+                                             &decoded, &outw, &outh));
+    ASSERT_EQ(100, outw);
+    ASSERT_EQ(80, outh);
+    std::vector<unsigned char> expected;
+    CropImage(full, fullw, bytes_per_pixel, options.region, &expected);
+    EXPECT_GE(jpeg_equality_threshold, AveragePixelDelta(expected, decoded));
+
+    // A region that runs off the image is clipped to it.
+    options.region = Rect(300, 200, 100, 100);
+    ASSERT_TRUE(JPEGCodec::DecodeWithOptions(&encoded[0], encoded.size(),
+                                             kFormats[i], options,
+                                             &decoded, &outw, &outh));
+    ASSERT_EQ(20, outw);
+    ASSERT_EQ(40, outh);
+    CropImage(full, fullw, bytes_per_pixel, Rect(300, 200, 20, 40),
+              &expected);
+    EXPECT_GE(jpeg_equality_threshold, AveragePixelDelta(expected, decoded));
+
+    // Scaled by 1/4; edge pixels that are only partly covered are included.
+    JPEGCodec::DecodeOptions scaled_options;
+    scaled_options.min_size = Size(80, 60);
+    ASSERT_TRUE(JPEGCodec::DecodeWithOptions(&encoded[0], encoded.size(),
+                                             kFormats[i], scaled_options,
+                                             &full, &fullw, &fullh));
+    ASSERT_EQ(80, fullw);
+    scaled_options.region = Rect(38, 22, 100, 80);
+    scaled_options.min_size = Size(25, 20);
+    ASSERT_TRUE(JPEGCodec::DecodeWithOptions(&encoded[0], encoded.size(),
+                                             kFormats[i], scaled_options,
+                                             &decoded, &outw, &outh));
+    ASSERT_EQ(26, outw);
+    ASSERT_EQ(21, outh);
+    CropImage(full, fullw, bytes_per_pixel, Rect(9, 5, 26, 21), &expected);
+    EXPECT_GE(jpeg_equality_threshold, AveragePixelDelta(expected, decoded));
+  }
+}
+
+TEST(JPEGCodec, DecodeWithOptionsRegionOutsideImage) {
+  const int w = 64, h = 64;
+  std::vector<unsigned char> original;
+  MakePhotoImage(w, h, &original);
+  std::vector<unsigned char> encoded;
+  ASSERT_TRUE(JPEGCodec::Encode(&original[0], JPEGCodec::FORMAT_RGB, w, h,
+                                w * 3, jpeg_quality, &encoded));
+
+  JPEGCodec::DecodeOptions options;
+  options.region = Rect(64, 0, 10, 10);
+  std::vector<unsigned char> decoded;
+  int outw, outh;
+  EXPECT_FALSE(JPEGCodec::DecodeWithOptions(&encoded[0], encoded.size(),
+                                            JPEGCodec::FORMAT_RGBA, options,
+                                            &decoded, &outw, &outh));
+}
+
+// Test that decoding straight into a SkBitmap gives the same pixels as
+// decoding into a vector.
+TEST(JPEGCodec, DecodeWithOptionsToSkBitmap) {
+  const int w = 160, h = 120;
+  std::vector<unsigned char> original;
+  MakePhotoImage(w, h, &original);
+  std::vector<unsigned char> encoded;
+  ASSERT_TRUE(JPEGCodec::Encode(&original[0], JPEGCodec::FORMAT_RGB, w, h,
+                                w * 3, jpeg_quality, &encoded));
+
+  JPEGCodec::DecodeOptions options;
+  options.min_size = Size(40, 30);
+  options.region = Rect(16, 8, 120, 100);
+  std::vector<unsigned char> decoded;
+  int outw, outh;
+  ASSERT_TRUE(JPEGCodec::DecodeWithOptions(&encoded[0], encoded.size(),
+                                           JPEGCodec::FORMAT_SkBitmap,
+                                           options, &decoded, &outw, &outh));
+  scoped_ptr<SkBitmap> bitmap(
+      JPEGCodec::DecodeWithOptions(&encoded[0], encoded.size(), options));
+  ASSERT_TRUE(bitmap.get());
+  ASSERT_EQ(outw, bitmap->width());
+  ASSERT_EQ(outh, bitmap->height());
+
+  SkAutoLockPixels lock(*bitmap);
+  for (int y = 0; y < outh; y++) {
+    EXPECT_EQ(0, memcmp(&decoded[y * outw * 4], bitmap->getAddr32(0, y),
+                        outw * 4));
+  }
+}
+
+// Compares making thumbnails of large photos by decoding at full size and
+// resizing against letting libjpeg scale first and resizing the rest.
+TEST(JPEGCodec, DISABLED_ThumbnailPerf) {
+  const int kSizes[][2] = { { 2048, 1536 }, { 3264, 2448 }, { 4000, 3000 } };
+  const int kThumbnailWidth = 212, kThumbnailHeight = 159;
+  const int kIterations = 5;
+
+  for (size_t i = 0; i < arraysize(kSizes); ++i) {
+    const int w = kSizes[i][0], h = kSizes[i][1];
+    std::vector<unsigned char> original;
+    MakePhotoImage(w, h, &original);
+    std::vector<unsigned char> encoded;
+    ASSERT_TRUE(JPEGCodec::Encode(&original[0], JPEGCodec::FORMAT_RGB, w, h,
+                                  w * 3, 90, &encoded));
+
+    base::TimeTicks start = base::TimeTicks::Now();
+    for (int j = 0; j < kIterations; ++j) {
+      scoped_ptr<SkBitmap> full(
+          JPEGCodec::Decode(&encoded[0], encoded.size()));
+      ASSERT_TRUE(full.get());
+      skia::ImageOperations::Resize(*full,
+                                    skia::ImageOperations::RESIZE_GOOD,
+                                    kThumbnailWidth, kThumbnailHeight);
+    }
+    base::TimeDelta full_decode =
+        (base::TimeTicks::Now() - start) / kIterations;
+
+    JPEGCodec::DecodeOptions options;
+    options.min_size = Size(kThumbnailWidth, kThumbnailHeight);
+    start = base::TimeTicks::Now();
+    int scaled_width = 0;
+    for (int j = 0; j < kIterations; ++j) {
+      scoped_ptr<SkBitmap> scaled(JPEGCodec::DecodeWithOptions(
+          &encoded[0], encoded.size(), options));
+      ASSERT_TRUE(scaled.get());
+      scaled_width = scaled->width();
+      skia::ImageOperations::Resize(*scaled,
+                                    skia::ImageOperations::RESIZE_GOOD,
+                                    kThumbnailWidth, kThumbnailHeight);
+    }
+    base::TimeDelta scaled_decode =
+        (base::TimeTicks::Now() - start) / kIterations;
+
+    LOG(INFO) << base::StringPrintf(
+        "%dx%d -> %dx%d: decode+resize %.1f ms, "
+        "scaled decode (%d wide)+resize %.1f ms",
+        w, h, kThumbnailWidth, kThumbnailHeight,
+        full_decode.InMillisecondsF(), scaled_width,
+        scaled_decode.InMillisecondsF());
+  }
+}
+
 }  // namespace gfx
@@ -4,8 +4,14 @@
 
 #include "ui/gfx/codec/png_codec.h"
 
+#include "base/atomicops.h"
+#include "base/bind.h"
+#include "base/location.h"
 #include "base/logging.h"
+#include "base/memory/ref_counted.h"
 #include "base/strings/string_util.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/worker_pool.h"
 #include "third_party/libpng/png.h"
 #include "third_party/skia/include/core/SkBitmap.h"
 #include "third_party/skia/include/core/SkColorPriv.h"
@@ -567,17 +573,361 @@ class CommentWriter {
 typedef void (*FormatConverter)(const unsigned char* in, int w,
                                 unsigned char* out, bool* is_opaque);
 
+int ToLibpngFilters(PNGCodec::RowFilter filter) {
+  switch (filter) {
+    case PNGCodec::ROW_FILTER_NONE:
+      return PNG_FILTER_NONE;
+    case PNGCodec::ROW_FILTER_SUB:
+      return PNG_FILTER_SUB;
+    case PNGCodec::ROW_FILTER_UP:
+      return PNG_FILTER_UP;
+    case PNGCodec::ROW_FILTER_AVERAGE:
+      return PNG_FILTER_AVG;
+    case PNGCodec::ROW_FILTER_PAETH:
+      return PNG_FILTER_PAETH;
+    case PNGCodec::ROW_FILTER_ADAPTIVE:
+      return PNG_ALL_FILTERS;
+  }
+  NOTREACHED();
+  return PNG_ALL_FILTERS;
+}
+
+int ToZlibStrategy(PNGCodec::DeflateStrategy strategy) {
+  switch (strategy) {
+    case PNGCodec::DEFLATE_DEFAULT:
+      return Z_DEFAULT_STRATEGY;
+    case PNGCodec::DEFLATE_FILTERED:
+      return Z_FILTERED;
+    case PNGCodec::DEFLATE_HUFFMAN_ONLY:
+      return Z_HUFFMAN_ONLY;
+    case PNGCodec::DEFLATE_RLE:
+      return Z_RLE;
+  }
+  NOTREACHED();
+  return Z_DEFAULT_STRATEGY;
+}
+
+// Parallel encoding ----------------------------------------------------------
+//
+// The rows of an image are cut into strips. Each strip is converted, filtered
+// and deflated on its own into a raw deflate stream, which ends with a sync
+// flush (or, for the last strip, the final block) so that the strips can
+// simply be concatenated. Filtering a strip's first row only needs the
+// previous row of the input, so strips never wait for each other. The zlib
+// header and the Adler-32 of the whole stream, combined from the strips'
+// checksums, are added around the joined strips.
+
+// Strips smaller than this are not worth a thread, and each strip boundary
+// costs some compression since the deflate history starts over.
+const int kMinBytesPerStrip = 256 * 1024;
+
+// Everything needed to encode any strip of an image. The input and options
+// belong to the caller of EncodeWithOptions(), which waits for all strips.
+struct StripParams {
+  const unsigned char* input;
+  int width;
+  int height;
+  int row_byte_width;
+  int output_color_components;
+  FormatConverter converter;
+  const PNGCodec::EncodeOptions* options;
+};
+
+struct DeflatedStrip {
+  DeflatedStrip() : adler(1), length(0), succeeded(false) {}
+
+  std::vector<unsigned char> data;
+  // Adler-32 and length of the filtered, uncompressed data.
+  uLong adler;
+  uLong length;
+  bool succeeded;
+};
+
+// Returns how many strips an image of |height| rows of |row_bytes| each should
+// be encoded in.
+int NumStripsForImage(int height, int row_bytes, int max_threads) {
+  if (max_threads <= 1)
+    return 1;
+  int64 strips = static_cast<int64>(height) * row_bytes / kMinBytesPerStrip;
+  strips = std::min<int64>(strips, max_threads);
+  strips = std::min<int64>(strips, height);
+  return std::max(1, static_cast<int>(strips));
+}
+
+// The predictor of the Paeth filter, as given by the PNG specification.
+inline unsigned char PaethPredictor(int a, int b, int c) {
+  int p = a + b - c;
+  int pa = std::abs(p - a);
+  int pb = std::abs(p - b);
+  int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc)
+    return a;
+  if (pb <= pc)
+    return b;
+  return c;
+}
+
+// Writes |row| filtered with |filter| to |out|, starting with the filter type
+// byte. |prior| is the unfiltered previous row, all zeroes for the first row.
+// |bpp| is the number of bytes per pixel.
+void FilterRow(PNGCodec::RowFilter filter,
+               int bpp,
+               const unsigned char* prior,
+               const unsigned char* row,
+               int row_bytes,
+               unsigned char* out) {
+  out[0] = filter;
+  unsigned char* filtered = out + 1;
+  switch (filter) {
+    case PNGCodec::ROW_FILTER_NONE:
+      memcpy(filtered, row, row_bytes);
+      break;
+    case PNGCodec::ROW_FILTER_SUB:
+      memcpy(filtered, row, bpp);
+      for (int i = bpp; i < row_bytes; ++i)
+        filtered[i] = row[i] - row[i - bpp];
+      break;
+    case PNGCodec::ROW_FILTER_UP:
+      for (int i = 0; i < row_bytes; ++i)
+        filtered[i] = row[i] - prior[i];
+      break;
+    case PNGCodec::ROW_FILTER_AVERAGE:
+      for (int i = 0; i < bpp; ++i)
+        filtered[i] = row[i] - (prior[i] >> 1);
+      for (int i = bpp; i < row_bytes; ++i)
+        filtered[i] = row[i] - ((row[i - bpp] + prior[i]) >> 1);
+      break;
+    case PNGCodec::ROW_FILTER_PAETH:
+      for (int i = 0; i < bpp; ++i)
+        filtered[i] = row[i] - PaethPredictor(0, prior[i], 0);
+      for (int i = bpp; i < row_bytes; ++i) {
+        filtered[i] = row[i] -
+            PaethPredictor(row[i - bpp], prior[i], prior[i - bpp]);
+      }
+      break;
+    case PNGCodec::ROW_FILTER_ADAPTIVE:
+      NOTREACHED();
+      break;
+  }
+}
+
+// Same heuristic as libpng: the sum of the filtered bytes taken as signed
+// values, lower being more compressible.
+uint32 SumOfAbsoluteValues(const unsigned char* filtered, int row_bytes) {
+  uint32 sum = 0;
+  for (int i = 0; i < row_bytes; ++i)
+    sum += filtered[i] < 128 ? filtered[i] : 256 - filtered[i];
+  return sum;
+}
+
+// Filters, with the filter chosen by |options|, and deflates rows
+// [|begin|, |end|) into |strip|.
+void EncodeStrip(const StripParams& params, int begin, int end,
+                 DeflatedStrip* strip) {
+  const PNGCodec::EncodeOptions& options = *params.options;
+  int bpp = params.output_color_components;
+  int row_bytes = params.width * bpp;
+  int filtered_row_bytes = row_bytes + 1;
+
+  // Unfiltered rows in the output format; |prior_row| starts as the row
+  // above the strip.
+  std::vector<unsigned char> zero_row(row_bytes, 0);
+  std::vector<unsigned char> converted(params.converter ? row_bytes * 2 : 0);
+  const unsigned char* prior_row = &zero_row[0];
+  if (begin > 0) {
+    const unsigned char* input_row =
+        &params.input[(begin - 1) * params.row_byte_width];
+    if (params.converter) {
+      params.converter(input_row, params.width, &converted[0], NULL);
+      prior_row = &converted[0];
+    } else {
+      prior_row = input_row;
+    }
+  }
+
+  std::vector<unsigned char> filtered(
+      static_cast<size_t>(end - begin) * filtered_row_bytes);
+  std::vector<unsigned char> candidate(filtered_row_bytes);
+  for (int y = begin; y < end; ++y) {
+    const unsigned char* row = &params.input[y * params.row_byte_width];
+    if (params.converter) {
+      // Alternate between the two halves, starting with the one that does
+      // not hold the row above the strip.
+      unsigned char* converted_row =
+          &converted[((y - begin + 1) & 1) * row_bytes];
+      params.converter(row, params.width, converted_row, NULL);
+      row = converted_row;
+    }
+
+    unsigned char* out = &filtered[(y - begin) * filtered_row_bytes];
+    if (options.row_filter != PNGCodec::ROW_FILTER_ADAPTIVE) {
+      FilterRow(options.row_filter, bpp, prior_row, row, row_bytes, out);
+    } else {
+      FilterRow(PNGCodec::ROW_FILTER_NONE, bpp, prior_row, row, row_bytes,
+                out);
+      uint32 best_sum = SumOfAbsoluteValues(out + 1, row_bytes);
+      for (int filter = PNGCodec::ROW_FILTER_SUB;
+           filter <= PNGCodec::ROW_FILTER_PAETH; ++filter) {
+        FilterRow(static_cast<PNGCodec::RowFilter>(filter), bpp, prior_row,
+                  row, row_bytes, &candidate[0]);
+        uint32 sum = SumOfAbsoluteValues(&candidate[1], row_bytes);
+        if (sum < best_sum) {
+          best_sum = sum;
+          memcpy(out, &candidate[0], filtered_row_bytes);
+        }
+      }
+    }
+    prior_row = row;
+  }
+
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  // Negative window bits give a raw deflate stream with no zlib header or
+  // trailer; those are added once for the whole image.
+  if (deflateInit2(&stream, options.compression_level, Z_DEFLATED, -MAX_WBITS,
+                   8, ToZlibStrategy(options.deflate_strategy)) != Z_OK) {
+    return;
+  }
+  stream.next_in = &filtered[0];
+  stream.avail_in = static_cast<uInt>(filtered.size());
+  // A sync flush leaves the stream on a byte boundary without marking the
+  // last block, so the next strip can follow directly.
+  int flush = end == params.height ? Z_FINISH : Z_SYNC_FLUSH;
+
+  std::vector<unsigned char>& data = strip->data;
+  data.resize(deflateBound(&stream, filtered.size()) + 16);
+  stream.next_out = &data[0];
+  stream.avail_out = static_cast<uInt>(data.size());
+  for (;;) {
+    int result = deflate(&stream, flush);
+    if (result == Z_STREAM_END)
+      break;
+    if (result != Z_OK && result != Z_BUF_ERROR) {
+      deflateEnd(&stream);
+      return;
+    }
+    if (flush == Z_SYNC_FLUSH && stream.avail_in == 0 &&
+        stream.avail_out != 0) {
+      break;
+    }
+    size_t used = data.size() - stream.avail_out;
+    data.resize(data.size() * 2);
+    stream.next_out = &data[used];
+    stream.avail_out = static_cast<uInt>(data.size() - used);
+  }
+  data.resize(data.size() - stream.avail_out);
+  deflateEnd(&stream);
+
+  strip->adler = adler32(adler32(0L, Z_NULL, 0), &filtered[0],
+                         static_cast<uInt>(filtered.size()));
+  strip->length = static_cast<uLong>(filtered.size());
+  strip->succeeded = true;
+}
+
+// Encodes the strips of an image on the calling thread and up to
+// |num_threads| - 1 worker pool threads, which claim strips one at a time.
+// Workers that start after every strip has been claimed return without
+// touching |params_|, so the caller only waits for the claimed strips.
+class StripEncoder : public base::RefCountedThreadSafe<StripEncoder> {
+ public:
+  StripEncoder(const StripParams& params, int num_strips)
+      : params_(params),
+        num_strips_(num_strips),
+        strips_(num_strips),
+        next_strip_(0),
+        strips_done_(0),
+        done_(true, false) {
+  }
+
+  void Run(int num_threads) {
+    for (int i = 1; i < std::min(num_threads, num_strips_); ++i) {
+      base::WorkerPool::PostTask(
+          FROM_HERE, base::Bind(&StripEncoder::EncodeStrips, this), true);
+    }
+    EncodeStrips();
+    done_.Wait();
+  }
+
+  std::vector<DeflatedStrip>* strips() { return &strips_; }
+
+ private:
+  friend class base::RefCountedThreadSafe<StripEncoder>;
+  ~StripEncoder() {}
+
+  void EncodeStrips() {
+    for (;;) {
+      int strip = base::subtle::NoBarrier_AtomicIncrement(&next_strip_, 1) - 1;
+      if (strip >= num_strips_)
+        return;
+      EncodeStrip(params_,
+                  params_.height * strip / num_strips_,
+                  params_.height * (strip + 1) / num_strips_,
+                  &strips_[strip]);
+      if (base::subtle::Barrier_AtomicIncrement(&strips_done_, 1) ==
+          num_strips_) {
+        done_.Signal();
+      }
+    }
+  }
+
+  const StripParams params_;
+  const int num_strips_;
+  std::vector<DeflatedStrip> strips_;
+  base::subtle::Atomic32 next_strip_;
+  base::subtle::Atomic32 strips_done_;
+  base::WaitableEvent done_;
+
+  DISALLOW_COPY_AND_ASSIGN(StripEncoder);
+};
+
+// Turns the strips into the contents of the IDAT chunks: the zlib header goes
+// in front of the first strip and the Adler-32 of everything after the last.
+bool JoinStrips(int compression_level, std::vector<DeflatedStrip>* strips) {
+  uLong adler = adler32(0L, Z_NULL, 0);
+  for (size_t i = 0; i < strips->size(); ++i) {
+    const DeflatedStrip& strip = (*strips)[i];
+    if (!strip.succeeded)
+      return false;
+    adler = adler32_combine(adler, strip.adler, strip.length);
+  }
+
+  // 32K window deflate, and the level hint zlib itself would write.
+  const unsigned char cmf = 0x78;
+  int level_hint = 2;
+  if (compression_level >= 0 && compression_level < 2)
+    level_hint = 0;
+  else if (compression_level >= 2 && compression_level < 6)
+    level_hint = 1;
+  else if (compression_level > 6)
+    level_hint = 3;
+  int flg = level_hint << 6;
+  flg += 31 - (cmf * 256 + flg) % 31;
+  const unsigned char header[] = { cmf, static_cast<unsigned char>(flg) };
+  std::vector<unsigned char>& first = strips->front().data;
+  first.insert(first.begin(), header, header + arraysize(header));
+
+  std::vector<unsigned char>& last = strips->back().data;
+  for (int shift = 24; shift >= 0; shift -= 8)
+    last.push_back(static_cast<unsigned char>(adler >> shift));
+  return true;
+}
+
 // libpng uses a wacky setjmp-based API, which makes the compiler nervous.
 // We constrain all of the calls we make to libpng where the setjmp() is in
 // place to this function.
+// When |idat_chunks| is given, it holds the already compressed image data,
+// which is written as one IDAT chunk per entry instead of having libpng
+// compress the rows.
 // Returns true on success.
 bool DoLibpngWrite(png_struct* png_ptr, png_info* info_ptr,
                    PngEncoderState* state,
                    int width, int height, int row_byte_width,
-                   const unsigned char* input, int compression_level,
+                   const unsigned char* input,
+                   const PNGCodec::EncodeOptions& options,
                    int png_output_color_type, int output_color_components,
                    FormatConverter converter,
-                   const std::vector<PNGCodec::Comment>& comments) {
+                   const std::vector<PNGCodec::Comment>& comments,
+                   std::vector<DeflatedStrip>* idat_chunks) {
 #ifdef PNG_TEXT_SUPPORTED
   CommentWriter comment_writer(comments);
 #endif
@@ -591,7 +941,11 @@ bool DoLibpngWrite(png_struct* png_ptr, png_info* info_ptr,
     return false;
   }
 
-  png_set_compression_level(png_ptr, compression_level);
+  png_set_compression_level(png_ptr, options.compression_level);
+  png_set_compression_strategy(png_ptr,
+                               ToZlibStrategy(options.deflate_strategy));
+  png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE,
+                 ToLibpngFilters(options.row_filter));
 
   // Set our callback for libpng to give us the data.
   png_set_write_fn(png_ptr, state, EncoderWriteCallback, FakeFlushCallback);
@@ -610,6 +964,19 @@ bool DoLibpngWrite(png_struct* png_ptr, png_info* info_ptr,
 
   png_write_info(png_ptr, info_ptr);
 
+  if (idat_chunks) {
+    // png_write_end() insists on rows having gone through libpng, and there
+    // is nothing else to write after the image data, so end the file here.
+    static png_byte kIDAT[5] = { 'I', 'D', 'A', 'T', '\0' };
+    static png_byte kIEND[5] = { 'I', 'E', 'N', 'D', '\0' };
+    for (size_t i = 0; i < idat_chunks->size(); ++i) {
+      std::vector<unsigned char>& data = (*idat_chunks)[i].data;
+      png_write_chunk(png_ptr, kIDAT, &data[0], data.size());
+    }
+    png_write_chunk(png_ptr, kIEND, NULL, 0);
+    return true;
+  }
+
   if (!converter) {
     // No conversion needed, give the data directly to libpng.
     for (int y = 0; y < height; y ++) {
@@ -630,14 +997,17 @@ bool DoLibpngWrite(png_struct* png_ptr, png_info* info_ptr,
   return true;
 }
 
-bool EncodeWithCompressionLevel(const unsigned char* input,
-                                PNGCodec::ColorFormat format,
-                                const Size& size,
-                                int row_byte_width,
-                                bool discard_transparency,
-                                const std::vector<PNGCodec::Comment>& comments,
-                                int compression_level,
-                                std::vector<unsigned char>* output) {
+}  // namespace
+
+// static
+bool PNGCodec::EncodeWithOptions(const unsigned char* input,
+                                 ColorFormat format,
+                                 const Size& size,
+                                 int row_byte_width,
+                                 bool discard_transparency,
+                                 const std::vector<Comment>& comments,
+                                 const EncodeOptions& options,
+                                 std::vector<unsigned char>* output) {
   // Run to convert an input row into the output row format, NULL means no
   // conversion is necessary.
   FormatConverter converter = NULL;
@@ -645,13 +1015,13 @@ bool EncodeWithCompressionLevel(const unsigned char* input,
   int input_color_components, output_color_components;
   int png_output_color_type;
   switch (format) {
-    case PNGCodec::FORMAT_RGB:
+    case FORMAT_RGB:
       input_color_components = 3;
       output_color_components = 3;
       png_output_color_type = PNG_COLOR_TYPE_RGB;
       break;
 
-    case PNGCodec::FORMAT_RGBA:
+    case FORMAT_RGBA:
       input_color_components = 4;
       if (discard_transparency) {
         output_color_components = 3;
@@ -664,7 +1034,7 @@ bool EncodeWithCompressionLevel(const unsigned char* input,
       }
       break;
 
-    case PNGCodec::FORMAT_BGRA:
+    case FORMAT_BGRA:
       input_color_components = 4;
       if (discard_transparency) {
         output_color_components = 3;
@@ -677,7 +1047,7 @@ bool EncodeWithCompressionLevel(const unsigned char* input,
       }
       break;
 
-    case PNGCodec::FORMAT_SkBitmap:
+    case FORMAT_SkBitmap:
       input_color_components = 4;
       if (discard_transparency) {
         output_color_components = 3;
@@ -698,6 +1068,26 @@ bool EncodeWithCompressionLevel(const unsigned char* input,
   // Row stride should be at least as long as the length of the data.
   DCHECK(input_color_components * size.width() <= row_byte_width);
 
+  // Compress the image data up front when it is split into strips.
+  scoped_refptr<StripEncoder> strip_encoder;
+  int num_strips = NumStripsForImage(size.height(),
+                                     size.width() * output_color_components,
+                                     options.num_threads);
+  if (num_strips > 1) {
+    StripParams params;
+    params.input = input;
+    params.width = size.width();
+    params.height = size.height();
+    params.row_byte_width = row_byte_width;
+    params.output_color_components = output_color_components;
+    params.converter = converter;
+    params.options = &options;
+    strip_encoder = new StripEncoder(params, num_strips);
+    strip_encoder->Run(options.num_threads);
+    if (!JoinStrips(options.compression_level, strip_encoder->strips()))
+      return false;
+  }
+
   png_struct* png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING,
                                                 NULL, NULL, NULL);
   if (!png_ptr)
@@ -713,29 +1103,27 @@ bool EncodeWithCompressionLevel(const unsigned char* input,
   PngEncoderState state(output);
   bool success = DoLibpngWrite(png_ptr, info_ptr, &state,
                                size.width(), size.height(), row_byte_width,
-                               input, compression_level, png_output_color_type,
-                               output_color_components, converter, comments);
+                               input, options, png_output_color_type,
+                               output_color_components, converter, comments,
+                               strip_encoder ? strip_encoder->strips() : NULL);
 
   return success;
 }
 
-
-}  // namespace
-
 // static
 bool PNGCodec::Encode(const unsigned char* input, ColorFormat format,
                       const Size& size, int row_byte_width,
                       bool discard_transparency,
                       const std::vector<Comment>& comments,
                       std::vector<unsigned char>* output) {
-  return EncodeWithCompressionLevel(input,
-                                    format,
-                                    size,
-                                    row_byte_width,
-                                    discard_transparency,
-                                    comments,
-                                    Z_DEFAULT_COMPRESSION,
-                                    output);
+  return EncodeWithOptions(input,
+                           format,
+                           size,
+                           row_byte_width,
+                           discard_transparency,
+                           comments,
+                           EncodeOptions(PRESET_DEFAULT),
+                           output);
 }
 
 // static
@@ -768,11 +1156,11 @@ bool PNGCodec::FastEncodeBGRASkBitmap(const SkBitmap& input,
   DCHECK_GE(static_cast<int>(input.rowBytes()), input.width() * bbp);
 
   SkAutoLockPixels lock_input(input);
-  return EncodeWithCompressionLevel(
+  return EncodeWithOptions(
       reinterpret_cast<unsigned char*>(input.getAddr32(0, 0)),
       FORMAT_SkBitmap, Size(input.width(), input.height()),
       static_cast<int>(input.rowBytes()), discard_transparency,
-      std::vector<Comment>(), Z_BEST_SPEED, output);
+      std::vector<Comment>(), EncodeOptions(PRESET_FAST), output);
 }
 
 PNGCodec::Comment::Comment(const std::string& k, const std::string& t)
@@ -782,4 +1170,31 @@ PNGCodec::Comment::Comment(const std::string& k, const std::string& t)
 PNGCodec::Comment::~Comment() {
 }
 
+PNGCodec::EncodeOptions::EncodeOptions(EncodePreset preset)
+    : row_filter(ROW_FILTER_ADAPTIVE),
+      compression_level(Z_DEFAULT_COMPRESSION),
+      deflate_strategy(DEFLATE_FILTERED),
+      num_threads(1) {
+  // libpng itself defaults to adaptive filtering and, since the rows are
+  // filtered, the filtered deflate strategy.
+  switch (preset) {
+    case PRESET_FASTEST:
+      row_filter = ROW_FILTER_SUB;
+      compression_level = Z_BEST_SPEED;
+      deflate_strategy = DEFLATE_RLE;
+      break;
+    case PRESET_FAST:
+      compression_level = Z_BEST_SPEED;
+      break;
+    case PRESET_DEFAULT:
+      break;
+    case PRESET_SMALLEST:
+      compression_level = Z_BEST_COMPRESSION;
+      break;
+  }
+}
+
+PNGCodec::EncodeOptions::~EncodeOptions() {
+}
+
 }  // namespace gfx
@@ -51,6 +51,65 @@ class GFX_EXPORT PNGCodec {
     std::string text;
   };
 
+  // Speed/size trade-offs for EncodeWithOptions(), fastest first.
+  enum EncodePreset {
+    // "Sub" row filter and run-length-only deflate at level 1. Screenshots of
+    // web pages and UI have long runs of identical pixels, which this still
+    // compresses well at a fraction of the cost of the default.
+    PRESET_FASTEST,
+
+    // Adaptive row filters and deflate level 1, like FastEncodeBGRASkBitmap().
+    PRESET_FAST,
+
+    // What Encode() uses: adaptive row filters and zlib's default level.
+    PRESET_DEFAULT,
+
+    // Adaptive row filters and deflate level 9.
+    PRESET_SMALLEST,
+  };
+
+  // The filter applied to each row before it is deflated. See the "Filter
+  // algorithms" section of the PNG specification.
+  enum RowFilter {
+    ROW_FILTER_NONE,
+    ROW_FILTER_SUB,
+    ROW_FILTER_UP,
+    ROW_FILTER_AVERAGE,
+    ROW_FILTER_PAETH,
+
+    // Tries every filter on each row and keeps the one whose output looks
+    // most compressible. This is libpng's default.
+    ROW_FILTER_ADAPTIVE,
+  };
+
+  // zlib deflate strategies; see deflateInit2() in zlib.h.
+  enum DeflateStrategy {
+    DEFLATE_DEFAULT,
+    DEFLATE_FILTERED,
+    DEFLATE_HUFFMAN_ONLY,
+    DEFLATE_RLE,
+  };
+
+  struct GFX_EXPORT EncodeOptions {
+    // Sets up the options of |preset|, encoding on a single thread.
+    explicit EncodeOptions(EncodePreset preset);
+    ~EncodeOptions();
+
+    RowFilter row_filter;
+
+    // From 0 (no compression) to 9 (best), or -1 for zlib's default.
+    int compression_level;
+
+    DeflateStrategy deflate_strategy;
+
+    // When greater than one, large images are cut into horizontal strips
+    // which are filtered and deflated independently on up to this many
+    // threads (the calling thread and the worker pool), then joined into a
+    // single zlib stream. Decoders see an ordinary PNG; it is slightly larger
+    // since no strip can refer back into the previous one.
+    int num_threads;
+  };
+
   // Encodes the given raw 'input' data, with each pixel being represented as
   // given in 'format'. The encoded PNG data will be written into the supplied
   // vector and true will be returned on success. On failure (false), the
@@ -76,6 +135,17 @@ class GFX_EXPORT PNGCodec {
                      const std::vector<Comment>& comments,
                      std::vector<unsigned char>* output);
 
+  // Same as Encode(), with the filtering, compression and threading given by
+  // |options|. Encode() is the same as passing EncodeOptions(PRESET_DEFAULT).
+  static bool EncodeWithOptions(const unsigned char* input,
+                                ColorFormat format,
+                                const Size& size,
+                                int row_byte_width,
+                                bool discard_transparency,
+                                const std::vector<Comment>& comments,
+                                const EncodeOptions& options,
+                                std::vector<unsigned char>* output);
+
   // Call PNGCodec::Encode on the supplied SkBitmap |input|, which is assumed
   // to be BGRA, 32 bits per pixel. The params |discard_transparency| and
   // |output| are passed directly to Encode; refer to Encode for more
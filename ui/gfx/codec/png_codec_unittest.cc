@@ -6,6 +6,8 @@
 #include <cmath>
 
 #include "base/logging.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
 #include "testing/gtest/include/gtest/gtest.h"
 #include "third_party/libpng/png.h"
 #include "third_party/skia/include/core/SkBitmap.h"
@@ -103,6 +105,36 @@ void MakeGrayscaleAlphaImage(int w, int h,
   }
 }
 
+// Creates an opaque RGBA image resembling a screenshot: a title bar
+// gradient, lines of "text" on a flat background and a noisy photo in one
+// corner.
+void MakeScreenshotImage(int w, int h, std::vector<unsigned char>* data) {
+  data->resize(w * h * 4);
+  uint32 noise = 1;
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      unsigned char* px = &(*data)[(y * w + x) * 4];
+      int r = 240, g = 240, b = 240;
+      if (y < 60) {
+        r = 60 + x * 100 / w;
+        g = 80;
+        b = 200;
+      } else if (x > w / 2 && y > h / 2) {
+        noise = noise * 1103515245 + 12345;
+        r = (x + (noise >> 16) % 32) & 0xff;
+        g = (y + (noise >> 20) % 32) & 0xff;
+        b = (x + y) & 0xff;
+      } else if ((x / 7) % 3 == 0 && y % 18 < 12 && (y / 18) % 2 == 0) {
+        r = g = b = 30;
+      }
+      px[0] = r;
+      px[1] = g;
+      px[2] = b;
+      px[3] = 0xff;
+    }
+  }
+}
+
 // User write function (to be passed to libpng by EncodeImage) which writes
 // into a buffer instead of to a file.
 void WriteImageData(png_structp png_ptr,
@@ -1147,5 +1179,120 @@ TEST(PNGCodec, EncodeDecodeWithVaryingCompressionLevels) {
   EXPECT_TRUE(BitmapsAreEqual(decoded, original_bitmap));
 }
 
+TEST(PNGCodec, EncodeWithOptionsDefaultPresetMatchesEncode) {
+  const int w = 20, h = 20;
+  std::vector<unsigned char> original;
+  MakeRGBAImage(w, h, true, &original);
+
+  std::vector<unsigned char> encoded;
+  EXPECT_TRUE(PNGCodec::Encode(&original[0], PNGCodec::FORMAT_RGBA,
+                               Size(w, h), w * 4, false,
+                               std::vector<PNGCodec::Comment>(), &encoded));
+  std::vector<unsigned char> encoded_with_options;
+  EXPECT_TRUE(PNGCodec::EncodeWithOptions(
+      &original[0], PNGCodec::FORMAT_RGBA, Size(w, h), w * 4, false,
+      std::vector<PNGCodec::Comment>(),
+      PNGCodec::EncodeOptions(PNGCodec::PRESET_DEFAULT),
+      &encoded_with_options));
+  EXPECT_TRUE(encoded == encoded_with_options);
+}
+
+// Every preset and row filter, encoded on one thread or in parallel strips,
+// must decode back to the original pixels.
+TEST(PNGCodec, EncodeWithOptionsRoundTrip) {
+  // Big enough to be split into several strips.
+  const int w = 640, h = 480;
+  std::vector<unsigned char> original;
+  MakeScreenshotImage(w, h, &original);
+  std::vector<unsigned char> original_rgb;
+  for (size_t i = 0; i < original.size(); i += 4)
+    original_rgb.insert(original_rgb.end(), &original[i], &original[i + 3]);
+
+  std::vector<PNGCodec::EncodeOptions> all_options;
+  for (int preset = PNGCodec::PRESET_FASTEST;
+       preset <= PNGCodec::PRESET_SMALLEST; ++preset) {
+    all_options.push_back(PNGCodec::EncodeOptions(
+        static_cast<PNGCodec::EncodePreset>(preset)));
+  }
+  for (int filter = PNGCodec::ROW_FILTER_NONE;
+       filter <= PNGCodec::ROW_FILTER_ADAPTIVE; ++filter) {
+    PNGCodec::EncodeOptions options(PNGCodec::PRESET_FAST);
+    options.row_filter = static_cast<PNGCodec::RowFilter>(filter);
+    all_options.push_back(options);
+  }
+
+  for (size_t i = 0; i < all_options.size(); ++i) {
+    for (int threads = 1; threads <= 4; threads *= 4) {
+      PNGCodec::EncodeOptions options = all_options[i];
+      options.num_threads = threads;
+      SCOPED_TRACE(base::StringPrintf("options %d, %d threads",
+                                      static_cast<int>(i), threads));
+
+      std::vector<unsigned char> encoded;
+      ASSERT_TRUE(PNGCodec::EncodeWithOptions(
+          &original[0], PNGCodec::FORMAT_RGBA, Size(w, h), w * 4, false,
+          std::vector<PNGCodec::Comment>(), options, &encoded));
+      std::vector<unsigned char> decoded;
+      int outw, outh;
+      ASSERT_TRUE(PNGCodec::Decode(&encoded[0], encoded.size(),
+                                   PNGCodec::FORMAT_RGBA, &decoded,
+                                   &outw, &outh));
+      ASSERT_EQ(w, outw);
+      ASSERT_EQ(h, outh);
+      EXPECT_TRUE(original == decoded);
+
+      // Dropping the alpha channel goes through a row conversion.
+      ASSERT_TRUE(PNGCodec::EncodeWithOptions(
+          &original[0], PNGCodec::FORMAT_RGBA, Size(w, h), w * 4, true,
+          std::vector<PNGCodec::Comment>(), options, &encoded));
+      ASSERT_TRUE(PNGCodec::Decode(&encoded[0], encoded.size(),
+                                   PNGCodec::FORMAT_RGB, &decoded,
+                                   &outw, &outh));
+      EXPECT_TRUE(original_rgb == decoded);
+    }
+  }
+}
+
+// Reports encode time and size for each preset and thread count over
+// screenshot-like images.
+TEST(PNGCodec, DISABLED_EncodePresetsPerf) {
+  const int kSizes[][2] = { { 1280, 800 }, { 1920, 1080 }, { 2560, 1600 } };
+  const int kThreadCounts[] = { 1, 2, 4 };
+  const char* const kPresetNames[] = {
+    "fastest", "fast", "default", "smallest"
+  };
+  const int kIterations = 3;
+
+  for (size_t i = 0; i < arraysize(kSizes); ++i) {
+    const int w = kSizes[i][0], h = kSizes[i][1];
+    std::vector<unsigned char> original;
+    MakeScreenshotImage(w, h, &original);
+
+    for (int preset = PNGCodec::PRESET_FASTEST;
+         preset <= PNGCodec::PRESET_SMALLEST; ++preset) {
+      for (size_t j = 0; j < arraysize(kThreadCounts); ++j) {
+        PNGCodec::EncodeOptions options(
+            static_cast<PNGCodec::EncodePreset>(preset));
+        options.num_threads = kThreadCounts[j];
+
+        std::vector<unsigned char> encoded;
+        base::TimeTicks start = base::TimeTicks::Now();
+        for (int k = 0; k < kIterations; ++k) {
+          ASSERT_TRUE(PNGCodec::EncodeWithOptions(
+              &original[0], PNGCodec::FORMAT_RGBA, Size(w, h), w * 4, true,
+              std::vector<PNGCodec::Comment>(), options, &encoded));
+        }
+        base::TimeDelta elapsed =
+            (base::TimeTicks::Now() - start) / kIterations;
+
+        LOG(INFO) << base::StringPrintf(
+            "%dx%d %-8s threads=%d: %.1f ms, %d bytes (%.1f%% of raw)",
+            w, h, kPresetNames[preset], kThreadCounts[j],
+            elapsed.InMillisecondsF(), static_cast<int>(encoded.size()),
+            100.0 * encoded.size() / (w * h * 3));
+      }
+    }
+  }
+}
 
 }  // namespace gfx
@@ -9,6 +9,7 @@
 #endif
 
 #include <algorithm>
+#include <map>
 #include <ostream>
 
 #include "url/gurl.h"
@@ -17,6 +18,12 @@
 #include "url/url_canon_stdstring.h"
 #include "url/url_util.h"
 
+#if defined(USE_SHARED_GURL_SPEC)
+#include "base/lazy_instance.h"
+#include "base/strings/string_piece.h"
+#include "base/synchronization/lock.h"
+#endif
+
 namespace {
 
 static std::string* empty_string = NULL;
@@ -59,6 +66,80 @@ const std::string& EmptyStringForGURL() {
 
 #endif  // WIN32
 
+#if defined(USE_SHARED_GURL_SPEC)
+
+// Upper bound on the number of specs kept by GURL::Interned(), so that
+// interning an unbounded set of URLs can't grow memory without limit. Beyond
+// this, Interned() just returns a copy.
+const size_t kMaxInternedSpecs = 4096;
+
+// Process-wide table backing GURL::Interned(). Entries are keyed by the text
+// of the shared spec itself, which is immutable and kept alive by the table.
+class SpecInternTable {
+ public:
+  SpecInternTable() {}
+
+  // Returns the interned spec with the same text as |spec|, adding |spec| to
+  // the table if there is none yet.
+  scoped_refptr<base::RefCountedString> Intern(
+      const scoped_refptr<base::RefCountedString>& spec) {
+    base::AutoLock lock(lock_);
+    base::StringPiece key(spec->data());
+    SpecMap::const_iterator found = specs_.find(key);
+    if (found != specs_.end())
+      return found->second;
+    if (specs_.size() < kMaxInternedSpecs)
+      specs_.insert(std::make_pair(key, spec));
+    return spec;
+  }
+
+ private:
+  typedef std::map<base::StringPiece,
+                   scoped_refptr<base::RefCountedString> > SpecMap;
+
+  base::Lock lock_;
+  SpecMap specs_;
+
+  DISALLOW_COPY_AND_ASSIGN(SpecInternTable);
+};
+
+base::LazyInstance<SpecInternTable>::Leaky g_spec_intern_table =
+    LAZY_INSTANCE_INITIALIZER;
+
+#endif  // USE_SHARED_GURL_SPEC
+
+// Copies |input| into |*spec| if it is a URL that canonicalization would not
+// change, filling |*parsed|. Returns false, leaving |*spec| empty, otherwise.
+bool InitFromCanonicalInput(const std::string& input,
+                            std::string* spec,
+                            url_parse::Parsed* parsed) {
+  if (!url_util::IsCanonicalStandardSpec(
+          input.data(), static_cast<int>(input.length()), parsed))
+    return false;
+  *spec = input;
+  return true;
+}
+
+bool InitFromCanonicalInput(const base::string16& input,
+                            std::string* spec,
+                            url_parse::Parsed* parsed) {
+  // Only ASCII input can be canonical, so narrowing is a plain copy.
+  spec->resize(input.length());
+  for (size_t i = 0; i < input.length(); i++) {
+    if (input[i] >= 0x80) {
+      spec->clear();
+      return false;
+    }
+    (*spec)[i] = static_cast<char>(input[i]);
+  }
+  if (!url_util::IsCanonicalStandardSpec(
+          spec->data(), static_cast<int>(spec->length()), parsed)) {
+    spec->clear();
+    return false;
+  }
+  return true;
+}
+
 } // namespace
 
 GURL::GURL() : is_valid_(false) {
@@ -88,9 +169,10 @@ GURL::GURL(const std::string& url_string, RetainWhiteSpaceSelector) {
 
 GURL::GURL(const char* canonical_spec, size_t canonical_spec_len,
            const url_parse::Parsed& parsed, bool is_valid)
-    : spec_(canonical_spec, canonical_spec_len),
-      is_valid_(is_valid),
+    : is_valid_(is_valid),
       parsed_(parsed) {
+  std::string spec(canonical_spec, canonical_spec_len);
+  TakeSpec(&spec);
   InitializeFromCanonicalSpec();
 }
 
@@ -98,31 +180,65 @@ GURL::GURL(std::string canonical_spec,
            const url_parse::Parsed& parsed, bool is_valid)
     : is_valid_(is_valid),
       parsed_(parsed) {
-  spec_.swap(canonical_spec);
+  TakeSpec(&canonical_spec);
   InitializeFromCanonicalSpec();
 }
 
 template<typename STR>
 void GURL::InitCanonical(const STR& input_spec, bool trim_path_end) {
+  // Most URLs we see are already canonical, so check for that first. This is
+  // a single pass over the input and saves building the output a character
+  // at a time. Canonical URLs found this way are never filesystem URLs.
+  std::string spec;
+  if (InitFromCanonicalInput(input_spec, &spec, &parsed_)) {
+    is_valid_ = true;
+    TakeSpec(&spec);
+    return;
+  }
+
   // Reserve enough room in the output for the input, plus some extra so that
   // we have room if we have to escape a few things without reallocating.
-  spec_.reserve(input_spec.size() + 32);
-  url_canon::StdStringCanonOutput output(&spec_);
+  spec.reserve(input_spec.size() + 32);
+  url_canon::StdStringCanonOutput output(&spec);
   is_valid_ = url_util::Canonicalize(
       input_spec.data(), static_cast<int>(input_spec.length()), trim_path_end,
       NULL, &output, &parsed_);
 
   output.Complete();  // Must be done before using string.
+  TakeSpec(&spec);
   if (is_valid_ && SchemeIsFileSystem()) {
-    inner_url_.reset(new GURL(spec_.data(), parsed_.Length(),
+    inner_url_.reset(new GURL(spec_string().data(), parsed_.Length(),
                               *parsed_.inner_parsed(), true));
   }
 }
 
+#if defined(USE_SHARED_GURL_SPEC)
+
+void GURL::TakeSpec(std::string* spec) {
+  if (spec->empty())
+    spec_ = NULL;
+  else
+    spec_ = base::RefCountedString::TakeString(spec);
+}
+
+// static
+const std::string& GURL::EmptySpecString() {
+  return EmptyStringForGURL();
+}
+
+#else
+
+void GURL::TakeSpec(std::string* spec) {
+  spec_.swap(*spec);
+  spec->clear();
+}
+
+#endif  // USE_SHARED_GURL_SPEC
+
 void GURL::InitializeFromCanonicalSpec() {
   if (is_valid_ && SchemeIsFileSystem()) {
     inner_url_.reset(
-        new GURL(spec_.data(), parsed_.Length(),
+        new GURL(spec_string().data(), parsed_.Length(),
                  *parsed_.inner_parsed(), true));
   }
 
@@ -135,17 +251,18 @@ void GURL::InitializeFromCanonicalSpec() {
     // We can't do this check on the inner_url of a filesystem URL, as
     // canonical_spec actually points to the start of the outer URL, so we'd
     // end up with infinite recursion in this constructor.
-    if (!url_util::FindAndCompareScheme(spec_.data(), spec_.length(),
+    const std::string& spec = spec_string();
+    if (!url_util::FindAndCompareScheme(spec.data(), spec.length(),
                                         "filesystem", &scheme) ||
         scheme.begin == parsed_.scheme.begin) {
       // We need to retain trailing whitespace on path URLs, as the |parsed_|
       // spec we originally received may legitimately contain trailing white-
       // space on the path or  components e.g. if the #ref has been
       // removed from a "foo:hello #ref" URL (see http://crbug.com/291747).
-      GURL test_url(spec_, RETAIN_TRAILING_PATH_WHITEPACE);
+      GURL test_url(spec_string(), RETAIN_TRAILING_PATH_WHITEPACE);
 
       DCHECK(test_url.is_valid_ == is_valid_);
-      DCHECK(test_url.spec_ == spec_);
+      DCHECK(test_url.spec_string() == spec_string());
 
       DCHECK(test_url.parsed_.scheme == parsed_.scheme);
       DCHECK(test_url.parsed_.username == parsed_.username);
@@ -169,8 +286,8 @@ GURL& GURL::operator=(GURL other) {
 }
 
 const std::string& GURL::spec() const {
-  if (is_valid_ || spec_.empty())
-    return spec_;
+  if (is_valid_ || spec_string().empty())
+    return spec_string();
 
   DCHECK(false) << "Trying to get the spec of an invalid URL!";
   return EmptyStringForGURL();
@@ -195,11 +312,13 @@ GURL GURL::ResolveWithCharsetConverter(
 
   // Reserve enough room in the output for the input, plus some extra so that
   // we have room if we have to escape a few things without reallocating.
-  result.spec_.reserve(spec_.size() + 32);
-  url_canon::StdStringCanonOutput output(&result.spec_);
+  std::string result_spec;
+  const std::string& spec = spec_string();
+  result_spec.reserve(spec.size() + 32);
+  url_canon::StdStringCanonOutput output(&result_spec);
 
   if (!url_util::ResolveRelative(
-          spec_.data(), static_cast<int>(spec_.length()), parsed_,
+          spec.data(), static_cast<int>(spec.length()), parsed_,
           relative.data(), static_cast<int>(relative.length()),
           charset_converter, &output, &result.parsed_)) {
     // Error resolving, return an empty URL.
@@ -207,10 +326,11 @@ GURL GURL::ResolveWithCharsetConverter(
   }
 
   output.Complete();
+  result.TakeSpec(&result_spec);
   result.is_valid_ = true;
   if (result.SchemeIsFileSystem()) {
     result.inner_url_.reset(
-        new GURL(result.spec_.data(), result.parsed_.Length(),
+        new GURL(result.spec_string().data(), result.parsed_.Length(),
                  *result.parsed_.inner_parsed(), true));
   }
   return result;
@@ -228,11 +348,13 @@ GURL GURL::ResolveWithCharsetConverter(
 
   // Reserve enough room in the output for the input, plus some extra so that
   // we have room if we have to escape a few things without reallocating.
-  result.spec_.reserve(spec_.size() + 32);
-  url_canon::StdStringCanonOutput output(&result.spec_);
+  std::string result_spec;
+  const std::string& spec = spec_string();
+  result_spec.reserve(spec.size() + 32);
+  url_canon::StdStringCanonOutput output(&result_spec);
 
   if (!url_util::ResolveRelative(
-          spec_.data(), static_cast<int>(spec_.length()), parsed_,
+          spec.data(), static_cast<int>(spec.length()), parsed_,
           relative.data(), static_cast<int>(relative.length()),
           charset_converter, &output, &result.parsed_)) {
     // Error resolving, return an empty URL.
@@ -240,10 +362,11 @@ GURL GURL::ResolveWithCharsetConverter(
   }
 
   output.Complete();
+  result.TakeSpec(&result_spec);
   result.is_valid_ = true;
   if (result.SchemeIsFileSystem()) {
     result.inner_url_.reset(
-        new GURL(result.spec_.data(), result.parsed_.Length(),
+        new GURL(result.spec_string().data(), result.parsed_.Length(),
                  *result.parsed_.inner_parsed(), true));
   }
   return result;
@@ -260,16 +383,19 @@ GURL GURL::ReplaceComponents(
 
   // Reserve enough room in the output for the input, plus some extra so that
   // we have room if we have to escape a few things without reallocating.
-  result.spec_.reserve(spec_.size() + 32);
-  url_canon::StdStringCanonOutput output(&result.spec_);
+  std::string result_spec;
+  const std::string& spec = spec_string();
+  result_spec.reserve(spec.size() + 32);
+  url_canon::StdStringCanonOutput output(&result_spec);
 
   result.is_valid_ = url_util::ReplaceComponents(
-      spec_.data(), static_cast<int>(spec_.length()), parsed_, replacements,
+      spec.data(), static_cast<int>(spec.length()), parsed_, replacements,
       NULL, &output, &result.parsed_);
 
   output.Complete();
+  result.TakeSpec(&result_spec);
   if (result.is_valid_ && result.SchemeIsFileSystem()) {
-    result.inner_url_.reset(new GURL(spec_.data(), result.parsed_.Length(),
+    result.inner_url_.reset(new GURL(spec.data(), result.parsed_.Length(),
                                      *result.parsed_.inner_parsed(), true));
   }
   return result;
@@ -286,16 +412,19 @@ GURL GURL::ReplaceComponents(
 
   // Reserve enough room in the output for the input, plus some extra so that
   // we have room if we have to escape a few things without reallocating.
-  result.spec_.reserve(spec_.size() + 32);
-  url_canon::StdStringCanonOutput output(&result.spec_);
+  std::string result_spec;
+  const std::string& spec = spec_string();
+  result_spec.reserve(spec.size() + 32);
+  url_canon::StdStringCanonOutput output(&result_spec);
 
   result.is_valid_ = url_util::ReplaceComponents(
-      spec_.data(), static_cast<int>(spec_.length()), parsed_, replacements,
+      spec.data(), static_cast<int>(spec.length()), parsed_, replacements,
       NULL, &output, &result.parsed_);
 
   output.Complete();
+  result.TakeSpec(&result_spec);
   if (result.is_valid_ && result.SchemeIsFileSystem()) {
-    result.inner_url_.reset(new GURL(spec_.data(), result.parsed_.Length(),
+    result.inner_url_.reset(new GURL(spec.data(), result.parsed_.Length(),
                                      *result.parsed_.inner_parsed(), true));
   }
   return result;
@@ -337,22 +466,25 @@ GURL GURL::GetWithEmptyPath() const {
   other.parsed_.ref.reset();
 
   // Set the path, since the path is longer than one, we can just set the
-  // first character and resize.
-  other.spec_[other.parsed_.path.begin] = '/';
+  // first character and resize. The spec is shared with |this|, so build
+  // the new one separately.
+  std::string spec(spec_string(), 0, other.parsed_.path.begin + 1);
+  spec[other.parsed_.path.begin] = '/';
   other.parsed_.path.len = 1;
-  other.spec_.resize(other.parsed_.path.begin + 1);
+  other.TakeSpec(&spec);
   return other;
 }
 
 bool GURL::IsStandard() const {
-  return url_util::IsStandard(spec_.data(), parsed_.scheme);
+  return url_util::IsStandard(spec_string().data(), parsed_.scheme);
 }
 
 bool GURL::SchemeIs(const char* lower_ascii_scheme) const {
   if (parsed_.scheme.len <= 0)
     return lower_ascii_scheme == NULL;
-  return url_util::LowerCaseEqualsASCII(spec_.data() + parsed_.scheme.begin,
-                                        spec_.data() + parsed_.scheme.end(),
+  const std::string& spec = spec_string();
+  return url_util::LowerCaseEqualsASCII(spec.data() + parsed_.scheme.begin,
+                                        spec.data() + parsed_.scheme.end(),
                                         lower_ascii_scheme);
 }
 
@@ -366,30 +498,32 @@ bool GURL::SchemeIsWSOrWSS() const {
 
 int GURL::IntPort() const {
   if (parsed_.port.is_nonempty())
-    return url_parse::ParsePort(spec_.data(), parsed_.port);
+    return url_parse::ParsePort(spec_string().data(), parsed_.port);
   return url_parse::PORT_UNSPECIFIED;
 }
 
 int GURL::EffectiveIntPort() const {
   int int_port = IntPort();
   if (int_port == url_parse::PORT_UNSPECIFIED && IsStandard())
-    return url_canon::DefaultPortForScheme(spec_.data() + parsed_.scheme.begin,
-                                           parsed_.scheme.len);
+    return url_canon::DefaultPortForScheme(
+        spec_string().data() + parsed_.scheme.begin, parsed_.scheme.len);
   return int_port;
 }
 
 std::string GURL::ExtractFileName() const {
   url_parse::Component file_component;
-  url_parse::ExtractFileName(spec_.data(), parsed_.path, &file_component);
+  url_parse::ExtractFileName(spec_string().data(), parsed_.path,
+                             &file_component);
   return ComponentString(file_component);
 }
 
 std::string GURL::PathForRequest() const {
-  DCHECK(parsed_.path.len > 0) << "Canonical path for requests should be non-empty";
+  DCHECK(parsed_.path.len > 0)
+      << "Canonical path for requests should be non-empty";
   if (parsed_.ref.len >= 0) {
     // Clip off the reference when it exists. The reference starts after the #
     // sign, so we have to subtract one to also remove it.
-    return std::string(spec_, parsed_.path.begin,
+    return std::string(spec_string(), parsed_.path.begin,
                        parsed_.ref.begin - parsed_.path.begin - 1);
   }
   // Compute the actual path length, rather than depending on the spec's
@@ -399,13 +533,14 @@ std::string GURL::PathForRequest() const {
   if (parsed_.query.is_valid())
     path_len = parsed_.query.end() - parsed_.path.begin;
 
-  return std::string(spec_, parsed_.path.begin, path_len);
+  return std::string(spec_string(), parsed_.path.begin, path_len);
 }
 
 std::string GURL::HostNoBrackets() const {
   // If host looks like an IPv6 literal, strip the square brackets.
   url_parse::Component h(parsed_.host);
-  if (h.len >= 2 && spec_[h.begin] == '[' && spec_[h.end() - 1] == ']') {
+  const std::string& spec = spec_string();
+  if (h.len >= 2 && spec[h.begin] == '[' && spec[h.end() - 1] == ']') {
     h.begin++;
     h.len -= 2;
   }
@@ -417,12 +552,12 @@ std::string GURL::GetContent() const {
 }
 
 bool GURL::HostIsIPAddress() const {
-  if (!is_valid_ || spec_.empty())
+  if (!is_valid_ || spec_string().empty())
      return false;
 
   url_canon::RawCanonOutputT<char, 128> ignored_output;
   url_canon::CanonHostInfo host_info;
-  url_canon::CanonicalizeIPAddress(spec_.c_str(), parsed_.host,
+  url_canon::CanonicalizeIPAddress(spec_string().c_str(), parsed_.host,
                                    &ignored_output, &host_info);
   return host_info.IsIPAddress();
 }
@@ -475,7 +610,7 @@ bool GURL::DomainIs(const char* lower_ascii_domain,
   // Check whether the host name is end with a dot. If yes, treat it
   // the same as no-dot unless the input comparison domain is end
   // with dot.
-  const char* last_pos = spec_.data() + parsed_.host.end() - 1;
+  const char* last_pos = spec_string().data() + parsed_.host.end() - 1;
   int host_len = parsed_.host.len;
   if ('.' == *last_pos && '.' != lower_ascii_domain[domain_len - 1]) {
     last_pos--;
@@ -487,7 +622,7 @@ bool GURL::DomainIs(const char* lower_ascii_domain,
     return false;
 
   // Compare this url whether belong specific domain.
-  const char* start_pos = spec_.data() + parsed_.host.begin +
+  const char* start_pos = spec_string().data() + parsed_.host.begin +
                           host_len - domain_len;
 
   if (!url_util::LowerCaseEqualsASCII(start_pos,
@@ -506,6 +641,15 @@ bool GURL::DomainIs(const char* lower_ascii_domain,
   return true;
 }
 
+GURL GURL::Interned() const {
+  GURL result(*this);
+#if defined(USE_SHARED_GURL_SPEC)
+  if (spec_.get())
+    result.spec_ = g_spec_intern_table.Get().Intern(spec_);
+#endif
+  return result;
+}
+
 void GURL::Swap(GURL* other) {
   spec_.swap(other->spec_);
   std::swap(is_valid_, other->is_valid_);
@@ -8,6 +8,10 @@
 #include <iosfwd>
 #include <string>
 
+#if defined(USE_SHARED_GURL_SPEC)
+#include "base/memory/ref_counted.h"
+#include "base/memory/ref_counted_memory.h"
+#endif
 #include "base/memory/scoped_ptr.h"
 #include "base/strings/string16.h"
 #include "url/url_canon.h"
@@ -23,8 +27,9 @@ class URL_EXPORT GURL {
   // Creates an empty, invalid URL.
   GURL();
 
-  // Copy construction is relatively inexpensive, with most of the time going
-  // to reallocating the string. It does not re-parse.
+  // Copy construction is inexpensive: it does not re-parse. When built with
+  // USE_SHARED_GURL_SPEC the spec is immutable and shared between copies, so
+  // only a reference count is touched; otherwise the string is copied.
   GURL(const GURL& other);
 
   // The narrow version requires the input be UTF-8. Invalid UTF-8 input will
@@ -68,7 +73,7 @@ class URL_EXPORT GURL {
   // invalid, and is_valid() will return false for them. This is provided
   // because some users may want to treat the empty case differently.
   bool is_empty() const {
-    return spec_.empty();
+    return spec_string().empty();
   }
 
   // Returns the raw spec, i.e., the full text of the URL, in canonical UTF-8,
@@ -94,7 +99,7 @@ class URL_EXPORT GURL {
   //
   // The returned string is guaranteed to be valid UTF-8.
   const std::string& possibly_invalid_spec() const {
-    return spec_;
+    return spec_string();
   }
 
   // Getter for the raw parsed structure. This allows callers to locate parts
@@ -111,18 +116,22 @@ class URL_EXPORT GURL {
 
   // Defiant equality operator!
   bool operator==(const GURL& other) const {
-    return spec_ == other.spec_;
+#if defined(USE_SHARED_GURL_SPEC)
+    if (spec_.get() == other.spec_.get())
+      return true;
+#endif
+    return spec_string() == other.spec_string();
   }
   bool operator!=(const GURL& other) const {
-    return spec_ != other.spec_;
+    return !(*this == other);
   }
 
   // Allows GURL to used as a key in STL (for example, a std::set or std::map).
   bool operator<(const GURL& other) const {
-    return spec_ < other.spec_;
+    return spec_string() < other.spec_string();
   }
   bool operator>(const GURL& other) const {
-    return spec_ > other.spec_;
+    return spec_string() > other.spec_string();
   }
 
   // Resolves a URL that's possibly relative to this object's URL, and returns
@@ -342,6 +351,15 @@ class URL_EXPORT GURL {
                     static_cast<int>(strlen(lower_ascii_domain)));
   }
 
+  // Returns a GURL equal to this one whose spec is shared with every other
+  // GURL interned with the same spec, so that many long-lived copies of a
+  // frequently seen URL, such as an origin, all use one allocation. The
+  // intern table is process-wide and thread-safe. It never shrinks and has a
+  // fixed capacity, after which this is just a copy, so only intern URLs
+  // drawn from a small, hot set. Without USE_SHARED_GURL_SPEC this is always
+  // just a copy.
+  GURL Interned() const;
+
   // Swaps the contents of this GURL object with the argument without doing
   // any memory allocations.
   void Swap(GURL* other);
@@ -371,15 +389,36 @@ class URL_EXPORT GURL {
 
   void InitializeFromCanonicalSpec();
 
+  // Replaces the spec with the contents of |spec|, which is left empty.
+  void TakeSpec(std::string* spec);
+
+  // Returns the spec, or an empty string if there is none.
+#if defined(USE_SHARED_GURL_SPEC)
+  const std::string& spec_string() const {
+    return spec_.get() ? spec_->data() : EmptySpecString();
+  }
+  static const std::string& EmptySpecString();
+#else
+  const std::string& spec_string() const {
+    return spec_;
+  }
+#endif
+
   // Returns the substring of the input identified by the given component.
   std::string ComponentString(const url_parse::Component& comp) const {
     if (comp.len <= 0)
       return std::string();
-    return std::string(spec_, comp.begin, comp.len);
+    return std::string(spec_string(), comp.begin, comp.len);
   }
 
   // The actual text of the URL, in canonical ASCII form.
+#if defined(USE_SHARED_GURL_SPEC)
+  // It is never modified once set, so copies of a GURL share it. NULL when the
+  // spec is empty.
+  scoped_refptr<base::RefCountedString> spec_;
+#else
   std::string spec_;
+#endif
 
   // Set when the given URL is valid. Otherwise, we may still have a spec and
   // components, but they may not identify valid resources (for example, an
@@ -2,6 +2,12 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <set>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
 #include "testing/gtest/include/gtest/gtest.h"
 #include "url/gurl.h"
 #include "url/url_canon.h"
@@ -564,3 +570,144 @@ TEST(GURLTest, SchemeIsWSOrWSS) {
   EXPECT_TRUE(GURL("wss://bar/").SchemeIsWSOrWSS());
   EXPECT_FALSE(GURL("http://bar/").SchemeIsWSOrWSS());
 }
+
+// URLs which are already canonical are adopted without running the
+// canonicalizer, and must end up the same as if they had been.
+TEST(GURLTest, AlreadyCanonical) {
+  const char* cases[] = {
+    "http://www.google.com/",
+    "https://www.google.com/search?q=a+b&ie=UTF-8#top",
+    "ws://host/a;b/c",
+  };
+  for (size_t i = 0; i < ARRAYSIZE(cases); i++) {
+    GURL url(cases[i]);
+    EXPECT_TRUE(url.is_valid());
+    EXPECT_EQ(cases[i], url.spec());
+
+    GURL url16(ConvertUTF8ToUTF16(cases[i]));
+    EXPECT_TRUE(url16.is_valid());
+    EXPECT_EQ(cases[i], url16.spec());
+  }
+
+  GURL url("https://www.google.com/search?q=a+b#top");
+  EXPECT_EQ("https", url.scheme());
+  EXPECT_EQ("www.google.com", url.host());
+  EXPECT_EQ("/search", url.path());
+  EXPECT_EQ("q=a+b", url.query());
+  EXPECT_EQ("top", url.ref());
+  EXPECT_EQ(443, url.EffectiveIntPort());
+}
+
+// Measures GURL construction over a large synthetic corpus of mostly
+// canonical URLs. Run manually with --gtest_also_run_disabled_tests.
+TEST(GURLTest, DISABLED_CanonicalizePerf) {
+  const int kURLCount = 1000000;
+  std::vector<std::string> urls;
+  urls.reserve(kURLCount);
+  for (int i = 0; i < kURLCount; i++) {
+    switch (i % 10) {
+      case 0:
+        // Needs canonicalization.
+        urls.push_back(base::StringPrintf("HTTP://Host%d.Example.com/a/../b",
+                                          i));
+        break;
+      case 1:
+        urls.push_back(base::StringPrintf("http://host%d.example.com:8080/",
+                                          i));
+        break;
+      default:
+        urls.push_back(base::StringPrintf(
+            "https://www%d.example.com/path/to/resource%d.html?id=%d&x=y#f",
+            i % 1000, i, i));
+        break;
+    }
+  }
+
+  size_t valid = 0;
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (size_t i = 0; i < urls.size(); i++) {
+    GURL url(urls[i]);
+    if (url.is_valid())
+      valid++;
+  }
+  base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+  EXPECT_EQ(urls.size(), valid);
+  LOG(INFO) << urls.size() << " URLs in " << elapsed.InMilliseconds() << "ms";
+}
+
+TEST(GURLTest, CopiesShareSpec) {
+  GURL a("http://www.google.com/foo?bar#baz");
+  GURL b(a);
+  GURL c;
+  c = b;
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(a, c);
+#if defined(USE_SHARED_GURL_SPEC)
+  EXPECT_EQ(&a.spec(), &b.spec());
+  EXPECT_EQ(&a.spec(), &c.spec());
+#endif
+
+  // Deriving a new URL leaves the shared spec alone.
+  GURL d = c.GetWithEmptyPath();
+  EXPECT_EQ("http://www.google.com/", d.spec());
+  EXPECT_EQ("http://www.google.com/foo?bar#baz", a.spec());
+  EXPECT_NE(&a.spec(), &d.spec());
+
+#if defined(USE_SHARED_GURL_SPEC)
+  // Empty URLs share the empty string.
+  GURL e;
+  EXPECT_TRUE(e.is_empty());
+  EXPECT_EQ(&e.possibly_invalid_spec(), &GURL().possibly_invalid_spec());
+#endif
+}
+
+TEST(GURLTest, Interned) {
+  GURL a("http://www.google.com/");
+  GURL b("http://www.google.com/");
+  EXPECT_NE(&a.spec(), &b.spec());
+
+  GURL interned_a = a.Interned();
+  GURL interned_b = b.Interned();
+  EXPECT_EQ(a, interned_a);
+  EXPECT_EQ(b, interned_b);
+#if defined(USE_SHARED_GURL_SPEC)
+  EXPECT_EQ(&interned_a.spec(), &interned_b.spec());
+#endif
+
+  // Interning an invalid or empty URL is harmless.
+  EXPECT_TRUE(GURL().Interned().is_empty());
+  EXPECT_FALSE(GURL("http:").Interned().is_valid());
+}
+
+// Counts the distinct spec buffers behind URLs copied along the lines of a
+// navigation followed by subresource loads: each URL is copied into a request,
+// a redirect chain, request info and a history row, and the origin of each is
+// kept per resource. This is the number of specs kept alive, not a count of
+// heap allocations, which would need hooks into the allocator. Run manually
+// with --gtest_also_run_disabled_tests.
+TEST(GURLTest, DISABLED_CopySpecBufferPerf) {
+  const int kPageCount = 1000;
+  const int kResourcesPerPage = 50;
+
+  std::set<const std::string*> buffers;
+  std::vector<GURL> kept;
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (int page = 0; page < kPageCount; page++) {
+    GURL page_url(base::StringPrintf("https://site%d.example.com/page%d.html",
+                                     page % 20, page));
+    for (int i = 0; i < kResourcesPerPage; i++) {
+      GURL resource(page_url.Resolve(base::StringPrintf("/r/%d.js", i)));
+      std::vector<GURL> url_chain(1, resource);  // Redirect chain.
+      GURL request_info_url(url_chain.back());
+      GURL history_url(request_info_url);
+      kept.push_back(history_url);
+      kept.push_back(resource.GetOrigin().Interned());
+    }
+  }
+  base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+  for (size_t i = 0; i < kept.size(); i++)
+    buffers.insert(&kept[i].spec());
+  LOG(INFO) << "urls_kept=" << kept.size()
+            << " distinct_spec_buffers=" << buffers.size()
+            << " ms=" << elapsed.InMilliseconds();
+}
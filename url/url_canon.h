@@ -515,6 +515,18 @@ URL_EXPORT bool CanonicalizeStandardURL(const base::char16* spec,
                                         CanonOutput* output,
                                         url_parse::Parsed* new_parsed);
 
+// Returns true if CanonicalizeStandardURL() would reproduce the given
+// already-parsed standard URL exactly, with the same |parsed| components,
+// when called with a NULL query converter. This is a conservative check for
+// the common case of plain ASCII URLs: it only accepts a lower-case scheme,
+// "//", a simple lower-case host name with no user info or port, and a path,
+// query and ref that need no escaping or normalization. Other URLs may still
+// be canonical; callers should fall back to CanonicalizeStandardURL() when
+// this returns false.
+URL_EXPORT bool IsCanonicalStandardURL(const char* spec,
+                                       int spec_len,
+                                       const url_parse::Parsed& parsed);
+
 // Use for file URLs.
 URL_EXPORT bool CanonicalizeFileURL(const char* spec,
                                     int spec_len,
@@ -405,6 +405,13 @@ bool CanonicalizePartialPath(const base::char16* spec,
                              int path_begin_in_output,
                              CanonOutput* output);
 
+// Implemented in url_canon_path.cc. Returns true if CanonicalizePath() would
+// copy the given non-empty path unchanged: it begins with a slash, contains
+// no escape sequences or characters that need escaping, and has no "." or
+// ".." segments. A false return does not mean the path is invalid, only that
+// it must go through the canonicalizer.
+bool IsCanonicalPath(const char* spec, const url_parse::Component& path);
+
 #ifndef WIN32
 
 // Implementations of Windows' int-to-string conversions
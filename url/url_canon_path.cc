@@ -350,4 +350,30 @@ bool CanonicalizePartialPath(const base::char16* spec,
                                                    output);
 }
 
+bool IsCanonicalPath(const char* spec, const url_parse::Component& path) {
+  if (!path.is_nonempty() || spec[path.begin] != '/')
+    return false;
+
+  int end = path.end();
+  for (int i = path.begin + 1; i < end; i++) {
+    unsigned char uch = static_cast<unsigned char>(spec[i]);
+    if (uch == '.') {
+      // A dot segment would be removed. Since the path begins with a slash,
+      // the previous character is always part of the path.
+      if (spec[i - 1] == '/') {
+        int after_dots = i + 1;
+        if (after_dots < end && spec[after_dots] == '.')
+          after_dots++;
+        if (after_dots == end || spec[after_dots] == '/')
+          return false;
+      }
+    } else if (kPathCharLookup[uch] & SPECIAL) {
+      // Needs escaping, is invalid, or is the start of an escape sequence
+      // which the canonicalizer may rewrite.
+      return false;
+    }
+  }
+  return true;
+}
+
 }  // namespace url_canon
@@ -89,6 +89,46 @@ bool DoCanonicalizeStandardURL(const URLComponentSource<CHAR>& source,
   return success;
 }
 
+// Returns true if the scheme is already lower case and contains only the
+// characters CanonicalizeScheme() copies through unchanged.
+bool IsCanonicalScheme(const char* spec, const url_parse::Component& scheme) {
+  if (!scheme.is_nonempty())
+    return false;
+  int end = scheme.end();
+  for (int i = scheme.begin; i < end; i++) {
+    char ch = spec[i];
+    if (!(ch >= 'a' && ch <= 'z') && !(ch >= '0' && ch <= '9') &&
+        ch != '+' && ch != '-' && ch != '.')
+      return false;
+  }
+  return true;
+}
+
+// Returns true if the host is a plain lower-case DNS name that
+// CanonicalizeHost() would copy unchanged. Anything that could be an IP
+// address (the last label starts with a digit) is rejected since the IP
+// canonicalizer may rewrite it.
+bool IsCanonicalHostName(const char* spec, const url_parse::Component& host) {
+  if (!host.is_nonempty())
+    return false;
+  int end = host.end();
+  int last_label_begin = host.begin;
+  for (int i = host.begin; i < end; i++) {
+    char ch = spec[i];
+    if (ch == '.') {
+      // Reject empty labels, including leading and trailing dots.
+      if (i == last_label_begin || i + 1 == end)
+        return false;
+      last_label_begin = i + 1;
+    } else if (!(ch >= 'a' && ch <= 'z') && !(ch >= '0' && ch <= '9') &&
+               ch != '-') {
+      return false;
+    }
+  }
+  char first = spec[last_label_begin];
+  return !(first >= '0' && first <= '9');
+}
+
 }  // namespace
 
 
@@ -123,6 +163,61 @@ int DefaultPortForScheme(const char* scheme, int scheme_len) {
   return default_port;
 }
 
+bool IsCanonicalStandardURL(const char* spec,
+                            int spec_len,
+                            const url_parse::Parsed& parsed) {
+  // Whitespace and control characters are stripped or escaped, backslashes
+  // become slashes and non-ASCII needs escaping or IDN handling.
+  for (int i = 0; i < spec_len; i++) {
+    unsigned char uch = static_cast<unsigned char>(spec[i]);
+    if (uch <= ' ' || uch >= 0x7f || uch == '\\')
+      return false;
+  }
+
+  // Scheme, which must start the spec and be followed by exactly "://".
+  if (parsed.scheme.begin != 0 || !IsCanonicalScheme(spec, parsed.scheme))
+    return false;
+  int cur = parsed.scheme.end();
+  if (cur + 3 > spec_len ||
+      spec[cur] != ':' || spec[cur + 1] != '/' || spec[cur + 2] != '/')
+    return false;
+  cur += 3;
+
+  // The authority must be just a host. User info and ports have their own
+  // normalization (e.g. default port removal), which this doesn't repeat.
+  if (parsed.username.is_valid() || parsed.password.is_valid() ||
+      parsed.port.is_valid())
+    return false;
+  if (parsed.host.begin != cur || !IsCanonicalHostName(spec, parsed.host))
+    return false;
+  cur = parsed.host.end();
+
+  // The canonicalizer makes up a "/" path when there is none.
+  if (parsed.path.begin != cur || !IsCanonicalPath(spec, parsed.path))
+    return false;
+  cur = parsed.path.end();
+
+  if (parsed.query.is_valid()) {
+    if (parsed.query.begin != cur + 1)
+      return false;
+    int end = parsed.query.end();
+    for (int i = parsed.query.begin; i < end; i++) {
+      if (!IsQueryChar(static_cast<unsigned char>(spec[i])))
+        return false;
+    }
+    cur = end;
+  }
+
+  // Printable ASCII in the ref is copied unchanged.
+  if (parsed.ref.is_valid()) {
+    if (parsed.ref.begin != cur + 1)
+      return false;
+    cur = parsed.ref.end();
+  }
+
+  return cur == spec_len;
+}
+
 bool CanonicalizeStandardURL(const char* spec,
                              int spec_len,
                              const url_parse::Parsed& parsed,
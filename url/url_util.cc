@@ -449,6 +449,24 @@ bool Canonicalize(const base::char16* spec,
                         output, output_parsed);
 }
 
+bool IsCanonicalStandardSpec(const char* spec,
+                             int spec_len,
+                             url_parse::Parsed* parsed) {
+  url_parse::Component scheme;
+  if (!url_parse::ExtractScheme(spec, spec_len, &scheme))
+    return false;
+
+  // File and filesystem URLs use their own canonicalizers, see
+  // DoCanonicalize().
+  if (DoCompareSchemeComponent(spec, scheme, kFileScheme) ||
+      DoCompareSchemeComponent(spec, scheme, kFileSystemScheme) ||
+      !DoIsStandard(spec, scheme))
+    return false;
+
+  url_parse::ParseStandardURL(spec, spec_len, parsed);
+  return url_canon::IsCanonicalStandardURL(spec, spec_len, *parsed);
+}
+
 bool ResolveRelative(const char* base_spec,
                      int base_spec_len,
                      const url_parse::Parsed& base_parsed,
@@ -123,6 +123,17 @@ URL_EXPORT bool Canonicalize(const base::char16* spec,
                              url_canon::CanonOutput* output,
                              url_parse::Parsed* output_parsed);
 
+// Returns true if |spec| is a standard URL (other than file: and filesystem:)
+// that Canonicalize() would return unchanged, with its components in
+// |*parsed|. This lets callers holding URLs that are almost always canonical
+// already, like GURL, skip the canonicalizer with a single pass over the
+// input. It is conservative: see url_canon::IsCanonicalStandardURL() for the
+// forms it accepts. When it returns false, |*parsed| is unspecified and the
+// caller must use Canonicalize().
+URL_EXPORT bool IsCanonicalStandardSpec(const char* spec,
+                                        int spec_len,
+                                        url_parse::Parsed* parsed);
+
 // Resolves a potentially relative URL relative to the given parsed base URL.
 // The base MUST be valid. The resulting canonical URL and parsed information
 // will be placed in to the given out variables.
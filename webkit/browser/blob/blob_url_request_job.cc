@@ -4,6 +4,7 @@
 
 #include "webkit/browser/blob/blob_url_request_job.h"
 
+#include <algorithm>
 #include <limits>
 
 #include "base/basictypes.h"
@@ -59,6 +60,10 @@ BlobURLRequestJob::BlobURLRequestJob(
       pending_get_file_info_count_(0),
       current_item_index_(0),
       current_item_offset_(0),
+      read_ahead_buf_size_(0),
+      read_ahead_size_(0),
+      read_ahead_pending_(false),
+      read_ahead_failed_(false),
       error_(false),
       byte_range_set_(false),
       weak_factory_(this) {
@@ -73,6 +78,9 @@ void BlobURLRequestJob::Start() {
 }
 
 void BlobURLRequestJob::Kill() {
+  // Deleting the reader cancels any read-ahead in flight.
+  read_ahead_pending_ = false;
+  read_ahead_data_ = NULL;
   DeleteCurrentFileReader();
 
   net::URLRequestJob::Kill();
@@ -92,6 +100,9 @@ bool BlobURLRequestJob::ReadRawData(net::IOBuffer* dest,
     return true;
   }
 
+  // Read ahead as much as the consumer asks for at a time.
+  read_ahead_size_ = dest_size;
+
   if (remaining_bytes_ < dest_size)
     dest_size = static_cast<int>(remaining_bytes_);
 
@@ -106,7 +117,10 @@ bool BlobURLRequestJob::ReadRawData(net::IOBuffer* dest,
   DCHECK(!read_buf_.get());
   read_buf_ = new net::DrainableIOBuffer(dest, dest_size);
 
-  return ReadLoop(bytes_read);
+  if (!ReadLoop(bytes_read))
+    return false;
+  StartReadAhead();
+  return true;
 }
 
 bool BlobURLRequestJob::GetMimeType(std::string* mime_type) const {
@@ -374,6 +388,11 @@ bool BlobURLRequestJob::ReadFileItem(FileStreamReader* reader,
                                      int bytes_to_read) {
   DCHECK_GE(read_buf_->BytesRemaining(), bytes_to_read);
   DCHECK(reader);
+
+  // Data already read ahead from |reader| comes first.
+  if (read_ahead_pending_ || read_ahead_data_.get() || read_ahead_failed_)
+    return ReadFromReadAhead(bytes_to_read);
+
   const int result = reader->Read(
       read_buf_.get(),
       bytes_to_read,
@@ -405,24 +424,113 @@ void BlobURLRequestJob::DidReadFile(int result) {
   // If the read buffer is completely filled, we're done.
   if (!read_buf_->BytesRemaining()) {
     int bytes_read = BytesReadCompleted();
+    // Start the read-ahead first, the consumer may read again from within
+    // NotifyReadComplete().
+    StartReadAhead();
     NotifyReadComplete(bytes_read);
     return;
   }
 
   // Otherwise, continue the reading.
   int bytes_read = 0;
-  if (ReadLoop(&bytes_read))
+  if (ReadLoop(&bytes_read)) {
+    StartReadAhead();
     NotifyReadComplete(bytes_read);
+  }
 }
 
 void BlobURLRequestJob::DeleteCurrentFileReader() {
   IndexToReaderMap::iterator found = index_to_reader_.find(current_item_index_);
   if (found != index_to_reader_.end() && found->second) {
+    DCHECK(!read_ahead_pending_ && !read_ahead_data_.get());
     delete found->second;
     index_to_reader_.erase(found);
   }
 }
 
+void BlobURLRequestJob::StartReadAhead() {
+  DCHECK(!read_buf_.get());
+  if (error_ || read_ahead_pending_ || read_ahead_data_.get() ||
+      read_ahead_failed_ || remaining_bytes_ == 0 ||
+      current_item_index_ >= blob_data_->items().size() ||
+      !IsFileType(blob_data_->items().at(current_item_index_).type())) {
+    return;
+  }
+
+  // Stay within the current item so that the data is always consumed
+  // before its reader is deleted.
+  int64 item_remaining =
+      item_length_list_[current_item_index_] - current_item_offset_;
+  const int size = static_cast<int>(std::min(
+      std::min(item_remaining, remaining_bytes_),
+      static_cast<int64>(read_ahead_size_)));
+  if (size <= 0)
+    return;
+
+  if (read_ahead_buf_size_ < size) {
+    read_ahead_buf_ = new net::IOBuffer(size);
+    read_ahead_buf_size_ = size;
+  }
+
+  const int result = GetFileStreamReader(current_item_index_)->Read(
+      read_ahead_buf_.get(),
+      size,
+      base::Bind(&BlobURLRequestJob::DidReadAhead, base::Unretained(this)));
+  if (result == net::ERR_IO_PENDING) {
+    read_ahead_pending_ = true;
+    return;
+  }
+  if (result > 0)
+    read_ahead_data_ =
+        new net::DrainableIOBuffer(read_ahead_buf_.get(), result);
+  else
+    read_ahead_failed_ = true;
+}
+
+void BlobURLRequestJob::DidReadAhead(int result) {
+  DCHECK(read_ahead_pending_);
+  read_ahead_pending_ = false;
+  if (result > 0)
+    read_ahead_data_ =
+        new net::DrainableIOBuffer(read_ahead_buf_.get(), result);
+  else
+    read_ahead_failed_ = true;
+
+  // Nothing more to do unless the consumer is waiting for this data.
+  if (!read_buf_.get())
+    return;
+
+  SetStatus(net::URLRequestStatus());  // Clear the IO_PENDING status
+  int bytes_read = 0;
+  if (ReadLoop(&bytes_read)) {
+    StartReadAhead();
+    NotifyReadComplete(bytes_read);
+  }
+}
+
+bool BlobURLRequestJob::ReadFromReadAhead(int bytes_to_read) {
+  // Wait for the read-ahead to finish, DidReadAhead() continues the read.
+  if (read_ahead_pending_) {
+    SetStatus(net::URLRequestStatus(net::URLRequestStatus::IO_PENDING, 0));
+    return false;
+  }
+
+  if (read_ahead_failed_) {
+    NotifyFailure(net::ERR_FAILED);
+    return false;
+  }
+
+  const int bytes =
+      std::min(bytes_to_read, read_ahead_data_->BytesRemaining());
+  memcpy(read_buf_->data(), read_ahead_data_->data(), bytes);
+  read_ahead_data_->DidConsume(bytes);
+  if (!read_ahead_data_->BytesRemaining())
+    read_ahead_data_ = NULL;
+
+  AdvanceBytesRead(bytes);
+  return true;
+}
+
 int BlobURLRequestJob::BytesReadCompleted() {
   int bytes_read = read_buf_->BytesConsumed();
   read_buf_ = NULL;
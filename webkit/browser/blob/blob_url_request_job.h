@@ -35,6 +35,10 @@ namespace webkit_blob {
 class FileStreamReader;
 
 // A request job that handles reading blob URLs.
+//
+// File items are read ahead into a buffer owned by the job.  Reads are not
+// zero-copy: ReadRawData() fills a buffer owned by the caller, so both bytes
+// items and read-ahead data are copied into it once.
 class WEBKIT_STORAGE_BROWSER_EXPORT BlobURLRequestJob
     : public net::URLRequestJob {
  public:
@@ -81,6 +85,14 @@ class WEBKIT_STORAGE_BROWSER_EXPORT BlobURLRequestJob
   void DidReadFile(int result);
   void DeleteCurrentFileReader();
 
+  // For reading ahead.  After data is returned to the consumer, the next
+  // range of the current file item is read into |read_ahead_buf_| so that
+  // the disk read overlaps with the consumer's processing.  The following
+  // read is then served from that buffer.
+  void StartReadAhead();
+  void DidReadAhead(int result);
+  bool ReadFromReadAhead(int bytes_to_read);
+
   int ComputeBytesToRead() const;
   int BytesReadCompleted();
 
@@ -113,6 +125,16 @@ class WEBKIT_STORAGE_BROWSER_EXPORT BlobURLRequestJob
   // Holds the buffer for read data with the IOBuffer interface.
   scoped_refptr<net::DrainableIOBuffer> read_buf_;
 
+  // Variables for reading ahead.  |read_ahead_data_| wraps the unconsumed
+  // part of |read_ahead_buf_| once a read-ahead completes.  Read-ahead is
+  // limited to the size of the consumer's last read.
+  scoped_refptr<net::IOBuffer> read_ahead_buf_;
+  int read_ahead_buf_size_;
+  scoped_refptr<net::DrainableIOBuffer> read_ahead_data_;
+  int read_ahead_size_;
+  bool read_ahead_pending_;
+  bool read_ahead_failed_;
+
   // Is set when NotifyFailure() is called and reset when DidStart is called.
   bool error_;
 
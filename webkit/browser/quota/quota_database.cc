@@ -9,6 +9,7 @@
 #include "base/auto_reset.h"
 #include "base/bind.h"
 #include "base/file_util.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/time/time.h"
 #include "sql/connection.h"
 #include "sql/meta_table.h"
@@ -28,6 +29,8 @@ const int kCompatibleVersion = 2;
 const char kHostQuotaTable[] = "HostQuotaTable";
 const char kOriginInfoTable[] = "OriginInfoTable";
 const char kIsOriginTableBootstrapped[] = "IsOriginTableBootstrapped";
+const char kGlobalUsageKeyPrefix[] = "GlobalUsage.";
+const char kGlobalUnlimitedUsageKeyPrefix[] = "GlobalUnlimitedUsage.";
 
 bool VerifyValidQuotaConfig(const char* key) {
   return (key != NULL &&
@@ -35,6 +38,10 @@ bool VerifyValidQuotaConfig(const char* key) {
            !strcmp(key, QuotaDatabase::kTemporaryQuotaOverrideKey)));
 }
 
+std::string GetGlobalUsageKey(const char* prefix, StorageType type) {
+  return prefix + base::IntToString(static_cast<int>(type));
+}
+
 const int kCommitIntervalMs = 30000;
 
 }  // anonymous namespace
@@ -324,6 +331,36 @@ bool QuotaDatabase::SetQuotaConfigValue(const char* key, int64 value) {
   return meta_table_->SetValue(key, value);
 }
 
+bool QuotaDatabase::GetGlobalUsage(
+    StorageType type, int64* usage, int64* unlimited_usage) {
+  DCHECK(usage);
+  DCHECK(unlimited_usage);
+  if (!LazyOpen(false))
+    return false;
+  return meta_table_->GetValue(
+             GetGlobalUsageKey(kGlobalUsageKeyPrefix, type).c_str(), usage) &&
+         meta_table_->GetValue(
+             GetGlobalUsageKey(kGlobalUnlimitedUsageKeyPrefix, type).c_str(),
+             unlimited_usage);
+}
+
+bool QuotaDatabase::SetGlobalUsage(
+    StorageType type, int64 usage, int64 unlimited_usage) {
+  DCHECK_GE(usage, 0);
+  DCHECK_GE(unlimited_usage, 0);
+  if (!LazyOpen(true))
+    return false;
+  if (!meta_table_->SetValue(
+          GetGlobalUsageKey(kGlobalUsageKeyPrefix, type).c_str(), usage) ||
+      !meta_table_->SetValue(
+          GetGlobalUsageKey(kGlobalUnlimitedUsageKeyPrefix, type).c_str(),
+          unlimited_usage))
+    return false;
+
+  ScheduleCommit();
+  return true;
+}
+
 bool QuotaDatabase::GetLRUOrigin(
     StorageType type,
     const std::set<GURL>& exceptions,
@@ -66,6 +66,12 @@ class WEBKIT_STORAGE_BROWSER_EXPORT_PRIVATE QuotaDatabase {
   bool GetQuotaConfigValue(const char* key, int64* value);
   bool SetQuotaConfigValue(const char* key, int64 value);
 
+  // Gets or sets the global usage of |type| as last recorded by the usage
+  // tracker, so that a new session can answer global usage queries before
+  // the quota clients have been scanned.
+  bool GetGlobalUsage(StorageType type, int64* usage, int64* unlimited_usage);
+  bool SetGlobalUsage(StorageType type, int64 usage, int64 unlimited_usage);
+
   // Sets |origin| to the least recently used origin of origins not included
   // in |exceptions| and not granted the special unlimited storage right.
   // It returns false when it failed in accessing the database.
@@ -124,6 +124,33 @@ class QuotaDatabaseTest : public testing::Test {
     EXPECT_EQ(kValue2, value);
   }
 
+  void GlobalUsage(const base::FilePath& kDbFile) {
+    QuotaDatabase db(kDbFile);
+    ASSERT_TRUE(db.LazyOpen(true));
+
+    int64 usage = 0;
+    int64 unlimited_usage = 0;
+    EXPECT_FALSE(db.GetGlobalUsage(kStorageTypeTemporary,
+                                   &usage, &unlimited_usage));
+
+    EXPECT_TRUE(db.SetGlobalUsage(kStorageTypeTemporary, 1000, 300));
+    EXPECT_TRUE(db.SetGlobalUsage(kStorageTypePersistent, 50, 0));
+    EXPECT_TRUE(db.GetGlobalUsage(kStorageTypeTemporary,
+                                  &usage, &unlimited_usage));
+    EXPECT_EQ(1000, usage);
+    EXPECT_EQ(300, unlimited_usage);
+    EXPECT_TRUE(db.GetGlobalUsage(kStorageTypePersistent,
+                                  &usage, &unlimited_usage));
+    EXPECT_EQ(50, usage);
+    EXPECT_EQ(0, unlimited_usage);
+
+    EXPECT_TRUE(db.SetGlobalUsage(kStorageTypeTemporary, 2000, 0));
+    EXPECT_TRUE(db.GetGlobalUsage(kStorageTypeTemporary,
+                                  &usage, &unlimited_usage));
+    EXPECT_EQ(2000, usage);
+    EXPECT_EQ(0, unlimited_usage);
+  }
+
   void OriginLastAccessTimeLRU(const base::FilePath& kDbFile) {
     QuotaDatabase db(kDbFile);
     ASSERT_TRUE(db.LazyOpen(true));
@@ -511,6 +538,15 @@ TEST_F(QuotaDatabaseTest, GlobalQuota) {
   GlobalQuota(base::FilePath());
 }
 
+TEST_F(QuotaDatabaseTest, GlobalUsage) {
+  base::ScopedTempDir data_dir;
+  ASSERT_TRUE(data_dir.CreateUniqueTempDir());
+  const base::FilePath kDbFile =
+      data_dir.path().AppendASCII("quota_manager.db");
+  GlobalUsage(kDbFile);
+  GlobalUsage(base::FilePath());
+}
+
 TEST_F(QuotaDatabaseTest, OriginLastAccessTimeLRU) {
   base::ScopedTempDir data_dir;
   ASSERT_TRUE(data_dir.CreateUniqueTempDir());
@@ -141,15 +141,31 @@ bool SetPersistentHostQuotaOnDBThread(const std::string& host,
 
 bool InitializeOnDBThread(int64* temporary_quota_override,
                           int64* desired_available_space,
+                          int64* temporary_global_usage,
+                          int64* temporary_global_unlimited_usage,
                           QuotaDatabase* database) {
   DCHECK(database);
   database->GetQuotaConfigValue(QuotaDatabase::kTemporaryQuotaOverrideKey,
                                 temporary_quota_override);
   database->GetQuotaConfigValue(QuotaDatabase::kDesiredAvailableSpaceKey,
                                 desired_available_space);
+  if (!database->GetGlobalUsage(kStorageTypeTemporary,
+                                temporary_global_usage,
+                                temporary_global_unlimited_usage)) {
+    *temporary_global_usage = -1;
+    *temporary_global_unlimited_usage = -1;
+  }
   return true;
 }
 
+bool SetGlobalUsageOnDBThread(StorageType type,
+                              int64 usage,
+                              int64 unlimited_usage,
+                              QuotaDatabase* database) {
+  DCHECK(database);
+  return database->SetGlobalUsage(type, usage, unlimited_usage);
+}
+
 bool GetLRUOriginOnDBThread(StorageType type,
                             std::set<GURL>* exceptions,
                             SpecialStoragePolicy* policy,
@@ -1187,8 +1203,22 @@ QuotaManager::~QuotaManager() {
   proxy_->manager_ = NULL;
   std::for_each(clients_.begin(), clients_.end(),
                 std::mem_fun(&QuotaClient::OnQuotaManagerDestroyed));
-  if (database_)
+  if (database_) {
+    // Record the usage we know for the next session.  Tasks on the DB thread
+    // run in order, so this completes before |database_| is deleted.
+    int64 usage = 0;
+    int64 unlimited_usage = 0;
+    if (temporary_usage_tracker_ &&
+        temporary_usage_tracker_->GetCachedGlobalUsage(&usage,
+                                                        &unlimited_usage)) {
+      db_thread_->PostTask(
+          FROM_HERE,
+          base::Bind(base::IgnoreResult(&SetGlobalUsageOnDBThread),
+                     kStorageTypeTemporary, usage, unlimited_usage,
+                     base::Unretained(database_.get())));
+    }
     db_thread_->DeleteSoon(FROM_HERE, database_.release());
+  }
 }
 
 QuotaManager::EvictionContext::EvictionContext()
@@ -1218,15 +1248,21 @@ void QuotaManager::LazyInitialize() {
 
   int64* temporary_quota_override = new int64(-1);
   int64* desired_available_space = new int64(-1);
+  int64* temporary_global_usage = new int64(-1);
+  int64* temporary_global_unlimited_usage = new int64(-1);
   PostTaskAndReplyWithResultForDBThread(
       FROM_HERE,
       base::Bind(&InitializeOnDBThread,
                  base::Unretained(temporary_quota_override),
-                 base::Unretained(desired_available_space)),
+                 base::Unretained(desired_available_space),
+                 base::Unretained(temporary_global_usage),
+                 base::Unretained(temporary_global_unlimited_usage)),
       base::Bind(&QuotaManager::DidInitialize,
                  weak_factory_.GetWeakPtr(),
                  base::Owned(temporary_quota_override),
-                 base::Owned(desired_available_space)));
+                 base::Owned(desired_available_space),
+                 base::Owned(temporary_global_usage),
+                 base::Owned(temporary_global_unlimited_usage)));
 }
 
 void QuotaManager::RegisterClient(QuotaClient* client) {
@@ -1373,6 +1409,16 @@ void QuotaManager::DidGetTemporaryGlobalUsageForHistogram(
     int64 unlimited_usage) {
   UMA_HISTOGRAM_MBYTES("Quota.GlobalUsageOfTemporaryStorage", usage);
 
+  // Checkpoint the usage so that it survives a crash as well.
+  if (!db_disabled_) {
+    PostTaskAndReplyWithResultForDBThread(
+        FROM_HERE,
+        base::Bind(&SetGlobalUsageOnDBThread,
+                   kStorageTypeTemporary, usage, unlimited_usage),
+        base::Bind(&QuotaManager::DidDatabaseWork,
+                   weak_factory_.GetWeakPtr()));
+  }
+
   std::set<GURL> origins;
   GetCachedOrigins(kStorageTypeTemporary, &origins);
 
@@ -1521,12 +1567,21 @@ void QuotaManager::DidSetPersistentHostQuota(const std::string& host,
 
 void QuotaManager::DidInitialize(int64* temporary_quota_override,
                                  int64* desired_available_space,
+                                 int64* temporary_global_usage,
+                                 int64* temporary_global_unlimited_usage,
                                  bool success) {
   temporary_quota_override_ = *temporary_quota_override;
   desired_available_space_ = *desired_available_space;
   temporary_quota_initialized_ = true;
   DidDatabaseWork(success);
 
+  // Answer global usage queries, e.g. for eviction, from the usage recorded
+  // by the last session while the clients are scanned in the background.
+  if (*temporary_global_usage >= 0 && *temporary_global_unlimited_usage >= 0) {
+    temporary_usage_tracker_->SetPersistedGlobalUsage(
+        *temporary_global_usage, *temporary_global_unlimited_usage);
+  }
+
   histogram_timer_.Start(FROM_HERE,
                          base::TimeDelta::FromMilliseconds(
                              kReportHistogramInterval),
@@ -359,6 +359,8 @@ class WEBKIT_STORAGE_BROWSER_EXPORT QuotaManager
                                  bool success);
   void DidInitialize(int64* temporary_quota_override,
                      int64* desired_available_space,
+                     int64* temporary_global_usage,
+                     int64* temporary_global_unlimited_usage,
                      bool success);
   void DidGetLRUOrigin(const GURL* origin,
                        bool success);
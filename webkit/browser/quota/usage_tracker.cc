@@ -38,6 +38,8 @@ void DidGetHostUsage(const UsageCallback& callback,
 
 void NoopHostUsageCallback(int64 usage) {}
 
+void NoopGlobalUsageCallback(int64 usage, int64 unlimited_usage) {}
+
 bool EraseOriginFromOriginSet(OriginSetByHost* origins_by_host,
                               const std::string& host,
                               const GURL& origin) {
@@ -74,6 +76,9 @@ UsageTracker::UsageTracker(const QuotaClientList& clients,
                            StorageType type,
                            SpecialStoragePolicy* special_storage_policy)
     : type_(type),
+      has_persisted_global_usage_(false),
+      persisted_global_usage_(0),
+      persisted_global_unlimited_usage_(0),
       weak_factory_(this) {
   for (QuotaClientList::const_iterator iter = clients.begin();
       iter != clients.end();
@@ -97,6 +102,12 @@ ClientUsageTracker* UsageTracker::GetClientTracker(QuotaClient::ID client_id) {
 }
 
 void UsageTracker::GetGlobalLimitedUsage(const UsageCallback& callback) {
+  if (has_persisted_global_usage_) {
+    callback.Run(persisted_global_usage_ - persisted_global_unlimited_usage_);
+    GatherGlobalUsage(base::Bind(&NoopGlobalUsageCallback));
+    return;
+  }
+
   if (global_usage_callbacks_.HasCallbacks()) {
     global_usage_callbacks_.Add(base::Bind(
         &DidGetGlobalUsageForLimitedGlobalUsage, callback));
@@ -129,6 +140,15 @@ void UsageTracker::GetGlobalLimitedUsage(const UsageCallback& callback) {
 }
 
 void UsageTracker::GetGlobalUsage(const GlobalUsageCallback& callback) {
+  if (has_persisted_global_usage_) {
+    callback.Run(persisted_global_usage_, persisted_global_unlimited_usage_);
+    GatherGlobalUsage(base::Bind(&NoopGlobalUsageCallback));
+    return;
+  }
+  GatherGlobalUsage(callback);
+}
+
+void UsageTracker::GatherGlobalUsage(const GlobalUsageCallback& callback) {
   if (!global_usage_callbacks_.Add(callback))
     return;
 
@@ -186,6 +206,13 @@ void UsageTracker::UpdateUsageCache(
   ClientUsageTracker* client_tracker = GetClientTracker(client_id);
   DCHECK(client_tracker);
   client_tracker->UpdateUsageCache(origin, delta);
+
+  // The snapshot does not say which origins are unlimited, so the delta is
+  // attributed to the limited usage until the scan reconciles it.
+  if (has_persisted_global_usage_) {
+    persisted_global_usage_ = std::max<int64>(
+        persisted_global_usage_ + delta, persisted_global_unlimited_usage_);
+  }
 }
 
 void UsageTracker::GetCachedHostsUsage(
@@ -216,12 +243,48 @@ void UsageTracker::SetUsageCacheEnabled(QuotaClient::ID client_id,
   client_tracker->SetUsageCacheEnabled(origin, enabled);
 }
 
+void UsageTracker::SetPersistedGlobalUsage(int64 usage,
+                                           int64 unlimited_usage) {
+  DCHECK_GE(usage, 0);
+  DCHECK_GE(unlimited_usage, 0);
+  int64 cached_usage = 0;
+  int64 cached_unlimited_usage = 0;
+  if (GetCachedGlobalUsage(&cached_usage, &cached_unlimited_usage))
+    return;
+
+  has_persisted_global_usage_ = true;
+  persisted_global_usage_ = usage;
+  persisted_global_unlimited_usage_ = std::min(unlimited_usage, usage);
+}
+
+bool UsageTracker::GetCachedGlobalUsage(int64* usage,
+                                        int64* unlimited_usage) const {
+  DCHECK(usage);
+  DCHECK(unlimited_usage);
+  *usage = 0;
+  *unlimited_usage = 0;
+  for (ClientTrackerMap::const_iterator iter = client_tracker_map_.begin();
+       iter != client_tracker_map_.end(); ++iter) {
+    int64 client_limited_usage = 0;
+    int64 client_unlimited_usage = 0;
+    if (!iter->second->GetCachedGlobalUsage(&client_limited_usage,
+                                            &client_unlimited_usage))
+      return false;
+    *usage += client_limited_usage + client_unlimited_usage;
+    *unlimited_usage += client_unlimited_usage;
+  }
+  return true;
+}
+
 void UsageTracker::AccumulateClientGlobalLimitedUsage(AccumulateInfo* info,
                                                       int64 limited_usage) {
   info->usage += limited_usage;
   if (--info->pending_clients)
     return;
 
+  // Every client has been scanned, so the persisted snapshot is stale.
+  has_persisted_global_usage_ = false;
+
   // All the clients have returned their usage data.  Dispatch the
   // pending callbacks.
   global_limited_usage_callbacks_.Run(MakeTuple(info->usage));
@@ -246,6 +309,9 @@ void UsageTracker::AccumulateClientGlobalUsage(AccumulateInfo* info,
   else if (info->unlimited_usage < 0)
     info->unlimited_usage = 0;
 
+  // Every client has been scanned, so the persisted snapshot is stale.
+  has_persisted_global_usage_ = false;
+
   // All the clients have returned their usage data.  Dispatch the
   // pending callbacks.
   global_usage_callbacks_.Run(MakeTuple(info->usage, info->unlimited_usage));
@@ -358,6 +424,7 @@ void ClientUsageTracker::UpdateUsageCache(
       return;
 
     cached_usage_by_host_[host][origin] += delta;
+    cached_usage_total_by_host_[host] += delta;
     if (IsStorageUnlimited(origin))
       global_unlimited_usage_ += delta;
     else
@@ -374,10 +441,10 @@ void ClientUsageTracker::UpdateUsageCache(
 void ClientUsageTracker::GetCachedHostsUsage(
     std::map<std::string, int64>* host_usage) const {
   DCHECK(host_usage);
-  for (HostUsageMap::const_iterator host_iter = cached_usage_by_host_.begin();
-       host_iter != cached_usage_by_host_.end(); host_iter++) {
-    const std::string& host = host_iter->first;
-    (*host_usage)[host] += GetCachedHostUsage(host);
+  for (HostUsageTotalMap::const_iterator host_iter =
+           cached_usage_total_by_host_.begin();
+       host_iter != cached_usage_total_by_host_.end(); host_iter++) {
+    (*host_usage)[host_iter->first] += host_iter->second;
   }
 }
 
@@ -405,10 +472,15 @@ void ClientUsageTracker::SetUsageCacheEnabled(const GURL& origin,
       UsageMap::iterator found = cached_usage_for_host.find(origin);
       if (found != cached_usage_for_host.end()) {
         int64 usage = found->second;
-        UpdateUsageCache(origin, -usage);
+        if (IsStorageUnlimited(origin))
+          global_unlimited_usage_ -= usage;
+        else
+          global_limited_usage_ -= usage;
+        cached_usage_total_by_host_[host] -= usage;
         cached_usage_for_host.erase(found);
         if (cached_usage_for_host.empty()) {
           cached_usage_by_host_.erase(found_host);
+          cached_usage_total_by_host_.erase(host);
           cached_hosts_.erase(host);
         }
       }
@@ -557,6 +629,7 @@ void ClientUsageTracker::AddCachedOrigin(
   int64* usage = &cached_usage_by_host_[host][origin];
   int64 delta = new_usage - *usage;
   *usage = new_usage;
+  cached_usage_total_by_host_[host] += delta;
   if (delta) {
     if (IsStorageUnlimited(origin))
       global_unlimited_usage_ += delta;
@@ -572,17 +645,11 @@ void ClientUsageTracker::AddCachedHost(const std::string& host) {
 }
 
 int64 ClientUsageTracker::GetCachedHostUsage(const std::string& host) const {
-  HostUsageMap::const_iterator found = cached_usage_by_host_.find(host);
-  if (found == cached_usage_by_host_.end())
+  HostUsageTotalMap::const_iterator found =
+      cached_usage_total_by_host_.find(host);
+  if (found == cached_usage_total_by_host_.end())
     return 0;
-
-  int64 usage = 0;
-  const UsageMap& map = found->second;
-  for (UsageMap::const_iterator iter = map.begin();
-       iter != map.end(); ++iter) {
-    usage += iter->second;
-  }
-  return usage;
+  return found->second;
 }
 
 bool ClientUsageTracker::GetCachedOriginUsage(
@@ -602,6 +669,17 @@ bool ClientUsageTracker::GetCachedOriginUsage(
   return true;
 }
 
+bool ClientUsageTracker::GetCachedGlobalUsage(int64* limited_usage,
+                                              int64* unlimited_usage) const {
+  if (!global_usage_retrieved_ ||
+      !non_cached_limited_origins_by_host_.empty() ||
+      !non_cached_unlimited_origins_by_host_.empty())
+    return false;
+  *limited_usage = global_limited_usage_;
+  *unlimited_usage = global_unlimited_usage_;
+  return true;
+}
+
 bool ClientUsageTracker::IsUsageCacheEnabledForOrigin(
     const GURL& origin) const {
   std::string host = net::GetHostOrSpecFromURL(origin);
@@ -55,6 +55,17 @@ class WEBKIT_STORAGE_BROWSER_EXPORT UsageTracker : public QuotaTaskObserver {
                             const GURL& origin,
                             bool enabled);
 
+  // Seeds the tracker with the global usage recorded by a previous session.
+  // Until every client has been scanned, global usage queries are answered
+  // from this snapshot, adjusted by the deltas reported in the meantime, and
+  // the scan runs in the background to reconcile it. The snapshot is dropped
+  // once the scan completes.
+  void SetPersistedGlobalUsage(int64 usage, int64 unlimited_usage);
+
+  // Returns true and fills in the global usage if it is known to every
+  // client's cache, i.e. if it can be had without scanning any client.
+  bool GetCachedGlobalUsage(int64* usage, int64* unlimited_usage) const;
+
  private:
   struct AccumulateInfo {
     AccumulateInfo() : pending_clients(0), usage(0), unlimited_usage(0) {}
@@ -66,6 +77,7 @@ class WEBKIT_STORAGE_BROWSER_EXPORT UsageTracker : public QuotaTaskObserver {
   typedef std::map<QuotaClient::ID, ClientUsageTracker*> ClientTrackerMap;
 
   friend class ClientUsageTracker;
+  void GatherGlobalUsage(const GlobalUsageCallback& callback);
   void AccumulateClientGlobalLimitedUsage(AccumulateInfo* info,
                                           int64 limited_usage);
   void AccumulateClientGlobalUsage(AccumulateInfo* info,
@@ -82,6 +94,10 @@ class WEBKIT_STORAGE_BROWSER_EXPORT UsageTracker : public QuotaTaskObserver {
   GlobalUsageCallbackQueue global_usage_callbacks_;
   HostUsageCallbackMap host_usage_callbacks_;
 
+  bool has_persisted_global_usage_;
+  int64 persisted_global_usage_;
+  int64 persisted_global_unlimited_usage_;
+
   base::WeakPtrFactory<UsageTracker> weak_factory_;
   DISALLOW_COPY_AND_ASSIGN(UsageTracker);
 };
@@ -114,6 +130,8 @@ class ClientUsageTracker : public SpecialStoragePolicy::Observer,
                               std::vector<GURL>* origins_not_in_cache);
   bool IsUsageCacheEnabledForOrigin(const GURL& origin) const;
   void SetUsageCacheEnabled(const GURL& origin, bool enabled);
+  bool GetCachedGlobalUsage(int64* limited_usage,
+                            int64* unlimited_usage) const;
 
  private:
   typedef CallbackQueueMap<HostUsageAccumulator, std::string,
@@ -122,6 +140,7 @@ class ClientUsageTracker : public SpecialStoragePolicy::Observer,
   typedef std::set<std::string> HostSet;
   typedef std::map<GURL, int64> UsageMap;
   typedef std::map<std::string, UsageMap> HostUsageMap;
+  typedef std::map<std::string, int64> HostUsageTotalMap;
 
   struct AccumulateInfo {
     int pending_jobs;
@@ -178,6 +197,10 @@ class ClientUsageTracker : public SpecialStoragePolicy::Observer,
   HostSet cached_hosts_;
   HostUsageMap cached_usage_by_host_;
 
+  // Running per-host sums of |cached_usage_by_host_|, kept up to date with
+  // every delta so that host usage lookups do not walk the host's origins.
+  HostUsageTotalMap cached_usage_total_by_host_;
+
   OriginSetByHost non_cached_limited_origins_by_host_;
   OriginSetByHost non_cached_unlimited_origins_by_host_;
 